@@ -6,45 +6,123 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <map>
+#include <unordered_set>
+#include <vector>
 #include <fstream>
 #include <cstdlib>
 #include <iomanip>
+#include <algorithm>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include "dot_writer.h"
 #include "expr.h"
 #include "stmt.h"
+#include "visitor.h"
+
+// Graphs are laid out and rendered in this process when linked with Graphviz
+#ifdef PRISM_HAVE_GVC
+#include <gvc.h>
+#endif
+
+// Formats a visualisation can be written as
+enum class ImageFormat
+{
+    SVG,   // Vector image, the cheapest to render and view
+    PNG,   // Image rasterised at 600 dpi
+    PLAIN, // Graphviz's plain-text layout: each node's position and size, then each edge
+    DOT    // The graph itself, unlaid out
+};
+
+/**
+ * How much of a large AST to draw; zero means no limit
+ */
+struct DetailLevel
+{
+    // Levels of nodes drawn below the root, or below the statement in focus
+    uint32_t max_depth = 0;
+
+    // Statements drawn from the program and from each block; the rest become one summary node
+    uint32_t max_block_statements = 0;
+
+    // Line whose statement is drawn, with only the statements enclosing it above
+    int focus_line = 0;
+
+    bool any() const
+    {
+        return max_depth != 0 || max_block_statements != 0 || focus_line != 0;
+    }
+};
 
 /**
  * AST Visualiser - Creates GraphViz dot representations of abstract syntax trees
  * Implements both expression and statement visitors with improved node formatting
+ *
+ * The DOT is streamed through a DotWriter as nodes are visited, each node
+ * named by an integer id, so no copy of the whole graph is built up. The
+ * DetailLevel cuts large trees down to something Graphviz can lay out:
+ * whatever is left out is drawn as a summary node saying how much it holds.
  */
-class AstPrinter : public ExprVisitor, public StmtVisitor
+class AstPrinter : public ExprVisitorOf<AstPrinter, uint32_t>,
+                   public StmtVisitorOf<AstPrinter, uint32_t>
 {
+public:
+    using NodeId = uint32_t;
+
 private:
     // Colour constants for different node types
     const std::string CONTROL_COLOUR = "#c8e6fe";  // Light blue for control structures, statements, operations
     const std::string VARIABLE_COLOUR = "#a7fe9c"; // Light green for variables
     const std::string CONSTANT_COLOUR = "#fefdc9"; // Light yellow for constants
+    const std::string UNEXECUTED_COLOUR = "#e0e0e0"; // Grey for heat-map nodes that never ran
+    const std::string SUMMARY_COLOUR = "#f5f5f5";    // Off-white for nodes standing in for what is left out
 
     // For generating unique node IDs
-    int node_counter = 0;
+    NodeId node_counter = 0;
+
+    // Where the DOT is written while a graph is being built
+    DotWriter *out = nullptr;
+
+    // Heat map: nodes show executions and share of the run's time
+    bool show_heat = false;
+    uint64_t total_nanoseconds = 0;
+
+    // Subtrees taking less than this percentage of the time are drawn as one node
+    double collapse_below_percent = 0;
 
-    // The DOT file content
-    std::ostringstream dot_output;
+    // What each visualisation is written as, and whether a viewer is then opened on it
+    ImageFormat image_format = ImageFormat::SVG;
+    bool open_viewer = false;
+
+    // Limits on what is drawn, and the depth of the node being visited
+    DetailLevel detail;
+    uint32_t depth = 0;
+
+    // With a line in focus in a program: the statements from the top level down to it, and the one on it
+    bool focusing = false;
+    std::unordered_set<const Stmt *> focus_path;
+    const Stmt *focus_root = nullptr;
+    bool inside_focus = false;
 
     // Initialise the DOT file structure
-    void init_graph()
+    void init_graph(DotWriter &writer)
     {
+        out = &writer;
         node_counter = 0;
-        dot_output.str("");
-        dot_output.clear();
-        dot_output << "digraph AST {\n";
-        dot_output << "  node [shape=box, fontname=\"Arial\", fontsize=10];\n";
+        depth = 0;
+        focusing = false;
+        inside_focus = false;
+        *out << "digraph AST {\n";
+        *out << "  node [shape=box, fontname=\"Arial\", fontsize=10];\n";
     }
 
     // Finalise the DOT file
     void finalise_graph()
     {
-        dot_output << "}\n";
+        *out << "}\n";
     }
 
     // Format floating point numbers to avoid excessive decimals
@@ -75,34 +153,379 @@ private:
         return oss.str();
     }
 
-    // Create a new node with multi-line label and colour
-    std::string create_node(const std::string &label, const std::string &colour = "white")
+    // Start a node, writing its id and the first line of its label
+    NodeId begin_node(std::string_view title)
     {
-        std::string node_id = "node" + std::to_string(node_counter++);
-        dot_output << "  " << node_id << " [label=\"" << escape_label(label)
-                   << "\", style=\"filled\", fillcolor=\"" << colour << "\"];\n";
+        NodeId node_id = node_counter++;
+        *out << "  node";
+        out->write_number(node_id);
+        *out << " [label=\"";
+        out->write_escaped(title);
         return node_id;
     }
 
-    // Create an edge between two nodes
-    void create_edge(const std::string &from_id, const std::string &to_id)
+    // Add a line to the label of the node begun last
+    void label_line(std::string_view field, std::string_view value)
+    {
+        *out << '\n';
+        out->write_escaped(field);
+        out->write_escaped(value);
+    }
+
+    // Finish the node begun last
+    void end_node(std::string_view colour)
+    {
+        *out << "\", style=\"filled\", fillcolor=\"" << colour << "\"];\n";
+    }
+
+    // Create a new node with a title, an optional field line and a colour
+    // In a heat map, the node's heat replaces its colour and is added to its label
+    NodeId create_node(std::string_view title, std::string_view field, std::string_view value,
+                       const std::string &colour, const NodeHeat *heat = nullptr)
+    {
+        NodeId node_id = begin_node(title);
+        if (!field.empty())
+        {
+            label_line(field, value);
+        }
+        if (show_heat && heat != nullptr)
+        {
+            out->write_escaped(heat_label(*heat));
+            end_node(heat->executions == 0 ? UNEXECUTED_COLOUR : heat_colour(time_share(*heat)));
+        }
+        else
+        {
+            end_node(colour);
+        }
+        return node_id;
+    }
+
+    NodeId create_node(std::string_view title, const std::string &colour, const NodeHeat *heat = nullptr)
+    {
+        return create_node(title, {}, {}, colour, heat);
+    }
+
+    // Fraction of the whole run's time spent in a node and below it
+    double time_share(const NodeHeat &heat) const
     {
-        dot_output << "  " << from_id << " -> " << to_id << ";\n";
+        return total_nanoseconds == 0 ? 0.0 : std::min(1.0, static_cast<double>(heat.nanoseconds) / total_nanoseconds);
     }
 
-    // Escape special characters in labels
-    std::string escape_label(const std::string &text)
+    // Label lines giving a node's executions and share of the time
+    std::string heat_label(const NodeHeat &heat) const
     {
-        std::string result;
-        for (char c : text)
+        std::ostringstream oss;
+        oss << "\nruns: " << heat.executions
+            << "\ntime: " << std::fixed << std::setprecision(1) << 100.0 * time_share(heat) << "%";
+        return oss.str();
+    }
+
+    // Colour on a gradient from white through yellow to red as the share of time grows
+    static std::string heat_colour(double share)
+    {
+        const int white[3] = {255, 255, 255};
+        const int yellow[3] = {255, 224, 102};
+        const int red[3] = {227, 74, 51};
+
+        const int *from = share < 0.5 ? white : yellow;
+        const int *to = share < 0.5 ? yellow : red;
+        double position = share < 0.5 ? share * 2 : (share - 0.5) * 2;
+
+        std::ostringstream oss;
+        oss << "#" << std::hex << std::setfill('0');
+        for (int channel = 0; channel < 3; channel++)
         {
-            if (c == '"' || c == '\\')
+            int value = static_cast<int>(from[channel] + (to[channel] - from[channel]) * position + 0.5);
+            oss << std::setw(2) << value;
+        }
+        return oss.str();
+    }
+
+    // Whether a subtree is cold enough to be collapsed into one node
+    bool is_cold(const NodeHeat &heat) const
+    {
+        return show_heat && collapse_below_percent > 0 && 100.0 * time_share(heat) < collapse_below_percent;
+    }
+
+    NodeId cold_node(const NodeHeat &heat)
+    {
+        NodeId node_id = begin_node("Cold subtree");
+        out->write_escaped(heat_label(heat));
+        end_node(UNEXECUTED_COLOUR);
+        return node_id;
+    }
+
+    // Whether children of the node being visited are past the depth limit
+    bool too_deep() const
+    {
+        return detail.max_depth != 0 && depth >= detail.max_depth;
+    }
+
+    // Whether the statement in focus has yet to be reached
+    bool above_focus() const
+    {
+        return focusing && !inside_focus;
+    }
+
+    // A single node standing in for a subtree that is not drawn
+    NodeId subtree_summary(size_t nodes)
+    {
+        NodeId node_id = begin_node("Subtree");
+        label_line("nodes: ", std::to_string(nodes));
+        end_node(SUMMARY_COLOUR);
+        return node_id;
+    }
+
+    // A single node standing in for a run of statements that are not drawn
+    NodeId statements_summary(size_t count, int first_line, int last_line)
+    {
+        NodeId node_id = begin_node("Statements");
+        label_line("count: ", std::to_string(count));
+        if (last_line > 0)
+        {
+            label_line(first_line == last_line ? "line: " : "lines: ",
+                       first_line == last_line ? std::to_string(first_line)
+                                               : std::to_string(first_line) + "-" + std::to_string(last_line));
+        }
+        end_node(SUMMARY_COLOUR);
+        return node_id;
+    }
+
+    // Visit a child node, or stand in a single node for it if its subtree is cold or too deep
+    NodeId visit_child(Expr &expr)
+    {
+        if (is_cold(expr.heat))
+        {
+            return cold_node(expr.heat);
+        }
+        if (too_deep())
+        {
+            return subtree_summary(count_nodes(expr));
+        }
+        depth++;
+        NodeId node_id = visit_expr(expr);
+        depth--;
+        return node_id;
+    }
+
+    NodeId visit_child(Stmt &stmt)
+    {
+        // Above the statement in focus, only the statements enclosing it are drawn, whatever their depth
+        if (above_focus())
+        {
+            if (focus_path.count(&stmt) == 0)
+            {
+                return subtree_summary(count_nodes(stmt));
+            }
+            if (&stmt != focus_root)
             {
-                result.push_back('\\');
+                return visit_stmt(stmt);
             }
-            result.push_back(c);
+            inside_focus = true;
+            uint32_t enclosing_depth = depth;
+            depth = 0;
+            NodeId node_id = visit_child(stmt);
+            depth = enclosing_depth;
+            inside_focus = false;
+            return node_id;
+        }
+
+        if (is_cold(stmt.heat))
+        {
+            return cold_node(stmt.heat);
         }
-        return result;
+        if (too_deep())
+        {
+            return subtree_summary(count_nodes(stmt));
+        }
+        depth++;
+        NodeId node_id = visit_stmt(stmt);
+        depth--;
+        return node_id;
+    }
+
+    /**
+     * Visits the statements of the program or a block, joining each to the parent
+     * Statements left out, because they do not enclose the line in focus or
+     * come after the block limit, are joined as runs of summary nodes
+     */
+    void visit_statements(NodeId parent, const std::vector<std::shared_ptr<Stmt>> &stmts)
+    {
+        size_t shown = 0;
+        size_t skipped = 0;
+        int first_skipped = 0;
+        int last_skipped = 0;
+        auto join_skipped = [&]
+        {
+            if (skipped > 0)
+            {
+                create_edge(parent, statements_summary(skipped, first_skipped, last_skipped));
+                skipped = 0;
+            }
+        };
+
+        for (const auto &stmt : stmts)
+        {
+            if (!stmt)
+            {
+                continue;
+            }
+            bool drawn = above_focus() ? focus_path.count(stmt.get()) != 0
+                                       : detail.max_block_statements == 0 || shown < detail.max_block_statements;
+            if (drawn)
+            {
+                join_skipped();
+                NodeId stmt_node = visit_child(*stmt);
+                create_edge(parent, stmt_node);
+                shown++;
+            }
+            else
+            {
+                first_skipped = skipped == 0 ? stmt->line_number : std::min(first_skipped, stmt->line_number);
+                last_skipped = skipped == 0 ? stmt->line_number : std::max(last_skipped, stmt->line_number);
+                skipped++;
+            }
+        }
+        join_skipped();
+    }
+
+    // Nodes in a subtree, counted for the summary node drawn in its place
+    static size_t count_nodes(const Expr &expr)
+    {
+        switch (expr.kind)
+        {
+        case ExprKind::ASSIGN:
+            return 1 + count_nodes(*static_cast<const Assign &>(expr).expr_value);
+        case ExprKind::BINARY:
+            return 1 + count_nodes(*static_cast<const Binary &>(expr).left_expr) +
+                   count_nodes(*static_cast<const Binary &>(expr).right_expr);
+        case ExprKind::GROUPING:
+            return 1 + count_nodes(*static_cast<const Grouping &>(expr).inner_expr);
+        case ExprKind::LOGICAL:
+            return 1 + count_nodes(*static_cast<const Logical &>(expr).left_expr) +
+                   count_nodes(*static_cast<const Logical &>(expr).right_expr);
+        case ExprKind::UNARY:
+            return 1 + count_nodes(*static_cast<const Unary &>(expr).operand);
+        default:
+            return 1;
+        }
+    }
+
+    static size_t count_nodes(const Stmt &stmt)
+    {
+        switch (stmt.kind)
+        {
+        case StmtKind::BLOCK:
+        {
+            size_t nodes = 1;
+            for (const auto &inner : static_cast<const Block &>(stmt).body())
+            {
+                nodes += inner ? count_nodes(*inner) : 0;
+            }
+            return nodes;
+        }
+        case StmtKind::EXPRESSION:
+            return 1 + count_nodes(*static_cast<const Expression &>(stmt).expression);
+        case StmtKind::IF:
+        {
+            const If &branch = static_cast<const If &>(stmt);
+            return 1 + count_nodes(*branch.condition) + count_nodes(*branch.then_branch) +
+                   (branch.else_branch ? count_nodes(*branch.else_branch) : 0);
+        }
+        case StmtKind::PRINT:
+            return 1 + count_nodes(*static_cast<const Print &>(stmt).expression);
+        case StmtKind::VAR:
+        {
+            const Var &declaration = static_cast<const Var &>(stmt);
+            return 1 + (declaration.initialiser ? count_nodes(*declaration.initialiser) : 0);
+        }
+        case StmtKind::WHILE:
+            return 1 + count_nodes(*static_cast<const While &>(stmt).condition) +
+                   count_nodes(*static_cast<const While &>(stmt).body);
+        }
+        return 1;
+    }
+
+    static bool holds_statements(const Stmt &stmt)
+    {
+        return stmt.kind == StmtKind::BLOCK || stmt.kind == StmtKind::IF || stmt.kind == StmtKind::WHILE;
+    }
+
+    /**
+     * Finds the statement to draw for the line in focus, and those enclosing it
+     * At each level this takes the statement starting closest before or on the
+     * line, stopping at one that starts on it or has nothing inside starting earlier
+     */
+    void find_focus(const std::vector<std::shared_ptr<Stmt>> &stmts)
+    {
+        focus_path.clear();
+        focus_root = nullptr;
+
+        std::vector<const Stmt *> candidates;
+        for (const auto &stmt : stmts)
+        {
+            candidates.push_back(stmt.get());
+        }
+
+        while (true)
+        {
+            // Among statements starting on the same line, prefer the last that can hold others, as a
+            // for loop's body does beside its increment
+            const Stmt *closest = nullptr;
+            for (const Stmt *candidate : candidates)
+            {
+                if (candidate == nullptr || candidate->line_number > detail.focus_line)
+                {
+                    continue;
+                }
+                if (closest == nullptr || candidate->line_number > closest->line_number ||
+                    (candidate->line_number == closest->line_number &&
+                     (holds_statements(*candidate) || !holds_statements(*closest))))
+                {
+                    closest = candidate;
+                }
+            }
+            if (closest == nullptr)
+            {
+                return;
+            }
+            focus_path.insert(closest);
+            focus_root = closest;
+            if (closest->line_number == detail.focus_line)
+            {
+                return;
+            }
+
+            candidates.clear();
+            switch (closest->kind)
+            {
+            case StmtKind::BLOCK:
+                for (const auto &inner : static_cast<const Block &>(*closest).body())
+                {
+                    candidates.push_back(inner.get());
+                }
+                break;
+            case StmtKind::IF:
+                candidates.push_back(static_cast<const If &>(*closest).then_branch.get());
+                candidates.push_back(static_cast<const If &>(*closest).else_branch.get());
+                break;
+            case StmtKind::WHILE:
+                candidates.push_back(static_cast<const While &>(*closest).body.get());
+                break;
+            default:
+                return;
+            }
+        }
+    }
+
+    // Create an edge between two nodes
+    void create_edge(NodeId from_id, NodeId to_id)
+    {
+        *out << "  node";
+        out->write_number(from_id);
+        *out << " -> node";
+        out->write_number(to_id);
+        *out << ";\n";
     }
 
     // Convert any value to string for visualisation with improved formatting
@@ -127,113 +550,283 @@ private:
         return "unknown";
     }
 
-    void generate_output(const std::string &base_filename)
+    // Graphviz name of the output format
+    const char *format_name() const
+    {
+        switch (image_format)
+        {
+        case ImageFormat::PNG:
+            return "png";
+        case ImageFormat::PLAIN:
+            return "plain";
+        case ImageFormat::DOT:
+            return "dot";
+        default:
+            return "svg";
+        }
+    }
+
+    /**
+     * Builds the graph and renders it to a file, streaming the DOT into the
+     * file itself, into Graphviz's input, or to the dot program
+     */
+    template <typename Build>
+    bool render(const std::string &path, Build build)
     {
-        // Write DOT file
-        std::string dot_file = "images\\" + base_filename + ".dot";
-        std::string png_file = "images\\" + base_filename + ".png";
+        if (image_format == ImageFormat::DOT)
+        {
+            std::FILE *file = std::fopen(path.c_str(), "wb");
+            if (file == nullptr)
+            {
+                return false;
+            }
+            bool written;
+            {
+                DotWriter writer{file};
+                build(writer);
+                written = writer.flush();
+            }
+            return std::fclose(file) == 0 && written;
+        }
+
+#ifdef PRISM_HAVE_GVC
+        // Graphviz parses from memory, so the DOT is gathered into one string
+        std::string dot;
+        {
+            DotWriter writer{dot};
+            build(writer);
+        }
 
-        std::ofstream out_file(dot_file);
-        out_file << dot_output.str();
-        out_file.close();
+        // One context for the whole run, as loading the plugins is the slow part
+        static std::unique_ptr<GVC_t, int (*)(GVC_t *)> context{gvContext(), gvFreeContext};
+        Agraph_t *graph = agmemread(dot.c_str());
+        if (graph == nullptr)
+        {
+            return false;
+        }
+        if (image_format == ImageFormat::PNG)
+        {
+            agsafeset(graph, const_cast<char *>("dpi"), const_cast<char *>("600"), const_cast<char *>(""));
+        }
+        bool rendered = gvLayout(context.get(), graph, "dot") == 0;
+        if (rendered)
+        {
+            rendered = gvRenderFilename(context.get(), graph, format_name(), path.c_str()) == 0;
+            gvFreeLayout(context.get(), graph);
+        }
+        agclose(graph);
+        return rendered;
+#else
+        // Without the library, pipe the DOT to the dot program
+#ifdef _WIN32
+        std::string command = "lib\\dot.exe";
+#else
+        std::string command = "dot";
+#endif
+        command += std::string{" -T"} + format_name() + (image_format == ImageFormat::PNG ? " -Gdpi=600" : "") +
+                   " -o \"" + path + "\"";
+#ifdef _WIN32
+        FILE *pipe = _popen(command.c_str(), "wb");
+        if (pipe == nullptr)
+        {
+            return false;
+        }
+        bool written;
+        {
+            DotWriter writer{pipe};
+            build(writer);
+            written = writer.flush();
+        }
+        return _pclose(pipe) == 0 && written;
+#else
+        // A missing dot closes the pipe early, which must fail the render rather than end prism
+        void (*previous_handler)(int) = std::signal(SIGPIPE, SIG_IGN);
+        FILE *pipe = popen(command.c_str(), "w");
+        bool written = false;
+        if (pipe != nullptr)
+        {
+            DotWriter writer{pipe};
+            build(writer);
+            written = writer.flush();
+        }
+        bool closed = pipe != nullptr && pclose(pipe) == 0;
+        std::signal(SIGPIPE, previous_handler);
+        return written && closed;
+#endif
+#endif
+    }
 
-        // Since dot.exe is in the same folder as our executable, get that path
-        std::string dot_cmd;
-        dot_cmd = "lib\\dot.exe";
+    template <typename Build>
+    void generate_output(const std::string &base_filename, Build build)
+    {
+        std::filesystem::path image_file = std::filesystem::path{"images"} / (base_filename + "." + format_name());
+        std::error_code ignored;
+        std::filesystem::create_directories(image_file.parent_path(), ignored);
 
-        // Run the command
-        std::string cmd = dot_cmd + " -Tpng -Gdpi=600 \"" + dot_file + "\" -o \"" + png_file + "\"";
-        int result = system(cmd.c_str());
+        if (!render(image_file.string(), build))
+        {
+            std::cerr << "Failed to generate visualisation. Make sure GraphViz is installed." << std::endl;
+            return;
+        }
 
-        if (result == 0)
+        if (open_viewer)
         {
 // Open the image (platform-specific)
 #ifdef _WIN32
-            cmd = "start " + png_file;
+            std::string cmd = "start " + image_file.string();
 #elif __APPLE__
-            cmd = "open " + png_file;
+            std::string cmd = "open " + image_file.string();
 #else
-            cmd = "xdg-open " + png_file;
+            std::string cmd = "xdg-open " + image_file.string();
 #endif
             system(cmd.c_str());
-
-            std::cout << "AST visualisation created: " << png_file << std::endl;
-        }
-        else
-        {
-            std::cerr << "Failed to generate visualisation. Make sure GraphViz is installed." << std::endl;
         }
+
+        std::cout << "AST visualisation created: " << image_file.string() << std::endl;
     }
 
 public:
-    void visualise_expr(std::shared_ptr<Expr> expr, const std::string &output_base = "ast_expr")
+    /**
+     * Chooses the file each visualisation is rendered to, and whether it is opened
+     * SVG and plain text skip the rasterising a PNG needs; DOT skips layout altogether
+     */
+    void set_output(ImageFormat format, bool open)
     {
-        init_graph();
-        std::any root_id = expr->accept(*this);
-        finalise_graph();
-        generate_output(output_base);
+        image_format = format;
+        open_viewer = open;
     }
 
-    void visualise_stmt(std::shared_ptr<Stmt> stmt, const std::string &output_base = "ast_stmt")
+    /**
+     * Limits how much of each tree is drawn, for programs too large to lay out whole
+     */
+    void set_detail(const DetailLevel &level)
     {
-        init_graph();
-        std::any root_id = stmt->accept(*this);
-        finalise_graph();
-        generate_output(output_base);
+        detail = level;
+    }
+
+    void visualise_expr(const std::shared_ptr<Expr> &expr, const std::string &output_base = "ast_expr")
+    {
+        generate_output(output_base, [&](DotWriter &writer)
+                        {
+                            init_graph(writer);
+                            visit_child(*expr);
+                            finalise_graph(); });
+    }
+
+    void visualise_stmt(const std::shared_ptr<Stmt> &stmt, const std::string &output_base = "ast_stmt")
+    {
+        generate_output(output_base, [&](DotWriter &writer)
+                        {
+                            init_graph(writer);
+                            visit_child(*stmt);
+                            finalise_graph(); });
+    }
+
+    /**
+     * Turns on heat-map colouring and labels, from the heat the interpreter recorded
+     * @param collapse_below Percentage of the time under which a subtree is drawn as one node; 0 never collapses
+     */
+    void set_heat(bool enabled, double collapse_below = 0)
+    {
+        show_heat = enabled;
+        collapse_below_percent = collapse_below;
     }
 
     void visualise_program(const std::vector<std::shared_ptr<Stmt>> &stmts,
                            const std::string &output_base = "ast_program")
     {
-        init_graph();
-
-        // Create a special root node for the program
-        std::string program_node = create_node("Program", CONTROL_COLOUR);
+        generate_output(output_base, [&](DotWriter &writer)
+                        { build_program_graph(writer, stmts); });
+    }
 
-        // Connect each statement to the program node
-        for (const auto &stmt : stmts)
+    /**
+     * The DOT for a whole program, without writing or rendering it
+     */
+    std::string print_program(const std::vector<std::shared_ptr<Stmt>> &stmts)
+    {
+        std::string dot;
         {
-            std::string stmt_node = std::any_cast<std::string>(stmt->accept(*this));
-            create_edge(program_node, stmt_node);
+            DotWriter writer{dot};
+            build_program_graph(writer, stmts);
         }
+        return dot;
+    }
 
-        finalise_graph();
-        generate_output(output_base);
+    std::string print(const std::shared_ptr<Expr> &expr)
+    {
+        std::string dot;
+        {
+            DotWriter writer{dot};
+            init_graph(writer);
+            visit_child(*expr);
+            finalise_graph();
+        }
+        return dot;
     }
 
-    std::string print(std::shared_ptr<Expr> expr)
+private:
+    /**
+     * Writes the DOT for a program, under a root Program node
+     */
+    void build_program_graph(DotWriter &writer, const std::vector<std::shared_ptr<Stmt>> &stmts)
     {
-        init_graph();
-        std::string root_id = std::any_cast<std::string>(expr->accept(*this));
+        init_graph(writer);
+        if (detail.focus_line != 0)
+        {
+            find_focus(stmts);
+            focusing = true;
+        }
+
+        // A heat map's percentages are of the time all top-level statements took
+        total_nanoseconds = 0;
+        for (const auto &stmt : stmts)
+        {
+            total_nanoseconds += stmt->heat.nanoseconds;
+        }
+
+        // Create a special root node for the program
+        NodeId program_node;
+        if (show_heat)
+        {
+            std::ostringstream oss;
+            oss << std::fixed << std::setprecision(1) << total_nanoseconds / 1e6 << " ms";
+            program_node = create_node("Program", "total: ", oss.str(), CONTROL_COLOUR);
+        }
+        else
+        {
+            program_node = create_node("Program", CONTROL_COLOUR);
+        }
+
+        // Connect each statement to the program node
+        visit_statements(program_node, stmts);
+
         finalise_graph();
-        return dot_output.str();
     }
 
+public:
     //----------------------------------------------
     // Expression Visitor Methods
     //----------------------------------------------
-    std::any visit_assign_expr(std::shared_ptr<Assign> expr) override
+    NodeId visit_assign_expr(Assign &expr)
     {
         // Create multi-line node for assignment
-        std::string label = "Assign\nname: " + expr->var_name.lexeme;
-        std::string assign_node = create_node(label, CONTROL_COLOUR);
+        NodeId assign_node = create_node("Assign", "name: ", expr.var_name.lexeme, CONTROL_COLOUR, &expr.heat);
 
         // Create node for value and connect
-        std::string value_node = std::any_cast<std::string>(expr->expr_value->accept(*this));
+        NodeId value_node = visit_child(*expr.expr_value);
         create_edge(assign_node, value_node);
 
         return assign_node;
     }
 
-    std::any visit_binary_expr(std::shared_ptr<Binary> expr) override
+    NodeId visit_binary_expr(Binary &expr)
     {
         // Create multi-line node for binary operator
-        std::string label = "Binary\noperator: " + expr->operator_token.lexeme;
-        std::string op_node = create_node(label, CONTROL_COLOUR);
+        NodeId op_node = create_node("Binary", "operator: ", expr.operator_token.lexeme, CONTROL_COLOUR, &expr.heat);
 
         // Create nodes for left and right operands and connect
-        std::string left_node = std::any_cast<std::string>(expr->left_expr->accept(*this));
-        std::string right_node = std::any_cast<std::string>(expr->right_expr->accept(*this));
+        NodeId left_node = visit_child(*expr.left_expr);
+        NodeId right_node = visit_child(*expr.right_expr);
 
         create_edge(op_node, left_node);
         create_edge(op_node, right_node);
@@ -241,34 +834,33 @@ public:
         return op_node;
     }
 
-    std::any visit_grouping_expr(std::shared_ptr<Grouping> expr) override
+    NodeId visit_grouping_expr(Grouping &expr)
     {
         // Simple node for grouping
-        std::string group_node = create_node("Grouping", CONTROL_COLOUR);
+        NodeId group_node = create_node("Grouping", CONTROL_COLOUR, &expr.heat);
 
         // Create node for inner expression and connect
-        std::string inner_node = std::any_cast<std::string>(expr->inner_expr->accept(*this));
+        NodeId inner_node = visit_child(*expr.inner_expr);
         create_edge(group_node, inner_node);
 
         return group_node;
     }
 
-    std::any visit_literal_expr(std::shared_ptr<Literal> expr) override
+    NodeId visit_literal_expr(Literal &expr)
     {
         // Create multi-line node for literal with its value
-        std::string label = "Literal\nvalue: " + any_to_string(expr->literal_value);
-        return create_node(label, CONSTANT_COLOUR);
+        return create_node("Literal", "value: ", any_to_string(expr.literal_value), CONSTANT_COLOUR, &expr.heat);
     }
 
-    std::any visit_logical_expr(std::shared_ptr<Logical> expr) override
+    NodeId visit_logical_expr(Logical &expr)
     {
         // Create multi-line node for logical operator
-        std::string label = "Logical\noperator: " + expr->operator_token.lexeme;
-        std::string logic_node = create_node(label, CONTROL_COLOUR);
+        NodeId logic_node = create_node("Logical", "operator: ", expr.operator_token.lexeme, CONTROL_COLOUR,
+                                        &expr.heat);
 
         // Create nodes for left and right operands and connect
-        std::string left_node = std::any_cast<std::string>(expr->left_expr->accept(*this));
-        std::string right_node = std::any_cast<std::string>(expr->right_expr->accept(*this));
+        NodeId left_node = visit_child(*expr.left_expr);
+        NodeId right_node = visit_child(*expr.right_expr);
 
         create_edge(logic_node, left_node);
         create_edge(logic_node, right_node);
@@ -276,118 +868,109 @@ public:
         return logic_node;
     }
 
-    std::any visit_unary_expr(std::shared_ptr<Unary> expr) override
+    NodeId visit_unary_expr(Unary &expr)
     {
         // Create multi-line node for unary operator
-        std::string label = "Unary\noperator: " + expr->operator_token.lexeme;
-        std::string unary_node = create_node(label, CONTROL_COLOUR);
+        NodeId unary_node = create_node("Unary", "operator: ", expr.operator_token.lexeme, CONTROL_COLOUR, &expr.heat);
 
         // Create node for operand and connect
-        std::string operand_node = std::any_cast<std::string>(expr->operand->accept(*this));
+        NodeId operand_node = visit_child(*expr.operand);
         create_edge(unary_node, operand_node);
 
         return unary_node;
     }
 
-    std::any visit_variable_expr(std::shared_ptr<Variable> expr) override
+    NodeId visit_variable_expr(Variable &expr)
     {
         // Create multi-line node for variable reference
-        std::string label = "Variable\nname: " + expr->var_name.lexeme;
-        return create_node(label, VARIABLE_COLOUR);
+        return create_node("Variable", "name: ", expr.var_name.lexeme, VARIABLE_COLOUR, &expr.heat);
     }
 
     //----------------------------------------------
     // Statement Visitor Methods
     //----------------------------------------------
-    std::any visit_block_stmt(std::shared_ptr<Block> stmt) override
+    NodeId visit_block_stmt(Block &stmt)
     {
         // Create node for block
-        std::string block_node = create_node("Block", CONTROL_COLOUR);
+        NodeId block_node = create_node("Block", CONTROL_COLOUR, &stmt.heat);
 
         // Create nodes for each statement in block and connect
-        for (const auto &statement : stmt->statements)
-        {
-            if (statement)
-            {
-                std::string stmt_node = std::any_cast<std::string>(statement->accept(*this));
-                create_edge(block_node, stmt_node);
-            }
-        }
+        visit_statements(block_node, stmt.body());
 
         return block_node;
     }
 
-    std::any visit_expression_stmt(std::shared_ptr<Expression> stmt) override
+    NodeId visit_expression_stmt(Expression &stmt)
     {
         // Create node for expression statement
-        std::string expr_stmt_node = create_node("ExprStmt", CONTROL_COLOUR);
+        NodeId expr_stmt_node = create_node("ExprStmt", CONTROL_COLOUR, &stmt.heat);
 
         // Create node for the expression and connect
-        std::string expr_node = std::any_cast<std::string>(stmt->expression->accept(*this));
+        NodeId expr_node = visit_child(*stmt.expression);
         create_edge(expr_stmt_node, expr_node);
 
         return expr_stmt_node;
     }
 
-    std::any visit_if_stmt(std::shared_ptr<If> stmt) override
+    NodeId visit_if_stmt(If &stmt)
     {
         // Create node for if statement
-        std::string if_node = create_node("If", CONTROL_COLOUR);
+        NodeId if_node = create_node("If", CONTROL_COLOUR, &stmt.heat);
 
         // Create nodes for condition, then branch, else branch and connect
-        std::string cond_node = std::any_cast<std::string>(stmt->condition->accept(*this));
+        NodeId cond_node = visit_child(*stmt.condition);
         create_edge(if_node, cond_node);
 
-        std::string then_node = std::any_cast<std::string>(stmt->then_branch->accept(*this));
+        NodeId then_node = visit_child(*stmt.then_branch);
         create_edge(if_node, then_node);
 
-        if (stmt->else_branch)
+        if (stmt.else_branch)
         {
-            std::string else_node = std::any_cast<std::string>(stmt->else_branch->accept(*this));
+            NodeId else_node = visit_child(*stmt.else_branch);
             create_edge(if_node, else_node);
         }
 
         return if_node;
     }
 
-    std::any visit_print_stmt(std::shared_ptr<Print> stmt) override
+    NodeId visit_print_stmt(Print &stmt)
     {
         // Create node for print statement
-        std::string print_node = create_node("Print", CONTROL_COLOUR);
+        NodeId print_node = create_node("Print", CONTROL_COLOUR, &stmt.heat);
 
         // Create node for expression and connect
-        std::string expr_node = std::any_cast<std::string>(stmt->expression->accept(*this));
+        NodeId expr_node = visit_child(*stmt.expression);
         create_edge(print_node, expr_node);
 
         return print_node;
     }
 
-    std::any visit_var_stmt(std::shared_ptr<Var> stmt) override
+    NodeId visit_var_stmt(Var &stmt)
     {
         // Create multi-line node for variable declaration
-        std::string label = "Var\nname: " + stmt->name.lexeme;
-        std::string var_node = create_node(label, VARIABLE_COLOUR);
+        NodeId var_node = create_node("Var", "name: ", stmt.name.lexeme, VARIABLE_COLOUR, &stmt.heat);
 
         // Create node for initialiser if present
-        if (stmt->initialiser)
+        if (stmt.initialiser)
         {
-            std::string init_node = std::any_cast<std::string>(stmt->initialiser->accept(*this));
+            NodeId init_node = visit_child(*stmt.initialiser);
             create_edge(var_node, init_node);
         }
 
         return var_node;
     }
 
-    std::any visit_while_stmt(std::shared_ptr<While> stmt) override
+    NodeId visit_while_stmt(While &stmt)
     {
         // Create node for while statement
-        std::string while_node = create_node("While", CONTROL_COLOUR);
+        NodeId while_node = create_node(stmt.parallel != nullptr ? "Parallel While" : "While", CONTROL_COLOUR,
+                                        &stmt.heat);
 
         // Create nodes for condition and body and connect
-        std::string cond_node = std::any_cast<std::string>(stmt->condition->accept(*this));
+        NodeId cond_node = visit_child(*stmt.condition);
         create_edge(while_node, cond_node);
 
-        std::string body_node = std::any_cast<std::string>(stmt->body->accept(*this));
+        NodeId body_node = visit_child(*stmt.body);
         create_edge(while_node, body_node);
 
         return while_node;
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "error.h"
+#include "interpreter.h"
+#include "lexer.h"
+#include "parser.h"
+#include "trace_recorder.h"
+
+/**
+ * Outcome of one script run by a BatchRunner
+ */
+struct BatchResult
+{
+    std::string path;
+
+    // Everything the script printed, and the errors prism would have reported
+    std::string output;
+    std::string errors;
+
+    // As prism would exit: 0, 65 for syntax errors, 70 for runtime errors, 74 if unreadable
+    int exit_status = 0;
+
+    double milliseconds = 0;
+};
+
+/**
+ * Runs many scripts in one process, several at a time
+ *
+ * Workers take the next script from a shared index until none are left.
+ * Each script is lexed, parsed and run by its own Interpreter, with its
+ * output captured and its errors sent to its own ErrorReporter, so
+ * scripts never see each other's variables, output or errors.
+ */
+class BatchRunner
+{
+public:
+    // Applies settings such as limits to each script's interpreter
+    using Configure = std::function<void(Interpreter &)>;
+
+private:
+    Configure configure;
+
+    /**
+     * Runs one script from start to finish on the calling thread
+     */
+    BatchResult run_script(const std::string &path) const
+    {
+        TraceSpan span{"script", "batch"};
+        auto start = std::chrono::steady_clock::now();
+
+        BatchResult result;
+        result.path = path;
+        std::ostringstream output;
+        std::ostringstream errors;
+        ErrorReporter reporter{errors};
+        ErrorReportingScope reporting_scope{reporter};
+
+        std::ifstream file{path, std::ios::binary};
+        if (!file)
+        {
+            errors << "Could not open file '" << path << "': " << std::strerror(errno) << "\n";
+            result.exit_status = 74;
+        }
+        else
+        {
+            std::string source{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+            try
+            {
+                std::vector<Token> tokens = Lexer{source}.scan_tokens();
+                Parser parser{tokens};
+                std::vector<std::shared_ptr<Stmt>> statements = parser.parse();
+
+                if (!reporter.had_error)
+                {
+                    Interpreter interpreter;
+                    if (configure)
+                    {
+                        configure(interpreter);
+                    }
+                    interpreter.capture_output(output);
+                    interpreter.interpret(statements);
+                }
+            }
+            catch (const std::exception &failure)
+            {
+                // Such as running out of memory; only this script fails
+                errors << failure.what() << "\n";
+                reporter.had_runtime_error = true;
+            }
+            result.exit_status = reporter.had_error ? 65 : reporter.had_runtime_error ? 70 : 0;
+        }
+
+        result.output = output.str();
+        result.errors = errors.str();
+        result.milliseconds =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+public:
+    explicit BatchRunner(Configure configure_interpreter = nullptr)
+        : configure{std::move(configure_interpreter)}
+    {
+    }
+
+    /**
+     * The scripts to run: every .prism file under a directory, in path
+     * order, or the paths listed one per line in a file
+     * @return Whether the directory or list could be read
+     */
+    static bool list_scripts(const std::string &directory_or_list, std::vector<std::string> &paths)
+    {
+        std::error_code error;
+        if (std::filesystem::is_directory(directory_or_list, error))
+        {
+            for (const auto &entry : std::filesystem::recursive_directory_iterator{directory_or_list, error})
+            {
+                if (entry.is_regular_file() && entry.path().extension() == ".prism")
+                {
+                    paths.push_back(entry.path().string());
+                }
+            }
+            std::sort(paths.begin(), paths.end());
+            return !error;
+        }
+
+        // Blank lines and lines starting with # are skipped
+        std::ifstream list{directory_or_list};
+        std::string line;
+        while (std::getline(list, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (!line.empty() && line[0] != '#')
+            {
+                paths.push_back(line);
+            }
+        }
+        return static_cast<bool>(list) || list.eof();
+    }
+
+    /**
+     * Runs every script on the given number of threads
+     * @return One result per script, in the order given
+     */
+    std::vector<BatchResult> run(const std::vector<std::string> &paths, unsigned threads) const
+    {
+        std::vector<BatchResult> results(paths.size());
+        std::atomic<size_t> next_script{0};
+        auto worker = [&]
+        {
+            for (size_t i = next_script++; i < paths.size(); i = next_script++)
+            {
+                results[i] = run_script(paths[i]);
+            }
+        };
+
+        // The calling thread is one of the workers
+        threads = static_cast<unsigned>(std::clamp<size_t>(threads, 1, std::max<size_t>(paths.size(), 1)));
+        std::vector<std::thread> workers;
+        for (unsigned i = 1; i < threads; i++)
+        {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (std::thread &thread : workers)
+        {
+            thread.join();
+        }
+        return results;
+    }
+
+    /**
+     * Writes how many scripts ran, how fast, and which failed
+     */
+    static void write_summary(std::ostream &out, const std::vector<BatchResult> &results, unsigned threads,
+                              double milliseconds)
+    {
+        size_t succeeded = 0, syntax_errors = 0, runtime_errors = 0, unreadable = 0;
+        for (const BatchResult &result : results)
+        {
+            switch (result.exit_status)
+            {
+            case 0:
+                succeeded++;
+                break;
+            case 65:
+                syntax_errors++;
+                break;
+            case 70:
+                runtime_errors++;
+                break;
+            default:
+                unreadable++;
+                break;
+            }
+        }
+
+        char line[160];
+        std::snprintf(line, sizeof(line), "Batch: %zu scripts on %u %s in %.1f ms (%.1f scripts/s)\n",
+                      results.size(), threads, threads == 1 ? "thread" : "threads", milliseconds,
+                      results.size() / std::max(milliseconds / 1e3, 1e-9));
+        out << line;
+        std::snprintf(line, sizeof(line), "  %zu succeeded, %zu syntax errors, %zu runtime errors, %zu unreadable\n",
+                      succeeded, syntax_errors, runtime_errors, unreadable);
+        out << line;
+        for (const BatchResult &result : results)
+        {
+            if (result.exit_status != 0)
+            {
+                out << "  failed (" << result.exit_status << "): " << result.path << "\n";
+            }
+        }
+    }
+};
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Runs the bench/ workloads against prism and gates on regressions
+ *
+ * Each workload is run as a separate process with its output discarded:
+ * first the warm-up runs, whose results are thrown away, then the measured
+ * repeats. Wall-clock time is taken around each run and peak RSS is read
+ * from the child's resource usage. The median and peak RSS are compared
+ * against a stored baseline; p95 is reported but too noisy to gate on.
+ * Timings only mean anything on the machine that took them, so the
+ * baseline is recorded locally with --write-baseline and never shipped;
+ * without one, the figures are still reported but nothing is gated.
+ */
+
+// Measurements for one workload
+struct Result
+{
+    std::string name;
+    double median_ms = 0;
+    double p95_ms = 0;
+    long peak_rss_kb = 0;
+};
+
+// Options from the command line
+int warmup_runs = 1;
+int repeat_runs = 5;
+double threshold_percent = 10;
+std::string baseline_path = "bench/baseline.txt";
+bool write_baseline = false;
+
+/**
+ * Workload name: the file name without its directory or extension
+ */
+std::string workload_name(const std::string &path)
+{
+    size_t start = path.find_last_of("/\\");
+    std::string name = path.substr(start == std::string::npos ? 0 : start + 1);
+    return name.substr(0, name.rfind(".prism"));
+}
+
+/**
+ * Runs prism on a workload once
+ * @return Whether it exited successfully; the time and peak RSS are filled in
+ */
+bool run_once(const std::string &prism, const std::string &workload, double &elapsed_ms, long &rss_kb)
+{
+    auto start = std::chrono::steady_clock::now();
+    pid_t child = fork();
+    if (child < 0)
+    {
+        return false;
+    }
+
+    if (child == 0)
+    {
+        // Output would only measure the terminal, so it is discarded
+        int null_device = open("/dev/null", O_WRONLY);
+        dup2(null_device, STDOUT_FILENO);
+        dup2(null_device, STDERR_FILENO);
+        execl(prism.c_str(), prism.c_str(), workload.c_str(), static_cast<char *>(nullptr));
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage{};
+    wait4(child, &status, 0, &usage);
+    elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    rss_kb = usage.ru_maxrss;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Runs the warm-up and measured repeats of a workload
+ * @return Whether every run succeeded
+ */
+bool measure(const std::string &prism, const std::string &workload, Result &result)
+{
+    result.name = workload_name(workload);
+    std::vector<double> times;
+    for (int run = 0; run < warmup_runs + repeat_runs; run++)
+    {
+        double elapsed_ms = 0;
+        long rss_kb = 0;
+        if (!run_once(prism, workload, elapsed_ms, rss_kb))
+        {
+            return false;
+        }
+        if (run >= warmup_runs)
+        {
+            times.push_back(elapsed_ms);
+            result.peak_rss_kb = std::max(result.peak_rss_kb, rss_kb);
+        }
+    }
+
+    // Median, and p95 by nearest rank
+    std::sort(times.begin(), times.end());
+    size_t count = times.size();
+    result.median_ms = count % 2 == 1 ? times[count / 2] : (times[count / 2 - 1] + times[count / 2]) / 2;
+    size_t rank = (95 * count + 99) / 100;
+    result.p95_ms = times[std::max<size_t>(rank, 1) - 1];
+    return true;
+}
+
+/**
+ * Reads the stored baseline; lines are "name median_ms p95_ms peak_rss_kb"
+ * @return Whether there is a baseline file to read
+ */
+bool read_baseline(std::map<std::string, Result> &baseline)
+{
+    std::ifstream file{baseline_path};
+    if (!file)
+    {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream fields{line};
+        Result result;
+        if (fields >> result.name >> result.median_ms >> result.p95_ms >> result.peak_rss_kb)
+        {
+            baseline[result.name] = result;
+        }
+    }
+    return true;
+}
+
+void save_baseline(const std::vector<Result> &results)
+{
+    std::ofstream file{baseline_path};
+    file << "# workload median_ms p95_ms peak_rss_kb\n";
+    for (const Result &result : results)
+    {
+        char row[128];
+        std::snprintf(row, sizeof(row), "%s %.2f %.2f %ld\n", result.name.c_str(), result.median_ms,
+                      result.p95_ms, result.peak_rss_kb);
+        file << row;
+    }
+}
+
+/**
+ * Percentage change from the baseline figure to the new one
+ */
+double change_percent(double baseline, double current)
+{
+    return baseline > 0 ? 100.0 * (current - baseline) / baseline : 0;
+}
+
+/**
+ * Parses the number after a flag's '=', exiting on bad input
+ */
+double parse_option(const std::string &flag, size_t prefix_length)
+{
+    char *end = nullptr;
+    std::string text = flag.substr(prefix_length);
+    double value = std::strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0' || value < 0)
+    {
+        std::cerr << "Invalid value in '" << flag << "'.\n";
+        std::exit(64);
+    }
+    return value;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> arguments;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string flag = argv[i];
+        if (flag.rfind("--warmup=", 0) == 0)
+        {
+            warmup_runs = static_cast<int>(parse_option(flag, 9));
+        }
+        else if (flag.rfind("--repeats=", 0) == 0)
+        {
+            repeat_runs = std::max(1, static_cast<int>(parse_option(flag, 10)));
+        }
+        else if (flag.rfind("--threshold=", 0) == 0)
+        {
+            threshold_percent = parse_option(flag, 12);
+        }
+        else if (flag.rfind("--baseline=", 0) == 0)
+        {
+            baseline_path = flag.substr(11);
+        }
+        else if (flag == "--write-baseline")
+        {
+            write_baseline = true;
+        }
+        else
+        {
+            arguments.push_back(flag);
+        }
+    }
+
+    if (arguments.size() < 2)
+    {
+        std::cerr << "Usage: bench_runner [--warmup=N] [--repeats=N] [--threshold=PCT] [--baseline=FILE] "
+                     "[--write-baseline] prism workload...\n";
+        return 64;
+    }
+
+    const std::string &prism = arguments[0];
+    std::map<std::string, Result> baseline;
+    bool has_baseline = read_baseline(baseline);
+    std::vector<Result> results;
+    int regressions = 0;
+    int failures = 0;
+
+    char row[160];
+    std::snprintf(row, sizeof(row), "%-20s %10s %10s %10s %12s %10s\n", "workload", "median ms", "p95 ms",
+                  "peak KB", "vs baseline", "peak vs");
+    std::cout << row;
+
+    for (size_t i = 1; i < arguments.size(); i++)
+    {
+        Result result;
+        if (!measure(prism, arguments[i], result))
+        {
+            std::cout << result.name << ": prism failed to run it\n";
+            failures++;
+            continue;
+        }
+        results.push_back(result);
+
+        std::snprintf(row, sizeof(row), "%-20s %10.2f %10.2f %10ld ", result.name.c_str(), result.median_ms,
+                      result.p95_ms, result.peak_rss_kb);
+        std::cout << row;
+
+        auto found = baseline.find(result.name);
+        if (write_baseline || found == baseline.end())
+        {
+            std::cout << (write_baseline ? "\n" : "  no baseline\n");
+            continue;
+        }
+
+        // Slower or bigger by more than the threshold is a regression
+        double time_change = change_percent(found->second.median_ms, result.median_ms);
+        double rss_change = change_percent(found->second.peak_rss_kb, result.peak_rss_kb);
+        bool regressed = time_change > threshold_percent || rss_change > threshold_percent;
+        std::snprintf(row, sizeof(row), "%+11.1f%% %+9.1f%%%s\n", time_change, rss_change,
+                      regressed ? "  REGRESSION" : "");
+        std::cout << row;
+        regressions += regressed ? 1 : 0;
+    }
+
+    if (failures != 0)
+    {
+        std::cout << failures << " workload(s) failed to run\n";
+        return 1;
+    }
+
+    if (write_baseline)
+    {
+        save_baseline(results);
+        std::cout << "Baseline written to " << baseline_path << "\n";
+        return 0;
+    }
+
+    if (!has_baseline)
+    {
+        std::cout << "No baseline at " << baseline_path
+                  << ", so nothing was compared; run make bench-baseline to record one on this machine\n";
+        return 0;
+    }
+
+    if (regressions != 0)
+    {
+        std::cout << regressions << " workload(s) regressed by more than " << threshold_percent << "%\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ast_printer.h"
+#include "column_engine.h"
+#include "environment.h"
+#include "interpreter.h"
+#include "lexer.h"
+#include "parser.h"
+#include "program_generator.h"
+
+/**
+ * Microbenchmarks for each stage of prism, on generated programs
+ *
+ * For every input size from --min-size to --max-size, growing fourfold, a
+ * program of the chosen shape is generated and then lexed, parsed, drawn
+ * as DOT and interpreted, timing each stage on its own. Environment
+ * lookups are measured separately, against scopes holding a growing number
+ * of variables, and so is an expression evaluated over columns, both by the
+ * columnar evaluator and row by row. Each measurement is repeated for a
+ * short while and the fastest run is kept.
+ */
+
+// Options from the command line
+std::string component = "all";
+size_t min_size = 1024;
+size_t max_size = 4 * 1024 * 1024;
+ProgramShape shape;
+
+// Time a measurement is repeated for before its best run is taken
+constexpr double REPEAT_SECONDS = 0.2;
+
+// Lookups made in each environment measurement
+constexpr size_t LOOKUPS = 1000000;
+
+/**
+ * Seconds taken by the fastest of several runs of a stage
+ */
+template <typename Stage>
+double time_best(Stage stage)
+{
+    double best = 0;
+    double spent = 0;
+    for (int run = 0; run == 0 || spent < REPEAT_SECONDS; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        stage();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = run == 0 ? seconds : std::min(best, seconds);
+        spent += seconds;
+    }
+    return best;
+}
+
+//---------------------------------------------
+// Counting AST nodes
+//---------------------------------------------
+
+size_t count_nodes(const std::shared_ptr<Expr> &expr)
+{
+    if (expr == nullptr)
+    {
+        return 0;
+    }
+    switch (expr->kind)
+    {
+    case ExprKind::ASSIGN:
+        return 1 + count_nodes(static_cast<Assign &>(*expr).expr_value);
+    case ExprKind::BINARY:
+        return 1 + count_nodes(static_cast<Binary &>(*expr).left_expr) +
+               count_nodes(static_cast<Binary &>(*expr).right_expr);
+    case ExprKind::GROUPING:
+        return 1 + count_nodes(static_cast<Grouping &>(*expr).inner_expr);
+    case ExprKind::LOGICAL:
+        return 1 + count_nodes(static_cast<Logical &>(*expr).left_expr) +
+               count_nodes(static_cast<Logical &>(*expr).right_expr);
+    case ExprKind::UNARY:
+        return 1 + count_nodes(static_cast<Unary &>(*expr).operand);
+    default:
+        return 1;
+    }
+}
+
+size_t count_nodes(const std::shared_ptr<Stmt> &stmt)
+{
+    if (stmt == nullptr)
+    {
+        return 0;
+    }
+    switch (stmt->kind)
+    {
+    case StmtKind::BLOCK:
+    {
+        size_t nodes = 1;
+        for (const auto &child : static_cast<Block &>(*stmt).body())
+        {
+            nodes += count_nodes(child);
+        }
+        return nodes;
+    }
+    case StmtKind::EXPRESSION:
+        return 1 + count_nodes(static_cast<Expression &>(*stmt).expression);
+    case StmtKind::IF:
+        return 1 + count_nodes(static_cast<If &>(*stmt).condition) +
+               count_nodes(static_cast<If &>(*stmt).then_branch) + count_nodes(static_cast<If &>(*stmt).else_branch);
+    case StmtKind::PRINT:
+        return 1 + count_nodes(static_cast<Print &>(*stmt).expression);
+    case StmtKind::VAR:
+        return 1 + count_nodes(static_cast<Var &>(*stmt).initialiser);
+    case StmtKind::WHILE:
+        return 1 + count_nodes(static_cast<While &>(*stmt).condition) + count_nodes(static_cast<While &>(*stmt).body);
+    }
+    return 1;
+}
+
+//---------------------------------------------
+// Reporting
+//---------------------------------------------
+
+/**
+ * A rate with an SI suffix, or "-" when the stage has no such rate
+ */
+std::string format_rate(double count, double seconds)
+{
+    if (count == 0)
+    {
+        return "-";
+    }
+    static const char *const suffixes[] = {"", "K", "M", "G", "T"};
+    double rate = count / seconds;
+    int suffix = 0;
+    while (rate >= 1000 && suffix < 4)
+    {
+        rate /= 1000;
+        suffix++;
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.2f%s/s", rate, suffixes[suffix]);
+    return text;
+}
+
+std::string format_size(size_t bytes)
+{
+    static const char *const suffixes[] = {"B", "KB", "MB", "GB"};
+    double size = static_cast<double>(bytes);
+    int suffix = 0;
+    while (size >= 1024 && suffix < 3)
+    {
+        size /= 1024;
+        suffix++;
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.0f %s", size, suffixes[suffix]);
+    return text;
+}
+
+/**
+ * Prints one measurement; counts of zero are shown as "-"
+ */
+void report(const char *stage, const std::string &input, double seconds, double bytes, double tokens,
+            double nodes, double lookups)
+{
+    char row[200];
+    std::snprintf(row, sizeof(row), "%-12s %-10s %11.3f %14s %14s %14s %14s\n", stage, input.c_str(),
+                  seconds * 1e3, format_rate(bytes, seconds).c_str(), format_rate(tokens, seconds).c_str(),
+                  format_rate(nodes, seconds).c_str(), format_rate(lookups, seconds).c_str());
+    std::cout << row << std::flush;
+}
+
+bool selected(const std::string &name)
+{
+    return component == "all" || component == name;
+}
+
+//---------------------------------------------
+// Benchmarks
+//---------------------------------------------
+
+/**
+ * Lexes, parses, draws and runs one generated program of the given size
+ */
+void bench_program(size_t size)
+{
+    ProgramGenerator generator{shape};
+    std::string source = generator.generate(size);
+    std::string input = format_size(size);
+
+    // Lexer: bytes and tokens scanned
+    std::vector<Token> tokens;
+    double seconds = time_best([&]
+                               { tokens = Lexer{source}.scan_tokens(); });
+    if (selected("lexer"))
+    {
+        report("lexer", input, seconds, source.size(), tokens.size(), 0, 0);
+    }
+    if (!selected("parser") && !selected("ast_printer") && !selected("interpreter"))
+    {
+        return;
+    }
+
+    // Parser: tokens consumed and nodes built
+    std::vector<std::shared_ptr<Stmt>> statements;
+    seconds = time_best([&]
+                        { statements = Parser{tokens}.parse(); });
+    size_t nodes = 0;
+    for (const auto &stmt : statements)
+    {
+        nodes += count_nodes(stmt);
+    }
+    if (selected("parser"))
+    {
+        report("parser", input, seconds, source.size(), tokens.size(), nodes, 0);
+    }
+    tokens.clear();
+    tokens.shrink_to_fit();
+
+    // AstPrinter: nodes drawn and bytes of DOT written
+    if (selected("ast_printer"))
+    {
+        size_t dot_bytes = 0;
+        seconds = time_best([&]
+                            { AstPrinter printer;
+                              dot_bytes = printer.print_program(statements).size(); });
+        report("ast_printer", input, seconds, dot_bytes, 0, nodes, 0);
+    }
+
+    // Interpreter: every node is evaluated once per run
+    if (selected("interpreter"))
+    {
+        seconds = time_best([&]
+                            { Interpreter interpreter;
+                              interpreter.interpret(statements); });
+        report("interpreter", input, seconds, 0, 0, nodes, 0);
+    }
+}
+
+/**
+ * Gets and assigns variables through nested scopes holding the given number of variables each
+ */
+void bench_environment(int variables)
+{
+    // Scopes nested depth deep; lookups cycle through every variable in every scope
+    int depth = std::max(1, shape.depth);
+    std::vector<Token> names;
+    auto scope = std::make_shared<Environment>();
+    for (int level = 0; level < depth; level++)
+    {
+        if (level != 0)
+        {
+            scope = std::make_shared<Environment>(scope);
+        }
+        for (int i = 0; i < variables; i++)
+        {
+            std::string name = "s" + std::to_string(level) + "_v" + std::to_string(i);
+            scope->define(name, std::any{static_cast<double>(i)});
+            names.emplace_back(IDENTIFIER, name, std::any{}, 1);
+        }
+    }
+
+    std::string input = "V=" + std::to_string(variables);
+    double seconds = time_best([&]
+                               { for (size_t i = 0; i < LOOKUPS; i++)
+                                 {
+                                     scope->get(names[i % names.size()]);
+                                 } });
+    report("env get", input, seconds, 0, 0, 0, LOOKUPS);
+
+    seconds = time_best([&]
+                        { for (size_t i = 0; i < LOOKUPS; i++)
+                          {
+                              scope->assign(names[i % names.size()], std::any{1.0});
+                          } });
+    report("env assign", input, seconds, 0, 0, 0, LOOKUPS);
+}
+
+/**
+ * Evaluates a filter expression over columns of the given number of rows,
+ * by the columnar evaluator and then row by row through the interpreter
+ */
+void bench_columns(size_t rows)
+{
+    std::vector<double> price, quantity;
+    std::vector<uint8_t> flag;
+    for (size_t row = 0; row < rows; row++)
+    {
+        price.push_back(static_cast<double>(row % 97));
+        quantity.push_back(static_cast<double>(row % 13));
+        flag.push_back(row % 3 == 0);
+    }
+    ColumnTable table;
+    table["price"] = Column::of_numbers(price);
+    table["quantity"] = Column::of_numbers(quantity);
+    table["flag"] = Column::of_bools(flag);
+
+    std::vector<Token> tokens = Lexer{"price * quantity + 1 > 100 and flag;"}.scan_tokens();
+    std::vector<std::shared_ptr<Stmt>> statements = Parser{tokens}.parse();
+    std::shared_ptr<Expr> expr = static_cast<Expression &>(*statements[0]).expression;
+
+    // Rows evaluated are reported as lookups
+    std::string input = "R=" + std::to_string(rows);
+    ColumnEvaluator evaluator{expr, table};
+    double seconds = time_best([&]
+                               { evaluator.evaluate(table); });
+    report("columns", input, seconds, 0, 0, 0, rows);
+
+    Interpreter interpreter;
+    seconds = time_best([&]
+                        { for (size_t row = 0; row < rows; row++)
+                          {
+                              interpreter.reset_globals();
+                              interpreter.define_global("price", std::any{price[row]});
+                              interpreter.define_global("quantity", std::any{quantity[row]});
+                              interpreter.define_global("flag", std::any{flag[row] != 0});
+                              interpreter.evaluate(expr);
+                          } });
+    report("column rows", input, seconds, 0, 0, 0, rows);
+}
+
+/**
+ * Parses a size such as 4096, 64K, 16M or 1G
+ */
+size_t parse_size(const std::string &flag, size_t prefix_length)
+{
+    std::string text = flag.substr(prefix_length);
+    char *end = nullptr;
+    unsigned long long size = std::strtoull(text.c_str(), &end, 10);
+    std::string suffix = end;
+    if (suffix == "K" || suffix == "k")
+    {
+        size <<= 10;
+    }
+    else if (suffix == "M" || suffix == "m")
+    {
+        size <<= 20;
+    }
+    else if (suffix == "G" || suffix == "g")
+    {
+        size <<= 30;
+    }
+    else if (!suffix.empty() || text.empty())
+    {
+        std::cerr << "Invalid size in '" << flag << "'.\n";
+        std::exit(64);
+    }
+    return static_cast<size_t>(size);
+}
+
+int parse_count(const std::string &flag, size_t prefix_length)
+{
+    return static_cast<int>(parse_size(flag, prefix_length));
+}
+
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string flag = argv[i];
+        if (flag.rfind("--component=", 0) == 0)
+        {
+            component = flag.substr(12);
+        }
+        else if (flag.rfind("--min-size=", 0) == 0)
+        {
+            min_size = std::max<size_t>(1, parse_size(flag, 11));
+        }
+        else if (flag.rfind("--max-size=", 0) == 0)
+        {
+            max_size = parse_size(flag, 11);
+        }
+        else if (flag.rfind("--depth=", 0) == 0)
+        {
+            shape.depth = parse_count(flag, 8);
+        }
+        else if (flag.rfind("--width=", 0) == 0)
+        {
+            shape.width = parse_count(flag, 8);
+        }
+        else if (flag.rfind("--variables=", 0) == 0)
+        {
+            shape.variables = parse_count(flag, 12);
+        }
+        else
+        {
+            std::cerr << "Usage: microbench [--component=lexer|parser|ast_printer|interpreter|environment|columns|all] "
+                         "[--min-size=SIZE] [--max-size=SIZE] [--depth=D] [--width=W] [--variables=V]\n";
+            return 64;
+        }
+    }
+
+    char row[200];
+    std::snprintf(row, sizeof(row), "%-12s %-10s %11s %14s %14s %14s %14s\n", "stage", "input", "best ms",
+                  "bytes", "tokens", "nodes", "lookups");
+    std::cout << "shape: depth " << shape.depth << ", width " << shape.width << ", " << shape.variables
+              << " variables\n"
+              << row;
+
+    if (component != "environment" && component != "columns")
+    {
+        for (size_t size = min_size; size <= max_size; size *= 4)
+        {
+            bench_program(size);
+        }
+    }
+
+    // Variables per scope grow fourfold up to 4096
+    if (selected("environment"))
+    {
+        for (int variables = 1; variables <= 4096; variables *= 4)
+        {
+            bench_environment(variables);
+        }
+    }
+
+    // Rows grow fourfold over the program sizes, each evaluated once per run
+    if (selected("columns"))
+    {
+        for (size_t rows = min_size; rows <= max_size; rows *= 4)
+        {
+            bench_columns(rows);
+        }
+    }
+    return 0;
+}
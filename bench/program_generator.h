@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Shape of a generated program
+ */
+struct ProgramShape
+{
+    // Blocks and ifs wrapped around each statement
+    int depth = 0;
+
+    // Variable operands in each statement's expression
+    int width = 4;
+
+    // Variables declared up front and read by the expressions
+    int variables = 16;
+};
+
+/**
+ * Generates syntactically valid Prism programs of a chosen size and shape
+ *
+ * A program declares its variables, then repeats a unit until it reaches
+ * the requested size. Each unit is one assignment to `total`, whose
+ * expression reads `width` variables, wrapped in `depth` alternating blocks
+ * and `if` statements. Every condition is true and nothing is printed, so
+ * running the program evaluates every node exactly once.
+ */
+class ProgramGenerator
+{
+private:
+    ProgramShape shape;
+
+    // Variable the next operand reads, cycling through all of them
+    int next_variable = 0;
+
+    std::string variable()
+    {
+        std::string name = "v" + std::to_string(next_variable);
+        next_variable = (next_variable + 1) % shape.variables;
+        return name;
+    }
+
+    /**
+     * Appends one assignment wrapped in the nesting, indented as a person would
+     */
+    void append_unit(std::string &program)
+    {
+        std::string indent;
+        for (int level = 0; level < shape.depth; level++)
+        {
+            program += indent + (level % 2 == 0 ? "{\n" : "if (v0 < 1) {\n");
+            indent += "  ";
+        }
+
+        static const char *const operators[] = {" + ", " * ", " - ", " / "};
+        program += indent + "total = " + variable();
+        for (int operand = 1; operand < shape.width; operand++)
+        {
+            program += operators[operand % 4];
+            program += variable();
+        }
+        program += ";\n";
+
+        for (int level = shape.depth; level > 0; level--)
+        {
+            indent.resize(indent.size() - 2);
+            program += indent + "}\n";
+        }
+    }
+
+public:
+    explicit ProgramGenerator(ProgramShape program_shape) : shape{program_shape}
+    {
+        shape.width = shape.width < 1 ? 1 : shape.width;
+        shape.variables = shape.variables < 1 ? 1 : shape.variables;
+    }
+
+    /**
+     * A program of at least the given number of bytes
+     */
+    std::string generate(size_t bytes)
+    {
+        std::string program;
+        program.reserve(bytes + 256);
+        next_variable = 0;
+
+        // Variables start at 0 so every `if (v0 < 1)` is taken; 1 avoids dividing by zero
+        program += "var total = 0;\nvar v0 = 0;\n";
+        for (int i = 1; i < shape.variables; i++)
+        {
+            program += "var v" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+        }
+
+        while (program.size() < bytes)
+        {
+            append_unit(program);
+        }
+        return program;
+    }
+};
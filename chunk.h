@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "value.h"
+
+/**
+ * Instruction set of the bytecode virtual machine
+ * Operands follow the opcode inline in little-endian order
+ */
+enum OpCode : uint8_t
+{
+    // Constants and literals
+    OP_CONSTANT, // u32 constant index
+    OP_NIL,
+    OP_TRUE,
+    OP_FALSE,
+
+    // Stack manipulation
+    OP_POP,
+    OP_POPN, // u16 count
+
+    // Variable access
+    OP_GET_LOCAL,     // u16 stack slot
+    OP_SET_LOCAL,     // u16 stack slot
+    OP_GET_GLOBAL,    // u32 global index
+    OP_SET_GLOBAL,    // u32 global index
+    OP_DEFINE_GLOBAL, // u32 global index
+
+    // Equality and comparison
+    OP_EQUAL,
+    OP_NOT_EQUAL,
+    OP_GREATER,
+    OP_GREATER_EQUAL,
+    OP_LESS,
+    OP_LESS_EQUAL,
+
+    // Arithmetic
+    OP_ADD,
+    OP_SUBTRACT,
+    OP_MULTIPLY,
+    OP_DIVIDE,
+    OP_NOT,
+    OP_NEGATE,
+
+    // Statements and control flow
+    OP_PRINT,
+    OP_JUMP,          // u32 forward offset
+    OP_JUMP_IF_FALSE, // u32 forward offset, condition left on stack
+    OP_JUMP_IF_TRUE,  // u32 forward offset, condition left on stack
+    OP_LOOP,          // u32 backward offset
+    OP_RETURN,
+
+    // Parallel loop reductions, combined in blocks; u8 is 1 for * and 0 for +
+    OP_REDUCE_BEGIN, // u8 operator: value -> total before the loop, or nil if not a number; block value
+    OP_REDUCE_COUNT, // u16 counter slot, u32 forward offset taken until a block is complete
+    OP_REDUCE_BLOCK, // u8 operator: total, block value -> new total, next block value
+    OP_REDUCE_END,   // u8 operator: total, block value -> combined value
+
+    // Number of opcodes, used to size dispatch tables
+    OP_COUNT
+};
+
+/**
+ * Global variable table shared by every chunk the VM runs
+ * Names are resolved to indices at compile time; definedness is checked at runtime
+ */
+struct GlobalTable
+{
+    std::unordered_map<std::string, uint32_t> index_of;
+    std::vector<std::string> names;
+    std::vector<Value> values;
+    std::vector<bool> defined;
+
+    /**
+     * Returns the index for a global name, creating an undefined slot if needed
+     */
+    uint32_t intern(const std::string &name)
+    {
+        auto iter = index_of.find(name);
+        if (iter != index_of.end())
+        {
+            return iter->second;
+        }
+
+        uint32_t index = static_cast<uint32_t>(names.size());
+        index_of.emplace(name, index);
+        names.push_back(name);
+        values.emplace_back(nullptr);
+        defined.push_back(false);
+        return index;
+    }
+};
+
+/**
+ * A compiled sequence of bytecode with its constant pool and line table
+ */
+struct Chunk
+{
+    // Instruction stream
+    std::vector<uint8_t> code;
+
+    // Constant pool for numbers and strings
+    std::vector<Value> constants;
+
+    // Run-length line table: (first code offset, source line) pairs
+    std::vector<std::pair<size_t, int>> lines;
+
+    // Deepest stack the code can reach, computed by the compiler
+    size_t max_stack = 0;
+
+    /**
+     * Appends a byte and records its source line
+     */
+    void write(uint8_t byte, int line)
+    {
+        if (lines.empty() || lines.back().second != line)
+        {
+            lines.emplace_back(code.size(), line);
+        }
+        code.push_back(byte);
+    }
+
+    /**
+     * Finds the source line for the instruction at a code offset
+     */
+    int line_at(size_t offset) const
+    {
+        auto iter = std::upper_bound(
+            lines.begin(), lines.end(), offset,
+            [](size_t target, const std::pair<size_t, int> &entry)
+            { return target < entry.first; });
+
+        if (iter == lines.begin())
+        {
+            return 0;
+        }
+        return std::prev(iter)->second;
+    }
+};
@@ -0,0 +1,858 @@
+#pragma once
+
+#include <algorithm>
+#include <any>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "chunk.h"
+#include "error.h"
+#include "expr.h"
+#include "output_sink.h"
+#include "parallel_loop.h"
+#include "runtime_error.h"
+#include "scope_resolver.h"
+#include "stmt.h"
+#include "value.h"
+
+/**
+ * Mutable state threaded through compiled closures at run time
+ */
+struct ClosureState
+{
+    GlobalTable &globals;
+    std::vector<Value> locals;
+};
+
+// Pre-bound callables produced by the closure compiler
+using ValueClosure = std::function<Value(ClosureState &)>;
+using NumberClosure = std::function<double(ClosureState &)>;
+using ConditionClosure = std::function<bool(ClosureState &)>;
+using StmtClosure = std::function<void(ClosureState &)>;
+
+/**
+ * Result type of an expression when it evaluates without error
+ */
+enum class StaticType
+{
+    UNKNOWN,
+    NIL,
+    BOOL,
+    NUMBER,
+    STRING
+};
+
+/**
+ * An expression compiled into callables, one per result form
+ */
+struct CompiledExpr
+{
+    StaticType type = StaticType::UNKNOWN;
+
+    // Always present: produces the boxed value
+    ValueClosure value;
+
+    // Present when type is NUMBER: produces the raw double
+    NumberClosure number;
+
+    // Always present: produces the truthiness, e.g. for conditions
+    ConditionClosure truthy;
+};
+
+/**
+ * Compiles each AST node once into a closure holding its children's closures
+ *
+ * Operators and variable bindings are resolved while compiling, and operand
+ * checks are dropped wherever the operand types are already known, so
+ * execution never goes through accept() or a switch on the operator.
+ */
+class ClosureCompiler : public ExprVisitor, public StmtVisitor
+{
+private:
+    // Shared global table and compile-time scope state
+    GlobalTable &globals;
+    ScopeResolver scopes;
+
+    // Results of the most recent visit
+    CompiledExpr last_expr;
+    StmtClosure last_stmt;
+
+    CompiledExpr compile_expr(const std::shared_ptr<Expr> &expr)
+    {
+        expr->accept(*this);
+        return std::move(last_expr);
+    }
+
+    StmtClosure compile_stmt(const std::shared_ptr<Stmt> &stmt)
+    {
+        stmt->accept(*this);
+        return std::move(last_stmt);
+    }
+
+    /**
+     * Fills in the closures a node did not provide itself
+     */
+    static CompiledExpr finish(CompiledExpr compiled)
+    {
+        if (compiled.type == StaticType::NUMBER && !compiled.number)
+        {
+            compiled.number = [value = compiled.value](ClosureState &state)
+            {
+                return std::get<double>(value(state));
+            };
+        }
+        if (!compiled.value && compiled.number)
+        {
+            compiled.value = [number = compiled.number](ClosureState &state) -> Value
+            {
+                return number(state);
+            };
+        }
+        if (!compiled.truthy)
+        {
+            if (compiled.type == StaticType::NUMBER)
+            {
+                // Numbers are always truthy, but must still be evaluated
+                compiled.truthy = [number = compiled.number](ClosureState &state)
+                {
+                    number(state);
+                    return true;
+                };
+            }
+            else
+            {
+                compiled.truthy = [value = compiled.value](ClosureState &state)
+                {
+                    return is_truthy(value(state));
+                };
+            }
+        }
+        return compiled;
+    }
+
+    static CompiledExpr make_number(NumberClosure number)
+    {
+        CompiledExpr compiled;
+        compiled.type = StaticType::NUMBER;
+        compiled.number = std::move(number);
+        return finish(std::move(compiled));
+    }
+
+    static CompiledExpr make_condition(ConditionClosure condition)
+    {
+        CompiledExpr compiled;
+        compiled.type = StaticType::BOOL;
+        compiled.value = [condition](ClosureState &state) -> Value
+        {
+            return condition(state);
+        };
+        compiled.truthy = std::move(condition);
+        return finish(std::move(compiled));
+    }
+
+    /**
+     * Builds an arithmetic or comparison operator on numbers,
+     * checking operands only when their types are unknown
+     */
+    template <typename Result, typename Operator>
+    static std::function<Result(ClosureState &)> numeric(const CompiledExpr &left,
+                                                         const CompiledExpr &right,
+                                                         const Token &op, Operator apply)
+    {
+        if (left.type == StaticType::NUMBER && right.type == StaticType::NUMBER)
+        {
+            return [l = left.number, r = right.number, apply](ClosureState &state)
+            {
+                double left_number = l(state);
+                return apply(left_number, r(state));
+            };
+        }
+
+        return [l = left.value, r = right.value, op, apply](ClosureState &state)
+        {
+            Value left_value = l(state);
+            Value right_value = r(state);
+            const double *left_number = std::get_if<double>(&left_value);
+            const double *right_number = std::get_if<double>(&right_value);
+            if (left_number == nullptr || right_number == nullptr)
+            {
+                throw RuntimeError{op, "Operands must be numbers."};
+            }
+            return apply(*left_number, *right_number);
+        };
+    }
+
+    /**
+     * Builds == or != from the operand types
+     */
+    static ConditionClosure equality(const CompiledExpr &left, const CompiledExpr &right,
+                                     bool negate)
+    {
+        if (left.type == StaticType::NUMBER && right.type == StaticType::NUMBER)
+        {
+            return [l = left.number, r = right.number, negate](ClosureState &state)
+            {
+                double left_number = l(state);
+                return (left_number == r(state)) != negate;
+            };
+        }
+
+        return [l = left.value, r = right.value, negate](ClosureState &state)
+        {
+            Value left_value = l(state);
+            return is_equal(left_value, r(state)) != negate;
+        };
+    }
+
+    /**
+     * Builds + as addition, concatenation or a runtime-dispatched operator
+     */
+    static CompiledExpr addition(const CompiledExpr &left, const CompiledExpr &right,
+                                 const Token &op)
+    {
+        if (left.type == StaticType::NUMBER && right.type == StaticType::NUMBER)
+        {
+            return make_number(numeric<double>(left, right, op, std::plus<double>{}));
+        }
+
+        CompiledExpr compiled;
+        if (left.type == StaticType::STRING && right.type == StaticType::STRING)
+        {
+            compiled.type = StaticType::STRING;
+            compiled.value = [l = left.value, r = right.value](ClosureState &state) -> Value
+            {
+                Value left_value = l(state);
+                std::get<std::string>(left_value) += std::get<std::string>(r(state));
+                return left_value;
+            };
+            return finish(std::move(compiled));
+        }
+
+        compiled.value = [l = left.value, r = right.value, op](ClosureState &state) -> Value
+        {
+            Value left_value = l(state);
+            Value right_value = r(state);
+
+            // Handle number addition
+            double *left_number = std::get_if<double>(&left_value);
+            const double *right_number = std::get_if<double>(&right_value);
+            if (left_number != nullptr && right_number != nullptr)
+            {
+                return *left_number + *right_number;
+            }
+
+            // Handle string concatenation
+            std::string *left_text = std::get_if<std::string>(&left_value);
+            const std::string *right_text = std::get_if<std::string>(&right_value);
+            if (left_text != nullptr && right_text != nullptr)
+            {
+                *left_text += *right_text;
+                return left_value;
+            }
+
+            throw RuntimeError{op, "Operands must be two numbers or two strings."};
+        };
+        return finish(std::move(compiled));
+    }
+
+public:
+    /**
+     * Creates a compiler that resolves globals through the given table
+     */
+    ClosureCompiler(GlobalTable &global_table)
+        : globals{global_table}
+    {
+    }
+
+    /**
+     * Compiles a program into a single closure
+     */
+    StmtClosure compile(const std::vector<std::shared_ptr<Stmt>> &statements)
+    {
+        std::vector<StmtClosure> compiled;
+        for (const auto &stmt : statements)
+        {
+            compiled.push_back(compile_stmt(stmt));
+        }
+
+        return [compiled = std::move(compiled)](ClosureState &state)
+        {
+            for (const auto &stmt : compiled)
+            {
+                stmt(state);
+            }
+        };
+    }
+
+    /**
+     * Number of local slots the compiled program needs
+     */
+    size_t slot_count() const
+    {
+        return scopes.slot_count();
+    }
+
+    //-----------------------------------------------
+    // Statement Visitor Methods
+    //-----------------------------------------------
+
+    std::any visit_block_stmt(std::shared_ptr<Block> stmt) override
+    {
+        scopes.begin_scope();
+        std::vector<StmtClosure> compiled;
+        for (const auto &statement : stmt->body())
+        {
+            compiled.push_back(compile_stmt(statement));
+        }
+        scopes.end_scope();
+
+        if (compiled.size() == 1)
+        {
+            last_stmt = std::move(compiled.front());
+            return {};
+        }
+
+        last_stmt = [compiled = std::move(compiled)](ClosureState &state)
+        {
+            for (const auto &stmt : compiled)
+            {
+                stmt(state);
+            }
+        };
+        return {};
+    }
+
+    std::any visit_expression_stmt(std::shared_ptr<Expression> stmt) override
+    {
+        CompiledExpr compiled = compile_expr(stmt->expression);
+
+        if (compiled.type == StaticType::NUMBER)
+        {
+            last_stmt = [number = compiled.number](ClosureState &state)
+            {
+                number(state);
+            };
+        }
+        else
+        {
+            last_stmt = [value = compiled.value](ClosureState &state)
+            {
+                value(state);
+            };
+        }
+        return {};
+    }
+
+    std::any visit_if_stmt(std::shared_ptr<If> stmt) override
+    {
+        ConditionClosure condition = compile_expr(stmt->condition).truthy;
+        StmtClosure then_branch = compile_stmt(stmt->then_branch);
+
+        if (stmt->else_branch == nullptr)
+        {
+            last_stmt = [condition, then_branch](ClosureState &state)
+            {
+                if (condition(state))
+                {
+                    then_branch(state);
+                }
+            };
+            return {};
+        }
+
+        StmtClosure else_branch = compile_stmt(stmt->else_branch);
+        last_stmt = [condition, then_branch, else_branch](ClosureState &state)
+        {
+            if (condition(state))
+            {
+                then_branch(state);
+            }
+            else
+            {
+                else_branch(state);
+            }
+        };
+        return {};
+    }
+
+    std::any visit_print_stmt(std::shared_ptr<Print> stmt) override
+    {
+        CompiledExpr compiled = compile_expr(stmt->expression);
+
+        if (compiled.type == StaticType::NUMBER)
+        {
+            last_stmt = [number = compiled.number](ClosureState &state)
+            {
+                standard_output().print_number(number(state));
+            };
+        }
+        else
+        {
+            last_stmt = [value = compiled.value](ClosureState &state)
+            {
+                standard_output().print_value(value(state));
+            };
+        }
+        return {};
+    }
+
+    std::any visit_var_stmt(std::shared_ptr<Var> stmt) override
+    {
+        // The initialiser sees the enclosing binding, as in the interpreter
+        ValueClosure initialiser = [](ClosureState &) -> Value
+        {
+            return nullptr;
+        };
+        if (stmt->initialiser != nullptr)
+        {
+            initialiser = compile_expr(stmt->initialiser).value;
+        }
+
+        ScopeResolver::Declaration declaration = scopes.declare(stmt->name.lexeme);
+        if (declaration.slot < 0)
+        {
+            uint32_t index = globals.intern(stmt->name.lexeme);
+            last_stmt = [index, initialiser](ClosureState &state)
+            {
+                Value initial_value = initialiser(state);
+                state.globals.values[index] = std::move(initial_value);
+                state.globals.defined[index] = true;
+            };
+            return {};
+        }
+
+        size_t slot = declaration.slot;
+        last_stmt = [slot, initialiser](ClosureState &state)
+        {
+            state.locals[slot] = initialiser(state);
+        };
+        return {};
+    }
+
+    std::any visit_while_stmt(std::shared_ptr<While> stmt) override
+    {
+        ConditionClosure condition = compile_expr(stmt->condition).truthy;
+        StmtClosure body = compile_stmt(stmt->body);
+
+        if (stmt->parallel == nullptr || stmt->parallel->reductions.empty())
+        {
+            last_stmt = [condition, body](ClosureState &state)
+            {
+                while (condition(state))
+                {
+                    body(state);
+                }
+            };
+            return {};
+        }
+
+        // Reductions are combined in blocks, as the tree-walking interpreter combines them
+        struct Binding
+        {
+            int slot;
+            uint32_t global;
+        };
+        std::vector<Binding> bindings;
+        for (const Reduction &reduction : stmt->parallel->reductions)
+        {
+            int slot = scopes.resolve(reduction.name.lexeme);
+            bindings.push_back(Binding{slot, slot >= 0 ? 0 : globals.intern(reduction.name.lexeme)});
+        }
+
+        last_stmt = [condition, body, loop = stmt->parallel, bindings](ClosureState &state)
+        {
+            auto find = [&](const Reduction &reduction)
+            {
+                const Binding &binding = bindings[&reduction - loop->reductions.data()];
+                if (binding.slot >= 0)
+                {
+                    return std::get_if<double>(&state.locals[binding.slot]);
+                }
+                return state.globals.defined[binding.global] ? std::get_if<double>(&state.globals.values[binding.global])
+                                                             : nullptr;
+            };
+
+            ReductionBlocks blocks{loop->reductions};
+            blocks.begin(find);
+            while (condition(state))
+            {
+                body(state);
+                blocks.end_iteration(find);
+            }
+            blocks.finish(find);
+        };
+        return {};
+    }
+
+    //-----------------------------------------------
+    // Expression Visitor Methods
+    //-----------------------------------------------
+
+    std::any visit_assign_expr(std::shared_ptr<Assign> expr) override
+    {
+        CompiledExpr value = compile_expr(expr->expr_value);
+        int slot = scopes.resolve(expr->var_name.lexeme);
+
+        CompiledExpr compiled;
+        compiled.type = value.type;
+
+        if (slot >= 0)
+        {
+            size_t local = slot;
+            if (value.type == StaticType::NUMBER)
+            {
+                compiled.number = [local, number = value.number](ClosureState &state)
+                {
+                    double result = number(state);
+                    state.locals[local] = result;
+                    return result;
+                };
+            }
+            else
+            {
+                compiled.value = [local, v = value.value](ClosureState &state)
+                {
+                    Value result = v(state);
+                    state.locals[local] = result;
+                    return result;
+                };
+            }
+            last_expr = finish(std::move(compiled));
+            return {};
+        }
+
+        uint32_t index = globals.intern(expr->var_name.lexeme);
+        Token name = expr->var_name;
+        compiled.value = [index, name, v = value.value](ClosureState &state)
+        {
+            Value result = v(state);
+            if (!state.globals.defined[index])
+            {
+                throw RuntimeError{name,
+                                   "Cannot assign to undefined variable '" + name.lexeme + "'."};
+            }
+            state.globals.values[index] = result;
+            return result;
+        };
+        last_expr = finish(std::move(compiled));
+        return {};
+    }
+
+    std::any visit_binary_expr(std::shared_ptr<Binary> expr) override
+    {
+        CompiledExpr left = compile_expr(expr->left_expr);
+        CompiledExpr right = compile_expr(expr->right_expr);
+        const Token &op = expr->operator_token;
+
+        // Resolve the operator once, here
+        switch (op.type)
+        {
+        case GREATER:
+            last_expr = make_condition(numeric<bool>(left, right, op, std::greater<double>{}));
+            break;
+        case GREATER_EQUAL:
+            last_expr = make_condition(numeric<bool>(left, right, op, std::greater_equal<double>{}));
+            break;
+        case LESS:
+            last_expr = make_condition(numeric<bool>(left, right, op, std::less<double>{}));
+            break;
+        case LESS_EQUAL:
+            last_expr = make_condition(numeric<bool>(left, right, op, std::less_equal<double>{}));
+            break;
+        case EQUAL_EQUAL:
+            last_expr = make_condition(equality(left, right, false));
+            break;
+        case BANG_EQUAL:
+            last_expr = make_condition(equality(left, right, true));
+            break;
+        case MINUS:
+            last_expr = make_number(numeric<double>(left, right, op, std::minus<double>{}));
+            break;
+        case SLASH:
+            last_expr = make_number(numeric<double>(left, right, op, std::divides<double>{}));
+            break;
+        case STAR:
+            last_expr = make_number(numeric<double>(left, right, op, std::multiplies<double>{}));
+            break;
+        case PLUS:
+            last_expr = addition(left, right, op);
+            break;
+        default:
+            break;
+        }
+        return {};
+    }
+
+    std::any visit_grouping_expr(std::shared_ptr<Grouping> expr) override
+    {
+        last_expr = compile_expr(expr->inner_expr);
+        return {};
+    }
+
+    std::any visit_literal_expr(std::shared_ptr<Literal> expr) override
+    {
+        Value literal = value_from_any(expr->literal_value);
+
+        if (const double *number = std::get_if<double>(&literal))
+        {
+            double constant = *number;
+            last_expr = make_number([constant](ClosureState &)
+                                    { return constant; });
+            return {};
+        }
+
+        CompiledExpr compiled;
+        if (std::holds_alternative<std::string>(literal))
+        {
+            compiled.type = StaticType::STRING;
+        }
+        else if (std::holds_alternative<bool>(literal))
+        {
+            compiled.type = StaticType::BOOL;
+        }
+        else
+        {
+            compiled.type = StaticType::NIL;
+        }
+
+        bool truthy = is_truthy(literal);
+        compiled.value = [literal](ClosureState &)
+        {
+            return literal;
+        };
+        compiled.truthy = [truthy](ClosureState &)
+        {
+            return truthy;
+        };
+        last_expr = finish(std::move(compiled));
+        return {};
+    }
+
+    std::any visit_logical_expr(std::shared_ptr<Logical> expr) override
+    {
+        CompiledExpr left = compile_expr(expr->left_expr);
+        CompiledExpr right = compile_expr(expr->right_expr);
+
+        CompiledExpr compiled;
+        compiled.type = left.type == right.type ? left.type : StaticType::UNKNOWN;
+
+        // The result's truthiness is that of whichever operand is returned
+        if (expr->operator_token.type == OR)
+        {
+            compiled.value = [l = left.value, r = right.value](ClosureState &state)
+            {
+                Value left_value = l(state);
+                return is_truthy(left_value) ? left_value : r(state);
+            };
+            compiled.truthy = [l = left.truthy, r = right.truthy](ClosureState &state)
+            {
+                return l(state) || r(state);
+            };
+        }
+        else
+        {
+            compiled.value = [l = left.value, r = right.value](ClosureState &state)
+            {
+                Value left_value = l(state);
+                return !is_truthy(left_value) ? left_value : r(state);
+            };
+            compiled.truthy = [l = left.truthy, r = right.truthy](ClosureState &state)
+            {
+                return l(state) && r(state);
+            };
+        }
+
+        if (compiled.type == StaticType::NUMBER)
+        {
+            // Numbers are truthy: 'or' returns the left, 'and' the right
+            if (expr->operator_token.type == OR)
+            {
+                compiled.number = left.number;
+            }
+            else
+            {
+                compiled.number = [l = left.number, r = right.number](ClosureState &state)
+                {
+                    l(state);
+                    return r(state);
+                };
+            }
+        }
+        last_expr = finish(std::move(compiled));
+        return {};
+    }
+
+    std::any visit_unary_expr(std::shared_ptr<Unary> expr) override
+    {
+        CompiledExpr operand = compile_expr(expr->operand);
+
+        if (expr->operator_token.type == BANG)
+        {
+            last_expr = make_condition([truthy = operand.truthy](ClosureState &state)
+                                       { return !truthy(state); });
+            return {};
+        }
+
+        if (operand.type == StaticType::NUMBER)
+        {
+            last_expr = make_number([number = operand.number](ClosureState &state)
+                                    { return -number(state); });
+            return {};
+        }
+
+        last_expr = make_number([value = operand.value, op = expr->operator_token](ClosureState &state)
+                                {
+            Value operand_value = value(state);
+            const double *number = std::get_if<double>(&operand_value);
+            if (number == nullptr)
+            {
+                throw RuntimeError{op, "Operand must be a number."};
+            }
+            return -*number; });
+        return {};
+    }
+
+    std::any visit_variable_expr(std::shared_ptr<Variable> expr) override
+    {
+        int slot = scopes.resolve(expr->var_name.lexeme);
+
+        CompiledExpr compiled;
+        if (slot >= 0)
+        {
+            size_t local = slot;
+            compiled.value = [local](ClosureState &state)
+            {
+                return state.locals[local];
+            };
+            last_expr = finish(std::move(compiled));
+            return {};
+        }
+
+        uint32_t index = globals.intern(expr->var_name.lexeme);
+        Token name = expr->var_name;
+        compiled.value = [index, name](ClosureState &state)
+        {
+            if (!state.globals.defined[index])
+            {
+                throw RuntimeError{name, "Undefined variable '" + name.lexeme + "'."};
+            }
+            return state.globals.values[index];
+        };
+        last_expr = finish(std::move(compiled));
+        return {};
+    }
+};
+
+/**
+ * Execution engine that runs programs compiled by the ClosureCompiler
+ */
+class ClosureEngine
+{
+private:
+    // Globals persist across programs, e.g. between interactive lines
+    GlobalTable globals;
+
+public:
+    /**
+     * Compiles and executes a program, reporting runtime errors
+     */
+    void interpret(const std::vector<std::shared_ptr<Stmt>> &statements)
+    {
+        ClosureCompiler compiler{globals};
+        StmtClosure program = compiler.compile(statements);
+
+        ClosureState state{globals, {}};
+        state.locals.resize(compiler.slot_count());
+
+        try
+        {
+            program(state);
+        }
+        catch (RuntimeError &error)
+        {
+            // Report runtime errors
+            runtime_error(error);
+        }
+    }
+};
+
+/**
+ * A program compiled once by the ClosureCompiler and run many times
+ *
+ * Each run can start from fresh globals: reset() marks every global
+ * undefined without freeing the table, and bind() defines an input at the
+ * index global() looked up for its name, so running against many inputs
+ * costs no parsing, compiling or lookups by name.
+ */
+class CompiledProgram
+{
+private:
+    GlobalTable globals;
+    StmtClosure program;
+    ClosureState state{globals, {}};
+
+public:
+    explicit CompiledProgram(const std::vector<std::shared_ptr<Stmt>> &statements)
+    {
+        ClosureCompiler compiler{globals};
+        program = compiler.compile(statements);
+        state.locals.resize(compiler.slot_count());
+    }
+
+    // The state refers to this program's own globals
+    CompiledProgram(const CompiledProgram &) = delete;
+    CompiledProgram &operator=(const CompiledProgram &) = delete;
+
+    /**
+     * Index of the global with the given name, for bind()
+     * Names the program never mentions get a slot too, so binding them is harmless
+     */
+    uint32_t global(const std::string &name)
+    {
+        return globals.intern(name);
+    }
+
+    /**
+     * Makes every global undefined, as before the first run
+     */
+    void reset()
+    {
+        std::fill(globals.defined.begin(), globals.defined.end(), false);
+    }
+
+    void bind(uint32_t index, Value value)
+    {
+        globals.values[index] = std::move(value);
+        globals.defined[index] = true;
+    }
+
+    /**
+     * Binds a string, reusing the buffer of the string the global last held
+     */
+    void bind_text(uint32_t index, std::string_view text)
+    {
+        if (std::string *held = std::get_if<std::string>(&globals.values[index]))
+        {
+            held->assign(text);
+        }
+        else
+        {
+            globals.values[index] = std::string{text};
+        }
+        globals.defined[index] = true;
+    }
+
+    /**
+     * Runs the program once against the current globals
+     * @throws RuntimeError for the caller to report
+     */
+    void run()
+    {
+        program(state);
+    }
+};
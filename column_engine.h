@@ -0,0 +1,983 @@
+#pragma once
+
+#include <algorithm>
+#include <any>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "expr.h"
+#include "interpreter.h"
+#include "runtime_error.h"
+#include "token_type.h"
+#include "value.h"
+
+/**
+ * How a column stores its values: numbers and booleans unboxed, anything
+ * else (strings, nil or a mix of types) as Values
+ */
+enum class ColumnType
+{
+    NUMBER,
+    BOOL,
+    VALUES
+};
+
+/**
+ * One column of values, stored contiguously
+ */
+struct Column
+{
+    ColumnType type = ColumnType::VALUES;
+    std::vector<double> numbers;
+
+    // One byte per row, 0 or 1, so kernels over them vectorise
+    std::vector<uint8_t> bools;
+
+    std::vector<Value> values;
+
+    static Column of_numbers(std::vector<double> numbers)
+    {
+        Column column;
+        column.type = ColumnType::NUMBER;
+        column.numbers = std::move(numbers);
+        return column;
+    }
+
+    static Column of_bools(std::vector<uint8_t> bools)
+    {
+        Column column;
+        column.type = ColumnType::BOOL;
+        column.bools = std::move(bools);
+        return column;
+    }
+
+    /**
+     * A column of any values, stored unboxed when they are all numbers or all booleans
+     */
+    static Column of_values(std::vector<Value> values)
+    {
+        bool all_numbers = std::all_of(values.begin(), values.end(), [](const Value &value)
+                                       { return std::holds_alternative<double>(value); });
+        bool all_bools = std::all_of(values.begin(), values.end(), [](const Value &value)
+                                     { return std::holds_alternative<bool>(value); });
+        if (values.empty() || (!all_numbers && !all_bools))
+        {
+            Column column;
+            column.values = std::move(values);
+            return column;
+        }
+
+        Column column;
+        column.type = all_numbers ? ColumnType::NUMBER : ColumnType::BOOL;
+        for (const Value &value : values)
+        {
+            if (all_numbers)
+            {
+                column.numbers.push_back(std::get<double>(value));
+            }
+            else
+            {
+                column.bools.push_back(std::get<bool>(value));
+            }
+        }
+        return column;
+    }
+
+    size_t size() const
+    {
+        switch (type)
+        {
+        case ColumnType::NUMBER:
+            return numbers.size();
+        case ColumnType::BOOL:
+            return bools.size();
+        default:
+            return values.size();
+        }
+    }
+
+    Value at(size_t row) const
+    {
+        switch (type)
+        {
+        case ColumnType::NUMBER:
+            return numbers[row];
+        case ColumnType::BOOL:
+            return bools[row] != 0;
+        default:
+            return values[row];
+        }
+    }
+};
+
+// Input columns by variable name, all of the same length
+using ColumnTable = std::map<std::string, Column>;
+
+/**
+ * A row whose evaluation raised a runtime error
+ */
+struct RowError
+{
+    size_t row;
+    int line;
+    std::string message;
+};
+
+/**
+ * Value of the expression for every row, and the rows that failed, in row order
+ * A failed row's entry in the column has no meaning
+ */
+struct ColumnResult
+{
+    Column column;
+    std::vector<RowError> errors;
+};
+
+/**
+ * Evaluates one expression over whole columns at a time
+ *
+ * The expression is compiled against the names and types of the input
+ * columns into a tree of kernels. Each kernel runs one operator over
+ * contiguous double or byte arrays in a plain loop the compiler can
+ * vectorise, with constants folded into the loop rather than broadcast.
+ * `and` and `or` evaluate their right operand only for the rows whose left
+ * operand did not decide the result, listed in a selection vector; a right
+ * operand that cannot fail is instead run over every row and masked when
+ * most rows need it, as the dense loop is faster.
+ *
+ * Anything whose types are not known from the columns, such as strings,
+ * nil, mixed-type columns, assignments or operators applied to the wrong
+ * types, is evaluated row by row by the tree-walking Interpreter, with the
+ * row's values bound as globals. Results, including runtime errors, are
+ * exactly those of evaluating the expression separately for each row.
+ */
+class ColumnEvaluator
+{
+private:
+    enum class Op : uint8_t
+    {
+        COLUMN,
+        CONSTANT,
+        NEGATE,
+        NOT,
+        ADD,
+        SUBTRACT,
+        MULTIPLY,
+        DIVIDE,
+        GREATER,
+        GREATER_EQUAL,
+        LESS,
+        LESS_EQUAL,
+        EQUAL,
+        NOT_EQUAL,
+        AND,
+        OR,
+        SCALAR
+    };
+
+    struct Node
+    {
+        Op op;
+        ColumnType type;
+
+        // Whether no row can fail anywhere in this subtree
+        bool pure = true;
+
+        // Operands; unary operators use only the left
+        std::unique_ptr<Node> left;
+        std::unique_ptr<Node> right;
+
+        // COLUMN: index of the input column
+        size_t column = 0;
+
+        // CONSTANT: its value, by type
+        double number = 0;
+        bool boolean = false;
+
+        // SCALAR: the subtree to interpret and the columns it reads
+        std::shared_ptr<Expr> expr;
+        std::vector<size_t> reads;
+    };
+
+    // Rows an operation applies to: every row, or only these, in increasing order
+    struct Selection
+    {
+        bool all = true;
+        std::vector<uint32_t> rows;
+    };
+
+    // Operand of a kernel: a column's array, or a constant repeated for every row
+    template <typename T>
+    struct Dense
+    {
+        const T *data;
+
+        T operator[](size_t row) const
+        {
+            return data[row];
+        }
+    };
+
+    template <typename T>
+    struct Repeated
+    {
+        T value;
+
+        T operator[](size_t) const
+        {
+            return value;
+        }
+    };
+
+    std::unique_ptr<Node> root;
+
+    // Columns the expression reads, as compiled against
+    std::vector<std::string> column_names;
+    std::vector<ColumnType> column_types;
+
+    // Evaluates the parts that cannot be vectorised
+    Interpreter fallback;
+
+    // State of the evaluate() in progress
+    std::vector<const Column *> inputs;
+    size_t rows = 0;
+    std::vector<uint8_t> failed;
+    std::vector<RowError> errors;
+
+    //---------------------------------------------
+    // Compiling
+    //---------------------------------------------
+
+    static bool assigns(const std::shared_ptr<Expr> &expr)
+    {
+        switch (expr->kind)
+        {
+        case ExprKind::ASSIGN:
+            return true;
+        case ExprKind::BINARY:
+            return assigns(static_cast<Binary &>(*expr).left_expr) || assigns(static_cast<Binary &>(*expr).right_expr);
+        case ExprKind::GROUPING:
+            return assigns(static_cast<Grouping &>(*expr).inner_expr);
+        case ExprKind::LOGICAL:
+            return assigns(static_cast<Logical &>(*expr).left_expr) ||
+                   assigns(static_cast<Logical &>(*expr).right_expr);
+        case ExprKind::UNARY:
+            return assigns(static_cast<Unary &>(*expr).operand);
+        default:
+            return false;
+        }
+    }
+
+    void add_read(const std::string &name, std::vector<size_t> &reads) const
+    {
+        auto found = std::find(column_names.begin(), column_names.end(), name);
+        size_t column = found - column_names.begin();
+        if (found != column_names.end() && std::find(reads.begin(), reads.end(), column) == reads.end())
+        {
+            reads.push_back(column);
+        }
+    }
+
+    /**
+     * Input columns a subtree reads, by index
+     * Assignment targets count, as assigning to an undefined global fails
+     */
+    void collect_reads(const std::shared_ptr<Expr> &expr, std::vector<size_t> &reads) const
+    {
+        switch (expr->kind)
+        {
+        case ExprKind::ASSIGN:
+            collect_reads(static_cast<Assign &>(*expr).expr_value, reads);
+            add_read(static_cast<Assign &>(*expr).var_name.lexeme, reads);
+            break;
+        case ExprKind::BINARY:
+            collect_reads(static_cast<Binary &>(*expr).left_expr, reads);
+            collect_reads(static_cast<Binary &>(*expr).right_expr, reads);
+            break;
+        case ExprKind::GROUPING:
+            collect_reads(static_cast<Grouping &>(*expr).inner_expr, reads);
+            break;
+        case ExprKind::LOGICAL:
+            collect_reads(static_cast<Logical &>(*expr).left_expr, reads);
+            collect_reads(static_cast<Logical &>(*expr).right_expr, reads);
+            break;
+        case ExprKind::UNARY:
+            collect_reads(static_cast<Unary &>(*expr).operand, reads);
+            break;
+        case ExprKind::VARIABLE:
+            add_read(static_cast<Variable &>(*expr).var_name.lexeme, reads);
+            break;
+        default:
+            break;
+        }
+    }
+
+    std::unique_ptr<Node> make_node(Op op, ColumnType type)
+    {
+        auto node = std::make_unique<Node>();
+        node->op = op;
+        node->type = type;
+        return node;
+    }
+
+    /**
+     * A subtree left to the interpreter, one row at a time
+     */
+    std::unique_ptr<Node> make_scalar(const std::shared_ptr<Expr> &expr)
+    {
+        auto node = make_node(Op::SCALAR, ColumnType::VALUES);
+        node->pure = false;
+        node->expr = expr;
+        collect_reads(expr, node->reads);
+        return node;
+    }
+
+    std::unique_ptr<Node> compile(const std::shared_ptr<Expr> &expr)
+    {
+        switch (expr->kind)
+        {
+        case ExprKind::GROUPING:
+            return compile(static_cast<Grouping &>(*expr).inner_expr);
+
+        case ExprKind::LITERAL:
+        {
+            const std::any &literal = static_cast<Literal &>(*expr).literal_value;
+            if (const double *number = std::any_cast<double>(&literal))
+            {
+                auto node = make_node(Op::CONSTANT, ColumnType::NUMBER);
+                node->number = *number;
+                return node;
+            }
+            if (const bool *boolean = std::any_cast<bool>(&literal))
+            {
+                auto node = make_node(Op::CONSTANT, ColumnType::BOOL);
+                node->boolean = *boolean;
+                return node;
+            }
+            return make_scalar(expr);
+        }
+
+        case ExprKind::VARIABLE:
+        {
+            auto found = std::find(column_names.begin(), column_names.end(),
+                                   static_cast<Variable &>(*expr).var_name.lexeme);
+            size_t column = found - column_names.begin();
+            if (found == column_names.end() || column_types[column] == ColumnType::VALUES)
+            {
+                return make_scalar(expr);
+            }
+            auto node = make_node(Op::COLUMN, column_types[column]);
+            node->column = column;
+            return node;
+        }
+
+        case ExprKind::UNARY:
+        {
+            Unary &unary = static_cast<Unary &>(*expr);
+            std::unique_ptr<Node> operand = compile(unary.operand);
+            if (unary.operator_token.type == MINUS && operand->type != ColumnType::NUMBER)
+            {
+                return make_scalar(expr);
+            }
+
+            // Any value has a truthiness, so ! only fails if its operand does
+            auto node = unary.operator_token.type == MINUS ? make_node(Op::NEGATE, ColumnType::NUMBER)
+                                                           : make_node(Op::NOT, ColumnType::BOOL);
+            node->pure = operand->pure;
+            node->left = std::move(operand);
+            return node;
+        }
+
+        case ExprKind::BINARY:
+        {
+            Binary &binary = static_cast<Binary &>(*expr);
+            std::unique_ptr<Node> left = compile(binary.left_expr);
+            std::unique_ptr<Node> right = compile(binary.right_expr);
+            bool numbers = left->type == ColumnType::NUMBER && right->type == ColumnType::NUMBER;
+            bool typed = left->type != ColumnType::VALUES && right->type != ColumnType::VALUES;
+
+            std::unique_ptr<Node> node;
+            switch (binary.operator_token.type)
+            {
+            case PLUS:
+            case MINUS:
+            case STAR:
+            case SLASH:
+            {
+                static const std::map<TokenType, Op> arithmetic = {
+                    {PLUS, Op::ADD}, {MINUS, Op::SUBTRACT}, {STAR, Op::MULTIPLY}, {SLASH, Op::DIVIDE}};
+                if (numbers)
+                {
+                    node = make_node(arithmetic.at(binary.operator_token.type), ColumnType::NUMBER);
+                }
+                break;
+            }
+            case GREATER:
+            case GREATER_EQUAL:
+            case LESS:
+            case LESS_EQUAL:
+            {
+                static const std::map<TokenType, Op> comparisons = {
+                    {GREATER, Op::GREATER}, {GREATER_EQUAL, Op::GREATER_EQUAL},
+                    {LESS, Op::LESS}, {LESS_EQUAL, Op::LESS_EQUAL}};
+                if (numbers)
+                {
+                    node = make_node(comparisons.at(binary.operator_token.type), ColumnType::BOOL);
+                }
+                break;
+            }
+            case EQUAL_EQUAL:
+            case BANG_EQUAL:
+            {
+                bool equal = binary.operator_token.type == EQUAL_EQUAL;
+                if (typed && left->type != right->type)
+                {
+                    // A number never equals a boolean, but an operand that can fail must still run
+                    if (!left->pure || !right->pure)
+                    {
+                        return make_scalar(expr);
+                    }
+                    node = make_node(Op::CONSTANT, ColumnType::BOOL);
+                    node->boolean = !equal;
+                    return node;
+                }
+                if (typed)
+                {
+                    node = make_node(equal ? Op::EQUAL : Op::NOT_EQUAL, ColumnType::BOOL);
+                }
+                break;
+            }
+            default:
+                break;
+            }
+
+            if (node == nullptr)
+            {
+                return make_scalar(expr);
+            }
+            node->pure = left->pure && right->pure;
+            node->left = std::move(left);
+            node->right = std::move(right);
+            return node;
+        }
+
+        case ExprKind::LOGICAL:
+        {
+            Logical &logical = static_cast<Logical &>(*expr);
+            std::unique_ptr<Node> left = compile(logical.left_expr);
+            std::unique_ptr<Node> right = compile(logical.right_expr);
+
+            // The result is one operand or the other, so it is typed only if both are alike
+            ColumnType type = left->type == right->type ? left->type : ColumnType::VALUES;
+            auto node = make_node(logical.operator_token.type == AND ? Op::AND : Op::OR, type);
+            node->pure = left->pure && right->pure;
+            node->left = std::move(left);
+            node->right = std::move(right);
+            return node;
+        }
+
+        default:
+            return make_scalar(expr);
+        }
+    }
+
+    //---------------------------------------------
+    // Kernels
+    //---------------------------------------------
+
+    /**
+     * Applies an operation to the selected rows
+     * Over every row this is a loop over contiguous arrays, which vectorises
+     */
+    template <typename Out, typename Left, typename Right, typename Operation>
+    static void kernel(Out *out, Left left, Right right, size_t count, const Selection &selection,
+                       Operation operation)
+    {
+        if (selection.all)
+        {
+            for (size_t row = 0; row < count; row++)
+            {
+                out[row] = operation(left[row], right[row]);
+            }
+        }
+        else
+        {
+            for (uint32_t row : selection.rows)
+            {
+                out[row] = operation(left[row], right[row]);
+            }
+        }
+    }
+
+    /**
+     * Calls visit with a typed operand: an input or computed array, or the node's constant
+     */
+    template <typename T, typename Visit>
+    static void with_operand(const Node &node, const Column *column, Visit visit)
+    {
+        if (node.op == Op::CONSTANT)
+        {
+            if constexpr (std::is_same_v<T, double>)
+            {
+                visit(Repeated<double>{node.number});
+            }
+            else
+            {
+                visit(Repeated<uint8_t>{static_cast<uint8_t>(node.boolean)});
+            }
+        }
+        else if constexpr (std::is_same_v<T, double>)
+        {
+            visit(Dense<double>{column->numbers.data()});
+        }
+        else
+        {
+            visit(Dense<uint8_t>{column->bools.data()});
+        }
+    }
+
+    /**
+     * Runs a binary kernel on two operands of element type In
+     */
+    template <typename In, typename Out, typename Operation>
+    void binary_kernel(const Node &node, const Column *left, const Column *right, Out *out,
+                       const Selection &selection, Operation operation)
+    {
+        size_t count = rows;
+        with_operand<In>(*node.left, left, [&](auto left_operand)
+                         { with_operand<In>(*node.right, right, [&](auto right_operand)
+                                            { kernel(out, left_operand, right_operand, count, selection, operation); }); });
+    }
+
+    //---------------------------------------------
+    // Evaluating
+    //---------------------------------------------
+
+    template <typename Visit>
+    void for_each_row(const Selection &selection, Visit visit)
+    {
+        if (selection.all)
+        {
+            for (size_t row = 0; row < rows; row++)
+            {
+                visit(row);
+            }
+        }
+        else
+        {
+            for (uint32_t row : selection.rows)
+            {
+                visit(row);
+            }
+        }
+    }
+
+    static Column empty_column(ColumnType type, size_t rows)
+    {
+        Column column;
+        column.type = type;
+        switch (type)
+        {
+        case ColumnType::NUMBER:
+            column.numbers.resize(rows);
+            break;
+        case ColumnType::BOOL:
+            column.bools.resize(rows);
+            break;
+        default:
+            column.values.resize(rows);
+            break;
+        }
+        return column;
+    }
+
+    /**
+     * A node's values for the selected rows; input columns are used in place
+     * @return The input column, or scratch filled in, or null for a constant
+     */
+    const Column *operand(const Node &node, const Selection &selection, Column &scratch)
+    {
+        if (node.op == Op::COLUMN)
+        {
+            return inputs[node.column];
+        }
+        if (node.op == Op::CONSTANT)
+        {
+            return nullptr;
+        }
+        scratch = evaluate_node(node, selection);
+        return &scratch;
+    }
+
+    /**
+     * A node's values as a column, with constants repeated for every row
+     */
+    const Column *materialise(const Node &node, const Selection &selection, Column &scratch)
+    {
+        if (node.op != Op::CONSTANT)
+        {
+            return operand(node, selection, scratch);
+        }
+        scratch = empty_column(node.type, rows);
+        if (node.type == ColumnType::NUMBER)
+        {
+            std::fill(scratch.numbers.begin(), scratch.numbers.end(), node.number);
+        }
+        else
+        {
+            std::fill(scratch.bools.begin(), scratch.bools.end(), static_cast<uint8_t>(node.boolean));
+        }
+        return &scratch;
+    }
+
+    static bool truthy(const Column &column, size_t row)
+    {
+        switch (column.type)
+        {
+        case ColumnType::NUMBER:
+            return true;
+        case ColumnType::BOOL:
+            return column.bools[row] != 0;
+        default:
+            return is_truthy(column.values[row]);
+        }
+    }
+
+    static std::any to_any(const Value &value)
+    {
+        return std::visit([](const auto &held)
+                          { return std::any{held}; },
+                          value);
+    }
+
+    static Value to_value(const std::any &value)
+    {
+        if (const double *number = std::any_cast<double>(&value))
+        {
+            return *number;
+        }
+        if (const bool *boolean = std::any_cast<bool>(&value))
+        {
+            return *boolean;
+        }
+        if (const std::string *text = std::any_cast<std::string>(&value))
+        {
+            return *text;
+        }
+        return nullptr;
+    }
+
+    Column evaluate_scalar(const Node &node, const Selection &selection)
+    {
+        Column out = empty_column(ColumnType::VALUES, rows);
+        for_each_row(selection, [&](size_t row)
+                     {
+            if (failed[row])
+            {
+                return;
+            }
+            fallback.reset_globals();
+            for (size_t column : node.reads)
+            {
+                fallback.define_global(column_names[column], to_any(inputs[column]->at(row)));
+            }
+            try
+            {
+                out.values[row] = to_value(fallback.evaluate(node.expr));
+            }
+            catch (const RuntimeError &error)
+            {
+                failed[row] = 1;
+                errors.push_back(RowError{row, error.token.line_number, error.what()});
+            } });
+        return out;
+    }
+
+    Column evaluate_not(const Node &node, const Selection &selection)
+    {
+        Column out = empty_column(ColumnType::BOOL, rows);
+        Column scratch;
+        const Column *operand_column = materialise(*node.left, selection, scratch);
+        size_t count = rows;
+        switch (operand_column->type)
+        {
+        case ColumnType::NUMBER:
+            // Numbers are always truthy
+            break;
+        case ColumnType::BOOL:
+            kernel(out.bools.data(), Dense<uint8_t>{operand_column->bools.data()}, Repeated<uint8_t>{0}, count,
+                   selection, [](uint8_t value, uint8_t) -> uint8_t
+                   { return value ^ 1; });
+            break;
+        default:
+            for_each_row(selection, [&](size_t row)
+                         { out.bools[row] = !is_truthy(operand_column->values[row]); });
+            break;
+        }
+        return out;
+    }
+
+    Column evaluate_logical(const Node &node, const Selection &selection)
+    {
+        bool is_and = node.op == Op::AND;
+        Column left_scratch;
+        const Column *left = materialise(*node.left, selection, left_scratch);
+
+        // Rows whose left operand does not decide the result
+        Selection undecided;
+        undecided.all = false;
+        size_t selected = 0;
+        for_each_row(selection, [&](size_t row)
+                     {
+            selected++;
+            if (!failed[row] && truthy(*left, row) == is_and)
+            {
+                undecided.rows.push_back(static_cast<uint32_t>(row));
+            } });
+
+        // A right operand that cannot fail may run over every row when most need it
+        const Selection &right_selection =
+            node.right->pure && undecided.rows.size() * 2 >= selected ? selection : undecided;
+        Column right_scratch;
+        const Column *right = nullptr;
+        if (!undecided.rows.empty())
+        {
+            right = materialise(*node.right, right_selection, right_scratch);
+        }
+
+        Column out = empty_column(node.type, rows);
+        size_t count = rows;
+        if (node.type == ColumnType::BOOL && right != nullptr)
+        {
+            // Masked: rows the left decided keep its value whatever the right holds
+            kernel(out.bools.data(), Dense<uint8_t>{left->bools.data()}, Dense<uint8_t>{right->bools.data()},
+                   count, selection, [is_and](uint8_t left_value, uint8_t right_value) -> uint8_t
+                   { return is_and ? (left_value & right_value) : (left_value | right_value); });
+            return out;
+        }
+
+        // Otherwise take each undecided row from the right and every other from the left
+        for_each_row(selection, [&](size_t row)
+                     {
+            if (node.type == ColumnType::NUMBER)
+            {
+                out.numbers[row] = left->numbers[row];
+            }
+            else if (node.type == ColumnType::BOOL)
+            {
+                out.bools[row] = left->bools[row];
+            }
+            else
+            {
+                out.values[row] = failed[row] ? Value{nullptr} : left->at(row);
+            } });
+        for (uint32_t row : undecided.rows)
+        {
+            if (failed[row])
+            {
+                out.values[row] = nullptr;
+            }
+            else if (node.type == ColumnType::NUMBER)
+            {
+                out.numbers[row] = right->numbers[row];
+            }
+            else
+            {
+                out.values[row] = right->at(row);
+            }
+        }
+        return out;
+    }
+
+    Column evaluate_node(const Node &node, const Selection &selection)
+    {
+        switch (node.op)
+        {
+        case Op::SCALAR:
+            return evaluate_scalar(node, selection);
+        case Op::NOT:
+            return evaluate_not(node, selection);
+        case Op::AND:
+        case Op::OR:
+            return evaluate_logical(node, selection);
+        case Op::COLUMN:
+            return *inputs[node.column];
+        case Op::CONSTANT:
+        {
+            Column scratch;
+            return *materialise(node, selection, scratch);
+        }
+        default:
+            break;
+        }
+
+        Column out = empty_column(node.type, rows);
+        Column left_scratch;
+        Column right_scratch;
+        const Column *left = operand(*node.left, selection, left_scratch);
+
+        if (node.op == Op::NEGATE)
+        {
+            size_t count = rows;
+            with_operand<double>(*node.left, left, [&](auto operand_values)
+                                 { kernel(out.numbers.data(), operand_values, Repeated<double>{0}, count, selection,
+                                          [](double value, double)
+                                          { return -value; }); });
+            return out;
+        }
+
+        const Column *right = operand(*node.right, selection, right_scratch);
+        double *numbers = out.numbers.data();
+        uint8_t *bools = out.bools.data();
+        switch (node.op)
+        {
+        case Op::ADD:
+            binary_kernel<double>(node, left, right, numbers, selection, [](double l, double r)
+                                  { return l + r; });
+            break;
+        case Op::SUBTRACT:
+            binary_kernel<double>(node, left, right, numbers, selection, [](double l, double r)
+                                  { return l - r; });
+            break;
+        case Op::MULTIPLY:
+            binary_kernel<double>(node, left, right, numbers, selection, [](double l, double r)
+                                  { return l * r; });
+            break;
+        case Op::DIVIDE:
+            binary_kernel<double>(node, left, right, numbers, selection, [](double l, double r)
+                                  { return l / r; });
+            break;
+        case Op::GREATER:
+            binary_kernel<double>(node, left, right, bools, selection, [](double l, double r) -> uint8_t
+                                  { return l > r; });
+            break;
+        case Op::GREATER_EQUAL:
+            binary_kernel<double>(node, left, right, bools, selection, [](double l, double r) -> uint8_t
+                                  { return l >= r; });
+            break;
+        case Op::LESS:
+            binary_kernel<double>(node, left, right, bools, selection, [](double l, double r) -> uint8_t
+                                  { return l < r; });
+            break;
+        case Op::LESS_EQUAL:
+            binary_kernel<double>(node, left, right, bools, selection, [](double l, double r) -> uint8_t
+                                  { return l <= r; });
+            break;
+        case Op::EQUAL:
+        case Op::NOT_EQUAL:
+        {
+            uint8_t flip = node.op == Op::NOT_EQUAL;
+            if (node.left->type == ColumnType::NUMBER)
+            {
+                binary_kernel<double>(node, left, right, bools, selection, [flip](double l, double r) -> uint8_t
+                                      { return (l == r) ^ flip; });
+            }
+            else
+            {
+                binary_kernel<uint8_t>(node, left, right, bools, selection, [flip](uint8_t l, uint8_t r) -> uint8_t
+                                       { return (l == r) ^ flip; });
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        return out;
+    }
+
+    std::string describe(const Node &node) const
+    {
+        static const char *const names[] = {"column", "constant", "negate", "not", "add", "subtract", "multiply",
+                                            "divide", "greater", "greater_equal", "less", "less_equal", "equal",
+                                            "not_equal", "and", "or", "scalar"};
+        switch (node.op)
+        {
+        case Op::COLUMN:
+            return column_names[node.column];
+        case Op::CONSTANT:
+            return node.type == ColumnType::NUMBER ? format_number(node.number)
+                                                   : (node.boolean ? "true" : "false");
+        case Op::SCALAR:
+        {
+            std::string text = "scalar[";
+            for (size_t i = 0; i < node.reads.size(); i++)
+            {
+                text += (i == 0 ? "" : ", ") + column_names[node.reads[i]];
+            }
+            return text + "]";
+        }
+        default:
+            break;
+        }
+
+        std::string text = std::string{names[static_cast<int>(node.op)]} + "(" + describe(*node.left);
+        if (node.right != nullptr)
+        {
+            text += ", " + describe(*node.right);
+        }
+        return text + ")";
+    }
+
+public:
+    /**
+     * Compiles an expression for tables with the same column names and types as this one
+     */
+    ColumnEvaluator(const std::shared_ptr<Expr> &expr, const ColumnTable &schema)
+    {
+        for (const auto &[name, column] : schema)
+        {
+            column_names.push_back(name);
+            column_types.push_back(column.type);
+        }
+
+        // Assignments change what later reads see, which only row-by-row evaluation can follow
+        root = assigns(expr) ? make_scalar(expr) : compile(expr);
+    }
+
+    /**
+     * The compiled kernels, such as and(greater(x, 1), scalar[name])
+     */
+    std::string plan() const
+    {
+        return describe(*root);
+    }
+
+    /**
+     * Evaluates the expression for every row of the table
+     * @throws std::invalid_argument if the columns differ from those compiled for
+     */
+    ColumnResult evaluate(const ColumnTable &table)
+    {
+        inputs.clear();
+        rows = table.empty() ? 0 : table.begin()->second.size();
+        for (size_t i = 0; i < column_names.size(); i++)
+        {
+            auto found = table.find(column_names[i]);
+            if (found == table.end() || found->second.type != column_types[i] || found->second.size() != rows)
+            {
+                throw std::invalid_argument{"Column '" + column_names[i] + "' differs from the one compiled for."};
+            }
+            inputs.push_back(&found->second);
+        }
+        if (rows > std::numeric_limits<uint32_t>::max())
+        {
+            throw std::invalid_argument{"Too many rows for one evaluation."};
+        }
+
+        failed.assign(rows, 0);
+        errors.clear();
+        ColumnResult result;
+        result.column = evaluate_node(*root, Selection{});
+        std::sort(errors.begin(), errors.end(), [](const RowError &left, const RowError &right)
+                  { return left.row < right.row; });
+        result.errors = std::move(errors);
+        return result;
+    }
+};
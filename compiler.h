@@ -0,0 +1,560 @@
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "chunk.h"
+#include "error.h"
+#include "expr.h"
+#include "parallel_loop.h"
+#include "scope_resolver.h"
+#include "stmt.h"
+#include "value.h"
+
+/**
+ * Compiles the abstract syntax tree into bytecode for the VM
+ * Locals are resolved to stack slots and globals to table indices
+ */
+class Compiler : public ExprVisitor, public StmtVisitor
+{
+private:
+    // Output chunk and shared global table
+    Chunk chunk;
+    GlobalTable &globals;
+
+    // Lexical scope state; a local's slot is its stack index
+    ScopeResolver scopes;
+
+    // Constant pool deduplication
+    std::map<uint64_t, uint32_t> number_constants;
+    std::map<std::string, uint32_t> string_constants;
+
+    // Line of the most recently visited token, used for the line table
+    int current_line = 1;
+
+    // Simulated stack height for computing the chunk's maximum
+    int stack_depth = 0;
+
+    //---------------------------------------------
+    // Emission helpers
+    //---------------------------------------------
+
+    void adjust_stack(int delta)
+    {
+        stack_depth += delta;
+        if (stack_depth > static_cast<int>(chunk.max_stack))
+        {
+            chunk.max_stack = stack_depth;
+        }
+    }
+
+    void emit_op(OpCode op, int stack_effect)
+    {
+        chunk.write(op, current_line);
+        adjust_stack(stack_effect);
+    }
+
+    void emit_u16(uint16_t operand)
+    {
+        chunk.write(operand & 0xff, current_line);
+        chunk.write(operand >> 8, current_line);
+    }
+
+    void emit_u32(uint32_t operand)
+    {
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            chunk.write((operand >> shift) & 0xff, current_line);
+        }
+    }
+
+    /**
+     * Emits a forward jump and returns the offset of its operand for patching
+     */
+    size_t emit_jump(OpCode op, int stack_effect)
+    {
+        emit_op(op, stack_effect);
+        emit_u32(0);
+        return chunk.code.size() - 4;
+    }
+
+    /**
+     * Points a forward jump at the current end of the code
+     */
+    void patch_jump(size_t operand_offset)
+    {
+        uint32_t distance = static_cast<uint32_t>(chunk.code.size() - operand_offset - 4);
+        std::memcpy(&chunk.code[operand_offset], &distance, sizeof(distance));
+    }
+
+    /**
+     * Emits a backward jump to the given loop start
+     */
+    void emit_loop(size_t loop_start)
+    {
+        emit_op(OP_LOOP, 0);
+        emit_u32(static_cast<uint32_t>(chunk.code.size() + 4 - loop_start));
+    }
+
+    void emit_constant(const Value &value)
+    {
+        emit_op(OP_CONSTANT, 1);
+        emit_u32(add_constant(value));
+    }
+
+    /**
+     * Adds a constant to the pool, reusing an existing entry when possible
+     */
+    uint32_t add_constant(const Value &value)
+    {
+        if (const double *number = std::get_if<double>(&value))
+        {
+            // Key on the bit pattern so -0.0 and 0.0 stay distinct
+            uint64_t bits;
+            std::memcpy(&bits, number, sizeof(bits));
+
+            auto iter = number_constants.find(bits);
+            if (iter != number_constants.end())
+            {
+                return iter->second;
+            }
+            uint32_t index = static_cast<uint32_t>(chunk.constants.size());
+            chunk.constants.push_back(value);
+            number_constants.emplace(bits, index);
+            return index;
+        }
+
+        if (const std::string *text = std::get_if<std::string>(&value))
+        {
+            auto iter = string_constants.find(*text);
+            if (iter != string_constants.end())
+            {
+                return iter->second;
+            }
+            uint32_t index = static_cast<uint32_t>(chunk.constants.size());
+            chunk.constants.push_back(value);
+            string_constants.emplace(*text, index);
+            return index;
+        }
+
+        uint32_t index = static_cast<uint32_t>(chunk.constants.size());
+        chunk.constants.push_back(value);
+        return index;
+    }
+
+    //---------------------------------------------
+    // Scope helpers
+    //---------------------------------------------
+
+    void begin_scope()
+    {
+        scopes.begin_scope();
+    }
+
+    void end_scope()
+    {
+        // Discard the locals declared in the closed scope
+        uint16_t count = static_cast<uint16_t>(scopes.end_scope());
+
+        if (count == 1)
+        {
+            emit_op(OP_POP, -1);
+        }
+        else if (count > 1)
+        {
+            emit_op(OP_POPN, -count);
+            emit_u16(count);
+        }
+    }
+
+    void emit_get_variable(const Token &name)
+    {
+        int slot = scopes.resolve(name.lexeme);
+        if (slot >= 0)
+        {
+            emit_op(OP_GET_LOCAL, 1);
+            emit_u16(static_cast<uint16_t>(slot));
+        }
+        else
+        {
+            emit_op(OP_GET_GLOBAL, 1);
+            emit_u32(globals.intern(name.lexeme));
+        }
+    }
+
+    void emit_set_variable(const Token &name)
+    {
+        int slot = scopes.resolve(name.lexeme);
+        if (slot >= 0)
+        {
+            emit_op(OP_SET_LOCAL, 0);
+            emit_u16(static_cast<uint16_t>(slot));
+        }
+        else
+        {
+            emit_op(OP_SET_GLOBAL, 0);
+            emit_u32(globals.intern(name.lexeme));
+        }
+    }
+
+    /**
+     * Compiles a parallel loop with reductions, combining each reduction in
+     * blocks as the Interpreter does
+     * Each reduction's total and the count of iterations in the current
+     * block are held in locals of a scope around the loop.
+     */
+    void compile_reducing_while(const While &stmt, const std::vector<Reduction> &reductions)
+    {
+        begin_scope();
+        std::vector<uint16_t> total_slots;
+        for (const Reduction &reduction : reductions)
+        {
+            current_line = reduction.name.line_number;
+            emit_get_variable(reduction.name);
+            emit_op(OP_REDUCE_BEGIN, 1);
+            chunk.write(reduction.operator_type == STAR, current_line);
+            emit_set_variable(reduction.name);
+            emit_op(OP_POP, -1);
+            // Names no variable can have
+            std::string total_name = " total" + std::to_string(total_slots.size());
+            total_slots.push_back(static_cast<uint16_t>(scopes.declare(total_name).slot));
+        }
+        emit_constant(0.0);
+        uint16_t counter_slot = static_cast<uint16_t>(scopes.declare(" block").slot);
+
+        size_t loop_start = chunk.code.size();
+        compile_expr(stmt.condition);
+        size_t exit_jump = emit_jump(OP_JUMP_IF_FALSE, 0);
+        emit_op(OP_POP, -1);
+        compile_stmt(stmt.body);
+
+        emit_op(OP_REDUCE_COUNT, 0);
+        emit_u16(counter_slot);
+        emit_u32(0);
+        size_t block_jump = chunk.code.size() - 4;
+        for (size_t i = 0; i < reductions.size(); i++)
+        {
+            emit_op(OP_GET_LOCAL, 1);
+            emit_u16(total_slots[i]);
+            emit_get_variable(reductions[i].name);
+            emit_op(OP_REDUCE_BLOCK, 0);
+            chunk.write(reductions[i].operator_type == STAR, current_line);
+            emit_set_variable(reductions[i].name);
+            emit_op(OP_POP, -1);
+            emit_op(OP_SET_LOCAL, 0);
+            emit_u16(total_slots[i]);
+            emit_op(OP_POP, -1);
+        }
+        patch_jump(block_jump);
+        emit_loop(loop_start);
+
+        patch_jump(exit_jump);
+        adjust_stack(1);
+        emit_op(OP_POP, -1);
+        for (size_t i = 0; i < reductions.size(); i++)
+        {
+            emit_op(OP_GET_LOCAL, 1);
+            emit_u16(total_slots[i]);
+            emit_get_variable(reductions[i].name);
+            emit_op(OP_REDUCE_END, -1);
+            chunk.write(reductions[i].operator_type == STAR, current_line);
+            emit_set_variable(reductions[i].name);
+            emit_op(OP_POP, -1);
+        }
+        end_scope();
+    }
+
+    void compile_expr(const std::shared_ptr<Expr> &expr)
+    {
+        expr->accept(*this);
+    }
+
+    void compile_stmt(const std::shared_ptr<Stmt> &stmt)
+    {
+        stmt->accept(*this);
+    }
+
+public:
+    /**
+     * Creates a compiler that resolves globals through the given table
+     */
+    Compiler(GlobalTable &global_table)
+        : globals{global_table}
+    {
+    }
+
+    /**
+     * Compiles a program into a chunk ending with OP_RETURN
+     */
+    Chunk compile(const std::vector<std::shared_ptr<Stmt>> &statements)
+    {
+        for (const auto &stmt : statements)
+        {
+            compile_stmt(stmt);
+        }
+        emit_op(OP_RETURN, 0);
+        return std::move(chunk);
+    }
+
+    //-----------------------------------------------
+    // Statement Visitor Methods
+    //-----------------------------------------------
+
+    std::any visit_block_stmt(std::shared_ptr<Block> stmt) override
+    {
+        begin_scope();
+        for (const auto &statement : stmt->body())
+        {
+            compile_stmt(statement);
+        }
+        end_scope();
+        return {};
+    }
+
+    std::any visit_expression_stmt(std::shared_ptr<Expression> stmt) override
+    {
+        compile_expr(stmt->expression);
+        emit_op(OP_POP, -1);
+        return {};
+    }
+
+    std::any visit_if_stmt(std::shared_ptr<If> stmt) override
+    {
+        compile_expr(stmt->condition);
+
+        // Skip the then branch when the condition is falsey
+        size_t then_jump = emit_jump(OP_JUMP_IF_FALSE, 0);
+        emit_op(OP_POP, -1);
+        compile_stmt(stmt->then_branch);
+
+        size_t else_jump = emit_jump(OP_JUMP, 0);
+        patch_jump(then_jump);
+
+        // The condition is still on the stack when arriving here
+        adjust_stack(1);
+        emit_op(OP_POP, -1);
+
+        if (stmt->else_branch != nullptr)
+        {
+            compile_stmt(stmt->else_branch);
+        }
+        patch_jump(else_jump);
+        return {};
+    }
+
+    std::any visit_print_stmt(std::shared_ptr<Print> stmt) override
+    {
+        compile_expr(stmt->expression);
+        emit_op(OP_PRINT, -1);
+        return {};
+    }
+
+    std::any visit_var_stmt(std::shared_ptr<Var> stmt) override
+    {
+        // The initialiser sees the enclosing binding, as in the interpreter
+        if (stmt->initialiser != nullptr)
+        {
+            compile_expr(stmt->initialiser);
+        }
+        else
+        {
+            emit_op(OP_NIL, 1);
+        }
+        current_line = stmt->name.line_number;
+
+        if (scopes.is_global_scope())
+        {
+            emit_op(OP_DEFINE_GLOBAL, -1);
+            emit_u32(globals.intern(stmt->name.lexeme));
+            return {};
+        }
+
+        if (scopes.live_count() > UINT16_MAX)
+        {
+            error(stmt->name, "Too many local variables in scope.");
+            return {};
+        }
+
+        // Redeclaring in the same scope overwrites the existing slot
+        ScopeResolver::Declaration declaration = scopes.declare(stmt->name.lexeme);
+        if (declaration.is_redeclare)
+        {
+            emit_op(OP_SET_LOCAL, 0);
+            emit_u16(static_cast<uint16_t>(declaration.slot));
+            emit_op(OP_POP, -1);
+        }
+
+        // Otherwise the initialiser value stays on the stack as the local's slot
+        return {};
+    }
+
+    std::any visit_while_stmt(std::shared_ptr<While> stmt) override
+    {
+        if (stmt->parallel != nullptr && !stmt->parallel->reductions.empty())
+        {
+            compile_reducing_while(*stmt, stmt->parallel->reductions);
+            return {};
+        }
+
+        size_t loop_start = chunk.code.size();
+        compile_expr(stmt->condition);
+
+        size_t exit_jump = emit_jump(OP_JUMP_IF_FALSE, 0);
+        emit_op(OP_POP, -1);
+        compile_stmt(stmt->body);
+        emit_loop(loop_start);
+
+        // The condition is still on the stack when leaving the loop
+        patch_jump(exit_jump);
+        adjust_stack(1);
+        emit_op(OP_POP, -1);
+        return {};
+    }
+
+    //-----------------------------------------------
+    // Expression Visitor Methods
+    //-----------------------------------------------
+
+    std::any visit_assign_expr(std::shared_ptr<Assign> expr) override
+    {
+        compile_expr(expr->expr_value);
+        current_line = expr->var_name.line_number;
+
+        int slot = scopes.resolve(expr->var_name.lexeme);
+        if (slot >= 0)
+        {
+            emit_op(OP_SET_LOCAL, 0);
+            emit_u16(static_cast<uint16_t>(slot));
+        }
+        else
+        {
+            emit_op(OP_SET_GLOBAL, 0);
+            emit_u32(globals.intern(expr->var_name.lexeme));
+        }
+        return {};
+    }
+
+    std::any visit_binary_expr(std::shared_ptr<Binary> expr) override
+    {
+        compile_expr(expr->left_expr);
+        compile_expr(expr->right_expr);
+        current_line = expr->operator_token.line_number;
+
+        switch (expr->operator_token.type)
+        {
+        case GREATER:
+            emit_op(OP_GREATER, -1);
+            break;
+        case GREATER_EQUAL:
+            emit_op(OP_GREATER_EQUAL, -1);
+            break;
+        case LESS:
+            emit_op(OP_LESS, -1);
+            break;
+        case LESS_EQUAL:
+            emit_op(OP_LESS_EQUAL, -1);
+            break;
+        case EQUAL_EQUAL:
+            emit_op(OP_EQUAL, -1);
+            break;
+        case BANG_EQUAL:
+            emit_op(OP_NOT_EQUAL, -1);
+            break;
+        case MINUS:
+            emit_op(OP_SUBTRACT, -1);
+            break;
+        case SLASH:
+            emit_op(OP_DIVIDE, -1);
+            break;
+        case STAR:
+            emit_op(OP_MULTIPLY, -1);
+            break;
+        case PLUS:
+            emit_op(OP_ADD, -1);
+            break;
+        default:
+            break;
+        }
+        return {};
+    }
+
+    std::any visit_grouping_expr(std::shared_ptr<Grouping> expr) override
+    {
+        compile_expr(expr->inner_expr);
+        return {};
+    }
+
+    std::any visit_literal_expr(std::shared_ptr<Literal> expr) override
+    {
+        Value value = value_from_any(expr->literal_value);
+
+        if (std::holds_alternative<std::nullptr_t>(value))
+        {
+            emit_op(OP_NIL, 1);
+        }
+        else if (const bool *boolean = std::get_if<bool>(&value))
+        {
+            emit_op(*boolean ? OP_TRUE : OP_FALSE, 1);
+        }
+        else
+        {
+            emit_constant(value);
+        }
+        return {};
+    }
+
+    std::any visit_logical_expr(std::shared_ptr<Logical> expr) override
+    {
+        compile_expr(expr->left_expr);
+        current_line = expr->operator_token.line_number;
+
+        // Keep the left value as the result when it short-circuits
+        OpCode short_circuit = expr->operator_token.type == OR
+                                   ? OP_JUMP_IF_TRUE
+                                   : OP_JUMP_IF_FALSE;
+        size_t end_jump = emit_jump(short_circuit, 0);
+        emit_op(OP_POP, -1);
+        compile_expr(expr->right_expr);
+        patch_jump(end_jump);
+        return {};
+    }
+
+    std::any visit_unary_expr(std::shared_ptr<Unary> expr) override
+    {
+        compile_expr(expr->operand);
+        current_line = expr->operator_token.line_number;
+
+        if (expr->operator_token.type == BANG)
+        {
+            emit_op(OP_NOT, 0);
+        }
+        else
+        {
+            emit_op(OP_NEGATE, 0);
+        }
+        return {};
+    }
+
+    std::any visit_variable_expr(std::shared_ptr<Variable> expr) override
+    {
+        current_line = expr->var_name.line_number;
+
+        int slot = scopes.resolve(expr->var_name.lexeme);
+        if (slot >= 0)
+        {
+            emit_op(OP_GET_LOCAL, 1);
+            emit_u16(static_cast<uint16_t>(slot));
+        }
+        else
+        {
+            emit_op(OP_GET_GLOBAL, 1);
+            emit_u32(globals.intern(expr->var_name.lexeme));
+        }
+        return {};
+    }
+};
@@ -0,0 +1,998 @@
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "expr.h"
+#include "parallel_loop.h"
+#include "scope_resolver.h"
+#include "stmt.h"
+
+/**
+ * Type of an expression or variable as inferred for C++ generation
+ * NONE means no value is ever produced, e.g. because evaluation always fails
+ */
+enum class InferredType : uint8_t
+{
+    NONE,
+    NIL,
+    BOOL,
+    NUMBER,
+    STRING,
+    DYNAMIC
+};
+
+/**
+ * Least upper bound of two inferred types
+ */
+inline InferredType join_types(InferredType left, InferredType right)
+{
+    if (left == InferredType::NONE || left == right)
+    {
+        return right;
+    }
+    if (right == InferredType::NONE)
+    {
+        return left;
+    }
+    return InferredType::DYNAMIC;
+}
+
+/**
+ * Binds every variable reference to its declaration and infers a type per binding
+ *
+ * Scoping is static (see ScopeResolver), so each local declaration and
+ * each global name becomes one binding. A global read before any top-level
+ * declaration of it can only fail, so it is bound to nothing. Types are
+ * found by re-walking the program until no binding's type grows.
+ */
+class CppTypeInference : public ExprVisitor, public StmtVisitor
+{
+public:
+    // A variable that becomes one C++ variable
+    struct Binding
+    {
+        std::string name;
+        bool is_global;
+        InferredType type = InferredType::NONE;
+    };
+
+    // Binding written by a var statement
+    struct Declaration
+    {
+        int binding;
+        bool is_new_local;
+    };
+
+    std::vector<Binding> bindings;
+
+    // Binding used by each Variable and Assign node, or -1 if undefined
+    std::unordered_map<const Expr *, int> binding_of;
+    std::unordered_map<const Stmt *, Declaration> declaration_of;
+
+    // Inferred type of each expression
+    std::unordered_map<const Expr *, InferredType> type_of;
+
+    // Expressions containing an assignment
+    std::unordered_set<const Expr *> assigning;
+
+    // Binding of each reduction of a parallel loop, or -1 if undefined
+    std::unordered_map<const Stmt *, std::vector<int>> reductions_of;
+
+private:
+    ScopeResolver scopes;
+
+    // Binding held by each local slot
+    std::vector<int> slot_bindings;
+
+    // Global bindings, and the globals declared so far in this walk
+    std::map<std::string, int> global_bindings;
+    std::unordered_set<std::string> defined_globals;
+
+    bool changed = false;
+
+    InferredType infer(const std::shared_ptr<Expr> &expr)
+    {
+        InferredType type = std::any_cast<InferredType>(expr->accept(*this));
+        type_of[expr.get()] = type;
+        return type;
+    }
+
+    void widen(int binding, InferredType type)
+    {
+        InferredType widened = join_types(bindings[binding].type, type);
+        if (widened != bindings[binding].type)
+        {
+            bindings[binding].type = widened;
+            changed = true;
+        }
+    }
+
+    int resolve(const std::string &name) const
+    {
+        int slot = scopes.resolve(name);
+        if (slot >= 0)
+        {
+            return slot_bindings[slot];
+        }
+        if (defined_globals.count(name) != 0)
+        {
+            return global_bindings.at(name);
+        }
+        return -1;
+    }
+
+    // Records assignments so readers know when operands must be copied
+    InferredType infer_pair(const Expr *parent, const std::shared_ptr<Expr> &left,
+                            const std::shared_ptr<Expr> &right, InferredType &right_type)
+    {
+        InferredType left_type = infer(left);
+        right_type = infer(right);
+        if (assigning.count(left.get()) != 0 || assigning.count(right.get()) != 0)
+        {
+            assigning.insert(parent);
+        }
+        return left_type;
+    }
+
+public:
+    /**
+     * Resolves and types the whole program
+     */
+    void analyse(const std::vector<std::shared_ptr<Stmt>> &statements)
+    {
+        do
+        {
+            changed = false;
+            defined_globals.clear();
+            for (const auto &statement : statements)
+            {
+                statement->accept(*this);
+            }
+        } while (changed);
+    }
+
+    //-----------------------------------------------
+    // Statement Visitor Methods
+    //-----------------------------------------------
+
+    std::any visit_block_stmt(std::shared_ptr<Block> stmt) override
+    {
+        scopes.begin_scope();
+        for (const auto &statement : stmt->body())
+        {
+            statement->accept(*this);
+        }
+        scopes.end_scope();
+        return {};
+    }
+
+    std::any visit_expression_stmt(std::shared_ptr<Expression> stmt) override
+    {
+        infer(stmt->expression);
+        return {};
+    }
+
+    std::any visit_if_stmt(std::shared_ptr<If> stmt) override
+    {
+        infer(stmt->condition);
+        stmt->then_branch->accept(*this);
+        if (stmt->else_branch != nullptr)
+        {
+            stmt->else_branch->accept(*this);
+        }
+        return {};
+    }
+
+    std::any visit_print_stmt(std::shared_ptr<Print> stmt) override
+    {
+        infer(stmt->expression);
+        return {};
+    }
+
+    std::any visit_var_stmt(std::shared_ptr<Var> stmt) override
+    {
+        InferredType type = stmt->initialiser != nullptr ? infer(stmt->initialiser)
+                                                         : InferredType::NIL;
+        const std::string &name = stmt->name.lexeme;
+
+        // Bindings keep their ids across walks, so reuse any recorded one
+        auto recorded = declaration_of.find(stmt.get());
+        int binding;
+        bool is_new_local = false;
+
+        if (scopes.is_global_scope())
+        {
+            auto global = global_bindings.find(name);
+            if (global == global_bindings.end())
+            {
+                global = global_bindings.emplace(name, static_cast<int>(bindings.size())).first;
+                bindings.push_back(Binding{name, true});
+            }
+            binding = global->second;
+            defined_globals.insert(name);
+        }
+        else
+        {
+            ScopeResolver::Declaration declaration = scopes.declare(name);
+            if (declaration.is_redeclare)
+            {
+                binding = slot_bindings[declaration.slot];
+            }
+            else
+            {
+                if (recorded != declaration_of.end())
+                {
+                    binding = recorded->second.binding;
+                }
+                else
+                {
+                    binding = static_cast<int>(bindings.size());
+                    bindings.push_back(Binding{name, false});
+                }
+                is_new_local = true;
+                if (slot_bindings.size() <= static_cast<size_t>(declaration.slot))
+                {
+                    slot_bindings.resize(declaration.slot + 1);
+                }
+                slot_bindings[declaration.slot] = binding;
+            }
+        }
+
+        declaration_of[stmt.get()] = Declaration{binding, is_new_local};
+        widen(binding, type);
+        return {};
+    }
+
+    std::any visit_while_stmt(std::shared_ptr<While> stmt) override
+    {
+        if (stmt->parallel != nullptr && !stmt->parallel->reductions.empty())
+        {
+            std::vector<int> &reductions = reductions_of[stmt.get()];
+            reductions.clear();
+            for (const Reduction &reduction : stmt->parallel->reductions)
+            {
+                reductions.push_back(resolve(reduction.name.lexeme));
+            }
+        }
+        infer(stmt->condition);
+        stmt->body->accept(*this);
+        return {};
+    }
+
+    //-----------------------------------------------
+    // Expression Visitor Methods
+    //-----------------------------------------------
+
+    std::any visit_assign_expr(std::shared_ptr<Assign> expr) override
+    {
+        InferredType type = infer(expr->expr_value);
+        assigning.insert(expr.get());
+
+        int binding = resolve(expr->var_name.lexeme);
+        binding_of[expr.get()] = binding;
+        if (binding < 0)
+        {
+            return InferredType::NONE;
+        }
+
+        widen(binding, type);
+        return type;
+    }
+
+    std::any visit_binary_expr(std::shared_ptr<Binary> expr) override
+    {
+        InferredType right;
+        InferredType left = infer_pair(expr.get(), expr->left_expr, expr->right_expr, right);
+
+        switch (expr->operator_token.type)
+        {
+        case MINUS:
+        case STAR:
+        case SLASH:
+            return InferredType::NUMBER;
+
+        case PLUS:
+            // A successful addition matches whichever operand type is known
+            if (left == InferredType::NONE || right == InferredType::NONE)
+            {
+                return InferredType::NONE;
+            }
+            if (left == InferredType::NUMBER || right == InferredType::NUMBER)
+            {
+                return left == InferredType::STRING || right == InferredType::STRING
+                           ? InferredType::NONE
+                           : InferredType::NUMBER;
+            }
+            if (left == InferredType::STRING || right == InferredType::STRING)
+            {
+                return InferredType::STRING;
+            }
+            return left == InferredType::DYNAMIC && right == InferredType::DYNAMIC
+                       ? InferredType::DYNAMIC
+                       : InferredType::NONE;
+
+        default:
+            return InferredType::BOOL;
+        }
+    }
+
+    std::any visit_grouping_expr(std::shared_ptr<Grouping> expr) override
+    {
+        InferredType type = infer(expr->inner_expr);
+        if (assigning.count(expr->inner_expr.get()) != 0)
+        {
+            assigning.insert(expr.get());
+        }
+        return type;
+    }
+
+    std::any visit_literal_expr(std::shared_ptr<Literal> expr) override
+    {
+        const std::any &value = expr->literal_value;
+        if (value.type() == typeid(double))
+        {
+            return InferredType::NUMBER;
+        }
+        if (value.type() == typeid(std::string))
+        {
+            return InferredType::STRING;
+        }
+        if (value.type() == typeid(bool))
+        {
+            return InferredType::BOOL;
+        }
+        return InferredType::NIL;
+    }
+
+    std::any visit_logical_expr(std::shared_ptr<Logical> expr) override
+    {
+        InferredType right;
+        InferredType left = infer_pair(expr.get(), expr->left_expr, expr->right_expr, right);
+        return join_types(left, right);
+    }
+
+    std::any visit_unary_expr(std::shared_ptr<Unary> expr) override
+    {
+        infer(expr->operand);
+        if (assigning.count(expr->operand.get()) != 0)
+        {
+            assigning.insert(expr.get());
+        }
+        return expr->operator_token.type == MINUS ? InferredType::NUMBER : InferredType::BOOL;
+    }
+
+    std::any visit_variable_expr(std::shared_ptr<Variable> expr) override
+    {
+        int binding = resolve(expr->var_name.lexeme);
+        binding_of[expr.get()] = binding;
+        return binding < 0 ? InferredType::NONE : bindings[binding].type;
+    }
+};
+
+/**
+ * Generates a standalone C++ translation unit from a Prism program
+ *
+ * Expressions are lowered to temporaries so evaluation order matches the
+ * interpreter exactly. Values with an inferred type use double, bool or
+ * std::string; everything else uses Value and the checked helpers in
+ * prism_runtime.h, which reproduce the interpreter's runtime errors.
+ */
+class CppEmitter : public ExprVisitor, public StmtVisitor
+{
+private:
+    // A side-effect-free C++ expression and its inferred type
+    struct Operand
+    {
+        std::string code;
+        InferredType type;
+    };
+
+    CppTypeInference types;
+
+    std::ostringstream output;
+    int indent_level = 1;
+    int temp_counter = 0;
+
+    // Whether an assignment runs later in the statement, so reads must be copied
+    bool copy_reads = false;
+
+    //---------------------------------------------
+    // Output helpers
+    //---------------------------------------------
+
+    void line(const std::string &code)
+    {
+        output << std::string(indent_level * 4, ' ') << code << "\n";
+    }
+
+    static std::string cpp_type(InferredType type)
+    {
+        switch (type)
+        {
+        case InferredType::BOOL:
+            return "bool";
+        case InferredType::NUMBER:
+            return "double";
+        case InferredType::STRING:
+            return "std::string";
+        default:
+            return "Value";
+        }
+    }
+
+    std::string variable_name(int binding) const
+    {
+        const CppTypeInference::Binding &info = types.bindings[binding];
+        if (info.is_global)
+        {
+            return "g_" + info.name;
+        }
+        return "l" + std::to_string(binding) + "_" + info.name;
+    }
+
+    // A reduction combined in blocks, its total before the current block, and the loop's block counter
+    struct ReducingVariable
+    {
+        std::string variable;
+        std::string total;
+        std::string counter;
+        bool dynamic;
+        bool multiply;
+    };
+
+    /**
+     * Starts combining a parallel loop's reductions in blocks, as the
+     * interpreter does; those that can never be numbers are updated in order
+     */
+    std::vector<ReducingVariable> begin_reduction_blocks(const While &stmt)
+    {
+        std::vector<ReducingVariable> reducing;
+        auto found = types.reductions_of.find(&stmt);
+        if (found == types.reductions_of.end())
+        {
+            return reducing;
+        }
+
+        std::string counter = "t" + std::to_string(++temp_counter);
+        for (size_t i = 0; i < found->second.size(); i++)
+        {
+            int binding = found->second[i];
+            InferredType type = binding < 0 ? InferredType::NONE : types.bindings[binding].type;
+            if (type != InferredType::NUMBER && type != InferredType::DYNAMIC)
+            {
+                continue;
+            }
+
+            bool multiply = stmt.parallel->reductions[i].operator_type == STAR;
+            ReducingVariable variable{variable_name(binding), "t" + std::to_string(++temp_counter), counter,
+                                      type == InferredType::DYNAMIC, multiply};
+            std::string identity = multiply ? "1.0" : "-0.0";
+            if (variable.dynamic)
+            {
+                line("Value " + variable.total + " = reduce_begin(" + variable.variable + ", " + identity + ");");
+            }
+            else
+            {
+                line("double " + variable.total + " = " + variable.variable + ";");
+                line(variable.variable + " = " + identity + ";");
+            }
+            reducing.push_back(variable);
+        }
+        if (!reducing.empty())
+        {
+            line("size_t " + counter + " = 0;");
+        }
+        return reducing;
+    }
+
+    /**
+     * Combines each reduction's block into its total, after every block's
+     * last iteration or once the loop has ended
+     */
+    void emit_reduction_blocks(const std::vector<ReducingVariable> &reducing, bool last)
+    {
+        if (!last)
+        {
+            indent_level++;
+            line("if (++" + reducing[0].counter + " == " + std::to_string(REDUCTION_BLOCK) + ")");
+            line("{");
+            indent_level++;
+            line(reducing[0].counter + " = 0;");
+        }
+        for (const ReducingVariable &variable : reducing)
+        {
+            std::string flags = std::string{variable.multiply ? "true" : "false"} + ", " + (last ? "true" : "false");
+            std::string op = variable.multiply ? " * " : " + ";
+            if (variable.dynamic)
+            {
+                line("reduce_block(" + variable.total + ", " + variable.variable + ", " + flags + ");");
+            }
+            else if (last)
+            {
+                line(variable.variable + " = " + variable.total + op + variable.variable + ";");
+            }
+            else
+            {
+                line(variable.total + " = " + variable.total + op + variable.variable + ";");
+                line(variable.variable + " = " + (variable.multiply ? "1.0" : "-0.0") + ";");
+            }
+        }
+        if (!last)
+        {
+            indent_level--;
+            line("}");
+            indent_level--;
+        }
+    }
+
+    /**
+     * Stores a value in a new temporary and returns it as an operand
+     */
+    Operand temp(InferredType type, const std::string &code)
+    {
+        std::string name = "t" + std::to_string(++temp_counter);
+        line(cpp_type(type) + " " + name + " = " + code + ";");
+        return Operand{name, type};
+    }
+
+    /**
+     * Converts an operand's code to the C++ type used for target
+     */
+    static std::string coerce(const Operand &operand, InferredType target)
+    {
+        std::string from = cpp_type(operand.type);
+        std::string to = cpp_type(target);
+        if (from == to || to == "Value")
+        {
+            return operand.code;
+        }
+        if (operand.type == InferredType::NONE)
+        {
+            return "unreachable_value<" + to + ">()";
+        }
+        return "std::get<" + to + ">(" + operand.code + ")";
+    }
+
+    /**
+     * C++ condition that is true when the operand is truthy
+     */
+    static std::string truthy(const Operand &operand)
+    {
+        switch (operand.type)
+        {
+        case InferredType::BOOL:
+            return operand.code;
+        case InferredType::NUMBER:
+        case InferredType::STRING:
+            return "true";
+        default:
+            return "is_truthy(" + operand.code + ")";
+        }
+    }
+
+    static std::string number_literal(double number)
+    {
+        // 17 significant digits round-trip every double exactly
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.17g", number);
+        std::string text{buffer};
+        if (text.find_first_of(".e") == std::string::npos)
+        {
+            text += ".0";
+        }
+        return text;
+    }
+
+    static std::string string_literal(const std::string &text)
+    {
+        std::string result = "std::string(\"";
+        for (unsigned char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                result += '\\';
+                result += static_cast<char>(c);
+            }
+            else if (c < 0x20 || c >= 0x7f)
+            {
+                // Three-digit octal escapes cannot swallow following digits
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\%03o", c);
+                result += escape;
+            }
+            else
+            {
+                result += static_cast<char>(c);
+            }
+        }
+        return result + "\", " + std::to_string(text.size()) + ")";
+    }
+
+    Operand emit(const std::shared_ptr<Expr> &expr)
+    {
+        return std::any_cast<Operand>(expr->accept(*this));
+    }
+
+    /**
+     * Emits an expression evaluated for a whole statement
+     */
+    Operand emit_root(const std::shared_ptr<Expr> &expr)
+    {
+        copy_reads = false;
+        return emit(expr);
+    }
+
+    /**
+     * Emits two operands in order; reads on the left are copied if the
+     * right operand assigns
+     */
+    std::pair<Operand, Operand> emit_pair(const std::shared_ptr<Expr> &left,
+                                          const std::shared_ptr<Expr> &right)
+    {
+        bool later = copy_reads;
+        copy_reads = later || types.assigning.count(right.get()) != 0;
+        Operand left_operand = emit(left);
+        copy_reads = later;
+        return {left_operand, emit(right)};
+    }
+
+    /**
+     * Emits a branch body, flattening a block into the surrounding braces
+     */
+    void emit_body(const std::shared_ptr<Stmt> &stmt)
+    {
+        indent_level++;
+        if (auto block = std::dynamic_pointer_cast<Block>(stmt))
+        {
+            for (const auto &statement : block->body())
+            {
+                statement->accept(*this);
+            }
+        }
+        else
+        {
+            stmt->accept(*this);
+        }
+        indent_level--;
+    }
+
+    // Checked numeric helper for each operator that needs two numbers
+    static const char *numeric_helper(TokenType type)
+    {
+        switch (type)
+        {
+        case MINUS:
+            return "subtract_values";
+        case STAR:
+            return "multiply_values";
+        case SLASH:
+            return "divide_values";
+        case GREATER:
+            return "greater_values";
+        case GREATER_EQUAL:
+            return "greater_equal_values";
+        case LESS:
+            return "less_values";
+        default:
+            return "less_equal_values";
+        }
+    }
+
+public:
+    /**
+     * Generates the translation unit for a parsed program
+     */
+    std::string emit_program(const std::vector<std::shared_ptr<Stmt>> &statements)
+    {
+        types.analyse(statements);
+
+        for (const auto &statement : statements)
+        {
+            statement->accept(*this);
+        }
+
+        std::ostringstream unit;
+        unit << "// Generated by prism --emit-cpp\n";
+        unit << "#include \"prism_runtime.h\"\n\n";
+        unit << "int main()\n{\n";
+        unit << "    std::ios::sync_with_stdio(false);\n";
+
+        // Globals live for the whole program, like the global environment
+        for (size_t i = 0; i < types.bindings.size(); i++)
+        {
+            if (types.bindings[i].is_global)
+            {
+                unit << "    " << cpp_type(types.bindings[i].type) << " "
+                     << variable_name(static_cast<int>(i)) << "{};\n";
+            }
+        }
+
+        unit << "\n"
+             << output.str();
+        unit << "    return 0;\n}\n";
+        return unit.str();
+    }
+
+    //-----------------------------------------------
+    // Statement Visitor Methods
+    //-----------------------------------------------
+
+    std::any visit_block_stmt(std::shared_ptr<Block> stmt) override
+    {
+        line("{");
+        emit_body(stmt);
+        line("}");
+        return {};
+    }
+
+    std::any visit_expression_stmt(std::shared_ptr<Expression> stmt) override
+    {
+        // Side effects are already emitted; the value itself is discarded
+        emit_root(stmt->expression);
+        return {};
+    }
+
+    std::any visit_if_stmt(std::shared_ptr<If> stmt) override
+    {
+        Operand condition = emit_root(stmt->condition);
+        line("if (" + truthy(condition) + ")");
+        line("{");
+        emit_body(stmt->then_branch);
+        line("}");
+
+        if (stmt->else_branch != nullptr)
+        {
+            line("else");
+            line("{");
+            emit_body(stmt->else_branch);
+            line("}");
+        }
+        return {};
+    }
+
+    std::any visit_print_stmt(std::shared_ptr<Print> stmt) override
+    {
+        Operand value = emit_root(stmt->expression);
+        line("print_value(" + value.code + ");");
+        return {};
+    }
+
+    std::any visit_var_stmt(std::shared_ptr<Var> stmt) override
+    {
+        Operand value{"Value{}", InferredType::NIL};
+        if (stmt->initialiser != nullptr)
+        {
+            value = emit_root(stmt->initialiser);
+        }
+
+        const CppTypeInference::Declaration &declaration = types.declaration_of.at(stmt.get());
+        InferredType type = types.bindings[declaration.binding].type;
+        std::string name = variable_name(declaration.binding);
+
+        if (declaration.is_new_local)
+        {
+            line(cpp_type(type) + " " + name + " = " + coerce(value, type) + ";");
+        }
+        else
+        {
+            line(name + " = " + coerce(value, type) + ";");
+        }
+        return {};
+    }
+
+    std::any visit_while_stmt(std::shared_ptr<While> stmt) override
+    {
+        std::vector<ReducingVariable> reducing = begin_reduction_blocks(*stmt);
+
+        // Emit the condition separately so it can go inside the loop
+        std::ostringstream condition_output;
+        std::swap(output, condition_output);
+        indent_level++;
+        Operand condition = emit_root(stmt->condition);
+        indent_level--;
+        std::swap(output, condition_output);
+        std::string condition_code = condition_output.str();
+
+        if (condition_code.empty())
+        {
+            line("while (" + truthy(condition) + ")");
+            line("{");
+        }
+        else
+        {
+            line("while (true)");
+            line("{");
+            output << condition_code;
+            indent_level++;
+            line("if (!(" + truthy(condition) + "))");
+            line("{");
+            line("    break;");
+            line("}");
+            indent_level--;
+        }
+        emit_body(stmt->body);
+        if (!reducing.empty())
+        {
+            emit_reduction_blocks(reducing, false);
+        }
+        line("}");
+        if (!reducing.empty())
+        {
+            emit_reduction_blocks(reducing, true);
+        }
+        return {};
+    }
+
+    //-----------------------------------------------
+    // Expression Visitor Methods
+    //-----------------------------------------------
+
+    std::any visit_assign_expr(std::shared_ptr<Assign> expr) override
+    {
+        Operand value = emit(expr->expr_value);
+
+        int binding = types.binding_of.at(expr.get());
+        if (binding < 0)
+        {
+            line("runtime_fail(\"Cannot assign to undefined variable '" + expr->var_name.lexeme +
+                 "'.\", " + std::to_string(expr->var_name.line_number) + ");");
+            return Operand{"Value{}", InferredType::NONE};
+        }
+
+        InferredType type = types.bindings[binding].type;
+        line(variable_name(binding) + " = " + coerce(value, type) + ";");
+
+        // The value is the variable's, read again unless a later assignment could change it
+        Operand variable{variable_name(binding), type};
+        if (copy_reads)
+        {
+            return temp(variable.type, variable.code);
+        }
+        return variable;
+    }
+
+    std::any visit_binary_expr(std::shared_ptr<Binary> expr) override
+    {
+        auto [left, right] = emit_pair(expr->left_expr, expr->right_expr);
+        InferredType type = types.type_of.at(expr.get());
+        TokenType op = expr->operator_token.type;
+        std::string line_number = std::to_string(expr->operator_token.line_number);
+
+        bool both_numbers = left.type == InferredType::NUMBER && right.type == InferredType::NUMBER;
+
+        switch (op)
+        {
+        case EQUAL_EQUAL:
+        case BANG_EQUAL:
+        {
+            // Same static types compare directly; anything else goes through Value
+            std::string negation = op == BANG_EQUAL ? "!" : "";
+            bool same_static_type = left.type == right.type &&
+                                    cpp_type(left.type) != "Value";
+            if (same_static_type)
+            {
+                return Operand{"(" + left.code + (op == BANG_EQUAL ? " != " : " == ") + right.code + ")",
+                               InferredType::BOOL};
+            }
+            return Operand{negation + "is_equal(" + left.code + ", " + right.code + ")",
+                           InferredType::BOOL};
+        }
+
+        case PLUS:
+            if (both_numbers ||
+                (left.type == InferredType::STRING && right.type == InferredType::STRING))
+            {
+                return Operand{"(" + left.code + " + " + right.code + ")", type};
+            }
+            return temp(type, coerce(Operand{"add_values(" + left.code + ", " + right.code + ", " + line_number + ")",
+                                             InferredType::DYNAMIC},
+                                     type));
+
+        default:
+        {
+            if (both_numbers)
+            {
+                return Operand{"(" + left.code + " " + expr->operator_token.lexeme + " " + right.code + ")", type};
+            }
+            return temp(type, std::string(numeric_helper(op)) + "(" + left.code + ", " +
+                                  right.code + ", " + line_number + ")");
+        }
+        }
+    }
+
+    std::any visit_grouping_expr(std::shared_ptr<Grouping> expr) override
+    {
+        return emit(expr->inner_expr);
+    }
+
+    std::any visit_literal_expr(std::shared_ptr<Literal> expr) override
+    {
+        const std::any &value = expr->literal_value;
+        if (value.type() == typeid(double))
+        {
+            return Operand{number_literal(std::any_cast<double>(value)), InferredType::NUMBER};
+        }
+        if (value.type() == typeid(std::string))
+        {
+            return Operand{string_literal(std::any_cast<std::string>(value)), InferredType::STRING};
+        }
+        if (value.type() == typeid(bool))
+        {
+            return Operand{std::any_cast<bool>(value) ? "true" : "false", InferredType::BOOL};
+        }
+        return Operand{"Value{}", InferredType::NIL};
+    }
+
+    std::any visit_logical_expr(std::shared_ptr<Logical> expr) override
+    {
+        InferredType type = types.type_of.at(expr.get());
+        Operand left = emit(expr->left_expr);
+        Operand result = temp(type, coerce(left, type));
+
+        // The right operand only runs when the left does not decide the result;
+        // test the temporary when it keeps the left operand's C++ type
+        std::string condition = cpp_type(left.type) == cpp_type(type)
+                                    ? truthy(Operand{result.code, left.type})
+                                    : truthy(left);
+        if (expr->operator_token.type == OR)
+        {
+            condition = "!(" + condition + ")";
+        }
+
+        line("if (" + condition + ")");
+        line("{");
+        indent_level++;
+        Operand right = emit(expr->right_expr);
+        line(result.code + " = " + coerce(right, type) + ";");
+        indent_level--;
+        line("}");
+        return result;
+    }
+
+    std::any visit_unary_expr(std::shared_ptr<Unary> expr) override
+    {
+        Operand operand = emit(expr->operand);
+
+        if (expr->operator_token.type == BANG)
+        {
+            return Operand{"(!" + truthy(operand) + ")", InferredType::BOOL};
+        }
+
+        if (operand.type == InferredType::NUMBER)
+        {
+            return Operand{"(-" + operand.code + ")", InferredType::NUMBER};
+        }
+        return temp(InferredType::NUMBER, "negate_value(" + operand.code + ", " +
+                                              std::to_string(expr->operator_token.line_number) + ")");
+    }
+
+    std::any visit_variable_expr(std::shared_ptr<Variable> expr) override
+    {
+        int binding = types.binding_of.at(expr.get());
+        if (binding < 0)
+        {
+            // Reads before any top-level declaration always fail
+            line("runtime_fail(\"Undefined variable '" + expr->var_name.lexeme + "'.\", " +
+                 std::to_string(expr->var_name.line_number) + ");");
+            return Operand{"Value{}", InferredType::NONE};
+        }
+
+        Operand variable{variable_name(binding), types.bindings[binding].type};
+
+        // Copy the current value if a later assignment could change it
+        if (copy_reads)
+        {
+            return temp(variable.type, variable.code);
+        }
+        return variable;
+    }
+};
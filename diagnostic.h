@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+/**
+ * One syntax or runtime error, as data rather than text
+ */
+struct Diagnostic
+{
+    enum class Kind
+    {
+        SYNTAX,
+        RUNTIME
+    };
+
+    Kind kind;
+
+    // Source line the error was found on
+    int line;
+
+    // Where on the line, such as "at 'x'" or "at end"; empty when only the line is known
+    std::string location;
+
+    std::string message;
+};
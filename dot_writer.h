@@ -0,0 +1,147 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/**
+ * Buffered writer for DOT text, to a file or pipe or into a string
+ *
+ * Text is gathered in a fixed buffer and handed on in large writes, so a
+ * graph of any size is streamed out without ever being held whole, unless
+ * the destination is a string. Node ids are written straight from
+ * integers, and labels are escaped as they are copied.
+ */
+class DotWriter
+{
+private:
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    char buffer[BUFFER_SIZE];
+    size_t used = 0;
+
+    std::FILE *file = nullptr;
+    std::string *text = nullptr;
+    bool failed = false;
+
+    void drain()
+    {
+        if (used == 0)
+        {
+            return;
+        }
+        if (text != nullptr)
+        {
+            text->append(buffer, used);
+        }
+        else if (!failed && std::fwrite(buffer, 1, used, file) != used)
+        {
+            failed = true;
+        }
+        used = 0;
+    }
+
+    void write_unbuffered(std::string_view part)
+    {
+        if (text != nullptr)
+        {
+            text->append(part);
+        }
+        else if (!failed && std::fwrite(part.data(), 1, part.size(), file) != part.size())
+        {
+            failed = true;
+        }
+    }
+
+public:
+    /**
+     * Streams to a file or pipe, which the caller opens and closes
+     */
+    explicit DotWriter(std::FILE *destination) : file{destination}
+    {
+    }
+
+    /**
+     * Appends to a string
+     */
+    explicit DotWriter(std::string &destination) : text{&destination}
+    {
+    }
+
+    DotWriter(const DotWriter &) = delete;
+    DotWriter &operator=(const DotWriter &) = delete;
+
+    ~DotWriter()
+    {
+        drain();
+    }
+
+    DotWriter &operator<<(std::string_view part)
+    {
+        if (part.size() > BUFFER_SIZE - used)
+        {
+            drain();
+            if (part.size() > BUFFER_SIZE)
+            {
+                write_unbuffered(part);
+                return *this;
+            }
+        }
+        std::memcpy(buffer + used, part.data(), part.size());
+        used += part.size();
+        return *this;
+    }
+
+    DotWriter &operator<<(char c)
+    {
+        if (used == BUFFER_SIZE)
+        {
+            drain();
+        }
+        buffer[used++] = c;
+        return *this;
+    }
+
+    DotWriter &write_number(uint64_t number)
+    {
+        if (BUFFER_SIZE - used < 20)
+        {
+            drain();
+        }
+        used = static_cast<size_t>(std::to_chars(buffer + used, buffer + BUFFER_SIZE, number).ptr - buffer);
+        return *this;
+    }
+
+    /**
+     * Writes text for a quoted DOT string, escaping quotes and backslashes
+     */
+    void write_escaped(std::string_view part)
+    {
+        for (char c : part)
+        {
+            if (c == '"' || c == '\\')
+            {
+                *this << '\\';
+            }
+            *this << c;
+        }
+    }
+
+    /**
+     * Hands on everything buffered so far
+     * @return Whether every write has succeeded
+     */
+    bool flush()
+    {
+        drain();
+        if (file != nullptr && !failed && std::fflush(file) != 0)
+        {
+            failed = true;
+        }
+        return !failed;
+    }
+};
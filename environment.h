@@ -6,8 +6,10 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 #include <stdexcept>
 #include "error.h"
+#include "memory_tracker.h"
 #include "token.h"
 #include "runtime_error.h"
 
@@ -21,11 +23,18 @@ private:
     // Storage for variable definitions
     std::map<std::string, std::any> variable_store;
 
+    // Nodes of variables forgotten by clear(), reused by later definitions
+    std::vector<std::map<std::string, std::any>::node_type> spare_nodes;
+
     // Parent environment for nested scopes
     std::shared_ptr<Environment> parent_scope;
 
+    // Bytes charged to the resource governor for this scope's variables
+    size_t charged_bytes = 0;
+
     // Allow Interpreter to access private members
-    friend class Interpreter;
+    template <bool CountHeat>
+    friend class BasicInterpreter;
 
 public:
     /**
@@ -54,13 +63,15 @@ public:
     std::any get(const Token &name_token)
     {
         // Try to find in current environment
-        std::string var_name = name_token.lexeme;
+        const std::string &var_name = name_token.lexeme;
         auto iter = variable_store.find(var_name);
 
         if (iter != variable_store.end())
         {
             // Found in current scope
-            return iter->second;
+            std::any value = iter->second;
+            memory_tracker.charge_string(value);
+            return value;
         }
 
         // Check parent scope if it exists
@@ -83,13 +94,14 @@ public:
     void assign(const Token &name_token, std::any new_value)
     {
         // Try to assign in current environment
-        std::string var_name = name_token.lexeme;
+        const std::string &var_name = name_token.lexeme;
         auto iter = variable_store.find(var_name);
 
         if (iter != variable_store.end())
         {
             // Update in current scope
             iter->second = std::move(new_value);
+            memory_tracker.charge_string(iter->second);
             return;
         }
 
@@ -113,6 +125,87 @@ public:
     void define(const std::string &var_name, std::any init_value)
     {
         // Add or replace in current scope only
-        variable_store[var_name] = std::move(init_value);
+        MemoryScope memory_scope{MemoryCategory::ENVIRONMENTS};
+        if (spare_nodes.empty())
+        {
+            std::any &stored = variable_store[var_name];
+            stored = std::move(init_value);
+            memory_tracker.charge_string(stored);
+            return;
+        }
+
+        auto iter = variable_store.find(var_name);
+        if (iter != variable_store.end())
+        {
+            iter->second = std::move(init_value);
+            memory_tracker.charge_string(iter->second);
+            return;
+        }
+
+        // Reuse a forgotten variable's node, and its name's buffer
+        auto node = std::move(spare_nodes.back());
+        spare_nodes.pop_back();
+        node.key() = var_name;
+        node.mapped() = std::move(init_value);
+        memory_tracker.charge_string(node.mapped());
+        variable_store.insert(std::move(node));
+    }
+
+    /**
+     * Forgets every variable in this scope, keeping their storage so that
+     * defining the same number of variables again does not allocate
+     */
+    void clear()
+    {
+        spare_nodes.reserve(spare_nodes.size() + variable_store.size());
+        while (!variable_store.empty())
+        {
+            spare_nodes.push_back(variable_store.extract(variable_store.begin()));
+            spare_nodes.back().mapped().reset();
+        }
+    }
+
+    /**
+     * Finds a variable's storage and how many scopes up it lives
+     * @param var_name The variable name as a string
+     * @param depth Set to the number of parent hops to the defining scope
+     * @return Pointer to the value, or nullptr if the variable doesn't exist
+     */
+    std::any *find(const std::string &var_name, int &depth)
+    {
+        depth = 0;
+        for (Environment *env = this; env != nullptr; env = env->parent_scope.get())
+        {
+            auto iter = env->variable_store.find(var_name);
+            if (iter != env->variable_store.end())
+            {
+                return &iter->second;
+            }
+            depth++;
+        }
+        return nullptr;
+    }
+
+    /**
+     * Looks a variable up only in the scope a fixed number of levels up
+     * @param depth Number of parent hops to the scope to search
+     * @param var_name The variable name as a string
+     * @return Pointer to the value, or nullptr if that scope doesn't define it
+     */
+    std::any *find_at(int depth, const std::string &var_name)
+    {
+        Environment *env = this;
+        for (int i = 0; i < depth && env != nullptr; i++)
+        {
+            env = env->parent_scope.get();
+        }
+
+        if (env == nullptr)
+        {
+            return nullptr;
+        }
+
+        auto iter = env->variable_store.find(var_name);
+        return iter != env->variable_store.end() ? &iter->second : nullptr;
     }
 };
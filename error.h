@@ -4,12 +4,98 @@
 #include <string>
 #include <string_view>
 #include <sstream>
+#include <vector>
+#include "diagnostic.h"
 #include "runtime_error.h"
 #include "token.h"
 
-// Global error state flags
-inline bool had_error = false;
-inline bool had_runtime_error = false;
+/**
+ * Where errors are reported, and whether a run has had any
+ *
+ * Each thread reports to the reporter made active on it with an
+ * ErrorReportingScope, or to the standard one on std::cerr otherwise, so
+ * scripts run side by side by --batch keep their errors and exit statuses
+ * apart. A reporter may print errors as prism does, or only collect them
+ * as Diagnostics for an embedding host.
+ */
+class ErrorReporter
+{
+private:
+    // Either may be null
+    std::ostream *stream;
+    std::vector<Diagnostic> *collected = nullptr;
+
+public:
+    // Set by syntax errors and runtime errors respectively
+    bool had_error = false;
+    bool had_runtime_error = false;
+
+    explicit ErrorReporter(std::ostream &errors = std::cerr) : stream{&errors}
+    {
+    }
+
+    /**
+     * A reporter that prints nothing and appends each error to diagnostics
+     */
+    explicit ErrorReporter(std::vector<Diagnostic> &diagnostics) : stream{nullptr}, collected{&diagnostics}
+    {
+    }
+
+    /**
+     * Prints and collects an error, as configured
+     * @param text The error as prism prints it
+     */
+    void add(Diagnostic diagnostic, const std::string &text)
+    {
+        (diagnostic.kind == Diagnostic::Kind::SYNTAX ? had_error : had_runtime_error) = true;
+        if (stream != nullptr)
+        {
+            *stream << text;
+        }
+        if (collected != nullptr)
+        {
+            collected->push_back(std::move(diagnostic));
+        }
+    }
+};
+
+// Reporter used by threads without an ErrorReportingScope
+inline ErrorReporter standard_error_reporter;
+
+// Reporter errors on this thread go to, when one has been made active
+inline thread_local ErrorReporter *active_error_reporter = nullptr;
+
+/**
+ * The reporter errors on this thread go to
+ */
+inline ErrorReporter &error_reporter()
+{
+    return active_error_reporter != nullptr ? *active_error_reporter : standard_error_reporter;
+}
+
+/**
+ * Sends this thread's errors to a reporter while it is alive
+ */
+class ErrorReportingScope
+{
+private:
+    ErrorReporter *previous;
+
+public:
+    explicit ErrorReportingScope(ErrorReporter &reporter)
+        : previous{active_error_reporter}
+    {
+        active_error_reporter = &reporter;
+    }
+
+    ~ErrorReportingScope()
+    {
+        active_error_reporter = previous;
+    }
+
+    ErrorReportingScope(const ErrorReportingScope &) = delete;
+    ErrorReportingScope &operator=(const ErrorReportingScope &) = delete;
+};
 
 /**
  * Logs error information to standard error output
@@ -18,7 +104,7 @@ inline bool had_runtime_error = false;
  * @param context Additional context about error location
  * @param error_msg The error message to display
  */
-static void report(int line_num, std::string_view context,
+inline void report(int line_num, std::string_view context,
                    std::string_view error_msg)
 {
     // Build error message
@@ -26,11 +112,10 @@ static void report(int line_num, std::string_view context,
     error_output << "[line " << line_num << "] Error"
                  << context << ": " << error_msg << "\n";
 
-    // Output to stderr
-    std::cerr << error_output.str();
-
-    // Set the error flag
-    had_error = true;
+    // Hand it to this thread's reporter, which also sets the error flag
+    std::string location{context.substr(context.empty() ? 0 : 1)};
+    error_reporter().add(Diagnostic{Diagnostic::Kind::SYNTAX, line_num, location, std::string{error_msg}},
+                         error_output.str());
 }
 
 /**
@@ -39,7 +124,7 @@ static void report(int line_num, std::string_view context,
  * @param token The token where the error occurred
  * @param error_msg Description of the error
  */
-void error(const Token &token, std::string_view error_msg)
+inline void error(const Token &token, std::string_view error_msg)
 {
     std::string context;
 
@@ -64,7 +149,7 @@ void error(const Token &token, std::string_view error_msg)
  * @param line_num The line where the error occurred
  * @param error_msg Description of the error
  */
-void error(int line_num, std::string_view error_msg)
+inline void error(int line_num, std::string_view error_msg)
 {
     // Report the error with no additional context
     report(line_num, "", error_msg);
@@ -75,15 +160,15 @@ void error(int line_num, std::string_view error_msg)
  *
  * @param runtime_exception The runtime error that occurred
  */
-void runtime_error(const RuntimeError &runtime_exception)
+inline void runtime_error(const RuntimeError &runtime_exception)
 {
     // Construct and output the error message with line information
     std::ostringstream error_output;
     error_output << runtime_exception.what() << "\n"
                  << "[line " << runtime_exception.token.line_number << "]\n";
 
-    std::cerr << error_output.str();
-
-    // Set the runtime error flag
-    had_runtime_error = true;
+    // Hand it to this thread's reporter, which also sets the runtime error flag
+    int line_num = runtime_exception.token.line_number;
+    error_reporter().add(Diagnostic{Diagnostic::Kind::RUNTIME, line_num, "", runtime_exception.what()},
+                         error_output.str());
 }
@@ -1,10 +1,13 @@
 #pragma once
 
 #include <any>
+#include <cstdint>
 #include <memory>
 #include <utility>
 #include <vector>
 #include "token.h"
+#include "node_heat.h"
+#include "type_feedback.h"
 
 // Forward declarations of expression types
 struct Assign;
@@ -34,11 +37,34 @@ struct ExprVisitor
     virtual ~ExprVisitor() = default;
 };
 
+/**
+ * Tag identifying the concrete type of an expression node
+ * Lets statically typed visitors dispatch with a switch instead of a virtual call
+ */
+enum class ExprKind : uint8_t
+{
+    ASSIGN,
+    BINARY,
+    GROUPING,
+    LITERAL,
+    LOGICAL,
+    UNARY,
+    VARIABLE,
+};
+
 /**
  * Base class for all expression types
  */
 struct Expr
 {
+    // Concrete node type, fixed at construction
+    const ExprKind kind;
+
+    // Executions and time, recorded while the interpreter counts heat
+    NodeHeat heat;
+
+    explicit Expr(ExprKind node_kind) : kind{node_kind} {}
+
     // Accept method to implement visitor pattern
     virtual std::any accept(ExprVisitor &visitor) = 0;
     // Virtual destructor
@@ -57,7 +83,7 @@ struct Assign : Expr, public std::enable_shared_from_this<Assign>
 
     // Constructor
     Assign(Token name, std::shared_ptr<Expr> value)
-        : var_name{std::move(name)}, expr_value{std::move(value)}
+        : Expr{ExprKind::ASSIGN}, var_name{std::move(name)}, expr_value{std::move(value)}
     {
     }
 
@@ -79,9 +105,13 @@ struct Binary : Expr, public std::enable_shared_from_this<Binary>
     const Token operator_token;
     const std::shared_ptr<Expr> right_expr;
 
+    // Operand type feedback recorded by the interpreter
+    BinaryFeedback feedback;
+
     // Constructor
     Binary(std::shared_ptr<Expr> left, Token op, std::shared_ptr<Expr> right)
-        : left_expr{std::move(left)},
+        : Expr{ExprKind::BINARY},
+          left_expr{std::move(left)},
           operator_token{std::move(op)},
           right_expr{std::move(right)}
     {
@@ -105,7 +135,7 @@ struct Grouping : Expr, public std::enable_shared_from_this<Grouping>
 
     // Constructor
     Grouping(std::shared_ptr<Expr> expression)
-        : inner_expr{std::move(expression)}
+        : Expr{ExprKind::GROUPING}, inner_expr{std::move(expression)}
     {
     }
 
@@ -127,7 +157,7 @@ struct Literal : Expr, public std::enable_shared_from_this<Literal>
 
     // Constructor
     Literal(std::any val)
-        : literal_value{std::move(val)}
+        : Expr{ExprKind::LITERAL}, literal_value{std::move(val)}
     {
     }
 
@@ -151,7 +181,8 @@ struct Logical : Expr, public std::enable_shared_from_this<Logical>
 
     // Constructor
     Logical(std::shared_ptr<Expr> left, Token op, std::shared_ptr<Expr> right)
-        : left_expr{std::move(left)},
+        : Expr{ExprKind::LOGICAL},
+          left_expr{std::move(left)},
           operator_token{std::move(op)},
           right_expr{std::move(right)}
     {
@@ -176,7 +207,7 @@ struct Unary : Expr, public std::enable_shared_from_this<Unary>
 
     // Constructor
     Unary(Token op, std::shared_ptr<Expr> right)
-        : operator_token{std::move(op)}, operand{std::move(right)}
+        : Expr{ExprKind::UNARY}, operator_token{std::move(op)}, operand{std::move(right)}
     {
     }
 
@@ -196,9 +227,12 @@ struct Variable : Expr, public std::enable_shared_from_this<Variable>
     // Member variable
     const Token var_name;
 
+    // Scope depth feedback recorded by the interpreter
+    VariableFeedback feedback;
+
     // Constructor
     Variable(Token name)
-        : var_name{std::move(name)}
+        : Expr{ExprKind::VARIABLE}, var_name{std::move(name)}
     {
     }
 
@@ -1,10 +1,17 @@
 #pragma once
 
+#include <algorithm>
 #include <any>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <utility>
 #include <typeinfo>
@@ -12,19 +19,74 @@
 #include "environment.h"
 #include "error.h"
 #include "expr.h"
+#include "jit.h"
+#include "memory_tracker.h"
+#include "output_sink.h"
+#include "parallel_loop.h"
+#include "resource_governor.h"
 #include "runtime_error.h"
 #include "stmt.h"
+#include "trace_recorder.h"
+#include "type_feedback.h"
+#include "visitor.h"
+#include "work_stealing_pool.h"
 
 /**
  * Executes the parsed abstract syntax tree by implementing
  * the visitor pattern for expressions and statements
+ *
+ * With CountHeat, every statement and expression also records its
+ * executions and time for the heat map. It is a separate instantiation so
+ * that the ordinary interpreter does not test for it at every node.
  */
-class Interpreter : public ExprVisitor, public StmtVisitor
+template <bool CountHeat>
+class BasicInterpreter : public ExprVisitorOf<BasicInterpreter<CountHeat>, std::any>,
+                         public StmtVisitorOf<BasicInterpreter<CountHeat>, void>
 {
 private:
     // Current execution environment
     std::shared_ptr<Environment> current_env{new Environment};
 
+    // Whether nodes may specialise on recorded type feedback
+    bool specialisation_enabled = true;
+
+    // Compiles hot numeric loops to native code when enabled
+    bool jit_enabled = false;
+    LoopJit loop_jit;
+
+    // Step, time and memory limits for each run
+    ResourceGovernor governor;
+
+    // Statement being executed, kept for the profiler's signal handler and the memory report
+    bool tracking_statements = false;
+    std::atomic<const Stmt *> current_statement{nullptr};
+
+    // Top-level statements and loops that take at least this long are traced
+    bool tracing_statements = false;
+    uint64_t trace_threshold_ns = 0;
+
+    // Whether statements go through exec_observed_statement for any of the above or the heat map
+    bool observing = CountHeat;
+
+    // Stream printed values go to instead of standard output, when captured
+    std::ostream *captured_output = nullptr;
+
+    // An interpreter that runs chunks of parallel loop iterations, with the output it printed
+    struct LoopWorker
+    {
+        std::unique_ptr<BasicInterpreter<false>> interpreter;
+        std::ostringstream output;
+    };
+
+    // Threads that run parallel loops, and a worker for each; made on the first parallel loop
+    size_t loop_threads = 1;
+    std::unique_ptr<WorkStealingPool> loop_pool;
+    std::vector<std::unique_ptr<LoopWorker>> loop_workers;
+
+    // Workers run chunks of another instantiation's loops
+    template <bool>
+    friend class BasicInterpreter;
+
     /**
      * Converts any value to its string representation
      */
@@ -39,16 +101,7 @@ private:
         // Handle numeric values
         if (value.type() == typeid(double))
         {
-            std::string num_str = std::to_string(std::any_cast<double>(value));
-
-            // Remove trailing .0 for integer values
-            if (num_str.size() >= 2 &&
-                num_str[num_str.length() - 2] == '.' &&
-                num_str[num_str.length() - 1] == '0')
-            {
-                return num_str.substr(0, num_str.length() - 2);
-            }
-            return num_str;
+            return format_number(std::any_cast<double>(value));
         }
 
         // Handle strings
@@ -156,23 +209,712 @@ private:
         throw RuntimeError{operator_token, "Operands must be numbers."};
     }
 
+    /**
+     * Picks the specialised variant for a Binary node's stable operand types
+     */
+    BinarySpecialisation choose_specialisation(TokenType operator_type,
+                                               ValueKind left, ValueKind right)
+    {
+        if (left == ValueKind::STRING && right == ValueKind::STRING && operator_type == PLUS)
+        {
+            return BinarySpecialisation::CONCAT_STRINGS;
+        }
+
+        if (left != ValueKind::NUMBER || right != ValueKind::NUMBER)
+        {
+            return BinarySpecialisation::GENERIC;
+        }
+
+        switch (operator_type)
+        {
+        case PLUS:
+            return BinarySpecialisation::ADD_NUMBERS;
+        case MINUS:
+            return BinarySpecialisation::SUBTRACT_NUMBERS;
+        case STAR:
+            return BinarySpecialisation::MULTIPLY_NUMBERS;
+        case SLASH:
+            return BinarySpecialisation::DIVIDE_NUMBERS;
+        case LESS:
+            return BinarySpecialisation::LESS_NUMBERS;
+        case LESS_EQUAL:
+            return BinarySpecialisation::LESS_EQUAL_NUMBERS;
+        case GREATER:
+            return BinarySpecialisation::GREATER_NUMBERS;
+        case GREATER_EQUAL:
+            return BinarySpecialisation::GREATER_EQUAL_NUMBERS;
+        case EQUAL_EQUAL:
+            return BinarySpecialisation::EQUAL_NUMBERS;
+        case BANG_EQUAL:
+            return BinarySpecialisation::NOT_EQUAL_NUMBERS;
+        default:
+            return BinarySpecialisation::GENERIC;
+        }
+    }
+
+    /**
+     * Runs a specialised Binary node behind its type guard
+     * @return false if the guard failed and the node must deoptimise
+     */
+    bool eval_specialised(BinarySpecialisation specialisation,
+                          std::any &left_value, std::any &right_value,
+                          std::any &result, int line)
+    {
+        // Strings: concatenate in place to reuse the left buffer
+        if (specialisation == BinarySpecialisation::CONCAT_STRINGS)
+        {
+            std::string *left_text = std::any_cast<std::string>(&left_value);
+            const std::string *right_text = std::any_cast<std::string>(&right_value);
+            if (left_text == nullptr || right_text == nullptr)
+            {
+                return false;
+            }
+            if (tracking_memory())
+            {
+                governor.check_allocation(left_text->size() + right_text->size(), line);
+            }
+            MemoryScope memory_scope{MemoryCategory::STRINGS};
+            *left_text += *right_text;
+            result = std::move(left_value);
+            return true;
+        }
+
+        // Numbers: pointer any_casts double as the type guard
+        const double *left_number = std::any_cast<double>(&left_value);
+        const double *right_number = std::any_cast<double>(&right_value);
+        if (left_number == nullptr || right_number == nullptr)
+        {
+            return false;
+        }
+
+        switch (specialisation)
+        {
+        case BinarySpecialisation::ADD_NUMBERS:
+            result = *left_number + *right_number;
+            break;
+        case BinarySpecialisation::SUBTRACT_NUMBERS:
+            result = *left_number - *right_number;
+            break;
+        case BinarySpecialisation::MULTIPLY_NUMBERS:
+            result = *left_number * *right_number;
+            break;
+        case BinarySpecialisation::DIVIDE_NUMBERS:
+            result = *left_number / *right_number;
+            break;
+        case BinarySpecialisation::LESS_NUMBERS:
+            result = *left_number < *right_number;
+            break;
+        case BinarySpecialisation::LESS_EQUAL_NUMBERS:
+            result = *left_number <= *right_number;
+            break;
+        case BinarySpecialisation::GREATER_NUMBERS:
+            result = *left_number > *right_number;
+            break;
+        case BinarySpecialisation::GREATER_EQUAL_NUMBERS:
+            result = *left_number >= *right_number;
+            break;
+        case BinarySpecialisation::EQUAL_NUMBERS:
+            result = *left_number == *right_number;
+            break;
+        case BinarySpecialisation::NOT_EQUAL_NUMBERS:
+            result = *left_number != *right_number;
+            break;
+        default:
+            return false;
+        }
+        return true;
+    }
+
     /**
      * Evaluates an expression and returns its value
      */
-    std::any eval_expression(std::shared_ptr<Expr> expr)
+    std::any eval_expression(const std::shared_ptr<Expr> &expr)
+    {
+        if constexpr (CountHeat)
+        {
+            return eval_counted_expression(*expr);
+        }
+        return this->visit_expr(*expr);
+    }
+
+    /**
+     * Evaluates an expression, adding to its execution count and time
+     */
+    std::any eval_counted_expression(Expr &expr)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::any value = this->visit_expr(expr);
+        expr.heat.executions++;
+        expr.heat.nanoseconds += elapsed_nanoseconds(start);
+        return value;
+    }
+
+    static uint64_t elapsed_nanoseconds(std::chrono::steady_clock::time_point start)
     {
-        return expr->accept(*this);
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                         std::chrono::steady_clock::now() - start)
+                                         .count());
     }
 
     /**
      * Executes a statement
      */
-    void exec_statement(std::shared_ptr<Stmt> stmt)
+    void exec_statement(const std::shared_ptr<Stmt> &stmt)
+    {
+        if (observing || governor.active())
+        {
+            exec_observed_statement(*stmt);
+            return;
+        }
+        this->visit_stmt(*stmt);
+    }
+
+    /**
+     * Executes a statement that is metered by limits, watched by the profiler,
+     * counted for the heat map or traced
+     */
+    void exec_observed_statement(Stmt &stmt)
+    {
+        if (governor.active())
+        {
+            governor.step(stmt.line_number);
+        }
+
+        // Relaxed stores are plain moves; the profiler's handler runs on this thread
+        const Stmt *enclosing = current_statement.load(std::memory_order_relaxed);
+        current_statement.store(&stmt, std::memory_order_relaxed);
+
+        // Only top-level statements and loops are candidates for a trace span
+        bool traced = tracing_statements && (enclosing == nullptr || stmt.kind == StmtKind::WHILE);
+        uint64_t trace_start = traced ? trace_recorder().now_ns() : 0;
+
+        if constexpr (CountHeat)
+        {
+            auto start = std::chrono::steady_clock::now();
+            this->visit_stmt(stmt);
+            stmt.heat.executions++;
+            stmt.heat.nanoseconds += elapsed_nanoseconds(start);
+        }
+        else
+        {
+            this->visit_stmt(stmt);
+        }
+
+        if (traced && trace_recorder().now_ns() - trace_start >= trace_threshold_ns)
+        {
+            trace_recorder().record(stmt_kind_name(stmt.kind), "statement", trace_start, stmt.line_number);
+        }
+        current_statement.store(enclosing, std::memory_order_relaxed);
+    }
+
+    /**
+     * Creates a scope nested in the current one
+     */
+    std::shared_ptr<Environment> new_scope()
+    {
+        MemoryScope memory_scope{MemoryCategory::ENVIRONMENTS};
+        return std::make_shared<Environment>(current_env);
+    }
+
+    //---------------------------------------------
+    // Memory accounting, only while memory is limited
+    //---------------------------------------------
+
+    bool tracking_memory() const
+    {
+        return governor.active() && governor.limits_memory();
+    }
+
+    static size_t value_bytes(const std::any &value)
+    {
+        const std::string *text = std::any_cast<std::string>(&value);
+        return text != nullptr ? text->size() : 0;
+    }
+
+    /**
+     * Charges a scope for a variable's value replacing old_bytes of storage
+     */
+    void charge_variable(Environment &env, size_t old_bytes, size_t new_bytes, int line)
+    {
+        if (new_bytes > old_bytes)
+        {
+            governor.charge(new_bytes - old_bytes, line);
+        }
+        else
+        {
+            governor.release(old_bytes - new_bytes);
+        }
+        env.charged_bytes += new_bytes;
+        env.charged_bytes -= old_bytes;
+    }
+
+    /**
+     * Charges for a variable about to be defined in the current scope
+     */
+    void charge_definition(const Token &name, const std::any &value)
+    {
+        auto existing = current_env->variable_store.find(name.lexeme);
+        size_t old_bytes = existing != current_env->variable_store.end()
+                               ? ResourceGovernor::VARIABLE_BYTES + name.lexeme.size() + value_bytes(existing->second)
+                               : 0;
+        size_t new_bytes = ResourceGovernor::VARIABLE_BYTES + name.lexeme.size() + value_bytes(value);
+        charge_variable(*current_env, old_bytes, new_bytes, name.line_number);
+    }
+
+    /**
+     * Charges the scope holding a variable for the value about to be assigned
+     */
+    void charge_assignment(const Token &name, const std::any &value)
+    {
+        for (Environment *env = current_env.get(); env != nullptr; env = env->parent_scope.get())
+        {
+            auto existing = env->variable_store.find(name.lexeme);
+            if (existing != env->variable_store.end())
+            {
+                charge_variable(*env, value_bytes(existing->second), value_bytes(value), name.line_number);
+                return;
+            }
+        }
+    }
+
+    //---------------------------------------------
+    // Parallel loops
+    //---------------------------------------------
+
+    /**
+     * Writes output printed by a chunk of parallel loop iterations
+     */
+    void write_printed(std::string_view text)
+    {
+        if (captured_output != nullptr)
+        {
+            captured_output->write(text.data(), static_cast<std::streamsize>(text.size()));
+            return;
+        }
+
+        // Line by line, so the sink flushes as it would have for each print
+        while (!text.empty())
+        {
+            size_t line_end = text.find('\n');
+            standard_output().print_text(text.substr(0, line_end));
+            text.remove_prefix(line_end + 1);
+        }
+    }
+
+    /**
+     * Runs iterations of a parallel loop on this worker, in a scope of its
+     * own holding the loop variable and the current block's reduction partials
+     * Each block's partials are appended in turn, reduction by reduction.
+     * Stops early once an earlier chunk has failed, as its output will not be used
+     */
+    void run_chunk(const ParallelLoop &loop, const std::shared_ptr<Environment> &loop_env, double first_value,
+                   double step, size_t iterations, std::vector<double> &partials,
+                   const std::atomic<size_t> &first_failure, size_t chunk)
+    {
+        std::shared_ptr<Environment> chunk_env = std::make_shared<Environment>(loop_env);
+        chunk_env->define(loop.variable.lexeme, first_value);
+        for (const Reduction &reduction : loop.reductions)
+        {
+            chunk_env->define(reduction.name.lexeme, reduction_identity(reduction.operator_type));
+        }
+        std::any *variable = chunk_env->find_at(0, loop.variable.lexeme);
+
+        // Updates as `sum = sum + value` keep a partial a number, or fail
+        auto end_block = [&]
+        {
+            for (const Reduction &reduction : loop.reductions)
+            {
+                std::any *partial = chunk_env->find_at(0, reduction.name.lexeme);
+                partials.push_back(std::any_cast<double>(*partial));
+                *partial = reduction_identity(reduction.operator_type);
+            }
+        };
+
+        std::shared_ptr<Environment> previous_env = current_env;
+        current_env = chunk_env;
+        try
+        {
+            for (size_t i = 0; i < iterations && first_failure.load(std::memory_order_relaxed) > chunk; i++)
+            {
+                *variable = first_value + static_cast<double>(i) * step;
+                exec_statement(loop.body);
+                if (!loop.reductions.empty() && (i + 1) % REDUCTION_BLOCK == 0)
+                {
+                    end_block();
+                }
+            }
+        }
+        catch (...)
+        {
+            current_env = previous_env;
+            throw;
+        }
+        current_env = previous_env;
+        if (iterations % REDUCTION_BLOCK != 0)
+        {
+            end_block();
+        }
+    }
+
+    /**
+     * Runs a parallel loop's iterations in chunks on the loop threads
+     *
+     * The loop variable has been declared. Chunks are a fixed size for a
+     * given number of iterations, and each reduction is combined from the
+     * partials of its blocks in order, as an engine running the iterations
+     * in order combines them, so results do not depend on the engine, the
+     * number of threads or which finishes first. Output printed by each
+     * chunk is held until every earlier chunk's has been written. If an
+     * iteration fails, later chunks are abandoned and its error is thrown
+     * after the output of every iteration before it.
+     *
+     * @return False if the loop must run in order instead: while metered,
+     *         observed or counted, or when the start, step or reductions are
+     *         not numbers that whole-number steps reach exactly
+     */
+    bool run_parallel(const ParallelLoop &loop)
+    {
+        if (CountHeat || observing || governor.active())
+        {
+            return false;
+        }
+
+        // Running in order reports any error from these in its proper place
+        std::any start_value, bound_value, step_value;
+        std::vector<double> initial;
+        try
+        {
+            start_value = current_env->get(loop.variable);
+            bound_value = eval_expression(loop.bound);
+            step_value = eval_expression(loop.step);
+            for (const Reduction &reduction : loop.reductions)
+            {
+                std::any value = current_env->get(reduction.name);
+                if (value.type() != typeid(double))
+                {
+                    return false;
+                }
+                initial.push_back(std::any_cast<double>(value));
+            }
+        }
+        catch (const RuntimeError &)
+        {
+            return false;
+        }
+
+        const double *start = std::any_cast<double>(&start_value);
+        const double *bound = std::any_cast<double>(&bound_value);
+        const double *step_operand = std::any_cast<double>(&step_value);
+        if (start == nullptr || bound == nullptr || step_operand == nullptr)
+        {
+            return false;
+        }
+
+        // Whole numbers below 2^53 are exact, so the variable can be computed for any iteration
+        constexpr double EXACT_LIMIT = 9007199254740992.0;
+        double step = loop.decrementing ? -*step_operand : *step_operand;
+        bool upward = loop.comparison == LESS || loop.comparison == LESS_EQUAL;
+        if (std::trunc(*start) != *start || std::trunc(step) != step || step == 0 || upward != (step > 0) ||
+            std::fabs(*start) > EXACT_LIMIT)
+        {
+            return false;
+        }
+
+        auto holds = [&](double value)
+        {
+            switch (loop.comparison)
+            {
+            case LESS:
+                return value < *bound;
+            case LESS_EQUAL:
+                return value <= *bound;
+            case GREATER:
+                return value > *bound;
+            default:
+                return value >= *bound;
+            }
+        };
+
+        // Iterations: the estimate is corrected by testing the condition either side of it
+        double estimate = std::floor((*bound - *start) / step);
+        if (!holds(*start) || !(estimate < EXACT_LIMIT))
+        {
+            return false;
+        }
+        size_t count = static_cast<size_t>(std::max(1.0, estimate));
+        while (count > 1 && !holds(*start + static_cast<double>(count - 1) * step))
+        {
+            count--;
+        }
+        while (holds(*start + static_cast<double>(count) * step))
+        {
+            count++;
+        }
+        double end_value = *start + static_cast<double>(count) * step;
+        if (std::fabs(end_value) > EXACT_LIMIT)
+        {
+            return false;
+        }
+
+        if (loop_pool == nullptr && loop_threads > 1)
+        {
+            loop_pool = std::make_unique<WorkStealingPool>(loop_threads);
+        }
+        size_t worker_count = loop_pool != nullptr ? loop_pool->size() : 1;
+        while (loop_workers.size() < worker_count)
+        {
+            auto worker = std::make_unique<LoopWorker>();
+            worker->interpreter = std::make_unique<BasicInterpreter<false>>();
+
+            // Workers share the tree, so none may rewrite it with type feedback
+            worker->interpreter->set_specialisation(false);
+            worker->interpreter->capture_output(worker->output);
+            loop_workers.push_back(std::move(worker));
+        }
+
+        struct ChunkResult
+        {
+            std::string output;
+            std::exception_ptr failure;
+            std::vector<double> partials;
+            bool finished = false;
+        };
+        size_t chunk_size = parallel_chunk_size(count, !loop.reductions.empty());
+        size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+        std::vector<ChunkResult> results(chunk_count);
+        std::atomic<size_t> first_failure{chunk_count};
+
+        std::mutex output_mutex;
+        size_t next_output = 0;
+
+        std::shared_ptr<Environment> loop_env = current_env;
+        WorkStealingPool::Task run_task = [&](size_t chunk, size_t worker_index)
+        {
+            TraceSpan span{"parallel chunk", "interpret"};
+            ChunkResult &result = results[chunk];
+            if (chunk < first_failure.load(std::memory_order_relaxed))
+            {
+                LoopWorker &worker = *loop_workers[worker_index];
+                size_t first = chunk * chunk_size;
+                try
+                {
+                    worker.interpreter->run_chunk(loop, loop_env, *start + static_cast<double>(first) * step, step,
+                                                 std::min(chunk_size, count - first), result.partials,
+                                                 first_failure, chunk);
+                }
+                catch (...)
+                {
+                    result.failure = std::current_exception();
+                    size_t failed = first_failure.load();
+                    while (chunk < failed && !first_failure.compare_exchange_weak(failed, chunk))
+                    {
+                    }
+                }
+                result.output = worker.output.str();
+                worker.output.str("");
+            }
+
+            // Write out every chunk that is next in order, up to and including the first to fail
+            std::lock_guard<std::mutex> lock{output_mutex};
+            result.finished = true;
+            while (next_output < chunk_count && results[next_output].finished &&
+                   (next_output == 0 || results[next_output - 1].failure == nullptr))
+            {
+                write_printed(results[next_output].output);
+                std::string{}.swap(results[next_output].output);
+                next_output++;
+            }
+        };
+
+        if (loop_pool != nullptr)
+        {
+            loop_pool->run(chunk_count, run_task);
+        }
+        else
+        {
+            for (size_t chunk = 0; chunk < chunk_count; chunk++)
+            {
+                run_task(chunk, 0);
+            }
+        }
+
+        size_t failed = first_failure.load();
+        if (failed < chunk_count)
+        {
+            std::rethrow_exception(results[failed].failure);
+        }
+
+        size_t reduction_count = loop.reductions.size();
+        for (size_t i = 0; i < reduction_count; i++)
+        {
+            double value = initial[i];
+            for (const ChunkResult &result : results)
+            {
+                for (size_t block = i; block < result.partials.size(); block += reduction_count)
+                {
+                    value = combine_reduction(loop.reductions[i].operator_type, value, result.partials[block]);
+                }
+            }
+            current_env->assign(loop.reductions[i].name, value);
+        }
+        current_env->assign(loop.variable, end_value);
+        return true;
+    }
+
+    /**
+     * Runs a parallel loop with reductions in order, combining each
+     * reduction in blocks as run_parallel() does
+     * Not handed to the loop JIT, which would run the rest of the loop as one block
+     */
+    void run_reducing(While &stmt, const std::vector<Reduction> &reductions)
     {
-        stmt->accept(*this);
+        std::shared_ptr<Environment> loop_env = current_env;
+        auto find = [&](const Reduction &reduction)
+        {
+            int depth;
+            std::any *value = loop_env->find(reduction.name.lexeme, depth);
+            return value != nullptr ? std::any_cast<double>(value) : nullptr;
+        };
+
+        ReductionBlocks blocks{reductions};
+        blocks.begin(find);
+        while (true)
+        {
+            if (governor.active())
+            {
+                governor.step(stmt.line_number);
+            }
+            if (!is_truthy(eval_expression(stmt.condition)))
+            {
+                break;
+            }
+            exec_statement(stmt.body);
+            blocks.end_iteration(find);
+        }
+        blocks.finish(find);
     }
 
 public:
+    /**
+     * Enables or disables type-feedback specialisation of AST nodes
+     */
+    void set_specialisation(bool enabled)
+    {
+        specialisation_enabled = enabled;
+    }
+
+    /**
+     * Enables the loop JIT, compiling loops after the given iteration count
+     */
+    void set_jit(bool enabled, uint32_t threshold)
+    {
+        jit_enabled = enabled;
+        loop_jit.set_threshold(threshold);
+    }
+
+    /**
+     * Sends printed values to the given stream instead of standard output
+     * Compiled loops print to standard output, so the loop JIT is not used
+     */
+    void capture_output(std::ostream &output)
+    {
+        captured_output = &output;
+    }
+
+    /**
+     * Sets the threads that run `parallel for` loops, including the calling one
+     * With one thread, the iterations still run in the same chunks, so
+     * reductions give the same results as on any number of threads
+     */
+    void set_loop_threads(size_t threads)
+    {
+        loop_threads = std::max<size_t>(1, threads);
+        loop_pool.reset();
+    }
+
+    /**
+     * Sets the step, time and memory limits applied to each run
+     * Native code cannot be metered, so the loop JIT is off while limits are set
+     */
+    void set_limits(const ResourceLimits &limits)
+    {
+        governor.set_limits(limits);
+    }
+
+    /**
+     * Stops the current run, or the next if none is in progress, at its next
+     * step with a ResourceLimitError
+     * Safe to call from another thread
+     */
+    void cancel()
+    {
+        governor.cancel();
+    }
+
+    /**
+     * Forgets every global variable before the next run, keeping their
+     * storage so that defining the same globals again does not allocate
+     */
+    void reset_globals()
+    {
+        governor.release(current_env->charged_bytes);
+        current_env->charged_bytes = 0;
+        current_env->clear();
+    }
+
+    /**
+     * Defines a global variable before a run, as `var name = value;` would
+     * @throws ResourceLimitError if it does not fit under the memory limit
+     */
+    void define_global(const std::string &name, std::any value)
+    {
+        if (tracking_memory())
+        {
+            charge_definition(Token{IDENTIFIER, name, nullptr, 0}, value);
+        }
+        current_env->define(name, std::move(value));
+    }
+
+    /**
+     * Calls visit(name, value) for each global variable after a run, in name order
+     */
+    template <typename Visit>
+    void for_each_global(Visit visit) const
+    {
+        for (const auto &[name, value] : current_env->variable_store)
+        {
+            visit(name, value);
+        }
+    }
+
+    /**
+     * Starts or stops keeping track of the statement being executed
+     */
+    void track_statements(bool enabled)
+    {
+        tracking_statements = enabled;
+        observing = tracking_statements || tracing_statements || CountHeat;
+    }
+
+    /**
+     * Records a trace span for each top-level statement and loop that takes
+     * at least the threshold; the recorder must be enabled
+     */
+    void trace_statements(uint64_t threshold_ns)
+    {
+        tracing_statements = true;
+        trace_threshold_ns = threshold_ns;
+        observing = tracking_statements || tracing_statements || CountHeat;
+    }
+
+    /**
+     * The statement currently being executed while tracking statements, or null
+     */
+    const std::atomic<const Stmt *> &executing_statement() const
+    {
+        return current_statement;
+    }
+
     /**
      * Executes a list of statements in a new environment scope
      */
@@ -204,11 +946,21 @@ public:
         this->current_env = previous_env;
     }
 
+    /**
+     * Evaluates one expression against the current globals
+     * @throws RuntimeError rather than reporting it
+     */
+    std::any evaluate(const std::shared_ptr<Expr> &expr)
+    {
+        return eval_expression(expr);
+    }
+
     /**
      * Main entry point - interprets a program of statements
      */
     void interpret(const std::vector<std::shared_ptr<Stmt>> &statements)
     {
+        governor.start_run();
         try
         {
             // Execute each statement in sequence
@@ -222,6 +974,10 @@ public:
             // Report runtime errors
             runtime_error(error);
         }
+        governor.finish_run();
+
+        // An error leaves the failing statement behind
+        current_statement.store(nullptr, std::memory_order_relaxed);
     }
 
     //-----------------------------------------------
@@ -231,80 +987,141 @@ public:
     /**
      * Executes a block statement
      */
-    std::any visit_block_stmt(std::shared_ptr<Block> stmt) override
+    void visit_block_stmt(Block &stmt)
     {
-        exec_block(stmt->statements,
-                   std::make_shared<Environment>(current_env));
-        return {};
+        if (!tracking_memory())
+        {
+            exec_block(stmt.body(), new_scope());
+            return;
+        }
+
+        // The scope and its variables are charged while it is live
+        std::shared_ptr<Environment> block_env = new_scope();
+        governor.charge(ResourceGovernor::SCOPE_BYTES, stmt.line_number);
+        try
+        {
+            exec_block(stmt.body(), block_env);
+        }
+        catch (...)
+        {
+            governor.release(ResourceGovernor::SCOPE_BYTES + block_env->charged_bytes);
+            throw;
+        }
+        governor.release(ResourceGovernor::SCOPE_BYTES + block_env->charged_bytes);
     }
 
     /**
      * Executes an expression statement
      */
-    std::any visit_expression_stmt(std::shared_ptr<Expression> stmt) override
+    void visit_expression_stmt(Expression &stmt)
     {
-        eval_expression(stmt->expression);
-        return {};
+        eval_expression(stmt.expression);
     }
 
     /**
      * Executes an if statement with optional else branch
      */
-    std::any visit_if_stmt(std::shared_ptr<If> stmt) override
+    void visit_if_stmt(If &stmt)
     {
         // Evaluate condition
-        if (is_truthy(eval_expression(stmt->condition)))
+        if (is_truthy(eval_expression(stmt.condition)))
         {
             // Execute then branch
-            exec_statement(stmt->then_branch);
+            exec_statement(stmt.then_branch);
         }
-        else if (stmt->else_branch != nullptr)
+        else if (stmt.else_branch != nullptr)
         {
             // Execute else branch if it exists
-            exec_statement(stmt->else_branch);
+            exec_statement(stmt.else_branch);
         }
-        return {};
     }
 
     /**
      * Executes a print statement
      */
-    std::any visit_print_stmt(std::shared_ptr<Print> stmt) override
+    void visit_print_stmt(Print &stmt)
     {
-        // Evaluate expression and convert to string
-        std::any result = eval_expression(stmt->expression);
-        std::cout << to_string(result) << "\n";
-        return {};
+        // Evaluate expression; numbers are formatted straight into the output buffer
+        std::any result = eval_expression(stmt.expression);
+        if (captured_output != nullptr)
+        {
+            *captured_output << to_string(result) << '\n';
+        }
+        else if (const double *number = std::any_cast<double>(&result))
+        {
+            standard_output().print_number(*number);
+        }
+        else
+        {
+            MemoryScope memory_scope{MemoryCategory::STRINGS};
+            standard_output().print_text(to_string(result));
+        }
     }
 
     /**
      * Executes a variable declaration
      */
-    std::any visit_var_stmt(std::shared_ptr<Var> stmt) override
+    void visit_var_stmt(Var &stmt)
     {
         // Evaluate initialiser if present, otherwise nil
         std::any initial_value = nullptr;
-        if (stmt->initialiser != nullptr)
+        if (stmt.initialiser != nullptr)
         {
-            initial_value = eval_expression(stmt->initialiser);
+            initial_value = eval_expression(stmt.initialiser);
         }
 
         // Define variable in current environment
-        current_env->define(stmt->name.lexeme, std::move(initial_value));
-        return {};
+        if (tracking_memory())
+        {
+            charge_definition(stmt.name, initial_value);
+        }
+        current_env->define(stmt.name.lexeme, std::move(initial_value));
     }
 
     /**
      * Executes a while loop
      */
-    std::any visit_while_stmt(std::shared_ptr<While> stmt) override
+    void visit_while_stmt(While &stmt)
     {
+        if (stmt.parallel != nullptr && run_parallel(*stmt.parallel))
+        {
+            return;
+        }
+        if (stmt.parallel != nullptr && !stmt.parallel->reductions.empty())
+        {
+            run_reducing(stmt, stmt.parallel->reductions);
+            return;
+        }
+
         // Loop until condition is falsey
-        while (is_truthy(eval_expression(stmt->condition)))
+        while (true)
         {
-            exec_statement(stmt->body);
+            if (governor.active())
+            {
+                governor.step(stmt.line_number);
+            }
+
+            // Hand hot loops over to native code, which runs them to the end
+            // Native code cannot be metered, counted or captured, so not while limits are set,
+            // heat is counted or output is captured
+            if (jit_enabled && !CountHeat && !governor.active() && captured_output == nullptr &&
+                loop_jit.try_run(stmt, *current_env))
+            {
+                break;
+            }
+
+            if (!is_truthy(eval_expression(stmt.condition)))
+            {
+                break;
+            }
+            exec_statement(stmt.body);
+
+            // Only the loop JIT reads the count; without it the AST is left untouched
+            if (jit_enabled)
+            {
+                stmt.feedback.iterations++;
+            }
         }
-        return {};
     }
 
     //-----------------------------------------------
@@ -314,43 +1131,72 @@ public:
     /**
      * Evaluates variable assignment
      */
-    std::any visit_assign_expr(std::shared_ptr<Assign> expr) override
+    std::any visit_assign_expr(Assign &expr)
     {
         // Evaluate right-hand side
-        std::any value = eval_expression(expr->expr_value);
+        std::any value = eval_expression(expr.expr_value);
 
         // Assign to variable in environment
-        current_env->assign(expr->var_name, value);
+        if (tracking_memory())
+        {
+            charge_assignment(expr.var_name, value);
+        }
+        current_env->assign(expr.var_name, value);
         return value;
     }
 
     /**
      * Evaluates a binary expression
      */
-    std::any visit_binary_expr(std::shared_ptr<Binary> expr) override
+    std::any visit_binary_expr(Binary &expr)
     {
         // Evaluate both operands
-        std::any left_value = eval_expression(expr->left_expr);
-        std::any right_value = eval_expression(expr->right_expr);
+        std::any left_value = eval_expression(expr.left_expr);
+        std::any right_value = eval_expression(expr.right_expr);
+
+        BinaryFeedback &feedback = expr.feedback;
+        if (specialisation_enabled)
+        {
+            // Specialised node: take the fast path while its guard holds
+            if (feedback.specialisation != BinarySpecialisation::GENERIC)
+            {
+                std::any result;
+                if (eval_specialised(feedback.specialisation, left_value, right_value, result,
+                                     expr.operator_token.line_number))
+                {
+                    return result;
+                }
+                feedback.deoptimise();
+            }
+
+            // Generic node: record the operand types and rewrite once stable
+            ValueKind left_kind = kind_of(left_value);
+            ValueKind right_kind = kind_of(right_value);
+            if (feedback.observe(left_kind, right_kind))
+            {
+                feedback.specialisation = choose_specialisation(
+                    expr.operator_token.type, left_kind, right_kind);
+            }
+        }
 
         // Process according to operator type
-        switch (expr->operator_token.type)
+        switch (expr.operator_token.type)
         {
         // Comparison operators
         case GREATER:
-            validate_number_operands(expr->operator_token, left_value, right_value);
+            validate_number_operands(expr.operator_token, left_value, right_value);
             return std::any_cast<double>(left_value) > std::any_cast<double>(right_value);
 
         case GREATER_EQUAL:
-            validate_number_operands(expr->operator_token, left_value, right_value);
+            validate_number_operands(expr.operator_token, left_value, right_value);
             return std::any_cast<double>(left_value) >= std::any_cast<double>(right_value);
 
         case LESS:
-            validate_number_operands(expr->operator_token, left_value, right_value);
+            validate_number_operands(expr.operator_token, left_value, right_value);
             return std::any_cast<double>(left_value) < std::any_cast<double>(right_value);
 
         case LESS_EQUAL:
-            validate_number_operands(expr->operator_token, left_value, right_value);
+            validate_number_operands(expr.operator_token, left_value, right_value);
             return std::any_cast<double>(left_value) <= std::any_cast<double>(right_value);
 
         // Equality operators
@@ -362,15 +1208,15 @@ public:
 
         // Arithmetic operators
         case MINUS:
-            validate_number_operands(expr->operator_token, left_value, right_value);
+            validate_number_operands(expr.operator_token, left_value, right_value);
             return std::any_cast<double>(left_value) - std::any_cast<double>(right_value);
 
         case SLASH:
-            validate_number_operands(expr->operator_token, left_value, right_value);
+            validate_number_operands(expr.operator_token, left_value, right_value);
             return std::any_cast<double>(left_value) / std::any_cast<double>(right_value);
 
         case STAR:
-            validate_number_operands(expr->operator_token, left_value, right_value);
+            validate_number_operands(expr.operator_token, left_value, right_value);
             return std::any_cast<double>(left_value) * std::any_cast<double>(right_value);
 
         case PLUS:
@@ -383,11 +1229,23 @@ public:
             // Handle string concatenation
             if (left_value.type() == typeid(std::string) && right_value.type() == typeid(std::string))
             {
-                return std::any_cast<std::string>(left_value) + std::any_cast<std::string>(right_value);
+                // Refuse to build a string that would not fit under the memory cap
+                if (tracking_memory())
+                {
+                    governor.check_allocation(std::any_cast<std::string &>(left_value).size() +
+                                                  std::any_cast<std::string &>(right_value).size(),
+                                              expr.operator_token.line_number);
+                }
+                std::string joined;
+                {
+                    MemoryScope memory_scope{MemoryCategory::STRINGS};
+                    joined = std::any_cast<std::string &>(left_value) + std::any_cast<std::string &>(right_value);
+                }
+                return joined;
             }
 
             // Error for invalid operands
-            throw RuntimeError{expr->operator_token, "Operands must be two numbers or two strings."};
+            throw RuntimeError{expr.operator_token, "Operands must be two numbers or two strings."};
         }
 
         // Unreachable, but needed to avoid compiler warnings
@@ -397,29 +1255,31 @@ public:
     /**
      * Evaluates a grouping expression
      */
-    std::any visit_grouping_expr(std::shared_ptr<Grouping> expr) override
+    std::any visit_grouping_expr(Grouping &expr)
     {
-        return eval_expression(expr->inner_expr);
+        return eval_expression(expr.inner_expr);
     }
 
     /**
      * Evaluates a literal value
      */
-    std::any visit_literal_expr(std::shared_ptr<Literal> expr) override
+    std::any visit_literal_expr(Literal &expr)
     {
-        return expr->literal_value;
+        std::any value = expr.literal_value;
+        memory_tracker.charge_string(value);
+        return value;
     }
 
     /**
      * Evaluates a logical expression with short-circuit evaluation
      */
-    std::any visit_logical_expr(std::shared_ptr<Logical> expr) override
+    std::any visit_logical_expr(Logical &expr)
     {
         // Evaluate left operand first
-        std::any left_result = eval_expression(expr->left_expr);
+        std::any left_result = eval_expression(expr.left_expr);
 
         // Short-circuit based on operator type
-        if (expr->operator_token.type == OR)
+        if (expr.operator_token.type == OR)
         {
             // For OR, if left is truthy, return it without evaluating right
             if (is_truthy(left_result))
@@ -437,19 +1297,19 @@ public:
         }
 
         // Otherwise evaluate and return right operand
-        return eval_expression(expr->right_expr);
+        return eval_expression(expr.right_expr);
     }
 
     /**
      * Evaluates a unary expression
      */
-    std::any visit_unary_expr(std::shared_ptr<Unary> expr) override
+    std::any visit_unary_expr(Unary &expr)
     {
         // Evaluate the operand
-        std::any operand_value = eval_expression(expr->operand);
+        std::any operand_value = eval_expression(expr.operand);
 
         // Apply the unary operator
-        switch (expr->operator_token.type)
+        switch (expr.operator_token.type)
         {
         case BANG:
             // Logical NOT
@@ -457,7 +1317,7 @@ public:
 
         case MINUS:
             // Numeric negation
-            validate_number_operand(expr->operator_token, operand_value);
+            validate_number_operand(expr.operator_token, operand_value);
             return -std::any_cast<double>(operand_value);
         }
 
@@ -468,8 +1328,51 @@ public:
     /**
      * Evaluates a variable reference
      */
-    std::any visit_variable_expr(std::shared_ptr<Variable> expr) override
+    std::any visit_variable_expr(Variable &expr)
     {
-        return current_env->get(expr->var_name);
+        if (!specialisation_enabled)
+        {
+            return current_env->get(expr.var_name);
+        }
+
+        VariableFeedback &feedback = expr.feedback;
+        const std::string &name = expr.var_name.lexeme;
+
+        // Specialised node: look only in the scope the variable has been found in.
+        // Bindings are lexical and declarations run in source order, so a hit
+        // at the cached depth is the binding a full walk would have found.
+        if (feedback.cached_depth >= 0)
+        {
+            if (std::any *value = current_env->find_at(feedback.cached_depth, name))
+            {
+                std::any copy = *value;
+                memory_tracker.charge_string(copy);
+                return copy;
+            }
+            feedback.deoptimise();
+        }
+
+        // Generic node: walk the scope chain and record the depth
+        int depth = 0;
+        std::any *value = current_env->find(name, depth);
+        if (value == nullptr)
+        {
+            // Report the undefined variable
+            return current_env->get(expr.var_name);
+        }
+
+        if (feedback.observe(depth))
+        {
+            feedback.cached_depth = depth;
+        }
+        std::any copy = *value;
+        memory_tracker.charge_string(copy);
+        return copy;
     }
 };
+
+// The interpreter used to run scripts
+using Interpreter = BasicInterpreter<false>;
+
+// Interpreter that records per-node heat, for -v --heat
+using HeatCountingInterpreter = BasicInterpreter<true>;
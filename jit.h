@@ -0,0 +1,800 @@
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "environment.h"
+#include "expr.h"
+#include "output_sink.h"
+#include "scope_resolver.h"
+#include "stmt.h"
+#include "value.h"
+
+// The JIT emits x86-64 System V code into mmap'd memory
+#if defined(__x86_64__) && defined(__linux__)
+#define PRISM_JIT_AVAILABLE 1
+#include <sys/mman.h>
+#endif
+
+/**
+ * Native code for one hot While loop, plus the variables it reads and writes
+ *
+ * The code runs the loop to completion on an array of doubles: variables
+ * from enclosing scopes come first, followed by locals declared inside the
+ * loop body. Every value the code touches is a number, so once the entry
+ * guard has checked the enclosing variables no type can change mid-loop.
+ */
+struct CompiledLoop
+{
+    // Signature of the generated function
+    using Entry = void (*)(double *slots);
+
+    Entry entry = nullptr;
+    void *memory = nullptr;
+    size_t memory_size = 0;
+
+    // Variables from enclosing scopes, in slot order
+    std::vector<std::string> outer_names;
+
+    // Total slots, including locals declared in the body
+    size_t slot_count = 0;
+
+    CompiledLoop() = default;
+    CompiledLoop(const CompiledLoop &) = delete;
+    CompiledLoop &operator=(const CompiledLoop &) = delete;
+
+    ~CompiledLoop()
+    {
+#ifdef PRISM_JIT_AVAILABLE
+        if (memory != nullptr)
+        {
+            munmap(memory, memory_size);
+        }
+#endif
+    }
+
+    /**
+     * Runs the loop if every enclosing variable currently holds a number
+     * @return false if the type guard failed and nothing was executed
+     */
+    bool run(Environment &env)
+    {
+        std::vector<std::any *> storage(outer_names.size());
+        std::vector<double> slots(slot_count);
+
+        // Type guard: all enclosing variables must be defined numbers
+        for (size_t i = 0; i < outer_names.size(); i++)
+        {
+            int depth = 0;
+            storage[i] = env.find(outer_names[i], depth);
+            const double *number = storage[i] != nullptr
+                                       ? std::any_cast<double>(storage[i])
+                                       : nullptr;
+            if (number == nullptr)
+            {
+                return false;
+            }
+            slots[i] = *number;
+        }
+
+        entry(slots.data());
+
+        // Write the final values back to the environment
+        for (size_t i = 0; i < outer_names.size(); i++)
+        {
+            *storage[i] = slots[i];
+        }
+        return true;
+    }
+};
+
+/**
+ * Called from generated code to print a number like the interpreter does
+ */
+inline void jit_print_number(double value)
+{
+    standard_output().print_number(value);
+}
+
+/**
+ * Minimal x86-64 assembler for the instructions the loop JIT needs
+ *
+ * Values are computed in xmm0, with xmm1 as the second operand; rbx holds
+ * the slot array and intermediate results are spilled to the native stack.
+ */
+class X86Assembler
+{
+public:
+    // Condition codes for Jcc, as the low nibble of the 0x0F 0x8? opcode
+    enum Condition : uint8_t
+    {
+        BELOW = 0x2,
+        ABOVE_EQUAL = 0x3,
+        EQUAL = 0x4,
+        NOT_EQUAL = 0x5,
+        BELOW_EQUAL = 0x6,
+        ABOVE = 0x7,
+        PARITY = 0xA,
+    };
+
+    // A jump target: unresolved jumps are patched when it is bound
+    struct Label
+    {
+        long position = -1;
+        std::vector<size_t> patch_sites;
+    };
+
+    std::vector<uint8_t> code;
+
+    void bytes(std::initializer_list<uint8_t> values)
+    {
+        code.insert(code.end(), values);
+    }
+
+    void u32(uint32_t value)
+    {
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            code.push_back((value >> shift) & 0xff);
+        }
+    }
+
+    void u64(uint64_t value)
+    {
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            code.push_back((value >> shift) & 0xff);
+        }
+    }
+
+    // Function frame: keep rbx and a 16-byte aligned stack for calls
+    void prologue()
+    {
+        bytes({0x53});             // push rbx
+        bytes({0x48, 0x89, 0xFB}); // mov rbx, rdi
+    }
+
+    void epilogue()
+    {
+        bytes({0x5B}); // pop rbx
+        bytes({0xC3}); // ret
+    }
+
+    // movsd xmm0, [rbx + disp32]; returns the offset of disp32
+    size_t load_slot(uint32_t offset)
+    {
+        bytes({0xF2, 0x0F, 0x10, 0x83});
+        u32(offset);
+        return code.size() - 4;
+    }
+
+    // movsd [rbx + disp32], xmm0; returns the offset of disp32
+    size_t store_slot(uint32_t offset)
+    {
+        bytes({0xF2, 0x0F, 0x11, 0x83});
+        u32(offset);
+        return code.size() - 4;
+    }
+
+    // xmm0 = constant, via rax
+    void load_constant(double value)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        bytes({0x48, 0xB8}); // mov rax, imm64
+        u64(bits);
+        bytes({0x66, 0x48, 0x0F, 0x6E, 0xC0}); // movq xmm0, rax
+    }
+
+    // Push xmm0 to the native stack, keeping 16-byte alignment
+    void spill()
+    {
+        bytes({0x48, 0x83, 0xEC, 0x10});       // sub rsp, 16
+        bytes({0xF2, 0x0F, 0x11, 0x04, 0x24}); // movsd [rsp], xmm0
+    }
+
+    // xmm1 = xmm0, then pop the spilled value into xmm0
+    void unspill_left()
+    {
+        bytes({0x66, 0x0F, 0x28, 0xC8});       // movapd xmm1, xmm0
+        bytes({0xF2, 0x0F, 0x10, 0x04, 0x24}); // movsd xmm0, [rsp]
+        bytes({0x48, 0x83, 0xC4, 0x10});       // add rsp, 16
+    }
+
+    void add()
+    {
+        bytes({0xF2, 0x0F, 0x58, 0xC1}); // addsd xmm0, xmm1
+    }
+
+    void subtract()
+    {
+        bytes({0xF2, 0x0F, 0x5C, 0xC1}); // subsd xmm0, xmm1
+    }
+
+    void multiply()
+    {
+        bytes({0xF2, 0x0F, 0x59, 0xC1}); // mulsd xmm0, xmm1
+    }
+
+    void divide()
+    {
+        bytes({0xF2, 0x0F, 0x5E, 0xC1}); // divsd xmm0, xmm1
+    }
+
+    // Flip the sign bit of xmm0, so -0.0 behaves as in C++
+    void negate()
+    {
+        bytes({0x48, 0xB8}); // mov rax, sign mask
+        u64(0x8000000000000000ull);
+        bytes({0x66, 0x48, 0x0F, 0x6E, 0xC8}); // movq xmm1, rax
+        bytes({0x66, 0x0F, 0x57, 0xC1});       // xorpd xmm0, xmm1
+    }
+
+    // Compare xmm0 with xmm1, or xmm1 with xmm0 when swapped
+    void compare(bool swapped)
+    {
+        if (swapped)
+        {
+            bytes({0x66, 0x0F, 0x2E, 0xC8}); // ucomisd xmm1, xmm0
+        }
+        else
+        {
+            bytes({0x66, 0x0F, 0x2E, 0xC1}); // ucomisd xmm0, xmm1
+        }
+    }
+
+    // Call a function whose only argument is already in xmm0
+    void call(const void *function)
+    {
+        bytes({0x48, 0xB8}); // mov rax, imm64
+        u64(reinterpret_cast<uint64_t>(function));
+        bytes({0xFF, 0xD0}); // call rax
+    }
+
+    void jump(Label &target)
+    {
+        bytes({0xE9});
+        emit_target(target);
+    }
+
+    void jump_if(Condition condition, Label &target)
+    {
+        bytes({0x0F, static_cast<uint8_t>(0x80 | condition)});
+        emit_target(target);
+    }
+
+    void bind(Label &label)
+    {
+        label.position = static_cast<long>(code.size());
+        for (size_t site : label.patch_sites)
+        {
+            patch_rel32(site, label.position);
+        }
+        label.patch_sites.clear();
+    }
+
+private:
+    void emit_target(Label &target)
+    {
+        size_t site = code.size();
+        u32(0);
+        if (target.position >= 0)
+        {
+            patch_rel32(site, target.position);
+        }
+        else
+        {
+            target.patch_sites.push_back(site);
+        }
+    }
+
+    void patch_rel32(size_t site, long target)
+    {
+        int32_t relative = static_cast<int32_t>(target - static_cast<long>(site + 4));
+        std::memcpy(&code[site], &relative, sizeof(relative));
+    }
+};
+
+/**
+ * Baseline JIT that compiles hot numeric While loops to native code
+ *
+ * A loop qualifies when its condition and body only use numbers:
+ * variables, number literals, arithmetic, comparisons, logical operators
+ * in conditions, assignments, print, if/while, blocks and numeric local
+ * declarations. Anything else makes compilation fail and the loop stays
+ * interpreted.
+ */
+class LoopCompiler : public ExprVisitor, public StmtVisitor
+{
+private:
+    // Thrown when the loop uses something the JIT does not support
+    struct Unsupported
+    {
+    };
+
+    using Label = X86Assembler::Label;
+
+    X86Assembler assembler;
+    ScopeResolver scopes;
+
+    // Enclosing-scope variables, by name and in slot order
+    std::map<std::string, uint32_t> outer_slots;
+    std::vector<std::string> outer_names;
+
+    // Displacements of body-local slots, fixed up once outer_names is final
+    std::vector<std::pair<size_t, uint32_t>> local_patches;
+
+    //---------------------------------------------
+    // Variable slots
+    //---------------------------------------------
+
+    uint32_t outer_slot(const std::string &name)
+    {
+        auto iter = outer_slots.find(name);
+        if (iter != outer_slots.end())
+        {
+            return iter->second;
+        }
+        uint32_t slot = static_cast<uint32_t>(outer_names.size());
+        outer_slots.emplace(name, slot);
+        outer_names.push_back(name);
+        return slot;
+    }
+
+    void load_variable(const std::string &name)
+    {
+        int local = scopes.resolve(name);
+        if (local >= 0)
+        {
+            local_patches.emplace_back(assembler.load_slot(0), local);
+        }
+        else
+        {
+            assembler.load_slot(outer_slot(name) * sizeof(double));
+        }
+    }
+
+    void store_variable(const std::string &name)
+    {
+        int local = scopes.resolve(name);
+        if (local >= 0)
+        {
+            local_patches.emplace_back(assembler.store_slot(0), local);
+        }
+        else
+        {
+            assembler.store_slot(outer_slot(name) * sizeof(double));
+        }
+    }
+
+    //---------------------------------------------
+    // Code generation
+    //---------------------------------------------
+
+    /**
+     * Emits code leaving a numeric expression's value in xmm0
+     */
+    void emit_number(const std::shared_ptr<Expr> &expr)
+    {
+        expr->accept(*this);
+    }
+
+    /**
+     * Emits code that jumps to target when the condition's truthiness
+     * equals jump_when, and falls through otherwise
+     */
+    void emit_branch(const std::shared_ptr<Expr> &expr, bool jump_when, Label &target)
+    {
+        // Look through parentheses
+        if (auto grouping = std::dynamic_pointer_cast<Grouping>(expr))
+        {
+            emit_branch(grouping->inner_expr, jump_when, target);
+            return;
+        }
+
+        // Boolean literals are constant conditions
+        if (auto literal = std::dynamic_pointer_cast<Literal>(expr))
+        {
+            if (literal->literal_value.type() == typeid(bool))
+            {
+                if (std::any_cast<bool>(literal->literal_value) == jump_when)
+                {
+                    assembler.jump(target);
+                }
+                return;
+            }
+        }
+
+        // Negation swaps the sense of the branch
+        if (auto unary = std::dynamic_pointer_cast<Unary>(expr))
+        {
+            if (unary->operator_token.type == BANG)
+            {
+                emit_branch(unary->operand, !jump_when, target);
+                return;
+            }
+        }
+
+        // Short-circuit operators: the result is truthy exactly when the
+        // operand it returns is truthy
+        if (auto logical = std::dynamic_pointer_cast<Logical>(expr))
+        {
+            bool is_or = logical->operator_token.type == OR;
+            if (is_or == jump_when)
+            {
+                emit_branch(logical->left_expr, jump_when, target);
+                emit_branch(logical->right_expr, jump_when, target);
+            }
+            else
+            {
+                Label skip;
+                emit_branch(logical->left_expr, !jump_when, skip);
+                emit_branch(logical->right_expr, jump_when, target);
+                assembler.bind(skip);
+            }
+            return;
+        }
+
+        if (auto binary = std::dynamic_pointer_cast<Binary>(expr))
+        {
+            if (emit_comparison(*binary, jump_when, target))
+            {
+                return;
+            }
+        }
+
+        // Any other expression must be numeric, and numbers are truthy
+        emit_number(expr);
+        if (jump_when)
+        {
+            assembler.jump(target);
+        }
+    }
+
+    /**
+     * Emits a numeric comparison branch; returns false for non-comparisons
+     */
+    bool emit_comparison(const Binary &binary, bool jump_when, Label &target)
+    {
+        TokenType op = binary.operator_token.type;
+        bool is_comparison = op == GREATER || op == GREATER_EQUAL ||
+                             op == LESS || op == LESS_EQUAL ||
+                             op == EQUAL_EQUAL || op == BANG_EQUAL;
+        if (!is_comparison)
+        {
+            return false;
+        }
+
+        emit_number(binary.left_expr);
+        assembler.spill();
+        emit_number(binary.right_expr);
+        assembler.unspill_left();
+
+        // ucomisd reports unordered (NaN) as ZF=PF=CF=1, which must make
+        // every comparison except != false
+        using X = X86Assembler;
+        switch (op)
+        {
+        case GREATER:
+            assembler.compare(false);
+            assembler.jump_if(jump_when ? X::ABOVE : X::BELOW_EQUAL, target);
+            break;
+        case GREATER_EQUAL:
+            assembler.compare(false);
+            assembler.jump_if(jump_when ? X::ABOVE_EQUAL : X::BELOW, target);
+            break;
+        case LESS:
+            assembler.compare(true);
+            assembler.jump_if(jump_when ? X::ABOVE : X::BELOW_EQUAL, target);
+            break;
+        case LESS_EQUAL:
+            assembler.compare(true);
+            assembler.jump_if(jump_when ? X::ABOVE_EQUAL : X::BELOW, target);
+            break;
+        default:
+        {
+            // Equal means ZF=1 and PF=0
+            assembler.compare(false);
+            bool jump_on_equal = (op == EQUAL_EQUAL) == jump_when;
+            if (jump_on_equal)
+            {
+                Label skip;
+                assembler.jump_if(X::PARITY, skip);
+                assembler.jump_if(X::EQUAL, target);
+                assembler.bind(skip);
+            }
+            else
+            {
+                assembler.jump_if(X::PARITY, target);
+                assembler.jump_if(X::NOT_EQUAL, target);
+            }
+            break;
+        }
+        }
+        return true;
+    }
+
+    void emit_stmt(const std::shared_ptr<Stmt> &stmt)
+    {
+        stmt->accept(*this);
+    }
+
+    /**
+     * Emits a complete loop: test the condition, run the body, repeat
+     */
+    void emit_loop(const While &loop)
+    {
+        Label top;
+        Label exit;
+        assembler.bind(top);
+        emit_branch(loop.condition, false, exit);
+        emit_stmt(loop.body);
+        assembler.jump(top);
+        assembler.bind(exit);
+    }
+
+public:
+    /**
+     * Compiles a While loop, or returns nullptr if it is not supported
+     */
+    std::shared_ptr<CompiledLoop> compile(const While &loop)
+    {
+#ifdef PRISM_JIT_AVAILABLE
+        try
+        {
+            assembler.prologue();
+            emit_loop(loop);
+            assembler.epilogue();
+        }
+        catch (Unsupported &)
+        {
+            return nullptr;
+        }
+
+        // Locals follow the enclosing variables in the slot array
+        for (const auto &[site, local] : local_patches)
+        {
+            uint32_t offset = static_cast<uint32_t>((outer_names.size() + local) * sizeof(double));
+            std::memcpy(&assembler.code[site], &offset, sizeof(offset));
+        }
+
+        auto compiled = std::make_shared<CompiledLoop>();
+        compiled->memory_size = assembler.code.size();
+        compiled->memory = mmap(nullptr, compiled->memory_size, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (compiled->memory == MAP_FAILED)
+        {
+            compiled->memory = nullptr;
+            return nullptr;
+        }
+
+        // Copy the code in, then make the page executable but not writable
+        std::memcpy(compiled->memory, assembler.code.data(), assembler.code.size());
+        if (mprotect(compiled->memory, compiled->memory_size, PROT_READ | PROT_EXEC) != 0)
+        {
+            return nullptr;
+        }
+
+        compiled->entry = reinterpret_cast<CompiledLoop::Entry>(compiled->memory);
+        compiled->outer_names = outer_names;
+        compiled->slot_count = outer_names.size() + scopes.slot_count();
+        return compiled;
+#else
+        // No native backend on this platform: keep interpreting
+        return nullptr;
+#endif
+    }
+
+    //-----------------------------------------------
+    // Statement Visitor Methods
+    //-----------------------------------------------
+
+    std::any visit_block_stmt(std::shared_ptr<Block> stmt) override
+    {
+        scopes.begin_scope();
+        for (const auto &statement : stmt->body())
+        {
+            emit_stmt(statement);
+        }
+        scopes.end_scope();
+        return {};
+    }
+
+    std::any visit_expression_stmt(std::shared_ptr<Expression> stmt) override
+    {
+        emit_number(stmt->expression);
+        return {};
+    }
+
+    std::any visit_if_stmt(std::shared_ptr<If> stmt) override
+    {
+        Label else_label;
+        Label end_label;
+
+        emit_branch(stmt->condition, false, else_label);
+        emit_stmt(stmt->then_branch);
+
+        if (stmt->else_branch != nullptr)
+        {
+            assembler.jump(end_label);
+            assembler.bind(else_label);
+            emit_stmt(stmt->else_branch);
+        }
+        else
+        {
+            assembler.bind(else_label);
+        }
+        assembler.bind(end_label);
+        return {};
+    }
+
+    std::any visit_print_stmt(std::shared_ptr<Print> stmt) override
+    {
+        emit_number(stmt->expression);
+        assembler.call(reinterpret_cast<const void *>(&jit_print_number));
+        return {};
+    }
+
+    std::any visit_var_stmt(std::shared_ptr<Var> stmt) override
+    {
+        // Locals must start out as numbers; nil would change type later
+        if (stmt->initialiser == nullptr || scopes.is_global_scope())
+        {
+            throw Unsupported{};
+        }
+
+        emit_number(stmt->initialiser);
+        scopes.declare(stmt->name.lexeme);
+        store_variable(stmt->name.lexeme);
+        return {};
+    }
+
+    std::any visit_while_stmt(std::shared_ptr<While> stmt) override
+    {
+        emit_loop(*stmt);
+        return {};
+    }
+
+    //-----------------------------------------------
+    // Expression Visitor Methods (numeric context)
+    //-----------------------------------------------
+
+    std::any visit_assign_expr(std::shared_ptr<Assign> expr) override
+    {
+        emit_number(expr->expr_value);
+        store_variable(expr->var_name.lexeme);
+        return {};
+    }
+
+    std::any visit_binary_expr(std::shared_ptr<Binary> expr) override
+    {
+        TokenType op = expr->operator_token.type;
+        if (op != PLUS && op != MINUS && op != STAR && op != SLASH)
+        {
+            // Comparisons produce booleans, which are only allowed as conditions
+            throw Unsupported{};
+        }
+
+        emit_number(expr->left_expr);
+        assembler.spill();
+        emit_number(expr->right_expr);
+        assembler.unspill_left();
+
+        switch (op)
+        {
+        case PLUS:
+            assembler.add();
+            break;
+        case MINUS:
+            assembler.subtract();
+            break;
+        case STAR:
+            assembler.multiply();
+            break;
+        default:
+            assembler.divide();
+            break;
+        }
+        return {};
+    }
+
+    std::any visit_grouping_expr(std::shared_ptr<Grouping> expr) override
+    {
+        emit_number(expr->inner_expr);
+        return {};
+    }
+
+    std::any visit_literal_expr(std::shared_ptr<Literal> expr) override
+    {
+        if (expr->literal_value.type() != typeid(double))
+        {
+            throw Unsupported{};
+        }
+        assembler.load_constant(std::any_cast<double>(expr->literal_value));
+        return {};
+    }
+
+    std::any visit_logical_expr(std::shared_ptr<Logical>) override
+    {
+        // Only supported as a condition, see emit_branch
+        throw Unsupported{};
+    }
+
+    std::any visit_unary_expr(std::shared_ptr<Unary> expr) override
+    {
+        if (expr->operator_token.type != MINUS)
+        {
+            throw Unsupported{};
+        }
+        emit_number(expr->operand);
+        assembler.negate();
+        return {};
+    }
+
+    std::any visit_variable_expr(std::shared_ptr<Variable> expr) override
+    {
+        load_variable(expr->var_name.lexeme);
+        return {};
+    }
+};
+
+/**
+ * Per-interpreter loop JIT: counts iterations and runs compiled loops
+ */
+class LoopJit
+{
+private:
+    // Iterations a loop must run before it is compiled
+    uint32_t threshold = 1000;
+
+    // Failed entry guards after which a loop is left to the interpreter
+    static constexpr uint8_t MAX_GUARD_FAILURES = 4;
+
+public:
+    void set_threshold(uint32_t iterations)
+    {
+        threshold = iterations;
+    }
+
+    /**
+     * Called at the top of each interpreted iteration of a While loop
+     * @return true if native code ran the rest of the loop
+     */
+    bool try_run(While &loop, Environment &env)
+    {
+        LoopFeedback &feedback = loop.feedback;
+        if (feedback.rejected || feedback.iterations < threshold)
+        {
+            return false;
+        }
+
+        if (feedback.compiled == nullptr)
+        {
+            feedback.compiled = LoopCompiler{}.compile(loop);
+            if (feedback.compiled == nullptr)
+            {
+                feedback.rejected = true;
+                return false;
+            }
+        }
+
+        if (feedback.compiled->run(env))
+        {
+            return true;
+        }
+
+        // Guard failed: interpret for a while before trying again
+        feedback.iterations = 0;
+        if (++feedback.guard_failures >= MAX_GUARD_FAILURES)
+        {
+            feedback.rejected = true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,157 @@
+#include "libprism.h"
+
+#include <any>
+#include <exception>
+#include <sstream>
+#include "error.h"
+#include "interpreter.h"
+#include "lexer.h"
+#include "parser.h"
+
+namespace prism
+{
+    //---------------------------------------------
+    // Program
+    //---------------------------------------------
+
+    struct Program::Impl
+    {
+        std::vector<std::shared_ptr<Stmt>> statements;
+    };
+
+    Program::Program() = default;
+
+    CompileResult Program::compile(std::string_view source)
+    {
+        CompileResult result;
+        ErrorReporter reporter{result.diagnostics};
+        ErrorReportingScope reporting_scope{reporter};
+
+        std::vector<Token> tokens = Lexer{source}.scan_tokens();
+        Parser parser{tokens};
+        std::vector<std::shared_ptr<Stmt>> statements = parser.parse();
+
+        if (!reporter.had_error)
+        {
+            result.program.impl = std::make_shared<const Impl>(Impl{std::move(statements)});
+        }
+        return result;
+    }
+
+    size_t Program::statement_count() const
+    {
+        return impl == nullptr ? 0 : impl->statements.size();
+    }
+
+    //---------------------------------------------
+    // Context
+    //---------------------------------------------
+
+    struct Context::Impl
+    {
+        // Output kept for take_output() when no stream was given
+        std::ostringstream kept_output;
+        std::ostream &output;
+
+        ResourceLimits limits;
+        std::unique_ptr<Interpreter> interpreter;
+
+        explicit Impl(std::ostream *stream) : output{stream != nullptr ? *stream : kept_output}
+        {
+            reset();
+        }
+
+        /**
+         * Replaces the interpreter, and with it the globals
+         */
+        void reset()
+        {
+            interpreter = std::make_unique<Interpreter>();
+
+            // Programs are shared between threads, so the syntax tree must not
+            // be rewritten with type feedback while running
+            interpreter->set_specialisation(false);
+            interpreter->capture_output(output);
+            interpreter->set_limits(limits);
+        }
+    };
+
+    Context::Context() : impl{std::make_unique<Impl>(nullptr)}
+    {
+    }
+
+    Context::Context(std::ostream &output) : impl{std::make_unique<Impl>(&output)}
+    {
+    }
+
+    Context::~Context() = default;
+    Context::Context(Context &&) noexcept = default;
+    Context &Context::operator=(Context &&) noexcept = default;
+
+    RunResult Context::run(const Program &program)
+    {
+        RunResult result;
+        if (program.impl == nullptr)
+        {
+            return result;
+        }
+
+        ErrorReporter reporter{result.diagnostics};
+        ErrorReportingScope reporting_scope{reporter};
+        try
+        {
+            impl->interpreter->interpret(program.impl->statements);
+        }
+        catch (const std::exception &failure)
+        {
+            // Such as running out of memory; reported like a runtime error without a line
+            result.diagnostics.push_back(Diagnostic{Diagnostic::Kind::RUNTIME, 0, "", failure.what()});
+        }
+        return result;
+    }
+
+    RunResult Context::run(const Program &program, const Inputs &inputs)
+    {
+        impl->interpreter->reset_globals();
+        for (const auto &[name, value] : inputs)
+        {
+            try
+            {
+                impl->interpreter->define_global(name, std::visit([](const auto &held)
+                                                                  { return std::any{held}; },
+                                                                  value));
+            }
+            catch (const RuntimeError &error)
+            {
+                // Only the memory limit can refuse an input
+                RunResult result;
+                result.diagnostics.push_back(Diagnostic{Diagnostic::Kind::RUNTIME, 0, "", error.what()});
+                return result;
+            }
+        }
+        return run(program);
+    }
+
+    std::string Context::take_output()
+    {
+        std::string output = impl->kept_output.str();
+        impl->kept_output.str("");
+        return output;
+    }
+
+    void Context::set_limits(const Limits &limits)
+    {
+        impl->limits = ResourceLimits{limits.max_steps, limits.time_limit, limits.max_memory_bytes};
+        impl->interpreter->set_limits(impl->limits);
+    }
+
+    void Context::cancel()
+    {
+        impl->interpreter->cancel();
+    }
+
+    void Context::reset()
+    {
+        impl->reset();
+    }
+}
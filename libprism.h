@@ -0,0 +1,172 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "diagnostic.h"
+
+/**
+ * libprism: runs Prism from a host program
+ *
+ * A Program is compiled once and never changes afterwards, so one Program
+ * can be run by any number of threads at the same time. Each thread runs it
+ * in its own Context, which holds the globals, printed output and limits
+ * for its runs. Errors are returned as Diagnostics instead of being printed.
+ *
+ *     prism::CompileResult compiled = prism::Program::compile("print 1 + 2;");
+ *     prism::Context context;
+ *     prism::RunResult result = context.run(compiled.program);
+ *     std::string output = context.take_output();    // "3.000000\n"
+ *
+ * The API lives in its own namespace so it cannot clash with names in the
+ * host; only this header and diagnostic.h need to be included. The one
+ * exception is Diagnostic, which the interpreter reports its own errors
+ * with, so it is declared globally and named here as prism::Diagnostic.
+ */
+namespace prism
+{
+    struct CompileResult;
+
+    // One syntax or runtime error, as data rather than text
+    using Diagnostic = ::Diagnostic;
+
+    // A Prism value: nil, a boolean, a number or a string
+    using Value = std::variant<std::nullptr_t, bool, double, std::string>;
+
+    // Globals defined before a run, by name
+    using Inputs = std::vector<std::pair<std::string, Value>>;
+
+    /**
+     * A parsed program, immutable and cheap to copy
+     * Copies share one syntax tree, which is freed with the last copy
+     */
+    class Program
+    {
+    private:
+        struct Impl;
+        std::shared_ptr<const Impl> impl;
+
+        friend class Context;
+
+    public:
+        /**
+         * An empty program; running it does nothing
+         */
+        Program();
+
+        /**
+         * Lexes and parses source; on syntax errors the program is empty
+         * Safe to call from several threads at once
+         */
+        static CompileResult compile(std::string_view source);
+
+        /**
+         * Number of top-level statements
+         */
+        size_t statement_count() const;
+    };
+
+    struct CompileResult
+    {
+        Program program;
+        std::vector<Diagnostic> diagnostics;
+
+        bool ok() const
+        {
+            return diagnostics.empty();
+        }
+    };
+
+    struct RunResult
+    {
+        // At most one runtime error, as a run stops at the first
+        std::vector<Diagnostic> diagnostics;
+
+        bool ok() const
+        {
+            return diagnostics.empty();
+        }
+    };
+
+    /**
+     * Limits on each run in a Context; zero means unlimited
+     * A run over a limit stops with a runtime Diagnostic
+     */
+    struct Limits
+    {
+        uint64_t max_steps = 0;
+        std::chrono::milliseconds time_limit{0};
+        size_t max_memory_bytes = 0;
+    };
+
+    /**
+     * Where Programs run: global variables, printed output and limits
+     *
+     * A Context is used by one thread at a time, but any number of Contexts
+     * may run the same Program at once. Globals persist from one run to the
+     * next until reset(), so a host can run a setup Program and then others
+     * that use its variables.
+     */
+    class Context
+    {
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl;
+
+    public:
+        /**
+         * A Context that keeps printed output until take_output()
+         */
+        Context();
+
+        /**
+         * A Context that prints to the given stream, which must outlive it
+         */
+        explicit Context(std::ostream &output);
+
+        ~Context();
+        Context(Context &&) noexcept;
+        Context &operator=(Context &&) noexcept;
+
+        /**
+         * Runs a Program to completion, or until its first runtime error
+         */
+        RunResult run(const Program &program);
+
+        /**
+         * Runs a Program against fresh globals holding only the inputs
+         * Global storage is reused from the previous run, so running the
+         * same Program against many inputs allocates little beyond strings
+         */
+        RunResult run(const Program &program, const Inputs &inputs);
+
+        /**
+         * Output printed since the last call, when not printing to a stream
+         */
+        std::string take_output();
+
+        /**
+         * Applies limits to subsequent runs
+         */
+        void set_limits(const Limits &limits);
+
+        /**
+         * Stops the current run at its next step with a runtime Diagnostic,
+         * or the next run if none is in progress
+         * Safe to call from another thread
+         */
+        void cancel();
+
+        /**
+         * Forgets every global variable; output and limits are kept
+         */
+        void reset();
+    };
+}
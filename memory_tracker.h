@@ -0,0 +1,367 @@
+#pragma once
+
+#include <algorithm>
+#include <any>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "stmt.h"
+
+/**
+ * What an allocation was for, as charged by the memory report
+ */
+enum class MemoryCategory : uint8_t
+{
+    TOKENS,       // Token vectors and lexemes
+    AST,          // Statement and expression nodes, including lazily parsed bodies
+    ENVIRONMENTS, // Scopes and their variable maps
+    VALUES,       // std::any boxes
+    STRINGS,      // String payloads, wherever they were built or copied
+    OTHER
+};
+
+constexpr size_t MEMORY_CATEGORY_COUNT = 6;
+
+// Category this thread's allocations are charged to
+inline thread_local MemoryCategory current_memory_category = MemoryCategory::OTHER;
+
+/**
+ * Charges allocations made while it is alive to a category
+ */
+class MemoryScope
+{
+private:
+    MemoryCategory previous;
+
+public:
+    explicit MemoryScope(MemoryCategory category)
+        : previous{current_memory_category}
+    {
+        current_memory_category = category;
+    }
+
+    ~MemoryScope()
+    {
+        current_memory_category = previous;
+    }
+
+    MemoryScope(const MemoryScope &) = delete;
+    MemoryScope &operator=(const MemoryScope &) = delete;
+};
+
+/**
+ * Bytes and objects per category, and runtime allocations per source line
+ *
+ * prism replaces the global operator new and delete with versions that
+ * report to this tracker while it is enabled. Each live allocation is kept
+ * in a side table with its size, category and line, so frees can be
+ * charged back without changing the layout of any allocation; when the
+ * tracker is off the only cost is one test of a flag.
+ *
+ * Allocations charged to environments, values and strings are made by the
+ * interpreter and attributed to the line of the statement being executed.
+ * Copying a string value allocates its box and its buffer together, so the
+ * interpreter moves the buffer over to strings afterwards with charge_string.
+ */
+class MemoryTracker
+{
+private:
+    struct Allocation
+    {
+        size_t bytes;
+        MemoryCategory category;
+        int line;
+    };
+
+    struct CategoryStats
+    {
+        size_t live_bytes = 0;
+        size_t peak_bytes = 0;
+        size_t live_objects = 0;
+        size_t allocations = 0;
+        size_t allocated_bytes = 0;
+    };
+
+    struct LineStats
+    {
+        size_t allocations = 0;
+        size_t allocated_bytes = 0;
+        size_t live_bytes = 0;
+    };
+
+    // Read by every operator new and delete
+    std::atomic<bool> enabled{false};
+
+    // Set while the tracker itself allocates, so its own tables are not tracked
+    inline static thread_local bool recording = false;
+
+    std::mutex tracker_mutex;
+    std::unordered_map<void *, Allocation> live_allocations;
+    std::array<CategoryStats, MEMORY_CATEGORY_COUNT> categories{};
+    std::map<int, LineStats> lines;
+    size_t live_total = 0;
+    size_t peak_total = 0;
+
+    // Statement the interpreter is executing, for line attribution
+    const std::atomic<const Stmt *> *current_statement = nullptr;
+
+    static constexpr const char *category_names[MEMORY_CATEGORY_COUNT] = {
+        "tokens", "ast", "environments", "values", "strings", "other"};
+
+    static bool is_runtime(MemoryCategory category)
+    {
+        return category == MemoryCategory::ENVIRONMENTS || category == MemoryCategory::VALUES ||
+               category == MemoryCategory::STRINGS;
+    }
+
+public:
+    ~MemoryTracker()
+    {
+        // Static destructors that run later still free memory
+        enabled.store(false, std::memory_order_relaxed);
+    }
+
+    bool is_enabled() const
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Starts tracking, attributing runtime allocations to the given statement's line
+     */
+    void start(const std::atomic<const Stmt *> &executing)
+    {
+        current_statement = &executing;
+        enabled.store(true, std::memory_order_relaxed);
+    }
+
+    /**
+     * Stops tracking; the figures at this point are the final ones
+     */
+    void stop()
+    {
+        enabled.store(false, std::memory_order_relaxed);
+    }
+
+    /**
+     * Called by operator new after a successful allocation
+     */
+    void record_allocation(void *memory, size_t bytes)
+    {
+        if (recording)
+        {
+            return;
+        }
+        recording = true;
+
+        MemoryCategory category = current_memory_category;
+        int line = 0;
+        if (is_runtime(category))
+        {
+            const Stmt *statement = current_statement->load(std::memory_order_relaxed);
+            line = statement != nullptr ? statement->line_number : 0;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{tracker_mutex};
+            live_allocations[memory] = Allocation{bytes, category, line};
+
+            CategoryStats &stats = categories[static_cast<size_t>(category)];
+            stats.live_bytes += bytes;
+            stats.peak_bytes = std::max(stats.peak_bytes, stats.live_bytes);
+            stats.live_objects++;
+            stats.allocations++;
+            stats.allocated_bytes += bytes;
+
+            live_total += bytes;
+            peak_total = std::max(peak_total, live_total);
+
+            if (line != 0)
+            {
+                LineStats &line_stats = lines[line];
+                line_stats.allocations++;
+                line_stats.allocated_bytes += bytes;
+                line_stats.live_bytes += bytes;
+            }
+        }
+
+        recording = false;
+    }
+
+    /**
+     * Moves a live allocation, and its counts, over to another category
+     * Memory the tracker does not know of, such as a short string's inline buffer, is ignored
+     */
+    void recharge(const void *memory, MemoryCategory category)
+    {
+        std::lock_guard<std::mutex> lock{tracker_mutex};
+        auto found = live_allocations.find(const_cast<void *>(memory));
+        if (found == live_allocations.end() || found->second.category == category)
+        {
+            return;
+        }
+
+        Allocation &allocation = found->second;
+        CategoryStats &from = categories[static_cast<size_t>(allocation.category)];
+        from.live_bytes -= allocation.bytes;
+        from.live_objects--;
+        from.allocations--;
+        from.allocated_bytes -= allocation.bytes;
+
+        CategoryStats &to = categories[static_cast<size_t>(category)];
+        to.live_bytes += allocation.bytes;
+        to.peak_bytes = std::max(to.peak_bytes, to.live_bytes);
+        to.live_objects++;
+        to.allocations++;
+        to.allocated_bytes += allocation.bytes;
+        allocation.category = category;
+    }
+
+    /**
+     * Charges the buffer of a string value to strings rather than to the copy that made it
+     */
+    void charge_string(const std::any &value)
+    {
+        if (!is_enabled())
+        {
+            return;
+        }
+        if (const std::string *text = std::any_cast<std::string>(&value))
+        {
+            recharge(text->data(), MemoryCategory::STRINGS);
+        }
+    }
+
+    /**
+     * Called by operator delete before the memory is freed
+     * Memory allocated while the tracker was off is not in the table and is ignored
+     */
+    void record_free(void *memory)
+    {
+        if (recording)
+        {
+            return;
+        }
+        recording = true;
+
+        {
+            std::lock_guard<std::mutex> lock{tracker_mutex};
+            auto found = live_allocations.find(memory);
+            if (found != live_allocations.end())
+            {
+                const Allocation &allocation = found->second;
+                CategoryStats &stats = categories[static_cast<size_t>(allocation.category)];
+                stats.live_bytes -= allocation.bytes;
+                stats.live_objects--;
+                live_total -= allocation.bytes;
+                if (allocation.line != 0)
+                {
+                    lines[allocation.line].live_bytes -= allocation.bytes;
+                }
+                live_allocations.erase(found);
+            }
+        }
+
+        recording = false;
+    }
+
+    /**
+     * Writes the per-category figures and the lines that allocated most as a table
+     */
+    void write_table(std::ostream &out, std::string_view source)
+    {
+        std::lock_guard<std::mutex> lock{tracker_mutex};
+
+        char row[160];
+        out << "Memory report\n";
+        std::snprintf(row, sizeof(row), "%-14s %12s %12s %10s %12s %14s\n",
+                      "category", "peak bytes", "final bytes", "final objs", "allocations", "allocated bytes");
+        out << row;
+        for (size_t i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+        {
+            const CategoryStats &stats = categories[i];
+            std::snprintf(row, sizeof(row), "%-14s %12zu %12zu %10zu %12zu %14zu\n", category_names[i],
+                          stats.peak_bytes, stats.live_bytes, stats.live_objects, stats.allocations,
+                          stats.allocated_bytes);
+            out << row;
+        }
+        std::snprintf(row, sizeof(row), "%-14s %12zu %12zu\n", "total", peak_total, live_total);
+        out << row;
+
+        if (lines.empty())
+        {
+            return;
+        }
+
+        // Split the source into lines so each row can show its code
+        std::vector<std::string_view> source_lines;
+        for (size_t start = 0; start <= source.size();)
+        {
+            size_t end = std::min(source.find('\n', start), source.size());
+            source_lines.push_back(source.substr(start, end - start));
+            start = end + 1;
+        }
+
+        out << "\nRuntime allocations by line\n";
+        std::snprintf(row, sizeof(row), "%6s %12s %14s %12s  %s\n", "line", "allocations", "allocated bytes",
+                      "final bytes", "source");
+        out << row;
+        for (const auto &[line, stats] : lines)
+        {
+            std::snprintf(row, sizeof(row), "%6d %12zu %14zu %12zu  ", line, stats.allocations,
+                          stats.allocated_bytes, stats.live_bytes);
+            out << row;
+            if (line >= 1 && static_cast<size_t>(line) <= source_lines.size())
+            {
+                out << source_lines[line - 1];
+            }
+            out << '\n';
+        }
+    }
+
+    /**
+     * Writes the same figures as a JSON object, for tracking in CI
+     */
+    void write_json(std::ostream &out)
+    {
+        std::lock_guard<std::mutex> lock{tracker_mutex};
+
+        out << "{\n  \"categories\": {\n";
+        for (size_t i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+        {
+            const CategoryStats &stats = categories[i];
+            out << "    \"" << category_names[i] << "\": {"
+                << "\"peak_bytes\": " << stats.peak_bytes
+                << ", \"final_bytes\": " << stats.live_bytes
+                << ", \"final_objects\": " << stats.live_objects
+                << ", \"allocations\": " << stats.allocations
+                << ", \"allocated_bytes\": " << stats.allocated_bytes << "}"
+                << (i + 1 < MEMORY_CATEGORY_COUNT ? ",\n" : "\n");
+        }
+        out << "  },\n  \"total\": {\"peak_bytes\": " << peak_total << ", \"final_bytes\": " << live_total << "},\n";
+
+        out << "  \"lines\": [";
+        bool first = true;
+        for (const auto &[line, stats] : lines)
+        {
+            out << (first ? "\n" : ",\n") << "    {\"line\": " << line
+                << ", \"allocations\": " << stats.allocations
+                << ", \"allocated_bytes\": " << stats.allocated_bytes
+                << ", \"final_bytes\": " << stats.live_bytes << "}";
+            first = false;
+        }
+        out << (first ? "]\n}\n" : "\n  ]\n}\n");
+    }
+};
+
+// The tracker prism's operator new and delete report to
+inline MemoryTracker memory_tracker;
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * How often an AST node ran and how long it took, for the heat map
+ *
+ * Only recorded while the interpreter is counting heat; otherwise the
+ * fields stay zero and are never touched. Time is inclusive: a node's
+ * time covers the nodes below it.
+ */
+struct NodeHeat
+{
+    uint64_t executions = 0;
+    uint64_t nanoseconds = 0;
+};
@@ -0,0 +1,334 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <streambuf>
+#include <string_view>
+#include <thread>
+#include "value.h"
+
+/**
+ * Buffered writer for everything the interpreter prints to standard output
+ *
+ * Print statements format straight into a large preallocated buffer,
+ * without going through iostream. The sink also replaces std::cout's
+ * stream buffer, so other output written to std::cout stays in order with
+ * printed values. Because std::cerr is tied to std::cout, the sink is
+ * flushed before anything is written to stderr, such as a runtime error.
+ *
+ * The buffer is written out according to a FlushPolicy. With ASYNC, full
+ * buffers are handed through a single-producer single-consumer ring to a
+ * writer thread, and the interpreter carries on filling the next one.
+ */
+class OutputSink : public std::streambuf
+{
+public:
+    enum class FlushPolicy
+    {
+        LINE,  // Write out after every printed line
+        SIZE,  // Write out when the buffer is full
+        ASYNC  // Hand full buffers to a writer thread
+    };
+
+private:
+    // Size of each buffer; the room needed for one formatted number is far less
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    // Buffers in the ring; SIZE and LINE only use the first
+    static constexpr size_t RING_BUFFERS = 8;
+
+    // Longest formatted number: 309 integer digits, a point and 6 decimals
+    static constexpr size_t MAX_NUMBER_LENGTH = 320;
+
+    struct Buffer
+    {
+        std::unique_ptr<char[]> data{new char[BUFFER_SIZE]};
+        size_t size = 0;
+    };
+
+    std::array<Buffer, RING_BUFFERS> ring;
+
+    // Counts of buffers handed to and written by the writer thread
+    std::atomic<size_t> published{0};
+    std::atomic<size_t> written{0};
+    std::atomic<bool> stopping{false};
+    std::thread writer;
+
+    FlushPolicy policy = FlushPolicy::SIZE;
+
+    // Stream buffer std::cout used before the sink replaced it
+    std::streambuf *previous_buffer;
+
+    Buffer &current()
+    {
+        return ring[published.load(std::memory_order_relaxed) % RING_BUFFERS];
+    }
+
+    /**
+     * Points the put area at the buffer being filled
+     */
+    void reset_put_area()
+    {
+        char *data = current().data.get();
+        setp(data, data + BUFFER_SIZE);
+    }
+
+    /**
+     * Passes on everything in the put area
+     * Synchronously writes it, or in ASYNC mode queues it for the writer
+     */
+    void drain()
+    {
+        size_t size = static_cast<size_t>(pptr() - pbase());
+        if (size == 0)
+        {
+            return;
+        }
+
+        if (policy != FlushPolicy::ASYNC)
+        {
+            std::fwrite(pbase(), 1, size, stdout);
+            reset_put_area();
+            return;
+        }
+
+        // Publish this buffer, then wait until the next one is free
+        current().size = size;
+        size_t count = published.load(std::memory_order_relaxed) + 1;
+        published.store(count, std::memory_order_release);
+        wait_until([&]
+                   { return count - written.load(std::memory_order_acquire) < RING_BUFFERS; });
+        reset_put_area();
+    }
+
+    /**
+     * Yields, then sleeps briefly, until the condition holds
+     */
+    template <typename Condition>
+    static void wait_until(Condition condition)
+    {
+        for (int spins = 0; !condition(); spins++)
+        {
+            if (spins < 64)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+
+    /**
+     * Writer thread: writes published buffers in order until stopped
+     */
+    void write_published()
+    {
+        while (true)
+        {
+            size_t next = written.load(std::memory_order_relaxed);
+            wait_until([&]
+                       { return published.load(std::memory_order_acquire) != next ||
+                                stopping.load(std::memory_order_acquire); });
+            if (published.load(std::memory_order_acquire) == next)
+            {
+                return;
+            }
+
+            const Buffer &buffer = ring[next % RING_BUFFERS];
+            std::fwrite(buffer.data.get(), 1, buffer.size, stdout);
+            written.store(next + 1, std::memory_order_release);
+        }
+    }
+
+    /**
+     * Writes out everything printed so far and waits until it has been written
+     */
+    void flush_all()
+    {
+        drain();
+        if (policy == FlushPolicy::ASYNC)
+        {
+            size_t count = published.load(std::memory_order_relaxed);
+            wait_until([&]
+                       { return written.load(std::memory_order_acquire) == count; });
+        }
+        std::fflush(stdout);
+    }
+
+    void stop_writer()
+    {
+        if (writer.joinable())
+        {
+            stopping.store(true, std::memory_order_release);
+            writer.join();
+            stopping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Makes room for at least length more characters
+     */
+    void reserve(size_t length)
+    {
+        if (static_cast<size_t>(epptr() - pptr()) < length)
+        {
+            drain();
+        }
+    }
+
+    /**
+     * Ends a printed line, writing it out under the LINE policy
+     */
+    void end_line()
+    {
+        *pptr() = '\n';
+        pbump(1);
+        if (policy == FlushPolicy::LINE)
+        {
+            flush_all();
+        }
+    }
+
+protected:
+    //---------------------------------------------
+    // std::streambuf interface, used by std::cout
+    //---------------------------------------------
+
+    int_type overflow(int_type character) override
+    {
+        drain();
+        if (!traits_type::eq_int_type(character, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(character);
+            pbump(1);
+        }
+        return traits_type::not_eof(character);
+    }
+
+    std::streamsize xsputn(const char *text, std::streamsize count) override
+    {
+        write(std::string_view{text, static_cast<size_t>(count)});
+        return count;
+    }
+
+    int sync() override
+    {
+        flush_all();
+        return 0;
+    }
+
+public:
+    /**
+     * Creates the sink and makes it std::cout's stream buffer
+     */
+    OutputSink()
+    {
+        reset_put_area();
+        previous_buffer = std::cout.rdbuf(this);
+    }
+
+    /**
+     * Writes out anything left and gives std::cout its own buffer back
+     */
+    ~OutputSink()
+    {
+        flush_all();
+        stop_writer();
+        std::cout.rdbuf(previous_buffer);
+    }
+
+    OutputSink(const OutputSink &) = delete;
+    OutputSink &operator=(const OutputSink &) = delete;
+
+    /**
+     * Changes when buffered output is written out
+     */
+    void set_policy(FlushPolicy new_policy)
+    {
+        flush_all();
+        stop_writer();
+
+        // Both counters restart so the ring begins at its first buffer again
+        published.store(0, std::memory_order_relaxed);
+        written.store(0, std::memory_order_relaxed);
+        policy = new_policy;
+        reset_put_area();
+
+        if (policy == FlushPolicy::ASYNC)
+        {
+            writer = std::thread{&OutputSink::write_published, this};
+        }
+    }
+
+    /**
+     * Appends text without ending the line
+     */
+    void write(std::string_view text)
+    {
+        while (!text.empty())
+        {
+            reserve(1);
+            size_t chunk = std::min(text.size(), static_cast<size_t>(epptr() - pptr()));
+            std::memcpy(pptr(), text.data(), chunk);
+            pbump(static_cast<int>(chunk));
+            text.remove_prefix(chunk);
+        }
+    }
+
+    //---------------------------------------------
+    // Printing, one value per line
+    //---------------------------------------------
+
+    void print_number(double number)
+    {
+        reserve(MAX_NUMBER_LENGTH + 1);
+        char *end = format_number_to(pptr(), epptr(), number);
+        pbump(static_cast<int>(end - pptr()));
+        end_line();
+    }
+
+    void print_text(std::string_view text)
+    {
+        write(text);
+        reserve(1);
+        end_line();
+    }
+
+    void print_value(const Value &value)
+    {
+        if (const double *number = std::get_if<double>(&value))
+        {
+            print_number(*number);
+        }
+        else if (const std::string *text = std::get_if<std::string>(&value))
+        {
+            print_text(*text);
+        }
+        else if (const bool *boolean = std::get_if<bool>(&value))
+        {
+            print_text(*boolean ? "true" : "false");
+        }
+        else
+        {
+            print_text("nil");
+        }
+    }
+};
+
+/**
+ * The sink for standard output, created and installed on first use
+ */
+inline OutputSink &standard_output()
+{
+    static OutputSink sink;
+    return sink;
+}
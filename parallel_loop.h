@@ -0,0 +1,441 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "expr.h"
+#include "stmt.h"
+#include "token.h"
+#include "token_type.h"
+
+/**
+ * A reduction variable of a parallel loop and the operator that combines it
+ */
+struct Reduction
+{
+    Token name;
+
+    // PLUS or STAR
+    TokenType operator_type;
+};
+
+/**
+ * What the interpreter needs to run a `parallel for` loop's iterations apart
+ *
+ *     parallel for (var i = 0; i < n; i = i + 1) reduce (+ sum) { sum = sum + i * i; }
+ *
+ * The loop is parsed into the same Block and While as a plain for loop, so
+ * every engine can run it in order; the While also carries this
+ * description, which the tree-walking interpreter uses to run the
+ * iterations in chunks on several threads. The parser has checked that
+ * the body only assigns variables declared inside it, and updates each
+ * reduction variable only as `sum = sum + value;`.
+ */
+struct ParallelLoop
+{
+    // Loop variable, declared by the initialiser
+    Token variable;
+
+    // LESS, LESS_EQUAL, GREATER or GREATER_EQUAL: the variable compared with the bound
+    TokenType comparison;
+    std::shared_ptr<Expr> bound;
+
+    // Added to the variable after each iteration, or subtracted when decrementing
+    std::shared_ptr<Expr> step;
+    bool decrementing = false;
+
+    // Body without the increment
+    std::shared_ptr<Stmt> body;
+
+    std::vector<Reduction> reductions;
+};
+
+/**
+ * Checks that a parallel loop's iterations cannot affect each other
+ *
+ * The bound and step may not assign or read the loop variable or a
+ * reduction, so they are the same for every iteration. The body may read
+ * anything, but may only assign variables it declares itself; a reduction
+ * variable may only appear in a statement of the form `sum = sum + value;`
+ * with its own operator, where value does not read it.
+ */
+class ParallelLoopChecker
+{
+private:
+    const ParallelLoop &loop;
+
+    // Names declared by the body, innermost scope last
+    std::vector<std::vector<std::string>> scopes;
+
+    // Where and why the check failed, when it did; the token is in the loop's tree
+    const Token *problem_token = nullptr;
+    std::string problem;
+
+    bool fail(const Token &token, std::string message)
+    {
+        problem_token = &token;
+        problem = std::move(message);
+        return false;
+    }
+
+    bool is_local(const std::string &name) const
+    {
+        for (const std::vector<std::string> &scope : scopes)
+        {
+            if (std::find(scope.begin(), scope.end(), name) != scope.end())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * The reduction a name refers to, unless the body declares its own
+     */
+    const Reduction *reduction(const std::string &name) const
+    {
+        if (is_local(name))
+        {
+            return nullptr;
+        }
+        for (const Reduction &candidate : loop.reductions)
+        {
+            if (candidate.name.lexeme == name)
+            {
+                return &candidate;
+            }
+        }
+        return nullptr;
+    }
+
+    bool fail_reduction(const Token &token, const Reduction &used)
+    {
+        const std::string &name = used.name.lexeme;
+        std::string symbol = used.operator_type == PLUS ? " + " : " * ";
+        return fail(token, "Reduction variable '" + name + "' can only be used as '" + name + " = " + name +
+                               symbol + "value;'.");
+    }
+
+    /**
+     * Checks the bound or step, which is evaluated once for every iteration
+     */
+    bool check_invariant(const std::shared_ptr<Expr> &expr, const char *clause)
+    {
+        switch (expr->kind)
+        {
+        case ExprKind::ASSIGN:
+            return fail(static_cast<Assign &>(*expr).var_name,
+                        std::string{"Parallel loop "} + clause + " cannot assign to variables.");
+        case ExprKind::BINARY:
+            return check_invariant(static_cast<Binary &>(*expr).left_expr, clause) &&
+                   check_invariant(static_cast<Binary &>(*expr).right_expr, clause);
+        case ExprKind::GROUPING:
+            return check_invariant(static_cast<Grouping &>(*expr).inner_expr, clause);
+        case ExprKind::LOGICAL:
+            return check_invariant(static_cast<Logical &>(*expr).left_expr, clause) &&
+                   check_invariant(static_cast<Logical &>(*expr).right_expr, clause);
+        case ExprKind::UNARY:
+            return check_invariant(static_cast<Unary &>(*expr).operand, clause);
+        case ExprKind::VARIABLE:
+        {
+            const Token &name = static_cast<Variable &>(*expr).var_name;
+            if (name.lexeme == loop.variable.lexeme || reduction(name.lexeme) != nullptr)
+            {
+                return fail(name, std::string{"Parallel loop "} + clause + " cannot use '" + name.lexeme + "'.");
+            }
+            return true;
+        }
+        default:
+            return true;
+        }
+    }
+
+    bool check_expression(const std::shared_ptr<Expr> &expr)
+    {
+        switch (expr->kind)
+        {
+        case ExprKind::ASSIGN:
+        {
+            Assign &assign = static_cast<Assign &>(*expr);
+            const std::string &name = assign.var_name.lexeme;
+            if (const Reduction *used = reduction(name))
+            {
+                return fail_reduction(assign.var_name, *used);
+            }
+            if (!is_local(name))
+            {
+                return fail(assign.var_name, name == loop.variable.lexeme
+                                                 ? "Parallel loop body cannot assign to its loop variable."
+                                                 : "Parallel loop body can only assign to variables declared "
+                                                   "inside it or listed in reduce.");
+            }
+            return check_expression(assign.expr_value);
+        }
+        case ExprKind::BINARY:
+            return check_expression(static_cast<Binary &>(*expr).left_expr) &&
+                   check_expression(static_cast<Binary &>(*expr).right_expr);
+        case ExprKind::GROUPING:
+            return check_expression(static_cast<Grouping &>(*expr).inner_expr);
+        case ExprKind::LOGICAL:
+            return check_expression(static_cast<Logical &>(*expr).left_expr) &&
+                   check_expression(static_cast<Logical &>(*expr).right_expr);
+        case ExprKind::UNARY:
+            return check_expression(static_cast<Unary &>(*expr).operand);
+        case ExprKind::VARIABLE:
+        {
+            const Token &name = static_cast<Variable &>(*expr).var_name;
+            if (const Reduction *used = reduction(name.lexeme))
+            {
+                return fail_reduction(name, *used);
+            }
+            return true;
+        }
+        default:
+            return true;
+        }
+    }
+
+    /**
+     * Checks a statement of the form `sum = sum + value;` updating a reduction
+     */
+    bool check_update(Assign &assign, const Reduction &used)
+    {
+        const Binary *combine = assign.expr_value->kind == ExprKind::BINARY
+                                    ? static_cast<Binary *>(assign.expr_value.get())
+                                    : nullptr;
+        if (combine == nullptr || combine->operator_token.type != used.operator_type ||
+            combine->left_expr->kind != ExprKind::VARIABLE ||
+            static_cast<Variable &>(*combine->left_expr).var_name.lexeme != used.name.lexeme)
+        {
+            return fail_reduction(assign.var_name, used);
+        }
+        return check_expression(combine->right_expr);
+    }
+
+    bool check_statement(const std::shared_ptr<Stmt> &stmt)
+    {
+        switch (stmt->kind)
+        {
+        case StmtKind::BLOCK:
+        {
+            scopes.emplace_back();
+            for (const std::shared_ptr<Stmt> &inner : static_cast<Block &>(*stmt).body())
+            {
+                if (inner != nullptr && !check_statement(inner))
+                {
+                    return false;
+                }
+            }
+            scopes.pop_back();
+            return true;
+        }
+        case StmtKind::EXPRESSION:
+        {
+            const std::shared_ptr<Expr> &expr = static_cast<Expression &>(*stmt).expression;
+            if (expr->kind == ExprKind::ASSIGN)
+            {
+                Assign &assign = static_cast<Assign &>(*expr);
+                if (const Reduction *used = reduction(assign.var_name.lexeme))
+                {
+                    return check_update(assign, *used);
+                }
+            }
+            return check_expression(expr);
+        }
+        case StmtKind::IF:
+        {
+            If &branch = static_cast<If &>(*stmt);
+            return check_expression(branch.condition) && check_statement(branch.then_branch) &&
+                   (branch.else_branch == nullptr || check_statement(branch.else_branch));
+        }
+        case StmtKind::PRINT:
+            return check_expression(static_cast<Print &>(*stmt).expression);
+        case StmtKind::VAR:
+        {
+            Var &declaration = static_cast<Var &>(*stmt);
+            if (declaration.initialiser != nullptr && !check_expression(declaration.initialiser))
+            {
+                return false;
+            }
+            scopes.back().push_back(declaration.name.lexeme);
+            return true;
+        }
+        case StmtKind::WHILE:
+        {
+            While &inner = static_cast<While &>(*stmt);
+            return check_expression(inner.condition) && check_statement(inner.body);
+        }
+        }
+        return true;
+    }
+
+public:
+    explicit ParallelLoopChecker(const ParallelLoop &parallel_loop) : loop{parallel_loop}
+    {
+    }
+
+    /**
+     * @return Whether the loop's iterations are independent; if not, see error() and error_token()
+     */
+    bool check()
+    {
+        for (size_t i = 0; i < loop.reductions.size(); i++)
+        {
+            const Token &name = loop.reductions[i].name;
+            if (name.lexeme == loop.variable.lexeme)
+            {
+                return fail(name, "Loop variable cannot be a reduction.");
+            }
+            for (size_t j = 0; j < i; j++)
+            {
+                if (loop.reductions[j].name.lexeme == name.lexeme)
+                {
+                    return fail(name, "Reduction variable '" + name.lexeme + "' is listed twice.");
+                }
+            }
+        }
+
+        if (!check_invariant(loop.bound, "bound") || !check_invariant(loop.step, "step"))
+        {
+            return false;
+        }
+
+        // The body itself is a scope, so a bare statement has somewhere to declare into
+        scopes.emplace_back();
+        return check_statement(loop.body);
+    }
+
+    const std::string &error() const
+    {
+        return problem;
+    }
+
+    const Token &error_token() const
+    {
+        return *problem_token;
+    }
+};
+
+/**
+ * Iterations whose contributions to a reduction are combined on their own
+ *
+ * Floating-point addition is not associative, so every engine combines a
+ * reduction the same way, whether the iterations run in parallel or in
+ * order: each block of REDUCTION_BLOCK iterations starts from the
+ * operator's identity, and the blocks are combined in order with the
+ * variable's value before the loop. A reduction that is not a number
+ * before the loop is updated in order, as in a plain for loop.
+ */
+constexpr size_t REDUCTION_BLOCK = 64;
+
+/**
+ * The value each block of a reduction starts from
+ * -0 leaves every sum unchanged, including -0 itself
+ */
+inline double reduction_identity(TokenType operator_type)
+{
+    return operator_type == PLUS ? -0.0 : 1.0;
+}
+
+inline double combine_reduction(TokenType operator_type, double total, double block)
+{
+    return operator_type == PLUS ? total + block : total * block;
+}
+
+/**
+ * Combines a loop's reductions in blocks while its iterations run in order
+ *
+ * Each engine passes a function finding a reduction variable's number in
+ * its own storage, or null if the variable does not hold one. The variable
+ * holds the current block's value while the loop runs, and the combined
+ * value once finish() is called.
+ */
+class ReductionBlocks
+{
+private:
+    const std::vector<Reduction> &reductions;
+
+    // Combined value of the finished blocks, for each reduction that was a number
+    std::vector<double> totals;
+    std::vector<bool> combining;
+
+    size_t block_iterations = 0;
+
+    template <typename Find>
+    void combine_block(Find find, bool start_next)
+    {
+        for (size_t i = 0; i < reductions.size(); i++)
+        {
+            double *value = combining[i] ? find(reductions[i]) : nullptr;
+            if (value == nullptr)
+            {
+                continue;
+            }
+            totals[i] = combine_reduction(reductions[i].operator_type, totals[i], *value);
+            *value = start_next ? reduction_identity(reductions[i].operator_type) : totals[i];
+        }
+    }
+
+public:
+    explicit ReductionBlocks(const std::vector<Reduction> &loop_reductions)
+        : reductions{loop_reductions}
+    {
+    }
+
+    /**
+     * Starts the first block, before the loop's first iteration
+     */
+    template <typename Find>
+    void begin(Find find)
+    {
+        for (const Reduction &reduction : reductions)
+        {
+            double *value = find(reduction);
+            combining.push_back(value != nullptr);
+            totals.push_back(value != nullptr ? *value : 0);
+            if (value != nullptr)
+            {
+                *value = reduction_identity(reduction.operator_type);
+            }
+        }
+    }
+
+    /**
+     * Called after each iteration; combines the block once it is complete
+     */
+    template <typename Find>
+    void end_iteration(Find find)
+    {
+        if (++block_iterations == REDUCTION_BLOCK)
+        {
+            block_iterations = 0;
+            combine_block(find, true);
+        }
+    }
+
+    /**
+     * Combines the last block, once the loop has ended
+     */
+    template <typename Find>
+    void finish(Find find)
+    {
+        combine_block(find, false);
+    }
+};
+
+/**
+ * Iterations in each chunk of a parallel loop
+ * Depends only on the number of iterations, never on the threads, so that
+ * reductions combine the same partials in the same order on any machine.
+ * A loop with reductions has chunks of whole blocks, so that no block is
+ * split between threads.
+ */
+inline size_t parallel_chunk_size(size_t iterations, bool reducing)
+{
+    constexpr size_t TARGET_CHUNKS = 1024;
+    size_t size = std::max<size_t>(1, (iterations + TARGET_CHUNKS - 1) / TARGET_CHUNKS);
+    return reducing ? (size + REDUCTION_BLOCK - 1) / REDUCTION_BLOCK * REDUCTION_BLOCK : size;
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "memory_tracker.h"
+#include "parser.h"
+#include "stmt.h"
+#include "token.h"
+#include "token_type.h"
+#include "trace_recorder.h"
+
+/**
+ * Parses the top-level declarations of a script on several threads
+ *
+ * A boundary pass splits the tokens into runs of whole top-level
+ * declarations using brace and parenthesis depth and semicolons. Worker
+ * threads take runs from a shared counter and parse them with their own
+ * silent Parser; the results are concatenated in source order.
+ *
+ * Workers never report errors themselves. If any run has a syntax error,
+ * the whole script is parsed again sequentially so that errors are
+ * reported through error() exactly as the Parser reports them.
+ */
+class ParallelParser
+{
+private:
+    // Token range [start, end) of consecutive top-level declarations
+    struct Range
+    {
+        int start;
+        int end;
+    };
+
+    // Fewer tokens than this per range are not worth a thread's time
+    static constexpr size_t MIN_RANGE_TOKENS = 4096;
+
+    // Ranges per thread, so threads that finish early can take more work
+    static constexpr size_t RANGES_PER_THREAD = 4;
+
+    // Kept alive for lazily parsed blocks; null when eager
+    std::shared_ptr<const std::vector<Token>> shared_tokens;
+
+    const std::vector<Token> &token_stream;
+
+    /**
+     * Creates a parser over the tokens, lazy if the tokens are shared
+     */
+    Parser make_parser() const
+    {
+        if (shared_tokens != nullptr)
+        {
+            return Parser{shared_tokens};
+        }
+        return Parser{token_stream};
+    }
+
+    /**
+     * Splits the tokens into ranges that each end on a top-level boundary
+     *
+     * A declaration ends at a `;` or `}` outside any braces or parentheses,
+     * unless an `else` follows and continues an if statement.
+     */
+    std::vector<Range> find_ranges(size_t target_tokens) const
+    {
+        std::vector<Range> ranges;
+        int range_start = 0;
+        int depth = 0;
+
+        for (int pos = 0; token_stream[pos].type != END_OF_FILE; pos++)
+        {
+            switch (token_stream[pos].type)
+            {
+            case LEFT_BRACE:
+            case LEFT_PAREN:
+                depth++;
+                break;
+            case RIGHT_BRACE:
+            case RIGHT_PAREN:
+                // Unbalanced input fails to parse and falls back anyway
+                depth = std::max(depth - 1, 0);
+                break;
+            default:
+                break;
+            }
+
+            TokenType type = token_stream[pos].type;
+            bool ends_declaration = depth == 0 && (type == SEMICOLON || type == RIGHT_BRACE) &&
+                                    token_stream[pos + 1].type != ELSE;
+            if (ends_declaration && static_cast<size_t>(pos + 1 - range_start) >= target_tokens)
+            {
+                ranges.push_back(Range{range_start, pos + 1});
+                range_start = pos + 1;
+            }
+        }
+
+        // The last range runs up to end of file
+        int end_of_file = static_cast<int>(token_stream.size()) - 1;
+        if (range_start < end_of_file || ranges.empty())
+        {
+            ranges.push_back(Range{range_start, end_of_file});
+        }
+        return ranges;
+    }
+
+public:
+    /**
+     * Constructs a parallel parser with the given token stream
+     */
+    explicit ParallelParser(const std::vector<Token> &tokens)
+        : token_stream{tokens}
+    {
+    }
+
+    /**
+     * Constructs a parallel parser whose blocks are parsed lazily
+     */
+    explicit ParallelParser(std::shared_ptr<const std::vector<Token>> tokens)
+        : shared_tokens{std::move(tokens)}, token_stream{*shared_tokens}
+    {
+    }
+
+    /**
+     * Parse all statements in the token stream
+     * @param thread_count Threads to parse on, including the calling thread
+     * @return The same statements, in the same order, as Parser::parse
+     */
+    std::vector<std::shared_ptr<Stmt>> parse(size_t thread_count)
+    {
+        size_t target_tokens = std::max(MIN_RANGE_TOKENS, token_stream.size() / (thread_count * RANGES_PER_THREAD));
+        std::vector<Range> ranges = thread_count > 1 ? find_ranges(target_tokens) : std::vector<Range>{};
+        if (ranges.size() < 2)
+        {
+            return make_parser().parse();
+        }
+
+        // Each worker claims the next unparsed range until none are left
+        std::vector<std::vector<std::shared_ptr<Stmt>>> results(ranges.size());
+        std::atomic<size_t> next_range{0};
+        std::atomic<bool> failed{false};
+        auto worker = [&]
+        {
+            MemoryScope memory_scope{MemoryCategory::AST};
+            for (size_t i = next_range++; i < ranges.size() && !failed; i = next_range++)
+            {
+                TraceSpan span{"parse range", "parse"};
+                Parser parser = make_parser();
+                parser.set_silent(true);
+                results[i] = parser.parse_range(ranges[i].start, ranges[i].end);
+                if (parser.found_errors())
+                {
+                    failed = true;
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < std::min(thread_count, ranges.size()); i++)
+        {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (std::thread &thread : workers)
+        {
+            thread.join();
+        }
+
+        // Report errors in source order with the Parser's own recovery
+        if (failed)
+        {
+            return make_parser().parse();
+        }
+
+        // Concatenate the ranges in source order
+        size_t statement_count = 0;
+        for (const auto &statements : results)
+        {
+            statement_count += statements.size();
+        }
+
+        std::vector<std::shared_ptr<Stmt>> program_statements;
+        program_statements.reserve(statement_count);
+        for (auto &statements : results)
+        {
+            std::move(statements.begin(), statements.end(), std::back_inserter(program_statements));
+        }
+        return program_statements;
+    }
+};
@@ -9,13 +9,28 @@
 #include <vector>
 #include "error.h"
 #include "expr.h"
+#include "memory_tracker.h"
+#include "parallel_loop.h"
 #include "stmt.h"
 #include "token.h"
 #include "token_type.h"
+#include "trace_recorder.h"
+
+/**
+ * Thrown when a lazily parsed block body turns out to contain syntax errors
+ * The errors themselves have already been reported through error()
+ */
+struct DeferredSyntaxError : public std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
 
 /**
  * Recursive descent parser for the Lox language
  * Transforms tokens into an abstract syntax tree
+ *
+ * In lazy mode, block bodies are only brace-matched: each Block records
+ * the token range of its body and parses it the first time it is needed.
  */
 class Parser
 {
@@ -26,10 +41,22 @@ private:
         using std::runtime_error::runtime_error;
     };
 
+    // Keeps the tokens alive for lazily parsed blocks; null when eager
+    std::shared_ptr<const std::vector<Token>> shared_tokens;
+
     // Parser state
     const std::vector<Token> &token_stream;
     int current_pos = 0;
 
+    // Position parsing stops at, or -1 to parse up to end of file
+    int end_pos = -1;
+
+    bool lazy_blocks = false;
+    bool found_error = false;
+
+    // Record errors without reporting them, so the parser can run off the main thread
+    bool silent = false;
+
 public:
     /**
      * Constructs a parser with the given token stream
@@ -39,6 +66,15 @@ public:
     {
     }
 
+    /**
+     * Constructs a parser that leaves block bodies unparsed until first use
+     * The blocks it creates share ownership of the tokens
+     */
+    explicit Parser(std::shared_ptr<const std::vector<Token>> tokens)
+        : shared_tokens{std::move(tokens)}, token_stream{*shared_tokens}, lazy_blocks{true}
+    {
+    }
+
     /**
      * Parse all statements in the token stream
      * @return Vector of parsed statements
@@ -56,6 +92,33 @@ public:
         return program_statements;
     }
 
+    /**
+     * Parse the statements in the token range [start, end)
+     * The range must start and end on statement boundaries
+     */
+    std::vector<std::shared_ptr<Stmt>> parse_range(int start, int end)
+    {
+        current_pos = start;
+        end_pos = end;
+        return parse();
+    }
+
+    /**
+     * Stops errors being reported through error(); found_errors() still records them
+     */
+    void set_silent(bool enabled)
+    {
+        silent = enabled;
+    }
+
+    /**
+     * Whether any syntax error has been found so far
+     */
+    bool found_errors() const
+    {
+        return found_error;
+    }
+
 private:
     //---------------------------------------------
     // Statement parsing methods
@@ -70,7 +133,10 @@ private:
         {
             if (match(VAR))
             {
-                return variable_declaration();
+                int line = previous().line_number;
+                std::shared_ptr<Stmt> declaration_stmt = variable_declaration();
+                declaration_stmt->line_number = line;
+                return declaration_stmt;
             }
             return statement();
         }
@@ -87,25 +153,40 @@ private:
      */
     std::shared_ptr<Stmt> statement()
     {
+        int line = peek().line_number;
+        std::shared_ptr<Stmt> parsed_stmt;
+
         if (match(FOR))
-            return for_statement();
-        if (match(IF))
-            return if_statement();
-        if (match(PRINT))
-            return print_statement();
-        if (match(WHILE))
-            return while_statement();
-        if (match(LEFT_BRACE))
-            return std::make_shared<Block>(block());
+            parsed_stmt = for_statement(false);
+        else if (check_word("parallel", FOR))
+        {
+            advance();
+            advance();
+            parsed_stmt = for_statement(true);
+        }
+        else if (match(IF))
+            parsed_stmt = if_statement();
+        else if (match(PRINT))
+            parsed_stmt = print_statement();
+        else if (match(WHILE))
+            parsed_stmt = while_statement();
+        else if (match(LEFT_BRACE))
+            parsed_stmt = lazy_blocks ? lazy_block() : std::make_shared<Block>(block());
+        else
+            parsed_stmt = expression_statement();
 
-        return expression_statement();
+        // Record where the statement starts, for errors that have no token
+        parsed_stmt->line_number = line;
+        return parsed_stmt;
     }
 
     /**
-     * Parse a for loop statement
+     * Parse a for loop statement, or a parallel for loop after `parallel for`
      */
-    std::shared_ptr<Stmt> for_statement()
+    std::shared_ptr<Stmt> for_statement(bool parallel)
     {
+        const Token &for_token = previous();
+        int for_line = for_token.line_number;
         consume(LEFT_PAREN, "Expect '(' after 'for'.");
 
         // Parse initialiser clause
@@ -139,18 +220,48 @@ private:
         }
         consume(RIGHT_PAREN, "Expect ')' after for clauses.");
 
-        // Parse loop body
+        // Parse reductions: reduce (+ sum, * product)
+        std::vector<Reduction> reductions;
+        if (parallel && check_word("reduce", LEFT_PAREN))
+        {
+            advance();
+            advance();
+            do
+            {
+                if (!match(PLUS, STAR))
+                {
+                    throw error(peek(), "Expect '+' or '*' before reduction variable.");
+                }
+                TokenType operator_type = previous().type;
+                Token name = consume(IDENTIFIER, "Expect reduction variable name.");
+                reductions.push_back(Reduction{std::move(name), operator_type});
+            } while (match(COMMA));
+            consume(RIGHT_PAREN, "Expect ')' after reductions.");
+        }
+
+        // Parse loop body; a parallel body is checked now, so it is never parsed lazily
+        bool lazy = lazy_blocks;
+        lazy_blocks = lazy_blocks && !parallel;
         std::shared_ptr<Stmt> loop_body = statement();
+        lazy_blocks = lazy;
+
+        std::shared_ptr<const ParallelLoop> parallel_loop;
+        if (parallel)
+        {
+            parallel_loop = parallel_loop_of(for_token, init_clause, condition_expr, increment_expr,
+                                             loop_body, std::move(reductions));
+        }
 
         // Desugar for loop into while loop structure
 
         // Add increment to end of body if it exists
         if (increment_expr != nullptr)
         {
+            std::shared_ptr<Stmt> increment_stmt = std::make_shared<Expression>(increment_expr);
+            increment_stmt->line_number = for_line;
             loop_body = std::make_shared<Block>(
-                std::vector<std::shared_ptr<Stmt>>{
-                    loop_body,
-                    std::make_shared<Expression>(increment_expr)});
+                std::vector<std::shared_ptr<Stmt>>{loop_body, increment_stmt});
+            loop_body->line_number = for_line;
         }
 
         // Create while loop with condition (or true if none provided)
@@ -158,7 +269,10 @@ private:
         {
             condition_expr = std::make_shared<Literal>(true);
         }
-        loop_body = std::make_shared<While>(condition_expr, loop_body);
+        std::shared_ptr<While> loop = std::make_shared<While>(condition_expr, loop_body);
+        loop->line_number = for_line;
+        loop->parallel = std::move(parallel_loop);
+        loop_body = std::move(loop);
 
         // Add initialiser before while loop if it exists
         if (init_clause != nullptr)
@@ -170,6 +284,68 @@ private:
         return loop_body;
     }
 
+    /**
+     * Describes a parallel for loop for the interpreter, checking its
+     * iterations are independent
+     * @return Null if the loop is not of a form that can run in parallel,
+     *         which is reported without unwinding, as it is not a parse error
+     */
+    std::shared_ptr<const ParallelLoop> parallel_loop_of(const Token &for_token,
+                                                         const std::shared_ptr<Stmt> &init_clause,
+                                                         const std::shared_ptr<Expr> &condition_expr,
+                                                         const std::shared_ptr<Expr> &increment_expr,
+                                                         const std::shared_ptr<Stmt> &loop_body,
+                                                         std::vector<Reduction> reductions)
+    {
+        // Initialiser: var i = start;
+        Var *declaration = dynamic_cast<Var *>(init_clause.get());
+        if (declaration == nullptr || declaration->initialiser == nullptr)
+        {
+            error(for_token, "Parallel loop must declare its variable, as in 'var i = 0;'.");
+            return nullptr;
+        }
+        const std::string &variable = declaration->name.lexeme;
+
+        // Condition: i < bound, or <=, > or >=
+        Binary *comparison = dynamic_cast<Binary *>(condition_expr.get());
+        if (comparison == nullptr ||
+            (comparison->operator_token.type != LESS && comparison->operator_token.type != LESS_EQUAL &&
+             comparison->operator_token.type != GREATER && comparison->operator_token.type != GREATER_EQUAL) ||
+            !names_variable(comparison->left_expr, variable))
+        {
+            error(for_token, "Parallel loop condition must compare its variable with a bound, as in 'i < n'.");
+            return nullptr;
+        }
+
+        // Increment: i = i + step, or i = i - step
+        Assign *increment = dynamic_cast<Assign *>(increment_expr.get());
+        Binary *stepped = increment != nullptr ? dynamic_cast<Binary *>(increment->expr_value.get()) : nullptr;
+        if (increment == nullptr || increment->var_name.lexeme != variable || stepped == nullptr ||
+            (stepped->operator_token.type != PLUS && stepped->operator_token.type != MINUS) ||
+            !names_variable(stepped->left_expr, variable))
+        {
+            error(for_token, "Parallel loop increment must step its variable, as in 'i = i + 1'.");
+            return nullptr;
+        }
+
+        auto loop = std::make_shared<ParallelLoop>(ParallelLoop{
+            declaration->name, comparison->operator_token.type, comparison->right_expr, stepped->right_expr,
+            stepped->operator_token.type == MINUS, loop_body, std::move(reductions)});
+        ParallelLoopChecker checker{*loop};
+        if (!checker.check())
+        {
+            error(checker.error_token(), checker.error());
+            return nullptr;
+        }
+        return loop;
+    }
+
+    static bool names_variable(const std::shared_ptr<Expr> &expr, const std::string &name)
+    {
+        Variable *variable = dynamic_cast<Variable *>(expr.get());
+        return variable != nullptr && variable->var_name.lexeme == name;
+    }
+
     /**
      * Parse an if statement
      */
@@ -257,6 +433,47 @@ private:
         return statements;
     }
 
+    /**
+     * Skip over a block body by matching braces, deferring its parsing
+     */
+    std::shared_ptr<Stmt> lazy_block()
+    {
+        int body_start = current_pos;
+        int depth = 0;
+
+        // Find the brace closing this block, reading token types in place
+        while (!is_at_end())
+        {
+            TokenType type = token_stream[current_pos].type;
+            if (type == RIGHT_BRACE && depth-- == 0)
+            {
+                break;
+            }
+            if (type == LEFT_BRACE)
+            {
+                depth++;
+            }
+            current_pos++;
+        }
+
+        int body_end = current_pos;
+        consume(RIGHT_BRACE, "Expect '}' after block.");
+
+        // Parse the body on first entry, failing if it has syntax errors
+        std::shared_ptr<const std::vector<Token>> tokens = shared_tokens;
+        return std::make_shared<Block>([tokens, body_start, body_end]
+                                       {
+            MemoryScope memory_scope{MemoryCategory::AST};
+            TraceSpan span{"parse block", "parse"};
+            Parser body_parser{tokens};
+            std::vector<std::shared_ptr<Stmt>> statements = body_parser.parse_range(body_start, body_end);
+            if (body_parser.found_errors())
+            {
+                throw DeferredSyntaxError{"Syntax error in block body."};
+            }
+            return statements; });
+    }
+
     //---------------------------------------------
     // Expression parsing methods - recursive descent
     //---------------------------------------------
@@ -483,7 +700,7 @@ private:
      * Consume current token if it matches expected type,
      * otherwise throw error
      */
-    Token consume(TokenType expected_type, std::string_view error_msg)
+    const Token &consume(TokenType expected_type, std::string_view error_msg)
     {
         if (check(expected_type))
         {
@@ -505,10 +722,20 @@ private:
         return peek().type == type;
     }
 
+    /**
+     * Whether the next tokens are an identifier used as a keyword here, such
+     * as `parallel` before `for`, so that it can still name variables elsewhere
+     */
+    bool check_word(std::string_view word, TokenType next)
+    {
+        return check(IDENTIFIER) && peek().lexeme == word &&
+               token_stream[current_pos + 1].type == next;
+    }
+
     /**
      * Advance to next token and return previous
      */
-    Token advance()
+    const Token &advance()
     {
         if (!is_at_end())
         {
@@ -522,13 +749,13 @@ private:
      */
     bool is_at_end()
     {
-        return peek().type == END_OF_FILE;
+        return current_pos == end_pos || peek().type == END_OF_FILE;
     }
 
     /**
      * Get current token without consuming
      */
-    Token peek()
+    const Token &peek()
     {
         return token_stream.at(current_pos);
     }
@@ -536,7 +763,7 @@ private:
     /**
      * Get previous token
      */
-    Token previous()
+    const Token &previous()
     {
         return token_stream.at(current_pos - 1);
     }
@@ -546,7 +773,11 @@ private:
      */
     ParseError error(const Token &token, std::string_view message)
     {
-        ::error(token, message);
+        if (!silent)
+        {
+            ::error(token, message);
+        }
+        found_error = true;
         return ParseError{""};
     }
 
@@ -5,20 +5,164 @@
 #include <vector>
 #include <memory>
 #include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <sstream>
+#include <cstdlib>
+#include <new>
 #include "ast_printer.h"
+#include "batch_runner.h"
 #include "token_printer.h"
 #include "error.h"
 #include "interpreter.h"
 #include "parser.h"
+#include "parallel_parser.h"
 #include "lexer.h"
+#include "memory_tracker.h"
+#include "closure_engine.h"
+#include "scheduler.h"
+#include "snapshot.h"
+#include "syntax_validator.h"
+#include "cpp_emitter.h"
+#include "output_sink.h"
+#include "profiler.h"
+#include "record_runner.h"
+#include "trace_recorder.h"
+#include "vm.h"
 
-// Environment state
-Interpreter interpreter{};
+// Available execution engines
+enum class Engine
+{
+    TREE,   // Tree-walking interpreter
+    VM,     // Bytecode compiler and virtual machine
+    CLOSURE,  // AST compiled into pre-bound closures
+    RESUMABLE // Stackless interpreter run in time slices
+};
+
+// Execution engines for the shell or a script; variables persist from one run to the next
+struct Engines
+{
+    Interpreter interpreter;
+    HeatCountingInterpreter heat_interpreter;
+    VM vm;
+    ClosureEngine closure_engine;
+    ResumableInterpreter resumable_interpreter;
+};
+
+// Engines Ctrl-C cancels, as a signal handler can only reach globals
+Engines *cancellable_engines = nullptr;
+
+Engine engine = Engine::TREE;
+
+// Type-feedback specialisation in the tree-walking interpreter
+bool specialisation_mode = true;
 
 // Visualisation mode flags
 bool visual_mode = false;
 bool token_mode = false; // New flag for token visualisation
 
+// What -v renders to, and whether a viewer is opened on each image
+ImageFormat image_format = ImageFormat::SVG;
+bool image_format_set = false;
+bool open_viewer = false;
+
+// How much of a large AST -v draws
+DetailLevel detail_level;
+
+// Heat map: run first, then draw the AST coloured by where the time went
+bool heat_mode = false;
+double heat_collapse_percent = 0;
+
+// Loop JIT settings for the tree-walking interpreter
+bool jit_mode = false;
+uint32_t jit_threshold = 1000;
+
+// Print the program as C++ instead of running it
+bool emit_cpp_mode = false;
+
+// Lazy parsing of block bodies, and when their syntax errors are reported
+enum class LazyParsing
+{
+    OFF,      // Parse everything up front
+    VALIDATE, // Check all syntax up front, build block bodies on first entry
+    DEFERRED  // Check and build block bodies on first entry
+};
+LazyParsing lazy_parsing = LazyParsing::OFF;
+
+// Threads that parse top-level declarations
+uint32_t parse_threads = 1;
+
+// Step, time and memory limits for the tree-walking interpreter
+ResourceLimits resource_limits;
+
+// Sampling profiler for the tree-walking interpreter, and where its stacks go
+bool profile_mode = false;
+std::string profile_path = "profile.folded";
+uint32_t profile_rate = SamplingProfiler::DEFAULT_RATE;
+
+// Memory report by category and line, and where its JSON goes
+bool mem_report_mode = false;
+std::string mem_report_path = "mem_report.json";
+
+// Timeline of phases written at exit, slow statements added to it, and a phase summary
+bool trace_mode = false;
+std::string trace_path = "trace.json";
+bool trace_statements_mode = false;
+uint32_t trace_threshold_us = 0;
+bool time_mode = false;
+
+// When printed output is written out; unset means per line in the shell, by size otherwise
+bool output_policy_set = false;
+OutputSink::FlushPolicy output_policy = OutputSink::FlushPolicy::SIZE;
+
+// Resumable engine: steps per time slice and scheduler threads, also the threads for a batch or parallel loops
+uint32_t time_slice = 1000;
+uint32_t thread_count = 1;
+bool thread_count_set = false;
+
+// Scripts run side by side in this process, from a directory or a list, and where their output goes
+std::string batch_source;
+std::string batch_output_path;
+
+// NDJSON records the script is run against, one run each, from a file or - for standard input
+bool records_mode = false;
+std::string records_path = "-";
+
+// Image the globals are restored from before the script or shell, and written to after the script
+std::string restore_path;
+std::string snapshot_path;
+
+// Allocation functions, replaced so the memory report can see every allocation
+// While the report is off they only test one flag on top of malloc and free
+void *operator new(std::size_t size)
+{
+    void *memory = std::malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc{};
+    }
+    if (memory_tracker.is_enabled())
+    {
+        memory_tracker.record_allocation(memory, size);
+    }
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    if (memory != nullptr && memory_tracker.is_enabled())
+    {
+        memory_tracker.record_free(memory);
+    }
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    operator delete(memory);
+}
+
 // File operations
 std::string read_file(std::string_view filename)
 {
@@ -48,72 +192,448 @@ std::string read_file(std::string_view filename)
 }
 
 // Execution functions
-void run(std::string_view code, bool is_interactive = false)
+
+/**
+ * Visualises and runs a parsed program
+ */
+void execute(const std::vector<std::shared_ptr<Stmt>> &statements, Engines &engines, bool is_interactive)
+{
+    // Visualisation if in visual mode; a heat map is drawn after the run instead
+    if (visual_mode && !heat_mode)
+    {
+        TraceSpan span{"visualise"};
+        AstPrinter printer;
+        printer.set_output(image_format, open_viewer);
+        printer.set_detail(detail_level);
+        if (is_interactive)
+        {
+            // For interactive mode, visualise each statement separately
+            // and reuse the same output file
+            if (!statements.empty())
+            {
+                printer.visualise_stmt(statements.back(), "ast");
+            }
+        }
+        else
+        {
+            // For file execution, visualise the whole program
+            printer.visualise_program(statements, "program_ast");
+        }
+    }
+
+    // Execution, or C++ generation instead
+    TraceSpan span{"interpret"};
+    if (emit_cpp_mode)
+    {
+        CppEmitter emitter;
+        std::cout << emitter.emit_program(statements);
+    }
+    else if (engine == Engine::VM)
+    {
+        engines.vm.interpret(statements);
+    }
+    else if (engine == Engine::CLOSURE)
+    {
+        engines.closure_engine.interpret(statements);
+    }
+    else if (engine == Engine::RESUMABLE)
+    {
+        // A single program simply runs slice after slice
+        engines.resumable_interpreter.load(statements);
+        while (engines.resumable_interpreter.resume(time_slice) == ResumableInterpreter::Status::SUSPENDED)
+        {
+        }
+        if (engines.resumable_interpreter.status() == ResumableInterpreter::Status::FAILED)
+        {
+            error_reporter().had_runtime_error = true;
+        }
+    }
+    else if (heat_mode)
+    {
+        engines.heat_interpreter.interpret(statements);
+        AstPrinter printer;
+        printer.set_output(image_format, open_viewer);
+        printer.set_detail(detail_level);
+        printer.set_heat(true, heat_collapse_percent);
+        printer.visualise_program(statements, "program_heat");
+    }
+    else
+    {
+        engines.interpreter.interpret(statements);
+    }
+}
+
+void run(std::string_view code, Engines &engines, bool is_interactive = false)
 {
+    // Track memory from the first token when reporting it
+    if (mem_report_mode)
+    {
+        memory_tracker.start(engines.interpreter.executing_statement());
+    }
+
     // Step 1: Lexical analysis
-    Lexer lexer{code};
-    std::vector<Token> tokens = lexer.scan_tokens();
+    std::vector<Token> tokens;
+    {
+        MemoryScope memory_scope{MemoryCategory::TOKENS};
+        TraceSpan span{"lex"};
+        Lexer lexer{code};
+        tokens = lexer.scan_tokens();
+    }
 
     // Step 1.5: Token visualisation if in token mode
     if (token_mode)
     {
+        TraceSpan span{"tokens"};
         TokenPrinter token_printer;
         token_printer.visualise_tokens(code, tokens);
     }
 
     // Step 2: Syntax analysis
-    Parser parser{tokens};
-    std::vector<std::shared_ptr<Stmt>> statements = parser.parse();
+    std::vector<std::shared_ptr<Stmt>> statements;
+    {
+        MemoryScope memory_scope{MemoryCategory::AST};
+        TraceSpan span{"parse"};
+        if (lazy_parsing == LazyParsing::OFF)
+        {
+            ParallelParser parser{tokens};
+            statements = parser.parse(parse_threads);
+        }
+        else
+        {
+            // Without deferred errors, report every syntax error before running
+            if (lazy_parsing == LazyParsing::VALIDATE)
+            {
+                SyntaxValidator validator{tokens};
+                validator.validate();
+            }
+            if (!error_reporter().had_error)
+            {
+                ParallelParser parser{std::make_shared<const std::vector<Token>>(std::move(tokens))};
+                statements = parser.parse(parse_threads);
+            }
+        }
+    }
 
     // Stop if syntax errors were found
-    if (had_error)
+    if (error_reporter().had_error)
     {
+        memory_tracker.stop();
         return;
     }
 
-    // Step 3: Visualisation if in visual mode
-    if (visual_mode)
+    // Sample the run when profiling, then write the stacks and line summary
+    SamplingProfiler profiler{engines.interpreter.executing_statement()};
+    engines.interpreter.track_statements(profile_mode || mem_report_mode);
+    if (profile_mode && !profiler.start(profile_rate))
     {
-        AstPrinter printer;
-        if (is_interactive)
+        std::cerr << "Could not start the profiling timer.\n";
+    }
+
+    try
+    {
+        MemoryScope memory_scope{MemoryCategory::VALUES};
+        execute(statements, engines, is_interactive);
+    }
+    catch (DeferredSyntaxError &)
+    {
+        // A block entered for the first time had syntax errors, already reported
+    }
+
+    if (profile_mode)
+    {
+        profiler.stop();
+        std::ofstream folded_stream{profile_path};
+        if (!folded_stream)
         {
-            // For interactive mode, visualise each statement separately
-            // and reuse the same output file
-            if (!statements.empty())
-            {
-                printer.visualise_stmt(statements.back(), "ast");
-            }
+            std::cerr << "Could not write profile '" << profile_path << "'.\n";
         }
-        else
+        profiler.write_folded(folded_stream, statements);
+        profiler.write_line_summary(std::cerr, statements, code);
+    }
+
+    // Final figures are taken while the tokens and AST are still alive
+    if (mem_report_mode)
+    {
+        memory_tracker.stop();
+        std::ofstream json_stream{mem_report_path};
+        if (!json_stream)
         {
-            // For file execution, visualise the whole program
-            printer.visualise_program(statements, "program_ast");
+            std::cerr << "Could not write memory report '" << mem_report_path << "'.\n";
         }
+        memory_tracker.write_json(json_stream);
+        memory_tracker.write_table(std::cerr, code);
     }
-
-    // Step 4: Execution
-    interpreter.interpret(statements);
 }
 
-void execute_file(std::string_view path)
+/**
+ * Runs a script, exiting if it fails
+ * @return The script's source
+ */
+std::string execute_file(std::string_view path, Engines &engines)
 {
     // Load and execute the file
     auto source = read_file(path);
-    run(source, false); // Not interactive
+    run(source, engines, false); // Not interactive
 
     // Handle errors with appropriate exit codes
-    if (had_error)
+    if (error_reporter().had_error)
+    {
+        std::exit(65); // Syntax error
+    }
+
+    if (error_reporter().had_runtime_error)
+    {
+        std::exit(70); // Runtime error
+    }
+    return source;
+}
+
+/**
+ * Defines the globals saved in an image, before anything runs
+ */
+void restore_snapshot(Engines &engines)
+{
+    MappedImage image;
+    if (!image.open(restore_path))
+    {
+        std::cerr << "Could not open image '" << restore_path << "': " << std::strerror(errno) << "\n";
+        std::exit(74); // IO error code
+    }
+
+    std::string program;
+    std::vector<std::pair<std::string, Value>> globals;
+    SnapshotReader reader{image.bytes()};
+    if (!reader.read(program, globals))
+    {
+        std::cerr << "Invalid image '" << restore_path << "': " << reader.error() << ".\n";
+        std::exit(65); // Data error
+    }
+
+    try
+    {
+        for (auto &[name, value] : globals)
+        {
+            engines.interpreter.define_global(name, std::visit([](auto &held)
+                                                               { return std::any{std::move(held)}; },
+                                                               value));
+        }
+    }
+    catch (const ResourceLimitError &error)
+    {
+        runtime_error(error);
+        std::exit(70); // Runtime error
+    }
+}
+
+/**
+ * Saves the globals a script left behind, with the script, as an image
+ */
+void take_snapshot(const std::string &program, const Engines &engines)
+{
+    std::vector<std::pair<std::string, Value>> globals;
+    engines.interpreter.for_each_global([&](const std::string &name, const std::any &value)
+                                        { globals.emplace_back(name, value_from_any(value)); });
+    if (!write_snapshot(snapshot_path, encode_snapshot(program, globals)))
+    {
+        std::cerr << "Could not write image '" << snapshot_path << "': " << std::strerror(errno) << "\n";
+        std::exit(74); // IO error code
+    }
+}
+
+void execute_scheduled(const std::vector<std::string> &paths)
+{
+    // Parse every script up front; each instance buffers its own output
+    std::vector<std::vector<std::shared_ptr<Stmt>>> programs;
+    for (const std::string &path : paths)
+    {
+        auto source = read_file(path);
+        std::vector<Token> tokens;
+        {
+            TraceSpan span{"lex"};
+            Lexer lexer{source};
+            tokens = lexer.scan_tokens();
+        }
+        TraceSpan span{"parse"};
+        Parser parser{tokens};
+        programs.push_back(parser.parse());
+    }
+
+    if (error_reporter().had_error)
+    {
+        std::exit(65); // Syntax error
+    }
+
+    std::vector<std::ostringstream> outputs(paths.size());
+    std::vector<std::ostringstream> errors(paths.size());
+    std::vector<std::unique_ptr<ResumableInterpreter>> instances;
+    Scheduler scheduler;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        instances.push_back(std::make_unique<ResumableInterpreter>(outputs[i], errors[i]));
+        instances.back()->load(programs[i]);
+        scheduler.spawn(*instances.back());
+    }
+
+    {
+        TraceSpan span{"interpret"};
+        scheduler.run(thread_count, time_slice);
+    }
+
+    // Report each script's output, then its error, in command-line order
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        std::cout << outputs[i].str() << std::flush;
+        std::cerr << errors[i].str();
+        if (instances[i]->status() == ResumableInterpreter::Status::FAILED)
+        {
+            error_reporter().had_runtime_error = true;
+        }
+    }
+
+    if (error_reporter().had_runtime_error)
+    {
+        std::exit(70); // Runtime error
+    }
+}
+
+/**
+ * Applies the command-line settings to a tree-walking interpreter
+ */
+template <typename TreeInterpreter>
+void configure_interpreter(TreeInterpreter &tree_interpreter)
+{
+    tree_interpreter.set_specialisation(specialisation_mode);
+    tree_interpreter.set_limits(resource_limits);
+    if (trace_statements_mode)
+    {
+        tree_interpreter.trace_statements(uint64_t{trace_threshold_us} * 1000);
+    }
+}
+
+/**
+ * Runs every script from a directory or list side by side, then summarises the batch
+ */
+void execute_batch()
+{
+    std::vector<std::string> paths;
+    if (!BatchRunner::list_scripts(batch_source, paths))
+    {
+        std::cerr << "Could not read scripts from '" << batch_source << "'.\n";
+        std::exit(74); // IO error code
+    }
+
+    unsigned threads = thread_count_set ? thread_count : std::max(1u, std::thread::hardware_concurrency());
+    BatchRunner runner{[](Interpreter &batch_interpreter)
+                       { configure_interpreter(batch_interpreter); }};
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<BatchResult> results;
+    {
+        TraceSpan span{"interpret"};
+        results = runner.run(paths, threads);
+    }
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Each script's output and errors go to files named after its path, or to prism's own streams in order
+    if (!batch_output_path.empty())
+    {
+        std::filesystem::create_directories(batch_output_path);
+    }
+    int exit_status = 0;
+    for (const BatchResult &result : results)
+    {
+        if (batch_output_path.empty())
+        {
+            std::cout << result.output << std::flush;
+            std::cerr << result.errors;
+        }
+        else
+        {
+            std::string name = result.path;
+            std::replace(name.begin(), name.end(), '/', '_');
+            std::replace(name.begin(), name.end(), '\\', '_');
+            std::ofstream{batch_output_path + "/" + name + ".out"} << result.output;
+            std::ofstream{batch_output_path + "/" + name + ".err"} << result.errors;
+        }
+        exit_status = std::max(exit_status, result.exit_status);
+    }
+
+    BatchRunner::write_summary(std::cerr, results, threads, milliseconds);
+    if (exit_status != 0)
+    {
+        std::exit(exit_status); // The worst of the scripts' exit codes
+    }
+}
+
+/**
+ * Compiles a script once, then runs it against each record with the record's fields as globals
+ */
+void execute_records(std::string_view path)
+{
+    auto source = read_file(path);
+    std::vector<Token> tokens;
+    {
+        TraceSpan span{"lex"};
+        tokens = Lexer{source}.scan_tokens();
+    }
+    std::vector<std::shared_ptr<Stmt>> statements;
+    {
+        TraceSpan span{"parse"};
+        statements = Parser{tokens}.parse();
+    }
+    if (error_reporter().had_error)
     {
         std::exit(65); // Syntax error
     }
 
-    if (had_runtime_error)
+    std::ifstream file;
+    if (records_path != "-")
+    {
+        file.open(records_path, std::ios::binary);
+        if (!file)
+        {
+            std::cerr << "Could not open records '" << records_path << "': " << std::strerror(errno) << "\n";
+            std::exit(74); // IO error code
+        }
+    }
+    else
+    {
+        std::ios::sync_with_stdio(false);
+    }
+    std::istream &records = records_path == "-" ? std::cin : file;
+
+    // A bad record or a runtime error is reported with its line number and the next record still runs
+    TraceSpan span{"interpret"};
+    RecordRunner runner{statements};
+    std::string line;
+    for (size_t line_number = 1; std::getline(records, line); line_number++)
+    {
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+        {
+            continue;
+        }
+        try
+        {
+            if (!runner.run(line))
+            {
+                std::cerr << "Record " << line_number << ": " << runner.error() << ".\n";
+                error_reporter().had_runtime_error = true;
+            }
+        }
+        catch (RuntimeError &error)
+        {
+            std::cerr << "Record " << line_number << ": ";
+            runtime_error(error);
+        }
+    }
+
+    if (error_reporter().had_runtime_error)
     {
         std::exit(70); // Runtime error
     }
 }
 
-void interactive_shell()
+void interactive_shell(Engines &engines)
 {
     std::string input_line;
 
@@ -143,11 +663,44 @@ void interactive_shell()
         }
 
         // Execute the entered code
-        run(input_line, true); // Interactive mode
+        run(input_line, engines, true); // Interactive mode
 
         // Reset error state for next line
-        had_error = false;
+        error_reporter().had_error = false;
+    }
+}
+
+/**
+ * Writes the trace and phase summary; registered with atexit so every exit path writes them
+ */
+void write_trace()
+{
+    if (trace_mode)
+    {
+        std::ofstream trace_stream{trace_path};
+        if (!trace_stream)
+        {
+            std::cerr << "Could not write trace '" << trace_path << "'.\n";
+        }
+        trace_recorder().write_json(trace_stream);
+    }
+    if (time_mode)
+    {
+        trace_recorder().write_summary(std::cerr);
+    }
+}
+
+/**
+ * Parses a non-negative count given to a command-line flag, exiting on bad input
+ */
+uint32_t parse_count(const std::string &what, const std::string &text)
+{
+    if (text.empty() || text.size() > 9 || text.find_first_not_of("0123456789") != std::string::npos)
+    {
+        std::cerr << "Invalid " << what << " '" << text << "'.\n";
+        std::exit(64);
     }
+    return static_cast<uint32_t>(std::stoul(text));
 }
 
 int main(int argc, char *argv[])
@@ -181,19 +734,604 @@ int main(int argc, char *argv[])
             i--;    // Process the current position again
             continue;
         }
-    }
 
-    if (argc > 2)
-    {
-        std::cout << "Usage: prism [-v] [-t] [script]\n";
-        std::exit(64);
-    }
-    else if (argc == 2)
-    {
-        execute_file(argv[1]);
+        // Handle type-feedback specialisation opt-out
+        if (std::string(argv[i]) == "--no-specialise")
+        {
+            specialisation_mode = false;
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+
+        // Handle C++ generation
+        if (std::string(argv[i]) == "--emit-cpp")
+        {
+            emit_cpp_mode = true;
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+
+        // Handle the loop JIT and its compile threshold
+        if (std::string(argv[i]) == "--jit" || std::string(argv[i]).rfind("--jit-threshold=", 0) == 0)
+        {
+            jit_mode = true;
+            if (std::string(argv[i]) != "--jit")
+            {
+                jit_threshold = parse_count("JIT threshold", std::string(argv[i]).substr(16));
+            }
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+
+        // Handle lazy parsing and its syntax error mode
+        if (std::string(argv[i]) == "--lazy" || std::string(argv[i]).rfind("--lazy=", 0) == 0)
+        {
+            std::string mode = std::string(argv[i]) == "--lazy" ? "validate" : std::string(argv[i]).substr(7);
+            if (mode == "validate")
+            {
+                lazy_parsing = LazyParsing::VALIDATE;
+            }
+            else if (mode == "deferred")
+            {
+                lazy_parsing = LazyParsing::DEFERRED;
+            }
+            else
+            {
+                std::cerr << "Unknown lazy parsing mode '" << mode << "'.\n";
+                std::exit(64);
+            }
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+
+        // Handle the output flushing policy
+        if (std::string(argv[i]).rfind("--output=", 0) == 0)
+        {
+            std::string policy_name = std::string(argv[i]).substr(9);
+            if (policy_name == "line")
+            {
+                output_policy = OutputSink::FlushPolicy::LINE;
+            }
+            else if (policy_name == "size")
+            {
+                output_policy = OutputSink::FlushPolicy::SIZE;
+            }
+            else if (policy_name == "async")
+            {
+                output_policy = OutputSink::FlushPolicy::ASYNC;
+            }
+            else
+            {
+                std::cerr << "Unknown output policy '" << policy_name << "'.\n";
+                std::exit(64);
+            }
+            output_policy_set = true;
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+
+        // Handle resource limits
+        if (std::string(argv[i]).rfind("--max-steps=", 0) == 0 ||
+            std::string(argv[i]).rfind("--time-limit=", 0) == 0 ||
+            std::string(argv[i]).rfind("--max-memory=", 0) == 0)
+        {
+            std::string flag = argv[i];
+            size_t value_start = flag.find('=') + 1;
+            if (flag[2] == 't')
+            {
+                resource_limits.time_limit = std::chrono::milliseconds{parse_count("time limit", flag.substr(value_start))};
+            }
+            else if (flag[6] == 's')
+            {
+                resource_limits.max_steps = parse_count("step limit", flag.substr(value_start));
+            }
+            else
+            {
+                resource_limits.max_memory_bytes = size_t{1024} * parse_count("memory limit", flag.substr(value_start));
+            }
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+
+        // Handle what visualisations are rendered to, opening them and how much they show
+        if (std::string(argv[i]).rfind("--viz-", 0) == 0)
+        {
+            std::string flag = argv[i];
+            if (flag == "--viz-open")
+            {
+                open_viewer = true;
+            }
+            else if (flag.rfind("--viz-depth=", 0) == 0)
+            {
+                detail_level.max_depth = parse_count("visualisation depth", flag.substr(12));
+            }
+            else if (flag.rfind("--viz-block=", 0) == 0)
+            {
+                detail_level.max_block_statements = parse_count("visualisation block size", flag.substr(12));
+            }
+            else if (flag.rfind("--viz-line=", 0) == 0)
+            {
+                detail_level.focus_line = static_cast<int>(parse_count("visualisation line", flag.substr(11)));
+            }
+            else if (flag.rfind("--viz-format=", 0) != 0)
+            {
+                std::cerr << "Unknown option '" << flag << "'.\n";
+                std::exit(64);
+            }
+            else
+            {
+                std::string format = flag.substr(13);
+                image_format_set = true;
+                if (format == "svg")
+                {
+                    image_format = ImageFormat::SVG;
+                }
+                else if (format == "png")
+                {
+                    image_format = ImageFormat::PNG;
+                }
+                else if (format == "plain")
+                {
+                    image_format = ImageFormat::PLAIN;
+                }
+                else if (format == "dot")
+                {
+                    image_format = ImageFormat::DOT;
+                }
+                else
+                {
+                    std::cerr << "Unknown visualisation format '" << format << "'.\n";
+                    std::exit(64);
+                }
+            }
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+
+        // Handle the heat map and its threshold for collapsing cold subtrees
+        if (std::string(argv[i]) == "--heat" || std::string(argv[i]).rfind("--heat-collapse=", 0) == 0)
+        {
+            std::string flag = argv[i];
+            heat_mode = true;
+            if (flag != "--heat")
+            {
+                std::string percent = flag.substr(16);
+                char *end = nullptr;
+                heat_collapse_percent = std::strtod(percent.c_str(), &end);
+                if (percent.empty() || *end != '\0' || heat_collapse_percent < 0 || heat_collapse_percent > 100)
+                {
+                    std::cerr << "Invalid heat collapse percentage '" << percent << "'.\n";
+                    std::exit(64);
+                }
+            }
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+
+        // Handle images of the globals, given as --snapshot FILE, --restore FILE or with =
+        if (std::string(argv[i]).rfind("--snapshot", 0) == 0 || std::string(argv[i]).rfind("--restore", 0) == 0)
+        {
+            std::string flag = argv[i];
+            bool snapshot = flag.rfind("--snapshot", 0) == 0;
+            std::string name = snapshot ? "--snapshot" : "--restore";
+            std::string &path = snapshot ? snapshot_path : restore_path;
+            int consumed = 1;
+            if (flag.rfind(name + "=", 0) == 0 && flag.size() > name.size() + 1)
+            {
+                path = flag.substr(name.size() + 1);
+            }
+            else if (flag == name && i + 1 < argc)
+            {
+                path = argv[i + 1];
+                consumed = 2;
+            }
+            else
+            {
+                std::cerr << name << " needs an image file.\n";
+                std::exit(64);
+            }
+            // Shift remaining arguments left
+            for (int j = i; j < argc - consumed; j++)
+            {
+                argv[j] = argv[j + consumed];
+            }
+            argc -= consumed; // Fewer arguments to process
+            i--;              // Process the current position again
+            continue;
+        }
+
+        // Handle batch runs, given as --batch DIR or --batch=DIR, and where their output goes
+        if (std::string(argv[i]).rfind("--batch", 0) == 0)
+        {
+            std::string flag = argv[i];
+            int consumed = 1;
+            if (flag.rfind("--batch-output=", 0) == 0)
+            {
+                batch_output_path = flag.substr(15);
+            }
+            else if (flag.rfind("--batch=", 0) == 0)
+            {
+                batch_source = flag.substr(8);
+            }
+            else if (flag == "--batch" && i + 1 < argc)
+            {
+                batch_source = argv[i + 1];
+                consumed = 2;
+            }
+            else
+            {
+                std::cerr << "--batch needs a directory or a list of scripts.\n";
+                std::exit(64);
+            }
+            // Shift remaining arguments left
+            for (int j = i; j < argc - consumed; j++)
+            {
+                argv[j] = argv[j + consumed];
+            }
+            argc -= consumed; // Fewer arguments to process
+            i--;              // Process the current position again
+            continue;
+        }
+
+        // Handle records to run the script against, from --records=FILE or standard input
+        if (std::string(argv[i]) == "--records" || std::string(argv[i]).rfind("--records=", 0) == 0)
+        {
+            std::string flag = argv[i];
+            records_mode = true;
+            records_path = flag == "--records" ? "-" : flag.substr(10);
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+
+        // Handle tracing, slow statement spans and the phase summary
+        if (std::string(argv[i]) == "--trace" || std::string(argv[i]).rfind("--trace=", 0) == 0 ||
+            std::string(argv[i]).rfind("--trace-statements=", 0) == 0 || std::string(argv[i]) == "--time")
+        {
+            std::string flag = argv[i];
+            if (flag == "--time")
+            {
+                time_mode = true;
+            }
+            else if (flag.rfind("--trace-statements=", 0) == 0)
+            {
+                trace_mode = true;
+                trace_statements_mode = true;
+                trace_threshold_us = parse_count("trace threshold", flag.substr(19));
+            }
+            else
+            {
+                trace_mode = true;
+                if (flag != "--trace")
+                {
+                    trace_path = flag.substr(8);
+                }
+            }
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+
+        // Handle the memory report and where its JSON goes
+        if (std::string(argv[i]) == "--mem-report" || std::string(argv[i]).rfind("--mem-report=", 0) == 0)
+        {
+            mem_report_mode = true;
+            if (std::string(argv[i]) != "--mem-report")
+            {
+                mem_report_path = std::string(argv[i]).substr(13);
+            }
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+
+        // Handle sampling profiler output and rate
+        if (std::string(argv[i]) == "--profile" || std::string(argv[i]).rfind("--profile=", 0) == 0 ||
+            std::string(argv[i]).rfind("--profile-rate=", 0) == 0)
+        {
+            std::string flag = argv[i];
+            profile_mode = true;
+            if (flag.rfind("--profile-rate=", 0) == 0)
+            {
+                profile_rate = std::max<uint32_t>(1, parse_count("profile rate", flag.substr(15)));
+            }
+            else if (flag != "--profile")
+            {
+                profile_path = flag.substr(10);
+            }
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+
+        // Handle parallel parsing
+        if (std::string(argv[i]).rfind("--parse-threads=", 0) == 0)
+        {
+            parse_threads = std::max<uint32_t>(1, parse_count("parse thread count", std::string(argv[i]).substr(16)));
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+
+        // Handle time slicing for the resumable engine
+        if (std::string(argv[i]).rfind("--slice=", 0) == 0 || std::string(argv[i]).rfind("--threads=", 0) == 0)
+        {
+            std::string flag = argv[i];
+            if (flag[2] == 's')
+            {
+                time_slice = std::max<uint32_t>(1, parse_count("time slice", flag.substr(8)));
+            }
+            else
+            {
+                thread_count = std::max<uint32_t>(1, parse_count("thread count", flag.substr(10)));
+                thread_count_set = true;
+            }
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+
+        // Handle execution engine selection
+        if (std::string(argv[i]).rfind("--engine=", 0) == 0)
+        {
+            std::string engine_name = std::string(argv[i]).substr(9);
+            if (engine_name == "vm")
+            {
+                engine = Engine::VM;
+            }
+            else if (engine_name == "closure")
+            {
+                engine = Engine::CLOSURE;
+            }
+            else if (engine_name == "resumable")
+            {
+                engine = Engine::RESUMABLE;
+            }
+            else if (engine_name == "tree")
+            {
+                engine = Engine::TREE;
+            }
+            else
+            {
+                std::cerr << "Unknown engine '" << engine_name << "'.\n";
+                std::exit(64);
+            }
+            // Shift remaining arguments left
+            for (int j = i; j < argc - 1; j++)
+            {
+                argv[j] = argv[j + 1];
+            }
+            argc--; // One less argument to process
+            i--;    // Process the current position again
+            continue;
+        }
+    }
+
+    // Limits are only enforced by the tree-walker; Ctrl-C then cancels the run
+    if (resource_limits.any())
+    {
+        if (engine != Engine::TREE || emit_cpp_mode)
+        {
+            std::cerr << "Resource limits need the tree engine.\n";
+            std::exit(64);
+        }
+        if (batch_source.empty())
+        {
+            std::signal(SIGINT, [](int)
+                        { if (cancellable_engines != nullptr)
+                          {
+                              cancellable_engines->interpreter.cancel();
+                              cancellable_engines->heat_interpreter.cancel();
+                          } });
+        }
+    }
+
+    // Samples come from the tree-walker running a single script
+    if (profile_mode)
+    {
+        if (!SamplingProfiler::available())
+        {
+            std::cerr << "Profiling is not available on this platform.\n";
+            std::exit(64);
+        }
+        if (engine != Engine::TREE || emit_cpp_mode || argc != 2)
+        {
+            std::cerr << "Profiling needs a script and the tree engine.\n";
+            std::exit(64);
+        }
+    }
+
+    // Spans are buffered from here on and written when prism exits
+    if (trace_mode || time_mode)
+    {
+        trace_recorder().enable();
+        std::atexit(write_trace);
+    }
+
+    // Runtime allocations are attributed to lines by the tree-walker running a single script
+    if (mem_report_mode && (engine != Engine::TREE || emit_cpp_mode || argc != 2))
+    {
+        std::cerr << "The memory report needs a script and the tree engine.\n";
+        std::exit(64);
+    }
+
+    // Formats and viewers only apply to the images -v draws
+    if ((image_format_set || open_viewer || detail_level.any()) && !visual_mode)
+    {
+        std::cerr << "--viz-format, --viz-open and the --viz detail options need -v.\n";
+        std::exit(64);
+    }
+
+    // A heat map comes from the tree-walker running a single script with -v
+    if (heat_mode && (!visual_mode || engine != Engine::TREE || emit_cpp_mode || profile_mode || argc != 2))
+    {
+        std::cerr << "A heat map needs -v, a script and the tree engine, without --profile.\n";
+        std::exit(64);
+    }
+
+    // A batch runs each script on its own tree-walker, keeping only its output and errors
+    if (!batch_source.empty() &&
+        (argc != 1 || engine != Engine::TREE || emit_cpp_mode || visual_mode || token_mode || profile_mode ||
+         mem_report_mode))
+    {
+        std::cerr << "A batch runs its scripts on the tree engine, without scripts on the command line, "
+                     "visualisation, --profile or --mem-report.\n";
+        std::exit(64);
+    }
+
+    // Records run one script, compiled once, on the closure engine
+    if (records_mode &&
+        (argc != 2 || (engine != Engine::TREE && engine != Engine::CLOSURE) || emit_cpp_mode || visual_mode ||
+         token_mode || profile_mode || mem_report_mode || resource_limits.any() || !batch_source.empty()))
+    {
+        std::cerr << "Records need one script and run it on the closure engine, without visualisation, limits, "
+                     "--profile, --mem-report or --batch.\n";
+        std::exit(64);
+    }
+
+    // Images hold the tree-walker's globals; a snapshot is taken after one script
+    if ((!snapshot_path.empty() || !restore_path.empty()) &&
+        (argc > 2 || engine != Engine::TREE || emit_cpp_mode || heat_mode || !batch_source.empty() || records_mode))
+    {
+        std::cerr << "Images need the tree engine and at most one script, without --emit-cpp, --heat, --batch or "
+                     "--records.\n";
+        std::exit(64);
+    }
+    if (!snapshot_path.empty() && argc != 2)
+    {
+        std::cerr << "--snapshot needs a script to run.\n";
+        std::exit(64);
+    }
+
+    // Route all standard output through the buffered sink
+    if (!output_policy_set && argc < 2 && batch_source.empty())
+    {
+        output_policy = OutputSink::FlushPolicy::LINE;
+    }
+    standard_output().set_policy(output_policy);
+
+    // C++ generation needs a whole script rather than interactive lines
+    // The resumable engine can run several scripts side by side
+    bool scheduling = engine == Engine::RESUMABLE && !emit_cpp_mode && !visual_mode && !token_mode;
+
+    // Engines for the shell or script, set up from the flags
+    auto engines = std::make_unique<Engines>();
+    configure_interpreter(engines->interpreter);
+    configure_interpreter(engines->heat_interpreter);
+    engines->interpreter.set_jit(jit_mode, jit_threshold);
+    engines->interpreter.set_loop_threads(thread_count_set ? thread_count
+                                                           : std::max(1u, std::thread::hardware_concurrency()));
+    cancellable_engines = engines.get();
+    if (!restore_path.empty())
+    {
+        restore_snapshot(*engines);
+    }
+
+    if ((argc > 2 && !scheduling) || (emit_cpp_mode && argc < 2))
+    {
+        std::cout << "Usage: prism [-v] [-t] [--engine=tree|vm|closure|resumable] [--no-specialise] [--jit] [--jit-threshold=N] [--emit-cpp] [--lazy[=validate|deferred]] [--parse-threads=N] [--output=line|size|async] [--max-steps=N] [--time-limit=MS] [--max-memory=KB] [--viz-format=svg|png|plain|dot] [--viz-open] [--viz-depth=N] [--viz-block=N] [--viz-line=N] [--heat] [--heat-collapse=PCT] [--profile[=FILE]] [--mem-report[=FILE]] [--trace[=FILE]] [--trace-statements=US] [--time] [--profile-rate=HZ] [--slice=N] [--threads=N] [--batch DIR|LIST] [--batch-output=DIR] [--records[=FILE]] [--snapshot FILE] [--restore FILE] [script...]\n";
+        std::exit(64);
+    }
+    else if (!batch_source.empty())
+    {
+        execute_batch();
+    }
+    else if (records_mode)
+    {
+        execute_records(argv[1]);
+    }
+    else if (argc > 2)
+    {
+        execute_scheduled(std::vector<std::string>(argv + 1, argv + argc));
+    }
+    else if (argc == 2)
+    {
+        std::string program = execute_file(argv[1], *engines);
+        if (!snapshot_path.empty())
+        {
+            take_snapshot(program, *engines);
+        }
     }
     else
     {
-        interactive_shell();
+        interactive_shell(*engines);
     }
 }
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <variant>
+#include "value.h"
+
+/**
+ * Runtime support for C++ generated by `prism --emit-cpp`
+ *
+ * Statically typed code uses plain doubles, bools and strings; these
+ * helpers cover the dynamically typed paths and reproduce the
+ * interpreter's printing and runtime errors exactly.
+ */
+
+/**
+ * Reports a runtime error like the interpreter and exits with code 70
+ */
+[[noreturn]] inline void runtime_fail(const std::string &message, int line)
+{
+    // Keep stdout ahead of the error, as the interpreter does
+    std::cout.flush();
+    std::cerr << message << "\n"
+              << "[line " << line << "]\n";
+    std::exit(70);
+}
+
+/**
+ * Stands in for a value on a path that has already failed
+ */
+template <typename T>
+[[noreturn]] T unreachable_value()
+{
+    std::abort();
+}
+
+//---------------------------------------------
+// Printing
+//---------------------------------------------
+
+inline void print_value(double number)
+{
+    std::cout << format_number(number) << "\n";
+}
+
+inline void print_value(bool boolean)
+{
+    std::cout << (boolean ? "true" : "false") << "\n";
+}
+
+inline void print_value(const std::string &text)
+{
+    std::cout << text << "\n";
+}
+
+inline void print_value(const Value &value)
+{
+    std::cout << stringify(value) << "\n";
+}
+
+//---------------------------------------------
+// Dynamically typed operators
+//---------------------------------------------
+
+/**
+ * Applies a numeric operator after the interpreter's operand check
+ */
+template <typename Operation>
+auto numeric_values(const Value &left, const Value &right, int line, Operation apply)
+{
+    const double *left_number = std::get_if<double>(&left);
+    const double *right_number = std::get_if<double>(&right);
+    if (left_number == nullptr || right_number == nullptr)
+    {
+        runtime_fail("Operands must be numbers.", line);
+    }
+    return apply(*left_number, *right_number);
+}
+
+inline double subtract_values(const Value &left, const Value &right, int line)
+{
+    return numeric_values(left, right, line, [](double a, double b)
+                          { return a - b; });
+}
+
+inline double multiply_values(const Value &left, const Value &right, int line)
+{
+    return numeric_values(left, right, line, [](double a, double b)
+                          { return a * b; });
+}
+
+inline double divide_values(const Value &left, const Value &right, int line)
+{
+    return numeric_values(left, right, line, [](double a, double b)
+                          { return a / b; });
+}
+
+inline bool greater_values(const Value &left, const Value &right, int line)
+{
+    return numeric_values(left, right, line, [](double a, double b)
+                          { return a > b; });
+}
+
+inline bool greater_equal_values(const Value &left, const Value &right, int line)
+{
+    return numeric_values(left, right, line, [](double a, double b)
+                          { return a >= b; });
+}
+
+inline bool less_values(const Value &left, const Value &right, int line)
+{
+    return numeric_values(left, right, line, [](double a, double b)
+                          { return a < b; });
+}
+
+inline bool less_equal_values(const Value &left, const Value &right, int line)
+{
+    return numeric_values(left, right, line, [](double a, double b)
+                          { return a <= b; });
+}
+
+/**
+ * Adds two numbers or concatenates two strings
+ */
+inline Value add_values(const Value &left, const Value &right, int line)
+{
+    const double *left_number = std::get_if<double>(&left);
+    const double *right_number = std::get_if<double>(&right);
+    if (left_number != nullptr && right_number != nullptr)
+    {
+        return *left_number + *right_number;
+    }
+
+    const std::string *left_text = std::get_if<std::string>(&left);
+    const std::string *right_text = std::get_if<std::string>(&right);
+    if (left_text != nullptr && right_text != nullptr)
+    {
+        return *left_text + *right_text;
+    }
+
+    runtime_fail("Operands must be two numbers or two strings.", line);
+}
+
+inline double negate_value(const Value &operand, int line)
+{
+    const double *number = std::get_if<double>(&operand);
+    if (number == nullptr)
+    {
+        runtime_fail("Operand must be a number.", line);
+    }
+    return -*number;
+}
+
+//---------------------------------------------
+// Parallel loop reductions
+//---------------------------------------------
+
+/**
+ * Starts combining a dynamically typed reduction in blocks
+ * @return The value before the loop, or nil if it is not a number and so is updated in order
+ */
+inline Value reduce_begin(Value &variable, double identity)
+{
+    if (!std::holds_alternative<double>(variable))
+    {
+        return Value{};
+    }
+    Value total = variable;
+    variable = identity;
+    return total;
+}
+
+/**
+ * Combines a block into a reduction's total, then starts the next block
+ * with the identity, or leaves the combined value in the variable if the
+ * loop has ended
+ */
+inline void reduce_block(Value &total, Value &variable, bool multiply, bool last)
+{
+    double *combined = std::get_if<double>(&total);
+    const double *block = std::get_if<double>(&variable);
+    if (combined == nullptr || block == nullptr)
+    {
+        return;
+    }
+    *combined = multiply ? *combined * *block : *combined + *block;
+    variable = last ? *combined : (multiply ? 1.0 : -0.0);
+}
@@ -0,0 +1,376 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "stmt.h"
+
+// Samples are taken by a per-thread CPU timer delivering SIGPROF
+#if defined(__linux__)
+#define PRISM_PROFILER_AVAILABLE 1
+#include <csignal>
+#include <ctime>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Older glibc has no name for the thread a SIGEV_THREAD_ID timer signals
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+/**
+ * Sampling profiler for the tree-walking interpreter
+ *
+ * The interpreter keeps a pointer to the statement it is executing. A timer
+ * measuring the interpreter thread's CPU time raises SIGPROF at a fixed
+ * rate, and the handler copies that pointer into a preallocated buffer.
+ * Nothing else happens while the script runs.
+ *
+ * Prism has no functions, so the statements enclosing the sampled one at
+ * run time are exactly its ancestors in the AST. The chain of enclosing
+ * While, If and Block nodes is therefore rebuilt after the run, from a map
+ * of each statement to its parent.
+ */
+class SamplingProfiler
+{
+public:
+    // Samples per second of CPU time
+    static constexpr uint32_t DEFAULT_RATE = 1000;
+
+private:
+    // Samples kept; a little over four minutes of CPU time at the default rate
+    static constexpr size_t SAMPLE_CAPACITY = 1 << 18;
+
+    // Profiler the signal handler records into
+    inline static SamplingProfiler *sampling = nullptr;
+
+    // Statement the interpreter is executing, owned by the interpreter
+    const std::atomic<const Stmt *> &current_statement;
+
+    // Allocated when sampling first starts
+    std::unique_ptr<const Stmt *[]> samples;
+    std::atomic<size_t> sample_count{0};
+    std::atomic<size_t> dropped_count{0};
+    uint32_t rate = DEFAULT_RATE;
+
+#ifdef PRISM_PROFILER_AVAILABLE
+    timer_t timer{};
+    struct sigaction previous_action{};
+#endif
+
+    /**
+     * SIGPROF handler: records the statement being executed
+     */
+    static void take_sample(int)
+    {
+        SamplingProfiler *profiler = sampling;
+        if (profiler == nullptr)
+        {
+            return;
+        }
+
+        const Stmt *statement = profiler->current_statement.load(std::memory_order_relaxed);
+        if (statement == nullptr)
+        {
+            return;
+        }
+
+        size_t index = profiler->sample_count.load(std::memory_order_relaxed);
+        if (index == SAMPLE_CAPACITY)
+        {
+            profiler->dropped_count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        profiler->samples[index] = statement;
+        profiler->sample_count.store(index + 1, std::memory_order_relaxed);
+    }
+
+    //---------------------------------------------
+    // Rebuilding stacks after the run
+    //---------------------------------------------
+
+    using ParentMap = std::unordered_map<const Stmt *, const Stmt *>;
+
+    /**
+     * Records the parent of every statement below the given one
+     * Unparsed lazy blocks were never entered, so they are not parsed here
+     */
+    static void map_parents(const Stmt *statement, ParentMap &parents)
+    {
+        auto add_child = [&](const std::shared_ptr<Stmt> &child)
+        {
+            if (child != nullptr)
+            {
+                parents[child.get()] = statement;
+                map_parents(child.get(), parents);
+            }
+        };
+
+        switch (statement->kind)
+        {
+        case StmtKind::BLOCK:
+        {
+            const Block *block = static_cast<const Block *>(statement);
+            if (block->is_parsed())
+            {
+                for (const auto &child : block->body())
+                {
+                    add_child(child);
+                }
+            }
+            break;
+        }
+        case StmtKind::IF:
+            add_child(static_cast<const If *>(statement)->then_branch);
+            add_child(static_cast<const If *>(statement)->else_branch);
+            break;
+        case StmtKind::WHILE:
+            add_child(static_cast<const While *>(statement)->body);
+            break;
+        default:
+            break;
+        }
+    }
+
+    static ParentMap map_program(const std::vector<std::shared_ptr<Stmt>> &program)
+    {
+        ParentMap parents;
+        for (const auto &statement : program)
+        {
+            parents[statement.get()] = nullptr;
+            map_parents(statement.get(), parents);
+        }
+        return parents;
+    }
+
+    /**
+     * The sampled statement and everything enclosing it, outermost first
+     */
+    static std::vector<const Stmt *> stack_of(const Stmt *statement, const ParentMap &parents)
+    {
+        std::vector<const Stmt *> stack;
+        while (statement != nullptr)
+        {
+            stack.push_back(statement);
+            auto parent = parents.find(statement);
+            statement = parent != parents.end() ? parent->second : nullptr;
+        }
+        std::reverse(stack.begin(), stack.end());
+        return stack;
+    }
+
+    static std::string frame_name(const Stmt *statement)
+    {
+        return std::string{stmt_kind_name(statement->kind)} +
+               " (line " + std::to_string(statement->line_number) + ")";
+    }
+
+    /**
+     * Samples per distinct statement, so each stack is only rebuilt once
+     */
+    std::unordered_map<const Stmt *, size_t> count_statements() const
+    {
+        std::unordered_map<const Stmt *, size_t> counts;
+        size_t total = sample_count.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < total; i++)
+        {
+            counts[samples[i]]++;
+        }
+        return counts;
+    }
+
+public:
+    explicit SamplingProfiler(const std::atomic<const Stmt *> &executing)
+        : current_statement{executing}
+    {
+    }
+
+    SamplingProfiler(const SamplingProfiler &) = delete;
+    SamplingProfiler &operator=(const SamplingProfiler &) = delete;
+
+    ~SamplingProfiler()
+    {
+        stop();
+    }
+
+    /**
+     * Whether this platform can take samples at all
+     */
+    static bool available()
+    {
+#ifdef PRISM_PROFILER_AVAILABLE
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * Starts sampling the calling thread, which must be the interpreter's
+     * @return Whether the timer could be started
+     */
+    bool start(uint32_t samples_per_second = DEFAULT_RATE)
+    {
+#ifdef PRISM_PROFILER_AVAILABLE
+        if (samples == nullptr)
+        {
+            samples.reset(new const Stmt *[SAMPLE_CAPACITY]);
+        }
+        rate = std::max<uint32_t>(1, samples_per_second);
+        sample_count.store(0, std::memory_order_relaxed);
+        dropped_count.store(0, std::memory_order_relaxed);
+        sampling = this;
+
+        struct sigaction action{};
+        action.sa_handler = &SamplingProfiler::take_sample;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, &previous_action);
+
+        // Signal this thread only, after every interval of its CPU time
+        struct sigevent event{};
+        event.sigev_notify = SIGEV_THREAD_ID;
+        event.sigev_signo = SIGPROF;
+        event.sigev_notify_thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+        if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer) != 0)
+        {
+            sigaction(SIGPROF, &previous_action, nullptr);
+            sampling = nullptr;
+            return false;
+        }
+
+        long interval_ns = 1000000000L / rate;
+        struct itimerspec period{};
+        period.it_interval.tv_sec = interval_ns / 1000000000L;
+        period.it_interval.tv_nsec = interval_ns % 1000000000L;
+        period.it_value = period.it_interval;
+        timer_settime(timer, 0, &period, nullptr);
+        return true;
+#else
+        (void)samples_per_second;
+        return false;
+#endif
+    }
+
+    /**
+     * Stops sampling; the samples taken are kept for the reports
+     */
+    void stop()
+    {
+#ifdef PRISM_PROFILER_AVAILABLE
+        if (sampling == this)
+        {
+            timer_delete(timer);
+            sigaction(SIGPROF, &previous_action, nullptr);
+            sampling = nullptr;
+        }
+#endif
+    }
+
+    size_t samples_taken() const
+    {
+        return sample_count.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Writes one line per distinct stack in collapsed-stack format
+     * Frames are separated by semicolons and followed by the sample count,
+     * as read by flamegraph.pl, speedscope and similar tools.
+     */
+    void write_folded(std::ostream &out, const std::vector<std::shared_ptr<Stmt>> &program) const
+    {
+        ParentMap parents = map_program(program);
+
+        // Statements on the same path are merged; ordered for stable output
+        std::map<std::string, size_t> stacks;
+        for (const auto &[statement, count] : count_statements())
+        {
+            std::string folded;
+            for (const Stmt *frame : stack_of(statement, parents))
+            {
+                folded += folded.empty() ? "" : ";";
+                folded += frame_name(frame);
+            }
+            stacks[folded] += count;
+        }
+
+        for (const auto &[folded, count] : stacks)
+        {
+            out << folded << ' ' << count << '\n';
+        }
+    }
+
+    /**
+     * Writes the share of samples spent on each source line
+     * Self counts samples taken in a statement on the line; total also
+     * counts samples in statements nested inside it.
+     */
+    void write_line_summary(std::ostream &out, const std::vector<std::shared_ptr<Stmt>> &program,
+                            std::string_view source) const
+    {
+        ParentMap parents = map_program(program);
+
+        struct LineCounts
+        {
+            size_t self = 0;
+            size_t total = 0;
+        };
+        std::map<int, LineCounts> lines;
+        for (const auto &[statement, count] : count_statements())
+        {
+            lines[statement->line_number].self += count;
+
+            // A line counts once per sample, however many of its statements enclose it
+            std::vector<int> stack_lines;
+            for (const Stmt *frame : stack_of(statement, parents))
+            {
+                if (std::find(stack_lines.begin(), stack_lines.end(), frame->line_number) == stack_lines.end())
+                {
+                    stack_lines.push_back(frame->line_number);
+                    lines[frame->line_number].total += count;
+                }
+            }
+        }
+
+        // Split the source into lines so each row can show its code
+        std::vector<std::string_view> source_lines;
+        for (size_t start = 0; start <= source.size();)
+        {
+            size_t end = std::min(source.find('\n', start), source.size());
+            source_lines.push_back(source.substr(start, end - start));
+            start = end + 1;
+        }
+
+        size_t total = samples_taken();
+        out << "Profile: " << total << " samples at " << rate << " Hz";
+        if (size_t dropped = dropped_count.load(std::memory_order_relaxed))
+        {
+            out << " (" << dropped << " dropped)";
+        }
+        out << "\n   total     self   line  source\n";
+
+        for (const auto &[line, counts] : lines)
+        {
+            char row[48];
+            std::snprintf(row, sizeof(row), "%7.1f%% %7.1f%% %6d  ",
+                          100.0 * counts.total / std::max<size_t>(total, 1),
+                          100.0 * counts.self / std::max<size_t>(total, 1), line);
+            out << row;
+            if (line >= 1 && static_cast<size_t>(line) <= source_lines.size())
+            {
+                out << source_lines[line - 1];
+            }
+            out << '\n';
+        }
+    }
+};
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "closure_engine.h"
+#include "stmt.h"
+#include "value.h"
+
+/**
+ * Runs one compiled program against many input records
+ *
+ * Each record is one line of NDJSON: a flat object whose fields become the
+ * program's globals for that run, as if each were declared with `var`.
+ * Numbers, strings, true, false and null are accepted; nested objects and
+ * arrays are not. The program is parsed and compiled once, and between
+ * records the globals are reset rather than rebuilt, so a record costs
+ * only its parse, its bindings and the run itself.
+ */
+class RecordRunner
+{
+private:
+    CompiledProgram program;
+
+    // Global bound by each field position of the previous record, so records
+    // whose keys come in the same order skip the lookup by name
+    std::vector<std::pair<std::string, uint32_t>> field_globals;
+
+    // Decoded key and string value of the field being parsed, reused throughout
+    std::string key;
+    std::string text;
+
+    // Record being parsed and the position in it
+    std::string_view record;
+    size_t position = 0;
+
+    // Why the record was rejected, when it was
+    const char *problem = nullptr;
+
+    bool fail(const char *message)
+    {
+        problem = message;
+        return false;
+    }
+
+    void skip_space()
+    {
+        while (position < record.size() &&
+               (record[position] == ' ' || record[position] == '\t' || record[position] == '\r'))
+        {
+            position++;
+        }
+    }
+
+    bool consume(char expected)
+    {
+        skip_space();
+        if (position < record.size() && record[position] == expected)
+        {
+            position++;
+            return true;
+        }
+        return false;
+    }
+
+    bool consume_word(std::string_view word)
+    {
+        if (record.substr(position, word.size()) == word)
+        {
+            position += word.size();
+            return true;
+        }
+        return false;
+    }
+
+    bool is_digit(size_t at) const
+    {
+        return at < record.size() && record[at] >= '0' && record[at] <= '9';
+    }
+
+    size_t skip_digits(size_t at) const
+    {
+        while (is_digit(at))
+        {
+            at++;
+        }
+        return at;
+    }
+
+    /**
+     * Finds the end of the JSON number at position: an optional '-', then 0
+     * or digits not starting with 0, then optionally '.' and digits, then
+     * optionally 'e' or 'E', a sign and digits
+     * @return The end of the number, or 0 if the text there is not one
+     */
+    size_t number_end() const
+    {
+        size_t at = position;
+        if (at < record.size() && record[at] == '-')
+        {
+            at++;
+        }
+        if (!is_digit(at))
+        {
+            return 0;
+        }
+        at = record[at] == '0' ? at + 1 : skip_digits(at);
+        if (at < record.size() && record[at] == '.')
+        {
+            if (!is_digit(++at))
+            {
+                return 0;
+            }
+            at = skip_digits(at);
+        }
+        if (at < record.size() && (record[at] == 'e' || record[at] == 'E'))
+        {
+            at++;
+            if (at < record.size() && (record[at] == '+' || record[at] == '-'))
+            {
+                at++;
+            }
+            if (!is_digit(at))
+            {
+                return 0;
+            }
+            at = skip_digits(at);
+        }
+        // A digit straight after a leading 0 is a leading zero, which JSON forbids
+        return is_digit(at) ? 0 : at;
+    }
+
+    /**
+     * Appends a code point as UTF-8
+     */
+    static void append_utf8(std::string &out, uint32_t code_point)
+    {
+        if (code_point < 0x80)
+        {
+            out += static_cast<char>(code_point);
+        }
+        else if (code_point < 0x800)
+        {
+            out += static_cast<char>(0xC0 | (code_point >> 6));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+        else if (code_point < 0x10000)
+        {
+            out += static_cast<char>(0xE0 | (code_point >> 12));
+            out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+        else
+        {
+            out += static_cast<char>(0xF0 | (code_point >> 18));
+            out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+    }
+
+    bool parse_hex4(uint32_t &value)
+    {
+        if (position + 4 > record.size())
+        {
+            return false;
+        }
+        auto [end, error] = std::from_chars(record.data() + position, record.data() + position + 4, value, 16);
+        if (error != std::errc{} || end != record.data() + position + 4)
+        {
+            return false;
+        }
+        position += 4;
+        return true;
+    }
+
+    /**
+     * Parses a string after its opening quote, decoding escapes into out
+     */
+    bool parse_string(std::string &out)
+    {
+        out.clear();
+        while (position < record.size())
+        {
+            // Copy the run of plain characters in one go
+            size_t run_end = record.find_first_of("\"\\", position);
+            if (run_end == std::string_view::npos)
+            {
+                break;
+            }
+            out.append(record, position, run_end - position);
+            position = run_end + 1;
+            if (record[run_end] == '"')
+            {
+                return true;
+            }
+
+            if (position >= record.size())
+            {
+                break;
+            }
+            char escape = record[position++];
+            switch (escape)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                out += escape;
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'u':
+            {
+                uint32_t code_point = 0;
+                if (!parse_hex4(code_point))
+                {
+                    return fail("invalid \\u escape");
+                }
+
+                // A high surrogate must be followed by its low half
+                if (code_point >= 0xD800 && code_point < 0xDC00)
+                {
+                    uint32_t low = 0;
+                    if (!consume_word("\\u") || !parse_hex4(low) || low < 0xDC00 || low >= 0xE000)
+                    {
+                        return fail("unpaired surrogate in \\u escape");
+                    }
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                }
+                append_utf8(out, code_point);
+                break;
+            }
+            default:
+                return fail("invalid escape in string");
+            }
+        }
+        return fail("unterminated string");
+    }
+
+    /**
+     * Global for the field at this position, looked up by name only when
+     * the key differs from the previous record's
+     */
+    uint32_t field_global(size_t field)
+    {
+        if (field < field_globals.size())
+        {
+            if (field_globals[field].first != key)
+            {
+                field_globals[field] = {key, program.global(key)};
+            }
+        }
+        else
+        {
+            field_globals.emplace_back(key, program.global(key));
+        }
+        return field_globals[field].second;
+    }
+
+    /**
+     * Parses one value and binds it to the global
+     */
+    bool parse_value(uint32_t global)
+    {
+        skip_space();
+        if (position >= record.size())
+        {
+            return fail("missing value");
+        }
+
+        char first = record[position];
+        if (first == '"')
+        {
+            position++;
+            if (!parse_string(text))
+            {
+                return false;
+            }
+            program.bind_text(global, text);
+            return true;
+        }
+        if (consume_word("true"))
+        {
+            program.bind(global, true);
+            return true;
+        }
+        if (consume_word("false"))
+        {
+            program.bind(global, false);
+            return true;
+        }
+        if (consume_word("null"))
+        {
+            program.bind(global, nullptr);
+            return true;
+        }
+        if (first == '{' || first == '[')
+        {
+            return fail("nested objects and arrays are not supported");
+        }
+
+        // from_chars is laxer than JSON, taking 01, 1. and inf, so the syntax is checked first
+        size_t end = number_end();
+        if (end == 0)
+        {
+            return fail(first == '-' || (first >= '0' && first <= '9') ? "invalid number" : "invalid value");
+        }
+        double number = 0;
+        auto [parsed, error] = std::from_chars(record.data() + position, record.data() + end, number);
+        if (error == std::errc::result_out_of_range)
+        {
+            return fail("number out of range");
+        }
+        if (error != std::errc{} || parsed != record.data() + end)
+        {
+            return fail("invalid number");
+        }
+        position = end;
+        program.bind(global, number);
+        return true;
+    }
+
+public:
+    explicit RecordRunner(const std::vector<std::shared_ptr<Stmt>> &statements)
+        : program{statements}
+    {
+    }
+
+    /**
+     * Binds a record's fields and runs the program against them
+     * @return False if the record is not a flat JSON object; see error()
+     * @throws RuntimeError from the program, for the caller to report
+     */
+    bool run(std::string_view line)
+    {
+        record = line;
+        position = 0;
+        problem = nullptr;
+        program.reset();
+
+        if (!consume('{'))
+        {
+            return fail("expected a JSON object");
+        }
+        if (!consume('}'))
+        {
+            for (size_t field = 0;; field++)
+            {
+                if (!consume('"'))
+                {
+                    return fail("expected a field name");
+                }
+                if (!parse_string(key))
+                {
+                    return false;
+                }
+                if (!consume(':'))
+                {
+                    return fail("expected ':' after a field name");
+                }
+                if (!parse_value(field_global(field)))
+                {
+                    return false;
+                }
+                if (consume('}'))
+                {
+                    break;
+                }
+                if (!consume(','))
+                {
+                    return fail("expected ',' or '}'");
+                }
+            }
+        }
+
+        skip_space();
+        if (position != record.size())
+        {
+            return fail("unexpected text after the object");
+        }
+
+        program.run();
+        return true;
+    }
+
+    /**
+     * Why the last record was rejected
+     */
+    const char *error() const
+    {
+        return problem;
+    }
+};
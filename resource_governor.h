@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "runtime_error.h"
+#include "token.h"
+#include "token_type.h"
+
+/**
+ * Limits on a single run of the interpreter; zero means unlimited
+ */
+struct ResourceLimits
+{
+    // Statements executed plus loop iterations
+    uint64_t max_steps = 0;
+
+    // Wall-clock time from the start of the run
+    std::chrono::milliseconds time_limit{0};
+
+    // Bytes held by variables, strings and scopes
+    size_t max_memory_bytes = 0;
+
+    bool any() const
+    {
+        return max_steps != 0 || time_limit.count() != 0 || max_memory_bytes != 0;
+    }
+};
+
+/**
+ * Which limit stopped a run
+ */
+enum class ResourceKind
+{
+    STEPS,
+    TIME,
+    MEMORY,
+    CANCELLED
+};
+
+/**
+ * Runtime error raised when a run exceeds one of its limits or is cancelled
+ * Derives from RuntimeError so it is reported like any other runtime error,
+ * but hosts can catch it separately and check which limit was hit.
+ */
+class ResourceLimitError : public RuntimeError
+{
+public:
+    const ResourceKind kind;
+
+    ResourceLimitError(ResourceKind limit_kind, int line, std::string_view message)
+        : RuntimeError{Token{END_OF_FILE, "", {}, line}, message}, kind{limit_kind}
+    {
+    }
+};
+
+/**
+ * Meters a run against its ResourceLimits
+ *
+ * The interpreter checks active() before calling in, so a run without
+ * limits pays one predictable branch per step. Steps are counted exactly;
+ * the clock is only read every CLOCK_CHECK_INTERVAL steps.
+ *
+ * Memory is an estimate of live bytes: each scope and variable is charged
+ * when created and refunded when its scope ends, and a new string is
+ * refused if it would not fit in what is left.
+ */
+class ResourceGovernor
+{
+public:
+    // Approximate cost of a scope and of one variable in it
+    static constexpr size_t SCOPE_BYTES = 128;
+    static constexpr size_t VARIABLE_BYTES = 96;
+
+private:
+    // Steps between reads of the clock
+    static constexpr uint32_t CLOCK_CHECK_INTERVAL = 1024;
+
+    ResourceLimits limits;
+
+    // Set while there is anything to meter; cancel() may set it from another thread
+    std::atomic<bool> metering{false};
+    std::atomic<bool> cancel_requested{false};
+
+    uint64_t steps_taken = 0;
+    uint32_t until_clock_check = CLOCK_CHECK_INTERVAL;
+    std::chrono::steady_clock::time_point deadline;
+    size_t bytes_in_use = 0;
+
+    bool fits(size_t bytes) const
+    {
+        return bytes_in_use <= limits.max_memory_bytes && bytes <= limits.max_memory_bytes - bytes_in_use;
+    }
+
+    [[noreturn]] void fail(ResourceKind kind, int line)
+    {
+        switch (kind)
+        {
+        case ResourceKind::STEPS:
+            throw ResourceLimitError{kind, line, "Step limit exceeded."};
+        case ResourceKind::TIME:
+            throw ResourceLimitError{kind, line, "Time limit exceeded."};
+        case ResourceKind::MEMORY:
+            throw ResourceLimitError{kind, line, "Memory limit exceeded."};
+        default:
+            throw ResourceLimitError{kind, line, "Execution cancelled."};
+        }
+    }
+
+public:
+    /**
+     * Sets the limits for subsequent runs
+     */
+    void set_limits(const ResourceLimits &new_limits)
+    {
+        limits = new_limits;
+        metering.store(limits.any(), std::memory_order_relaxed);
+    }
+
+    const ResourceLimits &current_limits() const
+    {
+        return limits;
+    }
+
+    /**
+     * Starts a run: resets the step count and the deadline
+     * Memory in use carries over, as variables outlive a run, and so does a
+     * cancel sent since the last run finished, which stops this one
+     */
+    void start_run()
+    {
+        steps_taken = 0;
+        until_clock_check = CLOCK_CHECK_INTERVAL;
+        deadline = std::chrono::steady_clock::now() + limits.time_limit;
+        metering.store(limits.any() || cancel_requested.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    /**
+     * Finishes a run, so a cancel it has answered does not stop the next one
+     */
+    void finish_run()
+    {
+        cancel_requested.store(false, std::memory_order_relaxed);
+        metering.store(limits.any(), std::memory_order_relaxed);
+    }
+
+    /**
+     * Asks the current run, or the next if none is in progress, to stop at
+     * its next step; safe from any thread
+     */
+    void cancel()
+    {
+        cancel_requested.store(true, std::memory_order_relaxed);
+        metering.store(true, std::memory_order_relaxed);
+    }
+
+    /**
+     * Whether steps need to be reported at all
+     */
+    bool active() const
+    {
+        return metering.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Whether memory use needs to be tracked
+     */
+    bool limits_memory() const
+    {
+        return limits.max_memory_bytes != 0;
+    }
+
+    /**
+     * Counts one statement or loop iteration at the given line
+     */
+    void step(int line)
+    {
+        if (cancel_requested.load(std::memory_order_relaxed))
+        {
+            fail(ResourceKind::CANCELLED, line);
+        }
+
+        if (limits.max_steps != 0 && ++steps_taken > limits.max_steps)
+        {
+            fail(ResourceKind::STEPS, line);
+        }
+
+        if (limits.time_limit.count() != 0 && --until_clock_check == 0)
+        {
+            until_clock_check = CLOCK_CHECK_INTERVAL;
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                fail(ResourceKind::TIME, line);
+            }
+        }
+    }
+
+    /**
+     * Records bytes newly held, failing if that goes over the cap
+     */
+    void charge(size_t bytes, int line)
+    {
+        if (!fits(bytes))
+        {
+            fail(ResourceKind::MEMORY, line);
+        }
+        bytes_in_use += bytes;
+    }
+
+    /**
+     * Records bytes no longer held
+     */
+    void release(size_t bytes)
+    {
+        bytes_in_use -= std::min(bytes, bytes_in_use);
+    }
+
+    /**
+     * Fails if a new string of the given size would not fit under the cap
+     */
+    void check_allocation(size_t bytes, int line)
+    {
+        if (!fits(bytes))
+        {
+            fail(ResourceKind::MEMORY, line);
+        }
+    }
+};
@@ -0,0 +1,565 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "expr.h"
+#include "parallel_loop.h"
+#include "runtime_error.h"
+#include "stmt.h"
+#include "value.h"
+
+/**
+ * Tree-walking interpreter that keeps its continuation on an explicit stack
+ *
+ * Instead of recursing through the AST on the native stack, each node being
+ * evaluated is a Frame recording how far it has got. resume() advances
+ * frames one step at a time and returns once its step budget is spent, so
+ * a program can be paused at any point and resumed later, possibly on
+ * another thread. Nesting depth is limited only by heap memory.
+ *
+ * Output and runtime errors match the Interpreter. The AST is only read,
+ * so many instances can run the same program concurrently.
+ */
+class ResumableInterpreter
+{
+public:
+    enum class Status
+    {
+        SUSPENDED, // Budget ran out, or not started yet
+        FINISHED,  // Ran every loaded statement
+        FAILED     // Stopped by a runtime error
+    };
+
+private:
+    // A node in progress; stage counts the steps it has completed
+    struct Frame
+    {
+        const Expr *expr;
+        const Stmt *stmt;
+        uint32_t stage;
+    };
+
+    // Loaded top-level statements and the next one to run
+    std::vector<std::shared_ptr<Stmt>> program;
+    size_t next_statement = 0;
+
+    // Continuation: nodes in progress, innermost last
+    std::vector<Frame> frames;
+
+    // Results of evaluated subexpressions
+    std::vector<Value> values;
+
+    // Scope chain, globals first; blocks nest strictly so a stack suffices
+    std::vector<std::unordered_map<std::string, Value>> scopes;
+
+    // Reductions of the parallel loops in progress, innermost last
+    std::vector<ReductionBlocks> reduction_blocks;
+
+    std::ostream &out;
+    std::ostream &err;
+    Status current_status = Status::SUSPENDED;
+
+    //---------------------------------------------
+    // Frames and scopes
+    //---------------------------------------------
+
+    void push_expr(const Expr &expr)
+    {
+        frames.push_back(Frame{&expr, nullptr, 0});
+    }
+
+    void push_stmt(const Stmt &stmt)
+    {
+        frames.push_back(Frame{nullptr, &stmt, 0});
+    }
+
+    Value pop_value()
+    {
+        Value value = std::move(values.back());
+        values.pop_back();
+        return value;
+    }
+
+    Value *find(const std::string &name)
+    {
+        for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope)
+        {
+            auto iter = scope->find(name);
+            if (iter != scope->end())
+            {
+                return &iter->second;
+            }
+        }
+        return nullptr;
+    }
+
+    //---------------------------------------------
+    // Operators
+    //---------------------------------------------
+
+    static const double &number_operand(const Token &op, const Value &operand)
+    {
+        const double *number = std::get_if<double>(&operand);
+        if (number == nullptr)
+        {
+            throw RuntimeError{op, "Operand must be a number."};
+        }
+        return *number;
+    }
+
+    static void check_number_operands(const Token &op, const Value &left, const Value &right)
+    {
+        if (!std::holds_alternative<double>(left) || !std::holds_alternative<double>(right))
+        {
+            throw RuntimeError{op, "Operands must be numbers."};
+        }
+    }
+
+    /**
+     * Applies a binary operator, storing the result in left
+     */
+    static void apply_binary(const Binary &expr, Value &left, const Value &right)
+    {
+        const Token &op = expr.operator_token;
+        switch (op.type)
+        {
+        case EQUAL_EQUAL:
+            left = is_equal(left, right);
+            return;
+        case BANG_EQUAL:
+            left = !is_equal(left, right);
+            return;
+
+        case PLUS:
+            // Handle number addition
+            if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right))
+            {
+                left = std::get<double>(left) + std::get<double>(right);
+                return;
+            }
+
+            // Handle string concatenation
+            if (std::holds_alternative<std::string>(left) && std::holds_alternative<std::string>(right))
+            {
+                std::get<std::string>(left) += std::get<std::string>(right);
+                return;
+            }
+            throw RuntimeError{op, "Operands must be two numbers or two strings."};
+
+        default:
+            break;
+        }
+
+        check_number_operands(op, left, right);
+        double a = std::get<double>(left);
+        double b = std::get<double>(right);
+        switch (op.type)
+        {
+        case GREATER:
+            left = a > b;
+            break;
+        case GREATER_EQUAL:
+            left = a >= b;
+            break;
+        case LESS:
+            left = a < b;
+            break;
+        case LESS_EQUAL:
+            left = a <= b;
+            break;
+        case MINUS:
+            left = a - b;
+            break;
+        case STAR:
+            left = a * b;
+            break;
+        default:
+            left = a / b;
+            break;
+        }
+    }
+
+    //---------------------------------------------
+    // Stepping
+    //---------------------------------------------
+
+    /**
+     * Advances the expression on top of the frame stack by one step
+     */
+    void step_expr(Frame &frame)
+    {
+        const Expr &node = *frame.expr;
+        switch (node.kind)
+        {
+        case ExprKind::LITERAL:
+            values.push_back(value_from_any(static_cast<const Literal &>(node).literal_value));
+            frames.pop_back();
+            return;
+
+        case ExprKind::VARIABLE:
+        {
+            const Token &name = static_cast<const Variable &>(node).var_name;
+            Value *value = find(name.lexeme);
+            if (value == nullptr)
+            {
+                throw RuntimeError{name, "Undefined variable '" + name.lexeme + "'."};
+            }
+            values.push_back(*value);
+            frames.pop_back();
+            return;
+        }
+
+        case ExprKind::ASSIGN:
+        {
+            const Assign &expr = static_cast<const Assign &>(node);
+            if (frame.stage++ == 0)
+            {
+                push_expr(*expr.expr_value);
+                return;
+            }
+
+            // The assigned value stays on the stack as the result
+            Value *target = find(expr.var_name.lexeme);
+            if (target == nullptr)
+            {
+                throw RuntimeError{expr.var_name,
+                                   "Cannot assign to undefined variable '" + expr.var_name.lexeme + "'."};
+            }
+            *target = values.back();
+            frames.pop_back();
+            return;
+        }
+
+        case ExprKind::GROUPING:
+            if (frame.stage++ == 0)
+            {
+                push_expr(*static_cast<const Grouping &>(node).inner_expr);
+                return;
+            }
+            frames.pop_back();
+            return;
+
+        case ExprKind::UNARY:
+        {
+            const Unary &expr = static_cast<const Unary &>(node);
+            if (frame.stage++ == 0)
+            {
+                push_expr(*expr.operand);
+                return;
+            }
+
+            Value &operand = values.back();
+            if (expr.operator_token.type == BANG)
+            {
+                operand = !is_truthy(operand);
+            }
+            else
+            {
+                operand = -number_operand(expr.operator_token, operand);
+            }
+            frames.pop_back();
+            return;
+        }
+
+        case ExprKind::BINARY:
+        {
+            const Binary &expr = static_cast<const Binary &>(node);
+            switch (frame.stage++)
+            {
+            case 0:
+                push_expr(*expr.left_expr);
+                return;
+            case 1:
+                push_expr(*expr.right_expr);
+                return;
+            default:
+            {
+                Value right = pop_value();
+                apply_binary(expr, values.back(), right);
+                frames.pop_back();
+                return;
+            }
+            }
+        }
+
+        case ExprKind::LOGICAL:
+        {
+            const Logical &expr = static_cast<const Logical &>(node);
+            switch (frame.stage++)
+            {
+            case 0:
+                push_expr(*expr.left_expr);
+                return;
+            case 1:
+            {
+                // Short-circuit: keep the left value as the result
+                bool left_truthy = is_truthy(values.back());
+                if (expr.operator_token.type == OR ? left_truthy : !left_truthy)
+                {
+                    frames.pop_back();
+                    return;
+                }
+                values.pop_back();
+                push_expr(*expr.right_expr);
+                return;
+            }
+            default:
+                frames.pop_back();
+                return;
+            }
+        }
+        }
+    }
+
+    /**
+     * Advances the statement on top of the frame stack by one step
+     */
+    void step_stmt(Frame &frame)
+    {
+        const Stmt &node = *frame.stmt;
+        switch (node.kind)
+        {
+        case StmtKind::EXPRESSION:
+            if (frame.stage++ == 0)
+            {
+                push_expr(*static_cast<const Expression &>(node).expression);
+                return;
+            }
+            values.pop_back();
+            frames.pop_back();
+            return;
+
+        case StmtKind::PRINT:
+            if (frame.stage++ == 0)
+            {
+                push_expr(*static_cast<const Print &>(node).expression);
+                return;
+            }
+            out << stringify(pop_value()) << "\n";
+            frames.pop_back();
+            return;
+
+        case StmtKind::VAR:
+        {
+            const Var &stmt = static_cast<const Var &>(node);
+            if (frame.stage++ == 0)
+            {
+                // Evaluate initialiser if present, otherwise nil
+                if (stmt.initialiser != nullptr)
+                {
+                    push_expr(*stmt.initialiser);
+                }
+                else
+                {
+                    values.push_back(nullptr);
+                }
+                return;
+            }
+            scopes.back()[stmt.name.lexeme] = pop_value();
+            frames.pop_back();
+            return;
+        }
+
+        case StmtKind::BLOCK:
+        {
+            // Stage 0 opens the scope, stage i runs statement i - 1
+            const Block &stmt = static_cast<const Block &>(node);
+            uint32_t stage = frame.stage++;
+            if (stage == 0)
+            {
+                scopes.emplace_back();
+                return;
+            }
+            const std::vector<std::shared_ptr<Stmt>> &statements = stmt.body();
+            if (stage <= statements.size())
+            {
+                push_stmt(*statements[stage - 1]);
+                return;
+            }
+            scopes.pop_back();
+            frames.pop_back();
+            return;
+        }
+
+        case StmtKind::IF:
+        {
+            const If &stmt = static_cast<const If &>(node);
+            if (frame.stage++ == 0)
+            {
+                push_expr(*stmt.condition);
+                return;
+            }
+
+            // Replace the if with the chosen branch
+            bool condition = is_truthy(pop_value());
+            frames.pop_back();
+            if (condition)
+            {
+                push_stmt(*stmt.then_branch);
+            }
+            else if (stmt.else_branch != nullptr)
+            {
+                push_stmt(*stmt.else_branch);
+            }
+            return;
+        }
+
+        case StmtKind::WHILE:
+        {
+            const While &stmt = static_cast<const While &>(node);
+            if (stmt.parallel != nullptr && !stmt.parallel->reductions.empty())
+            {
+                reducing_while_step(stmt, frame);
+                return;
+            }
+            if (frame.stage == 0)
+            {
+                frame.stage = 1;
+                push_expr(*stmt.condition);
+                return;
+            }
+
+            // Run the body, then come back to test the condition again
+            if (!is_truthy(pop_value()))
+            {
+                frames.pop_back();
+                return;
+            }
+            frame.stage = 0;
+            push_stmt(*stmt.body);
+            return;
+        }
+        }
+    }
+
+    /**
+     * Advances a parallel loop with reductions, combining each reduction in
+     * blocks as the Interpreter does; takes as many steps as any other loop
+     * Stages: 0 entering, 1 condition evaluated, 2 body finished
+     */
+    void reducing_while_step(const While &stmt, Frame &frame)
+    {
+        auto find_number = [this](const Reduction &reduction)
+        {
+            Value *value = find(reduction.name.lexeme);
+            return value != nullptr ? std::get_if<double>(value) : nullptr;
+        };
+
+        if (frame.stage == 0)
+        {
+            reduction_blocks.emplace_back(stmt.parallel->reductions);
+            reduction_blocks.back().begin(find_number);
+        }
+        else if (frame.stage == 1)
+        {
+            if (!is_truthy(pop_value()))
+            {
+                reduction_blocks.back().finish(find_number);
+                reduction_blocks.pop_back();
+                frames.pop_back();
+                return;
+            }
+            frame.stage = 2;
+            push_stmt(*stmt.body);
+            return;
+        }
+        else
+        {
+            reduction_blocks.back().end_iteration(find_number);
+        }
+        frame.stage = 1;
+        push_expr(*stmt.condition);
+    }
+
+    /**
+     * Reports a runtime error like runtime_error() and drops the continuation
+     */
+    void fail(const RuntimeError &error)
+    {
+        err << error.what() << "\n"
+            << "[line " << error.token.line_number << "]\n";
+        frames.clear();
+        values.clear();
+        reduction_blocks.clear();
+        scopes.resize(1);
+        current_status = Status::FAILED;
+    }
+
+public:
+    explicit ResumableInterpreter(std::ostream &output = std::cout, std::ostream &errors = std::cerr)
+        : scopes(1), out{output}, err{errors}
+    {
+    }
+
+    Status status() const
+    {
+        return current_status;
+    }
+
+    /**
+     * Queues more top-level statements; globals from earlier ones persist
+     */
+    void load(const std::vector<std::shared_ptr<Stmt>> &statements)
+    {
+        program.insert(program.end(), statements.begin(), statements.end());
+        current_status = Status::SUSPENDED;
+    }
+
+    /**
+     * Runs for at most step_budget steps
+     * @return SUSPENDED if there is more to do, otherwise why execution stopped
+     */
+    Status resume(size_t step_budget)
+    {
+        if (current_status != Status::SUSPENDED)
+        {
+            return current_status;
+        }
+
+        try
+        {
+            for (size_t steps = 0; steps < step_budget; steps++)
+            {
+                if (frames.empty())
+                {
+                    if (next_statement == program.size())
+                    {
+                        current_status = Status::FINISHED;
+                        return current_status;
+                    }
+                    push_stmt(*program[next_statement++]);
+                    continue;
+                }
+
+                Frame &frame = frames.back();
+                if (frame.stmt != nullptr)
+                {
+                    step_stmt(frame);
+                }
+                else
+                {
+                    step_expr(frame);
+                }
+            }
+        }
+        catch (RuntimeError &error)
+        {
+            // Abandon the rest of the program, like the Interpreter does
+            next_statement = program.size();
+            fail(error);
+            return current_status;
+        }
+
+        // Report completion as soon as nothing is left to run
+        if (frames.empty() && next_statement == program.size())
+        {
+            current_status = Status::FINISHED;
+        }
+        return current_status;
+    }
+};
@@ -6,7 +6,8 @@
 class RuntimeError : public std::runtime_error
 {
 public:
-    const Token &token;
+    // Copied so that errors can outlive the token that caused them
+    const Token token;
 
     RuntimeError(const Token &token, std::string_view message)
         : token{token}, std::runtime_error{message.data()}
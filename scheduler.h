@@ -0,0 +1,91 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "resumable_interpreter.h"
+
+/**
+ * Round-robin scheduler that multiplexes resumable interpreters onto threads
+ *
+ * Each worker takes the instance at the front of the run queue, runs it
+ * for one time slice of steps and, if it is not finished, puts it at the
+ * back. An instance is only ever run by one worker at a time.
+ */
+class Scheduler
+{
+private:
+    std::deque<ResumableInterpreter *> run_queue;
+    std::mutex queue_mutex;
+    std::condition_variable queue_changed;
+
+    // Instances currently being run by a worker
+    size_t running = 0;
+
+    /**
+     * Runs time slices until every instance has finished or failed
+     */
+    void worker(size_t time_slice)
+    {
+        std::unique_lock<std::mutex> lock{queue_mutex};
+        while (true)
+        {
+            // A running instance may still come back to the queue
+            queue_changed.wait(lock, [this]
+                               { return !run_queue.empty() || running == 0; });
+            if (run_queue.empty())
+            {
+                return;
+            }
+
+            ResumableInterpreter *instance = run_queue.front();
+            run_queue.pop_front();
+            running++;
+
+            lock.unlock();
+            ResumableInterpreter::Status status = instance->resume(time_slice);
+            lock.lock();
+
+            running--;
+            if (status == ResumableInterpreter::Status::SUSPENDED)
+            {
+                run_queue.push_back(instance);
+            }
+            queue_changed.notify_all();
+        }
+    }
+
+public:
+    /**
+     * Adds an instance to the back of the run queue
+     */
+    void spawn(ResumableInterpreter &instance)
+    {
+        std::lock_guard<std::mutex> lock{queue_mutex};
+        run_queue.push_back(&instance);
+        queue_changed.notify_one();
+    }
+
+    /**
+     * Runs every queued instance to completion
+     * @param thread_count Worker threads; 1 runs on the calling thread
+     * @param time_slice Steps an instance runs before yielding
+     */
+    void run(size_t thread_count, size_t time_slice)
+    {
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < thread_count; i++)
+        {
+            workers.emplace_back(&Scheduler::worker, this, time_slice);
+        }
+        worker(time_slice);
+
+        for (std::thread &thread : workers)
+        {
+            thread.join();
+        }
+    }
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * Resolves variable names to local slots at compile time
+ *
+ * Blocks are the only scopes and every declaration is executed in source
+ * order, so a name can be bound statically: the innermost local declared
+ * so far wins, and anything else is a global looked up by name.
+ */
+class ScopeResolver
+{
+private:
+    // A local variable occupying a slot
+    struct Local
+    {
+        std::string name;
+        int depth;
+    };
+
+    // Locals currently in scope, innermost last; the index is the slot
+    std::vector<Local> locals;
+    int scope_depth = 0;
+
+    // Highest number of locals alive at once
+    size_t max_slots = 0;
+
+public:
+    /**
+     * Result of declaring a variable in the current scope
+     */
+    struct Declaration
+    {
+        int slot;          // Slot index, or -1 for a global
+        bool is_redeclare; // True if the name already lived in this scope
+    };
+
+    bool is_global_scope() const
+    {
+        return scope_depth == 0;
+    }
+
+    size_t slot_count() const
+    {
+        return max_slots;
+    }
+
+    size_t live_count() const
+    {
+        return locals.size();
+    }
+
+    void begin_scope()
+    {
+        scope_depth++;
+    }
+
+    /**
+     * Closes the innermost scope and returns how many locals it held
+     */
+    int end_scope()
+    {
+        scope_depth--;
+
+        int count = 0;
+        while (!locals.empty() && locals.back().depth > scope_depth)
+        {
+            locals.pop_back();
+            count++;
+        }
+        return count;
+    }
+
+    /**
+     * Finds the slot of the innermost local with this name, or -1
+     */
+    int resolve(const std::string &name) const
+    {
+        for (int i = static_cast<int>(locals.size()) - 1; i >= 0; i--)
+        {
+            if (locals[i].name == name)
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * Declares a variable; call after compiling its initialiser so the
+     * initialiser still sees any enclosing binding of the same name
+     */
+    Declaration declare(const std::string &name)
+    {
+        if (is_global_scope())
+        {
+            return {-1, false};
+        }
+
+        // Redeclaring in the same scope overwrites the existing slot
+        int slot = resolve(name);
+        if (slot >= 0 && locals[slot].depth == scope_depth)
+        {
+            return {slot, true};
+        }
+
+        locals.push_back(Local{name, scope_depth});
+        if (locals.size() > max_slots)
+        {
+            max_slots = locals.size();
+        }
+        return {static_cast<int>(locals.size()) - 1, false};
+    }
+};
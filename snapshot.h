@@ -0,0 +1,412 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "value.h"
+
+// Images are memory-mapped where the platform has mmap, and read whole elsewhere
+#if defined(__unix__) || defined(__APPLE__)
+#define PRISM_MMAP_AVAILABLE 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Image of a script's global variables, written once and restored at startup
+ *
+ * Every integer is little-endian, whatever the machine:
+ *
+ *     header   "PRISMIMG", u32 version, u32 header size, u64 image size,
+ *              u64 FNV-1a checksum of everything after the header,
+ *              u32 global count, u32 program size
+ *     program  source of the script that built the globals
+ *     globals  sorted by name; each is u32 name size, name, u8 kind, then
+ *              nothing for nil, u8 0 or 1 for a boolean, the u64 bits of a
+ *              number, or u32 size and bytes for a string
+ *
+ * The program is kept so an image says what built it; Prism values never
+ * refer to code, so restoring does not run it again. Each kind is tagged,
+ * so values of new kinds need a new tag and a new version, and a reader
+ * rejects any image written for a version other than its own.
+ */
+namespace snapshot
+{
+    constexpr char MAGIC[8] = {'P', 'R', 'I', 'S', 'M', 'I', 'M', 'G'};
+    constexpr uint32_t VERSION = 1;
+    constexpr uint32_t HEADER_SIZE = 40;
+
+    enum Kind : uint8_t
+    {
+        NIL = 0,
+        BOOLEAN = 1,
+        NUMBER = 2,
+        STRING = 3,
+    };
+
+    inline uint64_t checksum(std::string_view bytes)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char byte : bytes)
+        {
+            hash = (hash ^ byte) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    inline void put_u8(std::string &out, uint8_t value)
+    {
+        out.push_back(static_cast<char>(value));
+    }
+
+    inline void put_u32(std::string &out, uint32_t value)
+    {
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            out.push_back(static_cast<char>(value >> shift));
+        }
+    }
+
+    inline void put_u64(std::string &out, uint64_t value)
+    {
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            out.push_back(static_cast<char>(value >> shift));
+        }
+    }
+
+    inline void put_bytes(std::string &out, std::string_view bytes)
+    {
+        put_u32(out, static_cast<uint32_t>(bytes.size()));
+        out.append(bytes);
+    }
+
+    inline uint64_t get_le(const char *bytes, int size)
+    {
+        uint64_t value = 0;
+        for (int i = size - 1; i >= 0; i--)
+        {
+            value = value << 8 | static_cast<unsigned char>(bytes[i]);
+        }
+        return value;
+    }
+
+    inline uint32_t get_u32(const char *bytes)
+    {
+        return static_cast<uint32_t>(get_le(bytes, 4));
+    }
+
+    inline uint64_t get_u64(const char *bytes)
+    {
+        return get_le(bytes, 8);
+    }
+}
+
+/**
+ * Builds an image from a program and its globals
+ */
+inline std::string encode_snapshot(std::string_view program,
+                                   const std::vector<std::pair<std::string, Value>> &globals)
+{
+    std::string body;
+    body.append(program);
+    for (const auto &[name, value] : globals)
+    {
+        snapshot::put_bytes(body, name);
+        if (const bool *boolean = std::get_if<bool>(&value))
+        {
+            snapshot::put_u8(body, snapshot::BOOLEAN);
+            snapshot::put_u8(body, *boolean);
+        }
+        else if (const double *number = std::get_if<double>(&value))
+        {
+            uint64_t bits;
+            std::memcpy(&bits, number, sizeof bits);
+            snapshot::put_u8(body, snapshot::NUMBER);
+            snapshot::put_u64(body, bits);
+        }
+        else if (const std::string *text = std::get_if<std::string>(&value))
+        {
+            snapshot::put_u8(body, snapshot::STRING);
+            snapshot::put_bytes(body, *text);
+        }
+        else
+        {
+            snapshot::put_u8(body, snapshot::NIL);
+        }
+    }
+
+    std::string image{snapshot::MAGIC, sizeof snapshot::MAGIC};
+    snapshot::put_u32(image, snapshot::VERSION);
+    snapshot::put_u32(image, snapshot::HEADER_SIZE);
+    snapshot::put_u64(image, snapshot::HEADER_SIZE + body.size());
+    snapshot::put_u64(image, snapshot::checksum(body));
+    snapshot::put_u32(image, static_cast<uint32_t>(globals.size()));
+    snapshot::put_u32(image, static_cast<uint32_t>(program.size()));
+    image += body;
+    return image;
+}
+
+/**
+ * Writes an image beside its destination, then renames it into place, so a
+ * failed write never leaves a partial image where a good one was
+ * @return Whether the image was written
+ */
+inline bool write_snapshot(const std::string &path, const std::string &image)
+{
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream output{temporary, std::ios::binary | std::ios::trunc};
+        if (!output || !output.write(image.data(), static_cast<std::streamsize>(image.size())) || !output.flush())
+        {
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * An image file, mapped read-only into memory, or read into a buffer without mmap
+ */
+class MappedImage
+{
+private:
+    const char *mapped = nullptr;
+    size_t mapped_size = 0;
+    std::string buffer;
+
+public:
+    MappedImage() = default;
+    MappedImage(const MappedImage &) = delete;
+    MappedImage &operator=(const MappedImage &) = delete;
+
+    ~MappedImage()
+    {
+#ifdef PRISM_MMAP_AVAILABLE
+        if (mapped != nullptr)
+        {
+            munmap(const_cast<char *>(mapped), mapped_size);
+        }
+#endif
+    }
+
+    /**
+     * @return Whether the file could be opened; if not, errno says why
+     */
+    bool open(const std::string &path)
+    {
+#ifdef PRISM_MMAP_AVAILABLE
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+        {
+            return false;
+        }
+        struct stat status;
+        if (fstat(descriptor, &status) != 0)
+        {
+            int saved = errno;
+            ::close(descriptor);
+            errno = saved;
+            return false;
+        }
+        // An empty file cannot be mapped, and is left to validation to reject
+        if (status.st_size > 0)
+        {
+            void *memory = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (memory == MAP_FAILED)
+            {
+                int saved = errno;
+                ::close(descriptor);
+                errno = saved;
+                return false;
+            }
+            mapped = static_cast<const char *>(memory);
+            mapped_size = static_cast<size_t>(status.st_size);
+        }
+        ::close(descriptor);
+        return true;
+#else
+        std::ifstream input{path, std::ios::binary};
+        if (!input)
+        {
+            return false;
+        }
+        buffer.assign(std::istreambuf_iterator<char>{input}, std::istreambuf_iterator<char>{});
+        return true;
+#endif
+    }
+
+    std::string_view bytes() const
+    {
+        return mapped != nullptr ? std::string_view{mapped, mapped_size} : std::string_view{buffer};
+    }
+};
+
+/**
+ * Checks an image and reads its program and globals
+ * Any image that is not exactly what encode_snapshot writes is rejected,
+ * with the reason in error()
+ */
+class SnapshotReader
+{
+private:
+    std::string_view image;
+    size_t position = 0;
+    std::string problem;
+
+    bool fail(std::string message)
+    {
+        problem = std::move(message);
+        return false;
+    }
+
+    bool take(size_t size, std::string_view &bytes)
+    {
+        if (image.size() - position < size)
+        {
+            return fail("it ends in the middle of a global");
+        }
+        bytes = image.substr(position, size);
+        position += size;
+        return true;
+    }
+
+    bool take_sized(std::string_view &bytes)
+    {
+        std::string_view size;
+        return take(4, size) && take(snapshot::get_u32(size.data()), bytes);
+    }
+
+public:
+    explicit SnapshotReader(std::string_view bytes) : image{bytes}
+    {
+    }
+
+    /**
+     * @return Whether the image is valid; if so, its program and globals are filled in
+     */
+    bool read(std::string &program, std::vector<std::pair<std::string, Value>> &globals)
+    {
+        if (image.size() < sizeof snapshot::MAGIC ||
+            image.compare(0, sizeof snapshot::MAGIC, std::string_view{snapshot::MAGIC, sizeof snapshot::MAGIC}) != 0)
+        {
+            return fail("it is not a prism image");
+        }
+        if (image.size() < snapshot::HEADER_SIZE)
+        {
+            return fail("its header is cut short");
+        }
+        const char *header = image.data();
+        uint32_t version = snapshot::get_u32(header + 8);
+        if (version != snapshot::VERSION)
+        {
+            return fail("it has format version " + std::to_string(version) + ", but this prism reads version " +
+                        std::to_string(snapshot::VERSION));
+        }
+        if (snapshot::get_u32(header + 12) != snapshot::HEADER_SIZE)
+        {
+            return fail("its header has the wrong size");
+        }
+        if (snapshot::get_u64(header + 16) != image.size())
+        {
+            return fail("it should be " + std::to_string(snapshot::get_u64(header + 16)) + " bytes, but is " +
+                        std::to_string(image.size()));
+        }
+        if (snapshot::get_u64(header + 24) != snapshot::checksum(image.substr(snapshot::HEADER_SIZE)))
+        {
+            return fail("its checksum does not match its contents");
+        }
+        uint32_t global_count = snapshot::get_u32(header + 32);
+        uint32_t program_size = snapshot::get_u32(header + 36);
+
+        position = snapshot::HEADER_SIZE;
+        std::string_view source;
+        if (!take(program_size, source))
+        {
+            return fail("its program is cut short");
+        }
+        program.assign(source);
+
+        globals.clear();
+        for (uint32_t i = 0; i < global_count; i++)
+        {
+            std::string_view name, kind;
+            if (!take_sized(name) || !take(1, kind))
+            {
+                return false;
+            }
+            if (!globals.empty() && globals.back().first >= name)
+            {
+                return fail("its globals are out of order");
+            }
+
+            Value value = nullptr;
+            std::string_view payload;
+            switch (static_cast<uint8_t>(kind[0]))
+            {
+            case snapshot::NIL:
+                break;
+            case snapshot::BOOLEAN:
+                if (!take(1, payload))
+                {
+                    return false;
+                }
+                if (payload[0] != 0 && payload[0] != 1)
+                {
+                    return fail("global '" + std::string{name} + "' is not a valid boolean");
+                }
+                value = payload[0] == 1;
+                break;
+            case snapshot::NUMBER:
+            {
+                if (!take(8, payload))
+                {
+                    return false;
+                }
+                uint64_t bits = snapshot::get_u64(payload.data());
+                double number;
+                std::memcpy(&number, &bits, sizeof number);
+                value = number;
+                break;
+            }
+            case snapshot::STRING:
+                if (!take_sized(payload))
+                {
+                    return false;
+                }
+                value = std::string{payload};
+                break;
+            default:
+                return fail("global '" + std::string{name} + "' has unknown kind " +
+                            std::to_string(static_cast<uint8_t>(kind[0])));
+            }
+            globals.emplace_back(std::string{name}, std::move(value));
+        }
+
+        if (position != image.size())
+        {
+            return fail("it has bytes after its last global");
+        }
+        return true;
+    }
+
+    const std::string &error() const
+    {
+        return problem;
+    }
+};
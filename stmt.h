@@ -1,11 +1,16 @@
 #pragma once
 
 #include <any>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <utility>
 #include <vector>
 #include "token.h"
 #include "expr.h"
+#include "node_heat.h"
 
 // Forward declarations of statement types
 struct Block;
@@ -15,6 +20,9 @@ struct Print;
 struct Var;
 struct While;
 
+// Described in parallel_loop.h
+struct ParallelLoop;
+
 /**
  * Visitor interface for processing statement nodes
  * Implements the visitor design pattern for statements
@@ -33,11 +41,45 @@ struct StmtVisitor
     virtual ~StmtVisitor() = default;
 };
 
+/**
+ * Tag identifying the concrete type of a statement node
+ * Lets statically typed visitors dispatch with a switch instead of a virtual call
+ */
+enum class StmtKind : uint8_t
+{
+    BLOCK,
+    EXPRESSION,
+    IF,
+    PRINT,
+    VAR,
+    WHILE,
+};
+
+/**
+ * Lower-case name of a statement kind, as used in profiles and traces
+ */
+inline const char *stmt_kind_name(StmtKind kind)
+{
+    static const char *const kind_names[] = {"block", "expression", "if", "print", "var", "while"};
+    return kind_names[static_cast<size_t>(kind)];
+}
+
 /**
  * Base class for all statement types
  */
 struct Stmt
 {
+    // Concrete node type, fixed at construction
+    const StmtKind kind;
+
+    // Line the statement starts on, set by the parser
+    int line_number = 0;
+
+    // Executions and time, recorded while the interpreter counts heat
+    NodeHeat heat;
+
+    explicit Stmt(StmtKind node_kind) : kind{node_kind} {}
+
     // Accept method to implement visitor pattern
     virtual std::any accept(StmtVisitor &visitor) = 0;
 
@@ -51,13 +93,47 @@ struct Stmt
  */
 struct Block : Stmt, public std::enable_shared_from_this<Block>
 {
-    // Member variable
-    const std::vector<std::shared_ptr<Stmt>> statements;
+    // Parses a lazily parsed body; may throw if the body has syntax errors
+    using BodyParser = std::function<std::vector<std::shared_ptr<Stmt>>()>;
 
-    // Constructor
+    // Constructor for a block whose body is already parsed
     Block(std::vector<std::shared_ptr<Stmt>> stmt_list)
-        : statements{std::move(stmt_list)}
+        : Stmt{StmtKind::BLOCK}, statements{std::move(stmt_list)}, parsed{true}
+    {
+    }
+
+    // Constructor for a block whose body is parsed when first needed
+    explicit Block(BodyParser body_parser)
+        : Stmt{StmtKind::BLOCK}, pending_body{std::move(body_parser)}, parsed{false}
+    {
+    }
+
+    /**
+     * Statements in the block, parsing them first if that has not happened yet
+     * Safe to call from several threads at once
+     */
+    const std::vector<std::shared_ptr<Stmt>> &body() const
+    {
+        if (!parsed.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> lock{parse_mutex};
+            if (!parsed.load(std::memory_order_relaxed))
+            {
+                // A throwing parse leaves the block unparsed to fail again later
+                statements = pending_body();
+                pending_body = nullptr;
+                parsed.store(true, std::memory_order_release);
+            }
+        }
+        return statements;
+    }
+
+    /**
+     * Whether the body has been parsed yet
+     */
+    bool is_parsed() const
     {
+        return parsed.load(std::memory_order_acquire);
     }
 
     // Implementation of visitor pattern
@@ -65,6 +141,12 @@ struct Block : Stmt, public std::enable_shared_from_this<Block>
     {
         return visitor.visit_block_stmt(shared_from_this());
     }
+
+private:
+    mutable std::vector<std::shared_ptr<Stmt>> statements;
+    mutable BodyParser pending_body;
+    mutable std::atomic<bool> parsed;
+    mutable std::mutex parse_mutex;
 };
 
 /**
@@ -78,7 +160,7 @@ struct Expression : Stmt, public std::enable_shared_from_this<Expression>
 
     // Constructor
     Expression(std::shared_ptr<Expr> expr)
-        : expression{std::move(expr)}
+        : Stmt{StmtKind::EXPRESSION}, expression{std::move(expr)}
     {
     }
 
@@ -104,7 +186,8 @@ struct If : Stmt, public std::enable_shared_from_this<If>
     If(std::shared_ptr<Expr> cond_expr,
        std::shared_ptr<Stmt> then_stmt,
        std::shared_ptr<Stmt> else_stmt)
-        : condition{std::move(cond_expr)},
+        : Stmt{StmtKind::IF},
+          condition{std::move(cond_expr)},
           then_branch{std::move(then_stmt)},
           else_branch{std::move(else_stmt)}
     {
@@ -128,7 +211,7 @@ struct Print : Stmt, public std::enable_shared_from_this<Print>
 
     // Constructor
     Print(std::shared_ptr<Expr> expr)
-        : expression{std::move(expr)}
+        : Stmt{StmtKind::PRINT}, expression{std::move(expr)}
     {
     }
 
@@ -151,7 +234,8 @@ struct Var : Stmt, public std::enable_shared_from_this<Var>
 
     // Constructor
     Var(Token var_name, std::shared_ptr<Expr> init_expr)
-        : name{std::move(var_name)},
+        : Stmt{StmtKind::VAR},
+          name{std::move(var_name)},
           initialiser{std::move(init_expr)}
     {
     }
@@ -173,9 +257,16 @@ struct While : Stmt, public std::enable_shared_from_this<While>
     const std::shared_ptr<Expr> condition;
     const std::shared_ptr<Stmt> body;
 
+    // Hotness and native code recorded by the loop JIT
+    LoopFeedback feedback;
+
+    // Set for a `parallel for` loop; engines that ignore it run the iterations in order
+    std::shared_ptr<const ParallelLoop> parallel;
+
     // Constructor
     While(std::shared_ptr<Expr> cond_expr, std::shared_ptr<Stmt> loop_body)
-        : condition{std::move(cond_expr)},
+        : Stmt{StmtKind::WHILE},
+          condition{std::move(cond_expr)},
           body{std::move(loop_body)}
     {
     }
@@ -0,0 +1,465 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+#include "error.h"
+#include "parser.h"
+#include "token.h"
+#include "token_type.h"
+
+/**
+ * Checks a token stream against the grammar without building an AST
+ *
+ * Follows the Parser rule for rule, reporting the same errors at the same
+ * tokens and recovering the same way, but allocates nothing. Running it
+ * before a lazy parse reports every syntax error up front, as an eager
+ * parse would, while block bodies are still only parsed when entered.
+ *
+ * The one exception is a parallel for loop: whether its iterations are
+ * independent can only be checked on its AST, so each outermost parallel
+ * loop without syntax errors is parsed by the Parser, which checks it.
+ */
+class SyntaxValidator
+{
+private:
+    // Unwinds to the enclosing declaration after an error
+    struct SyntaxError
+    {
+    };
+
+    const std::vector<Token> &token_stream;
+    size_t current_pos = 0;
+    bool valid = true;
+
+    // Errors reported so far, and parallel loops being validated around the current token
+    size_t reported = 0;
+    size_t parallel_depth = 0;
+
+public:
+    explicit SyntaxValidator(const std::vector<Token> &tokens)
+        : token_stream{tokens}
+    {
+    }
+
+    /**
+     * Checks every statement in the token stream
+     * @return Whether no syntax errors were found
+     */
+    bool validate()
+    {
+        while (!is_at_end())
+        {
+            declaration();
+        }
+        return valid;
+    }
+
+private:
+    //---------------------------------------------
+    // Statements
+    //---------------------------------------------
+
+    void declaration()
+    {
+        try
+        {
+            if (match(VAR))
+            {
+                variable_declaration();
+            }
+            else
+            {
+                statement();
+            }
+        }
+        catch (SyntaxError &)
+        {
+            synchronise();
+        }
+    }
+
+    void statement()
+    {
+        if (match(FOR))
+            for_statement(false);
+        else if (check_word("parallel", FOR))
+        {
+            parallel_for_statement();
+        }
+        else if (match(IF))
+            if_statement();
+        else if (match(PRINT))
+            print_statement();
+        else if (match(WHILE))
+            while_statement();
+        else if (match(LEFT_BRACE))
+            block();
+        else
+            expression_statement();
+    }
+
+    /**
+     * Validates a parallel for loop, then has the Parser check the outermost
+     * one's iterations are independent, as an eager parse would
+     */
+    void parallel_for_statement()
+    {
+        size_t start = current_pos;
+        size_t reported_before = reported;
+        advance();
+        advance();
+
+        parallel_depth++;
+        try
+        {
+            for_statement(true);
+        }
+        catch (SyntaxError &)
+        {
+            parallel_depth--;
+            throw;
+        }
+        parallel_depth--;
+
+        if (parallel_depth == 0 && reported == reported_before)
+        {
+            Parser parser{token_stream};
+            parser.parse_range(static_cast<int>(start), static_cast<int>(current_pos));
+            if (parser.found_errors())
+            {
+                valid = false;
+                reported++;
+            }
+        }
+    }
+
+    void for_statement(bool parallel)
+    {
+        consume(LEFT_PAREN, "Expect '(' after 'for'.");
+
+        // Initialiser clause
+        if (match(SEMICOLON))
+        {
+        }
+        else if (match(VAR))
+        {
+            variable_declaration();
+        }
+        else
+        {
+            expression_statement();
+        }
+
+        // Condition and increment
+        if (!check(SEMICOLON))
+        {
+            expression();
+        }
+        consume(SEMICOLON, "Expect ';' after loop condition.");
+
+        if (!check(RIGHT_PAREN))
+        {
+            expression();
+        }
+        consume(RIGHT_PAREN, "Expect ')' after for clauses.");
+
+        // Reductions
+        if (parallel && check_word("reduce", LEFT_PAREN))
+        {
+            advance();
+            advance();
+            do
+            {
+                if (!match(PLUS, STAR))
+                {
+                    report(peek(), "Expect '+' or '*' before reduction variable.");
+                    throw SyntaxError{};
+                }
+                consume(IDENTIFIER, "Expect reduction variable name.");
+            } while (match(COMMA));
+            consume(RIGHT_PAREN, "Expect ')' after reductions.");
+        }
+
+        statement();
+    }
+
+    void if_statement()
+    {
+        consume(LEFT_PAREN, "Expect '(' after 'if'.");
+        expression();
+        consume(RIGHT_PAREN, "Expect ')' after if condition.");
+
+        statement();
+        if (match(ELSE))
+        {
+            statement();
+        }
+    }
+
+    void print_statement()
+    {
+        expression();
+        consume(SEMICOLON, "Expect ';' after value.");
+    }
+
+    void variable_declaration()
+    {
+        consume(IDENTIFIER, "Expect variable name.");
+        if (match(EQUAL))
+        {
+            expression();
+        }
+        consume(SEMICOLON, "Expect ';' after variable declaration.");
+    }
+
+    void while_statement()
+    {
+        consume(LEFT_PAREN, "Expect '(' after 'while'.");
+        expression();
+        consume(RIGHT_PAREN, "Expect ')' after condition.");
+        statement();
+    }
+
+    void expression_statement()
+    {
+        expression();
+        consume(SEMICOLON, "Expect ';' after expression.");
+    }
+
+    void block()
+    {
+        while (!check(RIGHT_BRACE) && !is_at_end())
+        {
+            declaration();
+        }
+        consume(RIGHT_BRACE, "Expect '}' after block.");
+    }
+
+    //---------------------------------------------
+    // Expressions
+    // Each returns whether it was a bare variable, the only valid assignment target
+    //---------------------------------------------
+
+    bool expression()
+    {
+        return assignment();
+    }
+
+    bool assignment()
+    {
+        bool is_variable = or_expression();
+
+        if (match(EQUAL))
+        {
+            const Token &equals_token = previous();
+            assignment();
+
+            // Reported after the right side, like the Parser
+            if (!is_variable)
+            {
+                report(equals_token, "Invalid assignment target.");
+            }
+            return false;
+        }
+
+        return is_variable;
+    }
+
+    bool or_expression()
+    {
+        bool is_variable = and_expression();
+        while (match(OR))
+        {
+            and_expression();
+            is_variable = false;
+        }
+        return is_variable;
+    }
+
+    bool and_expression()
+    {
+        bool is_variable = equality();
+        while (match(AND))
+        {
+            equality();
+            is_variable = false;
+        }
+        return is_variable;
+    }
+
+    bool equality()
+    {
+        bool is_variable = comparison();
+        while (match(BANG_EQUAL, EQUAL_EQUAL))
+        {
+            comparison();
+            is_variable = false;
+        }
+        return is_variable;
+    }
+
+    bool comparison()
+    {
+        bool is_variable = term();
+        while (match(GREATER, GREATER_EQUAL, LESS, LESS_EQUAL))
+        {
+            term();
+            is_variable = false;
+        }
+        return is_variable;
+    }
+
+    bool term()
+    {
+        bool is_variable = factor();
+        while (match(MINUS, PLUS))
+        {
+            factor();
+            is_variable = false;
+        }
+        return is_variable;
+    }
+
+    bool factor()
+    {
+        bool is_variable = unary();
+        while (match(SLASH, STAR))
+        {
+            unary();
+            is_variable = false;
+        }
+        return is_variable;
+    }
+
+    bool unary()
+    {
+        if (match(BANG, MINUS))
+        {
+            unary();
+            return false;
+        }
+        return primary();
+    }
+
+    bool primary()
+    {
+        if (match(FALSE, TRUE, NIL, NUMBER, STRING))
+        {
+            return false;
+        }
+
+        if (match(IDENTIFIER))
+        {
+            return true;
+        }
+
+        if (match(LEFT_PAREN))
+        {
+            expression();
+            consume(RIGHT_PAREN, "Expect ')' after expression.");
+            return false;
+        }
+
+        report(peek(), "Expect expression.");
+        throw SyntaxError{};
+    }
+
+    //---------------------------------------------
+    // Helper methods
+    //---------------------------------------------
+
+    template <class... T>
+    bool match(T... types)
+    {
+        if ((... || check(types)))
+        {
+            advance();
+            return true;
+        }
+        return false;
+    }
+
+    void consume(TokenType expected_type, std::string_view error_msg)
+    {
+        if (!check(expected_type))
+        {
+            report(peek(), error_msg);
+            throw SyntaxError{};
+        }
+        advance();
+    }
+
+    bool check(TokenType type) const
+    {
+        return !is_at_end() && peek().type == type;
+    }
+
+    bool check_word(std::string_view word, TokenType next) const
+    {
+        return check(IDENTIFIER) && peek().lexeme == word && token_stream[current_pos + 1].type == next;
+    }
+
+    void advance()
+    {
+        if (!is_at_end())
+        {
+            current_pos++;
+        }
+    }
+
+    bool is_at_end() const
+    {
+        return peek().type == END_OF_FILE;
+    }
+
+    const Token &peek() const
+    {
+        return token_stream[current_pos];
+    }
+
+    const Token &previous() const
+    {
+        return token_stream[current_pos - 1];
+    }
+
+    void report(const Token &token, std::string_view message)
+    {
+        ::error(token, message);
+        valid = false;
+        reported++;
+    }
+
+    /**
+     * Skips to the next statement boundary, exactly as Parser::synchronise
+     */
+    void synchronise()
+    {
+        advance();
+
+        while (!is_at_end())
+        {
+            if (previous().type == SEMICOLON)
+            {
+                return;
+            }
+
+            switch (peek().type)
+            {
+            case CLASS:
+            case FUN:
+            case VAR:
+            case FOR:
+            case IF:
+            case WHILE:
+            case PRINT:
+            case RETURN:
+                return;
+            default:
+                break;
+            }
+
+            advance();
+        }
+    }
+};
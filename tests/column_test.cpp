@@ -0,0 +1,177 @@
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "column_engine.h"
+#include "interpreter.h"
+#include "lexer.h"
+#include "parser.h"
+
+/**
+ * Evaluates expressions over columns and checks every row against the
+ * tree-walking Interpreter evaluating that row on its own: the same value
+ * of the same type, or the same runtime error on the same line
+ */
+
+constexpr size_t ROWS = 10007;
+
+// Deterministic pseudo-random numbers, so the expected output is stable
+uint64_t seed = 42;
+
+uint64_t next_random()
+{
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return seed >> 33;
+}
+
+ColumnTable make_table()
+{
+    std::vector<double> a, b, c, threshold;
+    std::vector<uint8_t> flag;
+    std::vector<Value> mixed, names;
+    for (size_t row = 0; row < ROWS; row++)
+    {
+        a.push_back(static_cast<double>(next_random() % 200) - 100);
+        b.push_back(static_cast<double>(next_random() % 7)); // Zeros make inf and nan
+        c.push_back(static_cast<double>(next_random() % 1000) / 8);
+        threshold.push_back(50);
+        flag.push_back(next_random() % 3 == 0);
+
+        // Mostly numbers, with the odd string, nil or boolean
+        switch (next_random() % 10)
+        {
+        case 0:
+            mixed.push_back(std::string{"text"});
+            break;
+        case 1:
+            mixed.push_back(nullptr);
+            break;
+        case 2:
+            mixed.push_back(true);
+            break;
+        default:
+            mixed.push_back(static_cast<double>(next_random() % 100));
+            break;
+        }
+        names.push_back(std::string{row % 2 == 0 ? "even" : "odd"});
+    }
+
+    ColumnTable table;
+    table["a"] = Column::of_numbers(a);
+    table["b"] = Column::of_numbers(b);
+    table["c"] = Column::of_numbers(c);
+    table["threshold"] = Column::of_numbers(threshold);
+    table["flag"] = Column::of_bools(flag);
+    table["mixed"] = Column::of_values(mixed);
+    table["name"] = Column::of_values(names);
+    return table;
+}
+
+std::shared_ptr<Expr> parse_expression(const std::string &source)
+{
+    std::vector<Token> tokens = Lexer{source + ";"}.scan_tokens();
+    std::vector<std::shared_ptr<Stmt>> statements = Parser{tokens}.parse();
+    return static_cast<Expression &>(*statements[0]).expression;
+}
+
+bool same_value(const Value &left, const Value &right)
+{
+    if (left.index() != right.index())
+    {
+        return false;
+    }
+    if (const double *number = std::get_if<double>(&left))
+    {
+        // Bit for bit, so that -0 does not match 0 and nan must have the same sign and payload
+        double other = std::get<double>(right);
+        return std::memcmp(number, &other, sizeof(double)) == 0;
+    }
+    return left == right;
+}
+
+/**
+ * Evaluates each row separately, as the interpreter would
+ * @return The number of rows whose value or error differs
+ */
+size_t count_mismatches(const std::string &source, const ColumnTable &table, const ColumnResult &result)
+{
+    Interpreter interpreter;
+    std::shared_ptr<Expr> expr = parse_expression(source);
+    size_t mismatches = 0;
+    size_t next_error = 0;
+    for (size_t row = 0; row < ROWS; row++)
+    {
+        interpreter.reset_globals();
+        for (const auto &[name, column] : table)
+        {
+            interpreter.define_global(name, std::visit([](const auto &held)
+                                                       { return std::any{held}; },
+                                                       column.at(row)));
+        }
+
+        bool has_error = next_error < result.errors.size() && result.errors[next_error].row == row;
+        try
+        {
+            std::any value = interpreter.evaluate(expr);
+            Value expected = nullptr;
+            if (const double *number = std::any_cast<double>(&value))
+            {
+                expected = *number;
+            }
+            else if (const bool *boolean = std::any_cast<bool>(&value))
+            {
+                expected = *boolean;
+            }
+            else if (const std::string *text = std::any_cast<std::string>(&value))
+            {
+                expected = *text;
+            }
+            mismatches += has_error || !same_value(expected, result.column.at(row));
+        }
+        catch (const RuntimeError &error)
+        {
+            mismatches += !has_error || result.errors[next_error].message != error.what() ||
+                          result.errors[next_error].line != error.token.line_number;
+        }
+        next_error += has_error;
+    }
+    return mismatches;
+}
+
+int main()
+{
+    ColumnTable table = make_table();
+    const char *const expressions[] = {
+        "a * b + c > threshold and flag",
+        "a / b",
+        "-a * 2 <= c or !flag",
+        "a == b != flag",
+        "flag or a",
+        "b and c",
+        "flag and mixed > 10",
+        "!flag or mixed + 1 > 50",
+        "mixed or a",
+        "name + \"!\"",
+        "name == \"even\" and a > 0",
+        "(a > 0) == flag",
+        "missing and flag",
+        "flag and missing",
+        "-mixed",
+        "a = 5",
+        "(a = b) and a > 2",
+        "!(a - name) == b",
+        "a > 0 or !(a - name) == b",
+    };
+
+    for (const char *source : expressions)
+    {
+        ColumnEvaluator evaluator{parse_expression(source), table};
+        ColumnResult result = evaluator.evaluate(table);
+        size_t mismatches = count_mismatches(source, table, result);
+        std::cout << source << "\n  " << evaluator.plan() << "\n  " << result.errors.size() << " errors, "
+                  << (mismatches == 0 ? "all rows match" : std::to_string(mismatches) + " rows differ") << "\n";
+    }
+    return 0;
+}
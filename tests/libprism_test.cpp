@@ -0,0 +1,146 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "libprism.h"
+
+/**
+ * Embeds libprism: one Program shared by several threads, each running it
+ * in its own Context, then syntax errors, runtime errors, limits,
+ * cancellation and resets, all reported as Diagnostics
+ */
+
+void print_diagnostics(const std::vector<prism::Diagnostic> &diagnostics)
+{
+    for (const prism::Diagnostic &diagnostic : diagnostics)
+    {
+        std::cout << (diagnostic.kind == prism::Diagnostic::Kind::SYNTAX ? "syntax" : "runtime") << " line "
+                  << diagnostic.line << (diagnostic.location.empty() ? "" : " " + diagnostic.location) << ": "
+                  << diagnostic.message << "\n";
+    }
+}
+
+prism::Program compile(const std::string &source)
+{
+    prism::CompileResult compiled = prism::Program::compile(source);
+    print_diagnostics(compiled.diagnostics);
+    return compiled.program;
+}
+
+int main()
+{
+    // Each thread defines its own seed, then runs the shared program with it
+    prism::Program shared = compile("var total = 0;\n"
+                                    "var i = 0;\n"
+                                    "while (i < 1000) { total = total + seed; i = i + 1; }\n"
+                                    "print \"seed \" + label + \": \" + \"done\";\n"
+                                    "print total;\n");
+    std::cout << "compiled " << shared.statement_count() << " statements\n";
+
+    constexpr int THREADS = 4;
+    std::vector<std::string> outputs(THREADS);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++)
+    {
+        threads.emplace_back([&, t]
+                             {
+            prism::Context context;
+            prism::Program setup = prism::Program::compile(
+                "var seed = " + std::to_string(t + 1) + "; var label = \"" + std::to_string(t + 1) + "\";").program;
+            for (int run = 0; run < 50; run++)
+            {
+                context.run(setup);
+                if (!context.run(shared).ok())
+                {
+                    outputs[t] = "failed";
+                    return;
+                }
+                std::string output = context.take_output();
+                if (run == 0)
+                {
+                    outputs[t] = output;
+                }
+                else if (output != outputs[t])
+                {
+                    outputs[t] = "output changed between runs";
+                    return;
+                }
+            } });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    for (const std::string &output : outputs)
+    {
+        std::cout << output;
+    }
+
+    // Syntax errors come back as diagnostics and leave the program empty
+    std::cout << "-- syntax errors\n";
+    prism::CompileResult broken = prism::Program::compile("print 1 +;\nvar = 2;\n");
+    print_diagnostics(broken.diagnostics);
+    std::cout << "empty: " << (broken.program.statement_count() == 0 ? "yes" : "no") << "\n";
+
+    // A runtime error stops the run; what was printed before it is kept
+    std::cout << "-- runtime error\n";
+    prism::Context context;
+    print_diagnostics(context.run(compile("print \"before\";\nprint -\"text\";\nprint \"after\";")).diagnostics);
+    std::cout << context.take_output();
+
+    // Globals persist between runs until a reset
+    std::cout << "-- globals\n";
+    context.run(compile("var kept = 42;"));
+    context.run(compile("print kept;"));
+    context.reset();
+    print_diagnostics(context.run(compile("print kept;")).diagnostics);
+    std::cout << context.take_output();
+
+    // Each run with inputs starts from fresh globals; a missing input is undefined
+    std::cout << "-- inputs\n";
+    prism::Program rule = compile("if (amount > 100) print id + \": review \" + region; else print id + \": approve\";");
+    std::vector<prism::Inputs> records = {
+        {{"id", std::string{"order-1"}}, {"amount", 250.0}, {"region", std::string{"north"}}},
+        {{"id", std::string{"order-2"}}, {"amount", 5.0}},
+        {{"id", std::string{"order-3"}}, {"amount", 900.0}},
+    };
+    for (const prism::Inputs &record : records)
+    {
+        print_diagnostics(context.run(rule, record).diagnostics);
+        std::cout << context.take_output();
+    }
+
+    // Limits stop runaway programs
+    std::cout << "-- limits\n";
+    prism::Program forever = compile("while (true) {}");
+    prism::Limits limits;
+    limits.max_steps = 10000;
+    context.set_limits(limits);
+    print_diagnostics(context.run(forever).diagnostics);
+
+    // A cancel sent before a run stops that run, and only that run
+    std::cout << "-- cancel before run\n";
+    context.set_limits(prism::Limits{});
+    context.cancel();
+    print_diagnostics(context.run(forever).diagnostics);
+    context.run(compile("print \"after cancel\";"));
+    std::cout << context.take_output();
+
+    // Another thread can cancel a run in progress
+    std::cout << "-- cancel\n";
+    std::atomic<bool> finished{false};
+    std::thread canceller{[&]
+                          {
+                              while (!finished)
+                              {
+                                  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                                  context.cancel();
+                              }
+                          }};
+    print_diagnostics(context.run(forever).diagnostics);
+    finished = true;
+    canceller.join();
+    return 0;
+}
@@ -67,7 +67,7 @@ enum TokenType
  * @param type The token type to convert
  * @return A string representation of the token type
  */
-std::string to_string(TokenType type)
+inline std::string to_string(TokenType type)
 {
     // Define all token type names
     constexpr int TOKEN_COUNT = 40; // Total number of token types
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Timeline of interpreter phases and slow statements, for --trace and --time
+ *
+ * Each thread appends complete spans to its own buffer, so recording a span
+ * takes no lock; the buffers are only walked once, when the trace is
+ * written at exit. Spans are written as Chrome trace-event JSON, which
+ * chrome://tracing and Perfetto both open.
+ */
+class TraceRecorder
+{
+public:
+    // One complete span; names are string literals
+    struct Event
+    {
+        const char *name;
+        const char *category;
+        uint64_t start_ns;
+        uint64_t duration_ns;
+        int line;
+    };
+
+private:
+    struct ThreadBuffer
+    {
+        int thread_id;
+        std::vector<Event> events;
+    };
+
+    bool enabled = false;
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    // Buffers outlive their threads so spans from finished workers are still written
+    std::mutex buffers_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    /**
+     * This thread's buffer, registered the first time it records a span
+     */
+    ThreadBuffer &thread_buffer()
+    {
+        thread_local ThreadBuffer *buffer = nullptr;
+        if (buffer == nullptr)
+        {
+            std::lock_guard<std::mutex> lock{buffers_mutex};
+            buffers.push_back(std::make_unique<ThreadBuffer>());
+            buffer = buffers.back().get();
+            buffer->thread_id = static_cast<int>(buffers.size());
+        }
+        return *buffer;
+    }
+
+public:
+    /**
+     * Starts recording spans; before this, spans cost one test of a flag
+     */
+    void enable()
+    {
+        enabled = true;
+    }
+
+    bool active() const
+    {
+        return enabled;
+    }
+
+    /**
+     * Nanoseconds since the recorder was created
+     */
+    uint64_t now_ns() const
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                         std::chrono::steady_clock::now() - epoch)
+                                         .count());
+    }
+
+    /**
+     * Records a span that started at start_ns and ends now
+     */
+    void record(const char *name, const char *category, uint64_t start_ns, int line = 0)
+    {
+        uint64_t end_ns = now_ns();
+        thread_buffer().events.push_back(Event{name, category, start_ns, end_ns - start_ns, line});
+    }
+
+    /**
+     * Writes every thread's spans as Chrome trace-event JSON
+     * Call once the threads that recorded them have finished
+     */
+    void write_json(std::ostream &out)
+    {
+        std::lock_guard<std::mutex> lock{buffers_mutex};
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+        bool first = true;
+        for (const auto &buffer : buffers)
+        {
+            // Name each thread's track
+            out << (first ? "\n" : ",\n")
+                << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->thread_id
+                << ", \"args\": {\"name\": \"" << (buffer->thread_id == 1 ? "main" : "worker") << "\"}}";
+            first = false;
+
+            for (const Event &event : buffer->events)
+            {
+                char times[64];
+                std::snprintf(times, sizeof(times), "\"ts\": %.3f, \"dur\": %.3f",
+                              event.start_ns / 1e3, event.duration_ns / 1e3);
+                out << ",\n{\"name\": \"" << event.name << "\", \"cat\": \"" << event.category
+                    << "\", \"ph\": \"X\", " << times << ", \"pid\": 1, \"tid\": " << buffer->thread_id;
+                if (event.line != 0)
+                {
+                    out << ", \"args\": {\"line\": " << event.line << "}";
+                }
+                out << "}";
+            }
+        }
+        out << "\n]}\n";
+    }
+
+    /**
+     * Writes the total time spent in each phase, in the order phases first ran
+     */
+    void write_summary(std::ostream &out)
+    {
+        std::lock_guard<std::mutex> lock{buffers_mutex};
+
+        std::vector<std::pair<std::string, uint64_t>> phases;
+        uint64_t total_ns = 0;
+        for (const auto &buffer : buffers)
+        {
+            for (const Event &event : buffer->events)
+            {
+                if (std::string{event.category} != "phase")
+                {
+                    continue;
+                }
+
+                auto found = phases.begin();
+                while (found != phases.end() && found->first != event.name)
+                {
+                    ++found;
+                }
+                if (found == phases.end())
+                {
+                    phases.emplace_back(event.name, 0);
+                    found = phases.end() - 1;
+                }
+                found->second += event.duration_ns;
+                total_ns += event.duration_ns;
+            }
+        }
+
+        char row[64];
+        for (const auto &[name, duration_ns] : phases)
+        {
+            std::snprintf(row, sizeof(row), "%-12s %10.3f ms\n", name.c_str(), duration_ns / 1e6);
+            out << row;
+        }
+        std::snprintf(row, sizeof(row), "%-12s %10.3f ms\n", "total", total_ns / 1e6);
+        out << row;
+    }
+};
+
+/**
+ * The recorder for this process, created on first use
+ */
+inline TraceRecorder &trace_recorder()
+{
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+/**
+ * Records a span from construction to destruction while tracing is on
+ */
+class TraceSpan
+{
+private:
+    const char *name;
+    const char *category;
+    uint64_t start_ns = 0;
+    bool recording;
+
+public:
+    TraceSpan(const char *span_name, const char *span_category = "phase")
+        : name{span_name}, category{span_category}, recording{trace_recorder().active()}
+    {
+        if (recording)
+        {
+            start_ns = trace_recorder().now_ns();
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (recording)
+        {
+            trace_recorder().record(name, category, start_ns);
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * Type feedback the tree-walking interpreter records on AST nodes
+ *
+ * A node that keeps seeing the same operand types rewrites itself into a
+ * specialised variant guarded by a cheap type check. A failed guard
+ * deoptimises the node back to its generic form; nodes that deoptimise
+ * repeatedly stay generic.
+ */
+
+// Executions with identical types needed before a node specialises
+constexpr uint16_t SPECIALISE_THRESHOLD = 16;
+
+// Deoptimisations after which a node gives up specialising
+constexpr uint8_t MAX_DEOPTIMISATIONS = 4;
+
+/**
+ * Coarse runtime type of a value, as seen by the feedback
+ */
+enum class ValueKind : uint8_t
+{
+    NIL,
+    BOOL,
+    NUMBER,
+    STRING,
+    OTHER
+};
+
+/**
+ * Classifies a value using pointer any_casts, which avoid typeid lookups
+ */
+inline ValueKind kind_of(const std::any &value)
+{
+    if (std::any_cast<double>(&value) != nullptr)
+    {
+        return ValueKind::NUMBER;
+    }
+    if (std::any_cast<std::string>(&value) != nullptr)
+    {
+        return ValueKind::STRING;
+    }
+    if (std::any_cast<bool>(&value) != nullptr)
+    {
+        return ValueKind::BOOL;
+    }
+    if (std::any_cast<std::nullptr_t>(&value) != nullptr)
+    {
+        return ValueKind::NIL;
+    }
+    return ValueKind::OTHER;
+}
+
+/**
+ * Specialised variants a Binary node can rewrite itself into
+ */
+enum class BinarySpecialisation : uint8_t
+{
+    GENERIC,
+    ADD_NUMBERS,
+    SUBTRACT_NUMBERS,
+    MULTIPLY_NUMBERS,
+    DIVIDE_NUMBERS,
+    LESS_NUMBERS,
+    LESS_EQUAL_NUMBERS,
+    GREATER_NUMBERS,
+    GREATER_EQUAL_NUMBERS,
+    EQUAL_NUMBERS,
+    NOT_EQUAL_NUMBERS,
+    CONCAT_STRINGS
+};
+
+/**
+ * Feedback and current specialisation of a Binary node
+ */
+struct BinaryFeedback
+{
+    BinarySpecialisation specialisation = BinarySpecialisation::GENERIC;
+    ValueKind last_left = ValueKind::OTHER;
+    ValueKind last_right = ValueKind::OTHER;
+    uint16_t stable_count = 0;
+    uint8_t deopt_count = 0;
+
+    /**
+     * Records one execution; returns true once the types have been stable long enough
+     */
+    bool observe(ValueKind left, ValueKind right)
+    {
+        if (deopt_count >= MAX_DEOPTIMISATIONS)
+        {
+            return false;
+        }
+
+        if (left == last_left && right == last_right)
+        {
+            return ++stable_count >= SPECIALISE_THRESHOLD;
+        }
+
+        last_left = left;
+        last_right = right;
+        stable_count = 1;
+        return false;
+    }
+
+    /**
+     * Falls back to the generic node after a failed type guard
+     */
+    void deoptimise()
+    {
+        specialisation = BinarySpecialisation::GENERIC;
+        stable_count = 0;
+        deopt_count++;
+    }
+};
+
+/**
+ * Feedback and cached scope depth of a Variable node
+ */
+struct VariableFeedback
+{
+    // Scope depth the lookup is specialised to, or -1 when generic
+    int cached_depth = -1;
+    int last_depth = -1;
+    uint16_t stable_count = 0;
+    uint8_t deopt_count = 0;
+
+    /**
+     * Records the depth a lookup resolved at; returns true once it is stable
+     */
+    bool observe(int depth)
+    {
+        if (deopt_count >= MAX_DEOPTIMISATIONS)
+        {
+            return false;
+        }
+
+        if (depth == last_depth)
+        {
+            return ++stable_count >= SPECIALISE_THRESHOLD;
+        }
+
+        last_depth = depth;
+        stable_count = 1;
+        return false;
+    }
+
+    /**
+     * Falls back to the generic scope-chain walk after a failed guard
+     */
+    void deoptimise()
+    {
+        cached_depth = -1;
+        stable_count = 0;
+        deopt_count++;
+    }
+};
+
+// Native code for a loop, defined by the loop JIT
+struct CompiledLoop;
+
+/**
+ * Hotness counter and native code of a While node
+ */
+struct LoopFeedback
+{
+    // Interpreted iterations since the loop last became eligible
+    uint32_t iterations = 0;
+    uint8_t guard_failures = 0;
+
+    // Set once the loop is known not to compile or keeps failing its guard
+    bool rejected = false;
+    std::shared_ptr<CompiledLoop> compiled;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <any>
+#include <charconv>
+#include <string>
+#include <typeinfo>
+#include <utility>
+#include <variant>
+
+/**
+ * Runtime value used by the compiled execution engines
+ * Holds nil, booleans, numbers and strings without std::any boxing
+ */
+using Value = std::variant<std::nullptr_t, bool, double, std::string>;
+
+/**
+ * Writes a number into [first, last) exactly as the interpreter prints it
+ * Produces the same text as std::to_string, six fixed decimals, without
+ * allocating. The range must hold at least 320 characters.
+ * @return One past the last character written
+ */
+inline char *format_number_to(char *first, char *last, double number)
+{
+    char *end = std::to_chars(first, last, number, std::chars_format::fixed, 6).ptr;
+
+    // Remove trailing .0 for integer values
+    if (end - first >= 2 && end[-2] == '.' && end[-1] == '0')
+    {
+        end -= 2;
+    }
+    return end;
+}
+
+/**
+ * Formats a number exactly as the tree-walking interpreter prints it
+ */
+inline std::string format_number(double number)
+{
+    char buffer[320];
+    return std::string(buffer, format_number_to(buffer, buffer + sizeof buffer, number));
+}
+
+/**
+ * Converts a value to its printed representation
+ */
+inline std::string stringify(const Value &value)
+{
+    if (std::holds_alternative<double>(value))
+    {
+        return format_number(std::get<double>(value));
+    }
+    if (std::holds_alternative<std::string>(value))
+    {
+        return std::get<std::string>(value);
+    }
+    if (std::holds_alternative<bool>(value))
+    {
+        return std::get<bool>(value) ? "true" : "false";
+    }
+    return "nil";
+}
+
+/**
+ * Determines if a value is truthy: nil and false are falsey
+ */
+inline bool is_truthy(const Value &value)
+{
+    if (std::holds_alternative<std::nullptr_t>(value))
+    {
+        return false;
+    }
+    if (const bool *boolean = std::get_if<bool>(&value))
+    {
+        return *boolean;
+    }
+    return true;
+}
+
+/**
+ * Compares two values for equality; different types are never equal
+ */
+inline bool is_equal(const Value &left, const Value &right)
+{
+    // std::variant equality compares the active type first
+    return left == right;
+}
+
+/**
+ * Converts a literal value produced by the lexer or parser
+ */
+inline Value value_from_any(const std::any &literal)
+{
+    if (literal.type() == typeid(double))
+    {
+        return std::any_cast<double>(literal);
+    }
+    if (literal.type() == typeid(std::string))
+    {
+        return std::any_cast<std::string>(literal);
+    }
+    if (literal.type() == typeid(bool))
+    {
+        return std::any_cast<bool>(literal);
+    }
+    return nullptr;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdexcept>
+#include "expr.h"
+#include "stmt.h"
+
+/**
+ * Statically dispatched visitors for expressions and statements
+ *
+ * A visitor derives from ExprVisitorOf<Self, Result> and/or
+ * StmtVisitorOf<Self, Result> and defines non-virtual methods such as
+ * `Result visit_binary_expr(Binary &expr)`. Dispatch switches on the
+ * node's kind tag and calls the method on the derived class directly, so
+ * nodes travel by reference with no shared_ptr copies, no virtual accept
+ * call, and results come back in the visitor's own type instead of std::any.
+ */
+
+/**
+ * CRTP base that dispatches an expression to Derived's visit methods
+ */
+template <typename Derived, typename Result>
+class ExprVisitorOf
+{
+public:
+    Result visit_expr(Expr &expr)
+    {
+        Derived &self = static_cast<Derived &>(*this);
+        switch (expr.kind)
+        {
+        case ExprKind::ASSIGN:
+            return self.visit_assign_expr(static_cast<Assign &>(expr));
+        case ExprKind::BINARY:
+            return self.visit_binary_expr(static_cast<Binary &>(expr));
+        case ExprKind::GROUPING:
+            return self.visit_grouping_expr(static_cast<Grouping &>(expr));
+        case ExprKind::LITERAL:
+            return self.visit_literal_expr(static_cast<Literal &>(expr));
+        case ExprKind::LOGICAL:
+            return self.visit_logical_expr(static_cast<Logical &>(expr));
+        case ExprKind::UNARY:
+            return self.visit_unary_expr(static_cast<Unary &>(expr));
+        case ExprKind::VARIABLE:
+            return self.visit_variable_expr(static_cast<Variable &>(expr));
+        }
+        throw std::logic_error("Unknown expression kind");
+    }
+};
+
+/**
+ * CRTP base that dispatches a statement to Derived's visit methods
+ */
+template <typename Derived, typename Result>
+class StmtVisitorOf
+{
+public:
+    Result visit_stmt(Stmt &stmt)
+    {
+        Derived &self = static_cast<Derived &>(*this);
+        switch (stmt.kind)
+        {
+        case StmtKind::BLOCK:
+            return self.visit_block_stmt(static_cast<Block &>(stmt));
+        case StmtKind::EXPRESSION:
+            return self.visit_expression_stmt(static_cast<Expression &>(stmt));
+        case StmtKind::IF:
+            return self.visit_if_stmt(static_cast<If &>(stmt));
+        case StmtKind::PRINT:
+            return self.visit_print_stmt(static_cast<Print &>(stmt));
+        case StmtKind::VAR:
+            return self.visit_var_stmt(static_cast<Var &>(stmt));
+        case StmtKind::WHILE:
+            return self.visit_while_stmt(static_cast<While &>(stmt));
+        }
+        throw std::logic_error("Unknown statement kind");
+    }
+};
@@ -0,0 +1,436 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "chunk.h"
+#include "compiler.h"
+#include "error.h"
+#include "output_sink.h"
+#include "parallel_loop.h"
+#include "runtime_error.h"
+#include "stmt.h"
+#include "value.h"
+
+// Use computed-goto dispatch where the compiler supports labels as values
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(PRISM_NO_COMPUTED_GOTO)
+#define PRISM_COMPUTED_GOTO 1
+#endif
+
+/**
+ * Stack-based virtual machine that executes compiled bytecode
+ * Produces the same output and runtime errors as the tree-walking Interpreter
+ */
+class VM
+{
+private:
+    // Globals persist across chunks, e.g. between interactive lines
+    GlobalTable globals;
+
+    // Value stack holding locals and temporaries
+    std::vector<Value> stack;
+
+    /**
+     * Raises a runtime error attributed to the instruction before ip
+     */
+    [[noreturn]] void fail(const Chunk &chunk, const uint8_t *ip, const std::string &message)
+    {
+        int line = chunk.line_at(ip - chunk.code.data() - 1);
+        throw RuntimeError{Token{IDENTIFIER, "", nullptr, line}, message};
+    }
+
+    static uint16_t read_u16(const uint8_t *&ip)
+    {
+        uint16_t operand;
+        std::memcpy(&operand, ip, sizeof(operand));
+        ip += sizeof(operand);
+        return operand;
+    }
+
+    static uint32_t read_u32(const uint8_t *&ip)
+    {
+        uint32_t operand;
+        std::memcpy(&operand, ip, sizeof(operand));
+        ip += sizeof(operand);
+        return operand;
+    }
+
+    /**
+     * Runs a chunk until OP_RETURN using the fastest available dispatch
+     */
+    void run(const Chunk &chunk)
+    {
+        if (stack.size() < chunk.max_stack + 1)
+        {
+            stack.resize(chunk.max_stack + 1);
+        }
+
+        const uint8_t *ip = chunk.code.data();
+        const Value *constants = chunk.constants.data();
+        Value *base = stack.data();
+        Value *sp = base;
+
+#ifdef PRISM_COMPUTED_GOTO
+        // Label table indexed by opcode; must follow the OpCode order
+        static void *dispatch_table[OP_COUNT] = {
+            &&label_OP_CONSTANT, &&label_OP_NIL, &&label_OP_TRUE, &&label_OP_FALSE,
+            &&label_OP_POP, &&label_OP_POPN,
+            &&label_OP_GET_LOCAL, &&label_OP_SET_LOCAL,
+            &&label_OP_GET_GLOBAL, &&label_OP_SET_GLOBAL, &&label_OP_DEFINE_GLOBAL,
+            &&label_OP_EQUAL, &&label_OP_NOT_EQUAL,
+            &&label_OP_GREATER, &&label_OP_GREATER_EQUAL,
+            &&label_OP_LESS, &&label_OP_LESS_EQUAL,
+            &&label_OP_ADD, &&label_OP_SUBTRACT, &&label_OP_MULTIPLY, &&label_OP_DIVIDE,
+            &&label_OP_NOT, &&label_OP_NEGATE,
+            &&label_OP_PRINT, &&label_OP_JUMP, &&label_OP_JUMP_IF_FALSE,
+            &&label_OP_JUMP_IF_TRUE, &&label_OP_LOOP, &&label_OP_RETURN,
+            &&label_OP_REDUCE_BEGIN, &&label_OP_REDUCE_COUNT, &&label_OP_REDUCE_BLOCK, &&label_OP_REDUCE_END};
+
+#define TARGET(op) label_##op
+#define DISPATCH() goto *dispatch_table[*ip++]
+        DISPATCH();
+#else
+#define TARGET(op) case op
+#define DISPATCH() break
+        for (;;)
+        {
+            switch (*ip++)
+            {
+#endif
+
+// Numeric binary operation with the interpreter's operand check
+#define NUMERIC_BINARY(result_expr)                                 \
+    {                                                               \
+        double *left = std::get_if<double>(&sp[-2]);                \
+        const double *right = std::get_if<double>(&sp[-1]);         \
+        if (left == nullptr || right == nullptr)                    \
+        {                                                           \
+            fail(chunk, ip, "Operands must be numbers.");           \
+        }                                                           \
+        sp[-2] = result_expr;                                       \
+        sp--;                                                       \
+    }
+
+        TARGET(OP_CONSTANT):
+        {
+            *sp++ = constants[read_u32(ip)];
+            DISPATCH();
+        }
+
+        TARGET(OP_NIL):
+        {
+            *sp++ = nullptr;
+            DISPATCH();
+        }
+
+        TARGET(OP_TRUE):
+        {
+            *sp++ = true;
+            DISPATCH();
+        }
+
+        TARGET(OP_FALSE):
+        {
+            *sp++ = false;
+            DISPATCH();
+        }
+
+        TARGET(OP_POP):
+        {
+            sp--;
+            DISPATCH();
+        }
+
+        TARGET(OP_POPN):
+        {
+            sp -= read_u16(ip);
+            DISPATCH();
+        }
+
+        TARGET(OP_GET_LOCAL):
+        {
+            *sp = base[read_u16(ip)];
+            sp++;
+            DISPATCH();
+        }
+
+        TARGET(OP_SET_LOCAL):
+        {
+            base[read_u16(ip)] = sp[-1];
+            DISPATCH();
+        }
+
+        TARGET(OP_GET_GLOBAL):
+        {
+            uint32_t index = read_u32(ip);
+            if (!globals.defined[index])
+            {
+                fail(chunk, ip, "Undefined variable '" + globals.names[index] + "'.");
+            }
+            *sp++ = globals.values[index];
+            DISPATCH();
+        }
+
+        TARGET(OP_SET_GLOBAL):
+        {
+            uint32_t index = read_u32(ip);
+            if (!globals.defined[index])
+            {
+                fail(chunk, ip, "Cannot assign to undefined variable '" + globals.names[index] + "'.");
+            }
+            globals.values[index] = sp[-1];
+            DISPATCH();
+        }
+
+        TARGET(OP_DEFINE_GLOBAL):
+        {
+            uint32_t index = read_u32(ip);
+            globals.values[index] = std::move(*--sp);
+            globals.defined[index] = true;
+            DISPATCH();
+        }
+
+        TARGET(OP_EQUAL):
+        {
+            sp[-2] = is_equal(sp[-2], sp[-1]);
+            sp--;
+            DISPATCH();
+        }
+
+        TARGET(OP_NOT_EQUAL):
+        {
+            sp[-2] = !is_equal(sp[-2], sp[-1]);
+            sp--;
+            DISPATCH();
+        }
+
+        TARGET(OP_GREATER):
+        {
+            NUMERIC_BINARY(*left > *right);
+            DISPATCH();
+        }
+
+        TARGET(OP_GREATER_EQUAL):
+        {
+            NUMERIC_BINARY(*left >= *right);
+            DISPATCH();
+        }
+
+        TARGET(OP_LESS):
+        {
+            NUMERIC_BINARY(*left < *right);
+            DISPATCH();
+        }
+
+        TARGET(OP_LESS_EQUAL):
+        {
+            NUMERIC_BINARY(*left <= *right);
+            DISPATCH();
+        }
+
+        TARGET(OP_ADD):
+        {
+            Value &left = sp[-2];
+            Value &right = sp[-1];
+
+            // Handle number addition
+            if (double *left_number = std::get_if<double>(&left))
+            {
+                if (const double *right_number = std::get_if<double>(&right))
+                {
+                    *left_number += *right_number;
+                    sp--;
+                    DISPATCH();
+                }
+            }
+
+            // Handle string concatenation
+            if (std::string *left_text = std::get_if<std::string>(&left))
+            {
+                if (const std::string *right_text = std::get_if<std::string>(&right))
+                {
+                    *left_text += *right_text;
+                    sp--;
+                    DISPATCH();
+                }
+            }
+
+            fail(chunk, ip, "Operands must be two numbers or two strings.");
+        }
+
+        TARGET(OP_SUBTRACT):
+        {
+            NUMERIC_BINARY(*left - *right);
+            DISPATCH();
+        }
+
+        TARGET(OP_MULTIPLY):
+        {
+            NUMERIC_BINARY(*left * *right);
+            DISPATCH();
+        }
+
+        TARGET(OP_DIVIDE):
+        {
+            NUMERIC_BINARY(*left / *right);
+            DISPATCH();
+        }
+
+        TARGET(OP_NOT):
+        {
+            sp[-1] = !is_truthy(sp[-1]);
+            DISPATCH();
+        }
+
+        TARGET(OP_NEGATE):
+        {
+            double *operand = std::get_if<double>(&sp[-1]);
+            if (operand == nullptr)
+            {
+                fail(chunk, ip, "Operand must be a number.");
+            }
+            *operand = -*operand;
+            DISPATCH();
+        }
+
+        TARGET(OP_PRINT):
+        {
+            standard_output().print_value(*--sp);
+            DISPATCH();
+        }
+
+        TARGET(OP_JUMP):
+        {
+            uint32_t offset = read_u32(ip);
+            ip += offset;
+            DISPATCH();
+        }
+
+        TARGET(OP_JUMP_IF_FALSE):
+        {
+            uint32_t offset = read_u32(ip);
+            if (!is_truthy(sp[-1]))
+            {
+                ip += offset;
+            }
+            DISPATCH();
+        }
+
+        TARGET(OP_JUMP_IF_TRUE):
+        {
+            uint32_t offset = read_u32(ip);
+            if (is_truthy(sp[-1]))
+            {
+                ip += offset;
+            }
+            DISPATCH();
+        }
+
+        TARGET(OP_LOOP):
+        {
+            uint32_t offset = read_u32(ip);
+            ip -= offset;
+            DISPATCH();
+        }
+
+        TARGET(OP_RETURN):
+        {
+            return;
+        }
+
+        TARGET(OP_REDUCE_BEGIN):
+        {
+            TokenType op = *ip++ ? STAR : PLUS;
+            if (std::holds_alternative<double>(sp[-1]))
+            {
+                *sp++ = reduction_identity(op);
+            }
+            else
+            {
+                *sp = std::move(sp[-1]);
+                sp[-1] = nullptr;
+                sp++;
+            }
+            DISPATCH();
+        }
+
+        TARGET(OP_REDUCE_COUNT):
+        {
+            double &counter = std::get<double>(base[read_u16(ip)]);
+            uint32_t offset = read_u32(ip);
+            if (++counter < static_cast<double>(REDUCTION_BLOCK))
+            {
+                ip += offset;
+            }
+            else
+            {
+                counter = 0;
+            }
+            DISPATCH();
+        }
+
+        TARGET(OP_REDUCE_BLOCK):
+        {
+            TokenType op = *ip++ ? STAR : PLUS;
+            double *total = std::get_if<double>(&sp[-2]);
+            const double *block = std::get_if<double>(&sp[-1]);
+            if (total != nullptr && block != nullptr)
+            {
+                *total = combine_reduction(op, *total, *block);
+                sp[-1] = reduction_identity(op);
+            }
+            DISPATCH();
+        }
+
+        TARGET(OP_REDUCE_END):
+        {
+            TokenType op = *ip++ ? STAR : PLUS;
+            double *total = std::get_if<double>(&sp[-2]);
+            const double *block = std::get_if<double>(&sp[-1]);
+            sp[-2] = total != nullptr && block != nullptr ? Value{combine_reduction(op, *total, *block)}
+                                                          : std::move(sp[-1]);
+            sp--;
+            DISPATCH();
+        }
+
+#ifndef PRISM_COMPUTED_GOTO
+            default:
+                return;
+            }
+        }
+#endif
+
+#undef NUMERIC_BINARY
+#undef TARGET
+#undef DISPATCH
+    }
+
+public:
+    /**
+     * Compiles and executes a program, reporting runtime errors
+     */
+    void interpret(const std::vector<std::shared_ptr<Stmt>> &statements)
+    {
+        Compiler compiler{globals};
+        Chunk chunk = compiler.compile(statements);
+
+        // Stop if compilation reported errors
+        if (error_reporter().had_error)
+        {
+            return;
+        }
+
+        try
+        {
+            run(chunk);
+        }
+        catch (RuntimeError &error)
+        {
+            // Report runtime errors
+            runtime_error(error);
+        }
+    }
+};
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Threads that share out numbered tasks by work stealing
+ *
+ * For each run, the tasks are dealt out as contiguous ranges, one range
+ * per worker. A worker takes its own tasks from the front, lowest number
+ * first, and once it runs out steals from the back of another worker's
+ * range, so a worker that drew slow tasks is helped by those that did not.
+ * The calling thread is worker 0, and the others wait between runs, so a
+ * loop that runs many times does not start threads each time.
+ */
+class WorkStealingPool
+{
+public:
+    // Runs one task on the given worker; must not throw
+    using Task = std::function<void(size_t task, size_t worker)>;
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex run_mutex;
+    std::condition_variable run_started;
+    std::condition_variable run_finished;
+
+    // Task of the current run, which workers start on when the generation changes
+    const Task *current_task = nullptr;
+    uint64_t generation = 0;
+    size_t busy_workers = 0;
+    bool stopping = false;
+
+    bool take_own(size_t worker, size_t &task)
+    {
+        Queue &queue = *queues[worker];
+        std::lock_guard<std::mutex> lock{queue.mutex};
+        if (queue.tasks.empty())
+        {
+            return false;
+        }
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    bool steal(size_t worker, size_t &task)
+    {
+        for (size_t offset = 1; offset < queues.size(); offset++)
+        {
+            Queue &victim = *queues[(worker + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock{victim.mutex};
+            if (!victim.tasks.empty())
+            {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Runs tasks until none are left to take or steal
+     * No tasks are added during a run, so finding every queue empty means done
+     */
+    void work(size_t worker, const Task &task_function)
+    {
+        size_t task = 0;
+        while (take_own(worker, task) || steal(worker, task))
+        {
+            task_function(task, worker);
+        }
+    }
+
+    void wait_for_runs(size_t worker)
+    {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock{run_mutex};
+        while (true)
+        {
+            run_started.wait(lock, [&]
+                             { return stopping || generation != seen; });
+            if (stopping)
+            {
+                return;
+            }
+            seen = generation;
+            const Task &task_function = *current_task;
+
+            lock.unlock();
+            work(worker, task_function);
+            lock.lock();
+
+            if (--busy_workers == 0)
+            {
+                run_finished.notify_all();
+            }
+        }
+    }
+
+public:
+    /**
+     * @param worker_count Workers, including the thread that calls run()
+     */
+    explicit WorkStealingPool(size_t worker_count)
+    {
+        for (size_t i = 0; i < std::max<size_t>(1, worker_count); i++)
+        {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (size_t worker = 1; worker < queues.size(); worker++)
+        {
+            threads.emplace_back(&WorkStealingPool::wait_for_runs, this, worker);
+        }
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{run_mutex};
+            stopping = true;
+        }
+        run_started.notify_all();
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    size_t size() const
+    {
+        return queues.size();
+    }
+
+    /**
+     * Runs tasks 0 to task_count - 1 and returns once all have finished
+     */
+    void run(size_t task_count, const Task &task_function)
+    {
+        for (size_t worker = 0; worker < queues.size(); worker++)
+        {
+            std::lock_guard<std::mutex> lock{queues[worker]->mutex};
+            size_t first = task_count * worker / queues.size();
+            size_t last = task_count * (worker + 1) / queues.size();
+            for (size_t task = first; task < last; task++)
+            {
+                queues[worker]->tasks.push_back(task);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{run_mutex};
+            current_task = &task_function;
+            busy_workers = threads.size();
+            generation++;
+        }
+        run_started.notify_all();
+
+        work(0, task_function);
+
+        std::unique_lock<std::mutex> lock{run_mutex};
+        run_finished.wait(lock, [this]
+                          { return busy_workers == 0; });
+        current_task = nullptr;
+    }
+};